@@ -143,6 +143,7 @@ class FlatHashMap {
     values_ = std::move(other.values_);
     capacity_ = other.capacity_;
     size_ = other.size_;
+    num_tombstones_ = other.num_tombstones_;
     max_probe_length_ = other.max_probe_length_;
     load_limit_ = other.load_limit_;
     load_limit_percent_ = other.load_limit_percent_;
@@ -216,8 +217,12 @@ class FlatHashMap {
       // If we got to this point the key does not exist (otherwise we would have
       // hit the return above) and we are going to insert a new entry.
       // Before doing so, ensure we stay under the target load limit.
-      if (PERFETTO_UNLIKELY(size_ >= load_limit_)) {
-        MaybeGrowAndRehash(/*grow=*/true);
+      // Tombstones count towards the load, as lookups have to probe past them
+      // like for live entries. If most of the load is made of tombstones (e.g.
+      // if keys are continuously inserted and erased), rehash in place rather
+      // than growing.
+      if (PERFETTO_UNLIKELY(size_ + num_tombstones_ >= load_limit_)) {
+        MaybeGrowAndRehash(/*grow=*/size_ >= load_limit_ / 2);
         continue;
       }
       PERFETTO_DCHECK(insertion_slot != kSlotNotFound);
@@ -227,6 +232,10 @@ class FlatHashMap {
     PERFETTO_CHECK(insertion_slot < capacity_);
 
     // We found a free slot (or a tombstone). Proceed with the insertion.
+    if (!AppendOnly && tags_[insertion_slot] == kTombstone) {
+      PERFETTO_DCHECK(num_tombstones_ > 0);
+      num_tombstones_--;
+    }
     Value* value_idx = &values_[insertion_slot];
     new (&keys_[insertion_slot]) Key(std::move(key));
     new (value_idx) Value(std::move(value));
@@ -314,6 +323,7 @@ class FlatHashMap {
     keys_[idx].~Key();
     values_[idx].~Value();
     size_--;
+    num_tombstones_++;
   }
 
   PERFETTO_NO_INLINE void MaybeGrowAndRehash(bool grow) {
@@ -358,6 +368,7 @@ class FlatHashMap {
     capacity_ = n;
     max_probe_length_ = 0;
     size_ = 0;
+    num_tombstones_ = 0;
     load_limit_ = n * static_cast<size_t>(load_limit_percent_) / 100;
     load_limit_ = std::min(load_limit_, n);
 
@@ -377,6 +388,7 @@ class FlatHashMap {
 
   size_t capacity_ = 0;
   size_t size_ = 0;
+  size_t num_tombstones_ = 0;
   size_t max_probe_length_ = 0;
   size_t load_limit_ = 0;  // Updated every time |capacity_| changes.
   int load_limit_percent_ =
@@ -94,6 +94,19 @@ class HttpServerConnection {
   void SendResponseBody(const void* content, size_t content_length);
   void Close();
 
+  // Returns true if the socket has room for more data, i.e. if the next
+  // SendResponseBody() is unlikely to block. Returns false when the client is
+  // not keeping up with the data sent so far. Large responses can be produced
+  // incrementally while this is true, and paused while it isn't.
+  // Always returns true on Windows.
+  bool CanSendWithoutBlocking() const;
+
+  // Called within OnHttpRequest() by handlers that reply to the request only
+  // later, outside of the callback (e.g. once some other work is done). Without
+  // this, a request left without response headers is failed with a HTTP 500.
+  // The handler must eventually send the response or Close() the connection.
+  void DeferResponse() { response_deferred_ = true; }
+
   // All the above in one shot.
   void SendResponse(const char* http_code,
                     std::initializer_list<const char*> headers = {},
@@ -133,6 +146,7 @@ class HttpServerConnection {
   size_t rxbuf_used = 0;
   bool is_websocket_ = false;
   bool headers_sent_ = false;
+  bool response_deferred_ = false;
   size_t content_len_headers_ = 0;
   size_t content_len_actual_ = 0;
 
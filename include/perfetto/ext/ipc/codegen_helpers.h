@@ -28,9 +28,10 @@
 // A templated protobuf message decoder. Returns nullptr in case of failure.
 template <typename T>
 ::std::unique_ptr<::perfetto::ipc::ProtoMessage> _IPC_Decoder(
-    const std::string& proto_data) {
+    const void* data,
+    size_t size) {
   ::std::unique_ptr<::perfetto::ipc::ProtoMessage> msg(new T());
-  if (msg->ParseFromString(proto_data))
+  if (msg->ParseFromArray(data, size))
     return msg;
   return nullptr;
 }
@@ -17,6 +17,8 @@
 #ifndef INCLUDE_PERFETTO_EXT_IPC_SERVICE_DESCRIPTOR_H_
 #define INCLUDE_PERFETTO_EXT_IPC_SERVICE_DESCRIPTOR_H_
 
+#include <stddef.h>
+
 #include <functional>
 #include <string>
 #include <utility>
@@ -40,9 +42,11 @@ class ServiceDescriptor {
   struct Method {
     const char* name;
 
-    // DecoderFunc is pointer to a function that takes a string in input
+    // DecoderFunc is pointer to a function that takes a buffer in input
     // containing protobuf encoded data and returns a decoded protobuf message.
-    using DecoderFunc = std::unique_ptr<ProtoMessage> (*)(const std::string&);
+    // The buffer usually points into the IPC receive buffer.
+    using DecoderFunc = std::unique_ptr<ProtoMessage> (*)(const void* data,
+                                                          size_t size);
 
     // Function pointer to decode the request argument of the method.
     DecoderFunc request_proto_decoder;
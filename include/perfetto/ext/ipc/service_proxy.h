@@ -29,6 +29,7 @@
 #include "perfetto/base/export.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/ipc/deferred.h"
+#include "perfetto/protozero/field.h"
 
 namespace perfetto {
 namespace ipc {
@@ -65,18 +66,40 @@ class PERFETTO_EXPORT_COMPONENT ServiceProxy {
                          ServiceID,
                          std::map<std::string, MethodID>);
 
+  // Invoked with the proto-encoded reply of a method invoked through
+  // BeginInvokeRaw(). |reply| points into the IPC receive buffer and is valid
+  // only until the callback returns. |success| == false means request failure.
+  using RawReplyCallback = std::function<
+      void(bool success, protozero::ConstBytes reply, bool has_more)>;
+
   // Called by the IPC methods in the autogenerated classes.
   void BeginInvoke(const std::string& method_name,
                    const ProtoMessage& request,
                    DeferredBase reply,
                    int fd = -1);
 
+  // Like BeginInvoke(), but the reply is passed to |reply| without being
+  // decoded into a ProtoMessage. This is for methods with large replies (e.g.
+  // ReadBuffers) that the caller can decode in place. Unlike Deferred
+  // replies, pending callbacks are not invoked when the proxy is destroyed.
+  void BeginInvokeRaw(const std::string& method_name,
+                      const ProtoMessage& request,
+                      RawReplyCallback reply,
+                      int fd = -1);
+
   // Called by ClientImpl.
   // |reply_args| == nullptr means request failure.
   void EndInvoke(RequestID,
                  std::unique_ptr<ProtoMessage> reply_arg,
                  bool has_more);
 
+  // Called by ClientImpl. Returns false if the request was not issued through
+  // BeginInvokeRaw(), in which case the reply must go through EndInvoke().
+  bool EndInvokeRaw(RequestID,
+                    bool success,
+                    protozero::ConstBytes reply,
+                    bool has_more);
+
   // Called by ClientImpl.
   void OnConnect(bool success);
   void OnDisconnect();
@@ -88,10 +111,18 @@ class PERFETTO_EXPORT_COMPONENT ServiceProxy {
   virtual const ServiceDescriptor& GetDescriptor() = 0;
 
  private:
+  // Sends the request to the host, returns 0 if no reply is expected or the
+  // request could not be sent.
+  RequestID SendRequest(const std::string& method_name,
+                        const ProtoMessage& request,
+                        bool drop_reply,
+                        int fd);
+
   base::WeakPtr<Client> client_;
   ServiceID service_id_ = 0;
   std::map<std::string, MethodID> remote_method_ids_;
   std::map<RequestID, DeferredBase> pending_callbacks_;
+  std::map<RequestID, RawReplyCallback> pending_raw_callbacks_;
   EventListener* const event_listener_;
   base::WeakPtrFactory<ServiceProxy> weak_ptr_factory_;  // Keep last.
 };
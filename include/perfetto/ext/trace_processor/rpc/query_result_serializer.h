@@ -18,6 +18,7 @@
 #define INCLUDE_PERFETTO_EXT_TRACE_PROCESSOR_RPC_QUERY_RESULT_SERIALIZER_H_
 
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <limits.h>
@@ -51,9 +52,20 @@ class IteratorImpl;
 //   of a row).
 // The intended use case is streaaming these batches onto through a
 // chunked-encoded HTTP response, or through a repetition of Wasm calls.
+// By default batches are serialized as row-major CellsBatch. With
+// ResultFormat::kColumnar they are serialized as ColumnarBatch instead, which
+// stores the values of each column in a contiguous buffer.
 class QueryResultSerializer {
  public:
   static constexpr uint32_t kDefaultBatchSplitThreshold = 128 * 1024;
+  static constexpr uint32_t kDefaultCellsPerBatch = 50000;
+  static constexpr uint32_t kMaxCellsPerBatch = 1024 * 1024;
+
+  enum class ResultFormat {
+    kCells,     // QueryResult.batch.
+    kColumnar,  // QueryResult.columnar_batch.
+  };
+
   explicit QueryResultSerializer(Iterator);
   ~QueryResultSerializer();
 
@@ -70,6 +82,15 @@ class QueryResultSerializer {
   // extra copies.
   bool Serialize(std::vector<uint8_t>*);
 
+  // Overrides the max number of cells in each batch (e.g. as requested by the
+  // client through QueryArgs.cells_per_batch). The value is clamped so that a
+  // batch always fits at least one row and at most |kMaxCellsPerBatch| cells.
+  void set_cells_per_batch(uint32_t cells_per_batch);
+
+  // Selects the format of the batches. Must be called before the first
+  // Serialize() call.
+  void set_result_format(ResultFormat format);
+
   void set_batch_size_for_testing(uint32_t cells_per_batch, uint32_t thres) {
     cells_per_batch_ = cells_per_batch;
     batch_split_threshold_ = thres;
@@ -78,6 +99,7 @@ class QueryResultSerializer {
  private:
   void SerializeMetadata(protos::pbzero::QueryResult*);
   void SerializeBatch(protos::pbzero::QueryResult*);
+  void SerializeColumnarBatch(protos::pbzero::QueryResult*);
   void MaybeSerializeError(protos::pbzero::QueryResult*);
 
   std::unique_ptr<IteratorImpl> iter_;
@@ -85,6 +107,11 @@ class QueryResultSerializer {
   bool did_write_metadata_ = false;
   bool eof_reached_ = false;
   uint32_t col_ = UINT32_MAX;
+  ResultFormat result_format_ = ResultFormat::kCells;
+
+  // Set if the results cannot be represented in |result_format_|. Reported
+  // like query errors.
+  std::string format_error_;
 
   // These params specify the thresholds for splitting the results in batches,
   // in terms of: (1) max cells (row x cols); (2) serialized batch size in
@@ -92,7 +119,7 @@ class QueryResultSerializer {
   // 100% accurate and can occasionally yield to batches slighly larger than
   // the limit (it splits on the next row *after* the limit is hit).
   // Overridable for testing only.
-  uint32_t cells_per_batch_ = 50000;
+  uint32_t cells_per_batch_ = kDefaultCellsPerBatch;
   uint32_t batch_split_threshold_ = kDefaultBatchSplitThreshold;
 };
 
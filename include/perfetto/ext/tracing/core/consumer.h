@@ -57,6 +57,11 @@ class PERFETTO_EXPORT_COMPONENT Consumer {
   // called more than once. Each invocation can carry one or more
   // TracePacket(s). Upon the last call, |has_more| is set to true (i.e.
   // |has_more| is a !EOF).
+  // The slices of the packets can point into memory owned by the service or
+  // by the transport layer, which is valid only until this function returns:
+  // the packets must be consumed or copied synchronously. This is the case
+  // for in-process consumers and for IPC consumers which opted in (see
+  // ConsumerIPCClient::Connect()). Otherwise, the slices own their data.
   virtual void OnTraceData(std::vector<TracePacket>, bool has_more) = 0;
 
   // Called back by the Service (or transport layer) after invoking
@@ -142,6 +142,16 @@ class PERFETTO_EXPORT_COMPONENT SharedMemoryArbiter {
   // DataSourceDescriptor.will_notify_on_stop=true).
   virtual void SetBatchCommitsDuration(uint32_t batch_commits_duration_ms) = 0;
 
+  // Called to make the length of the batching period adapt to the rate at
+  // which chunks are committed. When enabled, the duration set with
+  // SetBatchCommitsDuration() becomes an upper bound: the period starts at 0ms
+  // (commits are sent at the next opportunity), doubles every time a new
+  // period starts right after the previous one was flushed, i.e. under a burst
+  // of writes, and halves every time the producer stays idle for a few periods.
+  // As with fixed batching, the commits are sent immediately when the shared
+  // memory buffer gets too full. The default implementation ignores it.
+  virtual void SetAdaptiveBatchCommits(bool enabled);
+
   // Called to enable direct producer-side patching of chunks that have not yet
   // been committed to the service. The return value indicates whether direct
   // patching was successfully enabled. It will be true if
@@ -283,6 +283,9 @@ struct PERFETTO_EXPORT_COMPONENT TracingServiceInitOpts {
   // compressed ones.
   using CompressorFn = void (*)(std::vector<TracePacket>*);
   CompressorFn compressor_fn = nullptr;
+
+  // Same as |compressor_fn|, for TraceConfig.COMPRESSION_TYPE_ZSTD.
+  CompressorFn zstd_compressor_fn = nullptr;
 };
 
 // The public API of the tracing Service business logic.
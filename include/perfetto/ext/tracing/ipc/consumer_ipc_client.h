@@ -17,6 +17,8 @@
 #ifndef INCLUDE_PERFETTO_EXT_TRACING_IPC_CONSUMER_IPC_CLIENT_H_
 #define INCLUDE_PERFETTO_EXT_TRACING_IPC_CONSUMER_IPC_CLIENT_H_
 
+#include <stddef.h>
+
 #include <memory>
 #include <string>
 
@@ -42,9 +44,26 @@ class PERFETTO_EXPORT_COMPONENT ConsumerIPCClient {
   // callbacks invoked on the Consumer interface: no more Consumer callbacks are
   // invoked immediately after its destruction and any pending callback will be
   // dropped.
+  // The TracePacket(s) passed to Consumer::OnTraceData() own their slices.
   static std::unique_ptr<TracingService::ConsumerEndpoint>
   Connect(const char* service_sock_name, Consumer*, base::TaskRunner*);
 
+  // Like the above, but the slices of the TracePacket(s) passed to
+  // Consumer::OnTraceData() are not copied: they point into the IPC receive
+  // buffer or into the shared memory ring below, and are valid only until the
+  // call returns, as it happens for in-process consumers.
+  // If |read_buffers_shm_size| is not 0, also asks the service to return the
+  // trace data of ReadBuffers() through a shared memory ring buffer of about
+  // |read_buffers_shm_size| bytes rather than through the socket. This is
+  // faster when reading large buffers. It falls back silently on the socket
+  // where not supported (e.g. TCP sockets, platforms without memfd, older
+  // services).
+  static std::unique_ptr<TracingService::ConsumerEndpoint> Connect(
+      const char* service_sock_name,
+      Consumer*,
+      base::TaskRunner*,
+      size_t read_buffers_shm_size);
+
  protected:
   ConsumerIPCClient() = delete;
 };
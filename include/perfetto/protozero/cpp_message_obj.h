@@ -26,6 +26,8 @@
 
 namespace protozero {
 
+class Message;
+
 // Base class for generated .gen.h classes, which are full C++ objects that
 // support both ser and deserialization (but are not zero-copy).
 // This is only used by the "cpp" targets not the "pbzero" ones.
@@ -36,6 +38,10 @@ class PERFETTO_EXPORT_COMPONENT CppMessageObj {
   virtual std::vector<uint8_t> SerializeAsArray() const = 0;
   virtual bool ParseFromArray(const void*, size_t) = 0;
 
+  // Writes the fields of the message into |msg|. This allows to serialize the
+  // message as a nested field of another message without intermediate copies.
+  virtual void Serialize(Message* msg) const = 0;
+
   bool ParseFromString(const std::string& str) {
     return ParseFromArray(str.data(), str.size());
   }
@@ -377,6 +377,14 @@ class PERFETTO_EXPORT_COMPONENT TypedProtoDecoderBase : public ProtoDecoder {
 
   void ParseAllFields();
 
+  // As ParseAllFields(), but stores each field in the slot that
+  // |field_slots|[field_id] maps it to, rather than at |fields_|[field_id].
+  // Ids > |max_field_id| or mapped to slot 0 are skipped. Used by
+  // SpecializedProtoDecoder.
+  void ParseAllFieldsIntoSlots(const uint16_t* field_slots,
+                               uint32_t max_field_id,
+                               bool has_nonpacked_repeated_fields);
+
   // Called when the default on-stack storage is exhausted and new repeated
   // fields need to be pushed.
   void ExpandHeapStorage();
@@ -465,6 +473,114 @@ class TypedProtoDecoder : public TypedProtoDecoderBase {
   Field on_stack_storage_[PROTOZERO_DECODER_INITIAL_STACK_CAPACITY];
 };
 
+// Template class instantiated by the auto-generated decoder classes when the
+// pbzero plugin runs with specialized_decoders=true (the default). It exposes
+// the same accessors of TypedProtoDecoder but, rather than reserving a slot for
+// each field id up to MAX_FIELD_ID, it reserves one only for the fields known
+// by the .proto. All the fields of a oneof share the same slot.
+// This keeps the storage for messages like FtraceEvent (hundreds of field ids,
+// all but a handful in a single oneof) small enough to be always on the stack,
+// while unknown field ids are skipped with a single table lookup.
+//
+// The generated decoder passes to the constructor a constexpr table that maps
+// each field id up to |max_field_id| to its slot (0 if unknown) and, as slots
+// are known at codegen time, its accessors use at<FIELD_ID, SLOT>(), which
+// doesn't need the table.
+//
+// The heap is used only when a message has more non-packed repeated fields
+// than the on-stack capacity, as TypedProtoDecoder does.
+template <uint32_t NUM_FIELD_SLOTS, bool HAS_NONPACKED_REPEATED_FIELDS>
+class SpecializedProtoDecoder : public TypedProtoDecoderBase {
+ public:
+  SpecializedProtoDecoder(const uint16_t* field_slots,
+                          uint32_t max_field_id,
+                          const uint8_t* buffer,
+                          size_t length)
+      : TypedProtoDecoderBase(on_stack_storage_,
+                              /*num_fields=*/NUM_FIELD_SLOTS,
+                              kCapacity,
+                              buffer,
+                              length),
+        field_slots_(field_slots),
+        max_field_id_(max_field_id) {
+    static_assert(NUM_FIELD_SLOTS > 0, "Slot 0 is always reserved");
+    TypedProtoDecoderBase::ParseAllFieldsIntoSlots(
+        field_slots, max_field_id, HAS_NONPACKED_REPEATED_FIELDS);
+  }
+
+  template <uint32_t FIELD_ID, uint32_t SLOT>
+  const Field& at() const {
+    static_assert(SLOT > 0 && SLOT < NUM_FIELD_SLOTS, "Invalid SLOT");
+    // The id check is needed for fields that share the slot of a oneof. For
+    // the other fields the slot holds either this field or an invalid one.
+    const Field& field = fields_[SLOT];
+    return field.id() == FIELD_ID ? field : fields_[0];
+  }
+
+  // For callers that don't know the slot of the field.
+  template <uint32_t FIELD_ID>
+  const Field& at() const {
+    return Get(FIELD_ID);
+  }
+
+  // The methods below hide the ones of TypedProtoDecoderBase, which assume
+  // that fields are stored at |fields_|[field_id].
+  const Field& Get(uint32_t id) const {
+    if (PERFETTO_UNLIKELY(id > max_field_id_))
+      return fields_[0];
+    const Field& field = fields_[field_slots_[id]];
+    return field.id() == id ? field : fields_[0];
+  }
+
+  template <typename T>
+  RepeatedFieldIterator<T> GetRepeated(uint32_t field_id) const {
+    // Unlike TypedProtoDecoderBase, |size_| is always >= |num_fields_|.
+    return RepeatedFieldIterator<T>(field_id, &fields_[num_fields_],
+                                    &fields_[size_], &Get(field_id));
+  }
+
+  template <proto_utils::ProtoWireType wire_type, typename cpp_type>
+  PackedRepeatedFieldIterator<wire_type, cpp_type> GetPackedRepeated(
+      uint32_t field_id,
+      bool* parse_error_location) const {
+    const Field& field = Get(field_id);
+    if (field.valid() &&
+        field.type() == proto_utils::ProtoWireType::kLengthDelimited) {
+      return PackedRepeatedFieldIterator<wire_type, cpp_type>(
+          field.data(), field.size(), parse_error_location);
+    }
+    return PackedRepeatedFieldIterator<wire_type, cpp_type>(
+        nullptr, 0, parse_error_location);
+  }
+
+  SpecializedProtoDecoder(SpecializedProtoDecoder&& other) noexcept
+      : TypedProtoDecoderBase(std::move(other)),
+        field_slots_(other.field_slots_),
+        max_field_id_(other.max_field_id_) {
+    // See the comment in the TypedProtoDecoder move constructor.
+    if (fields_ == other.on_stack_storage_) {
+      fields_ = on_stack_storage_;
+      memcpy(on_stack_storage_, other.on_stack_storage_,
+             sizeof(on_stack_storage_));
+    }
+  }
+
+ private:
+  // Messages without non-packed repeated fields need only their slots. The
+  // others keep the same on-stack capacity of TypedProtoDecoder, leaving at
+  // least one entry for the repeated fields storage.
+  static constexpr uint32_t kCapacity =
+      !HAS_NONPACKED_REPEATED_FIELDS
+          ? NUM_FIELD_SLOTS
+          : (NUM_FIELD_SLOTS < PROTOZERO_DECODER_INITIAL_STACK_CAPACITY
+                 ? PROTOZERO_DECODER_INITIAL_STACK_CAPACITY
+                 : NUM_FIELD_SLOTS + 1);
+
+  const uint16_t* field_slots_;
+  uint32_t max_field_id_;
+  Field on_stack_storage_[kCapacity];
+};
+
 }  // namespace protozero
 
 #endif  // INCLUDE_PERFETTO_PROTOZERO_PROTO_DECODER_H_
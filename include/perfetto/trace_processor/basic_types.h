@@ -148,6 +148,37 @@ struct PERFETTO_EXPORT_COMPONENT Config {
   // The flag has no impact on non-proto traces.
   bool analyze_trace_proto_content = false;
 
+  // Number of worker threads used to decompress |compressed_packets| bundles
+  // of proto traces ahead of tokenization. Packets are still tokenized and
+  // sorted on the thread calling Parse(), in trace order, so the result is
+  // identical to the single-threaded case.
+  //
+  // Values <= 1 disable the worker threads and values above
+  // |kMaxTokenizerThreadCount| are capped to it. Has no effect on non-proto
+  // traces and on platforms without thread support (e.g. WASM).
+  static constexpr uint32_t kMaxTokenizerThreadCount = 64;
+  uint32_t tokenizer_thread_count = 0;
+
+  // Maximum amount of memory, in bytes, used to hold tokenized events while
+  // they are waiting to be sorted. Events over this budget are spilled to an
+  // unlinked temporary file (see |sorter_spill_dir|) and read back while
+  // sorting. This bounds the memory use of |SortingMode::kForceFullSort| on
+  // large traces.
+  //
+  // Note that this does not cover the trace data referenced by the events
+  // themselves: traces should be memory-mapped (which is what the shell does
+  // for files on disk) for that to not be held in memory as well.
+  //
+  // 0 means no limit. Has no effect on platforms without mmap (e.g. WASM,
+  // Windows).
+  uint64_t sorter_memory_budget_bytes = 0;
+
+  // Directory where the temporary file used by |sorter_memory_budget_bytes| is
+  // created. If empty, the system temporary directory ($TMPDIR or /tmp) is
+  // used. This should not be on a tmpfs, as that would keep the spilled
+  // events in memory (or swap).
+  std::string sorter_spill_dir;
+
   // When set to true, trace processor will be augmented with a bunch of helpful
   // features for local development such as extra SQL fuctions.
   //
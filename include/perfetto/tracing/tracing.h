@@ -108,6 +108,14 @@ struct TracingInitArgs {
   // delay, i.e. commits will be sent to the service at the next opportunity.
   uint32_t shmem_batch_commits_duration_ms = 0;
 
+  // [Optional] If set, `shmem_batch_commits_duration_ms` is the upper bound of
+  // a batching period that adapts to the rate of trace writes: it grows while
+  // chunks are filled in bursts, to reduce the number of IPCs, and shrinks
+  // back to 0ms when the producer is idle, to reduce the latency of commits.
+  // For more details, see the SetAdaptiveBatchCommits method in
+  // shared_memory_arbiter.h.
+  bool shmem_adaptive_batch_commits = false;
+
   // [Optional] Enables direct producer-side patching of chunks that have not
   // yet been committed to the service. This flag will only have an effect
   // if the service supports direct patching, otherwise it will be ignored.
@@ -211,6 +211,111 @@ class TraceProcessor:
       self.__current_index += 1
       return result
 
+  class ColumnarQueryResult:
+    """The result of query_columnar(): the query result as column-major
+    batches (see QueryResult.ColumnarBatch in trace_processor.proto)."""
+
+    def __init__(self, column_names, batches):
+      self.__column_names = list(column_names)
+      self.__batches = list(batches)
+      self.__count = sum(batch.row_count for batch in self.__batches)
+
+    def __len__(self):
+      return self.__count
+
+    # Unlike QueryResultIterator.as_pandas_dataframe(), this doesn't create a
+    # Python object for each cell: integer and double columns are numpy
+    # arrays overlaid on the buffers received from trace processor. Integer
+    # columns with NULLs use the nullable pandas 'Int64' dtype and NULL doubles
+    # are NaN.
+    def as_pandas_dataframe(self):
+      try:
+        import numpy as np
+        import pandas as pd
+      except ModuleNotFoundError:
+        raise TraceProcessorException(
+            'Python dependencies missing. Please pip3 install pandas numpy')
+
+      parts = [[] for _ in self.__column_names]
+      for batch in self.__batches:
+        if batch.row_count == 0:
+          continue
+        if len(batch.columns) != len(self.__column_names):
+          raise TraceProcessorException(
+              'Column count ' + str(len(batch.columns)) +
+              ' does not match the number of column names ' +
+              str(len(self.__column_names)))
+        for i, column in enumerate(batch.columns):
+          parts[i].append(self.__decode_column(np, column, batch.row_count))
+
+      df = pd.DataFrame(
+          {i: self.__concat_parts(np, pd, p) for i, p in enumerate(parts)},
+          index=pd.RangeIndex(self.__count))
+      df.columns = self.__column_names
+      return df
+
+    # Returns a tuple (values, null_mask) for the column of a batch. The mask
+    # is None if no value is NULL; |values| is None if all of them are.
+    @staticmethod
+    def __decode_column(np, column, row_count):
+      if column.type == column.COLUMN_NULL:
+        return None, np.ones(row_count, dtype=bool)
+
+      mask = None
+      if column.validity:
+        bits = np.unpackbits(
+            np.frombuffer(column.validity, dtype=np.uint8), bitorder='little')
+        mask = bits[:row_count] == 0
+
+      if column.type == column.COLUMN_INT64:
+        return np.frombuffer(column.values, dtype='<i8'), mask
+      if column.type == column.COLUMN_FLOAT64:
+        return np.frombuffer(column.values, dtype='<f8'), mask
+
+      if column.type == column.COLUMN_STRING:
+        # See QueryResultIterator for why the dictionary is decoded this way.
+        dictionary = column.dictionary.decode('utf-8', 'ignore').split('\0')
+        values = np.array(dictionary[:-1], dtype=object)[np.frombuffer(
+            column.values, dtype='<u4')]
+      elif column.type == column.COLUMN_BLOB:
+        values = np.empty(row_count, dtype=object)
+        rows = np.arange(row_count) if mask is None else np.flatnonzero(~mask)
+        for row, blob in zip(rows, column.blobs):
+          values[row] = blob
+      else:
+        raise TraceProcessorException('Invalid column type')
+      if mask is not None:
+        values[mask] = None
+      return values, None
+
+    @staticmethod
+    def __concat_parts(np, pd, parts):
+      if all(values is None for values, _ in parts):
+        return pd.Series([None] * sum(len(mask) for _, mask in parts),
+                         dtype=object)
+
+      # numpy promotes integers to doubles, and numbers to objects (e.g. if a
+      # column is INT64 in a batch and STRING in another).
+      dtype = np.result_type(
+          *[values.dtype for values, _ in parts if values is not None])
+      values = np.concatenate([
+          np.zeros(len(mask), dtype=dtype) if values is None else values
+          for values, mask in parts
+      ]) if len(parts) > 1 else parts[0][0]
+      if all(mask is None for _, mask in parts):
+        return pd.Series(values, dtype=values.dtype)
+      mask = np.concatenate([
+          np.zeros(len(values), dtype=bool) if mask is None else mask
+          for values, mask in parts
+      ])
+      if dtype == np.int64:
+        return pd.arrays.IntegerArray(values, mask)
+      if dtype == np.float64:
+        return np.where(mask, np.nan, values)
+      values = values.astype(object)
+      values[mask] = None
+      return pd.Series(values, dtype=object)
+
   def __init__(self,
                trace: Optional[TraceReference] = None,
                addr: Optional[str] = None,
@@ -286,6 +391,28 @@ class TraceProcessor:
     return TraceProcessor.QueryResultIterator(response.column_names,
                                               response.batch)
 
+  def query_columnar(self, sql: str):
+    """Executes passed in SQL query like query(), but transfers the results
+    in column-major batches. Raises TraceProcessorException if the response
+    returns with an error.
+
+    This is much faster than query() for queries returning many rows which
+    are then converted to a pandas dataframe.
+
+    Args:
+      sql: SQL query written as a String
+
+    Returns:
+      A ColumnarQueryResult, which can be converted to a pandas dataframe by
+      calling its as_pandas_dataframe() function.
+    """
+    response = self.http.execute_query(sql, columnar=True)
+    if response.error:
+      raise TraceProcessorException(response.error)
+
+    return TraceProcessor.ColumnarQueryResult(response.column_names,
+                                              response.columnar_batch)
+
   def metric(self, metrics: List[str]):
     """Returns the metrics data corresponding to the passed in trace metric.
     Raises TraceProcessorException if the response returns with an error.
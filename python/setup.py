@@ -19,6 +19,10 @@ setup(
     install_requires=[
         'protobuf',
     ],
+    # Needed by as_pandas_dataframe() and query_columnar(), and by the tests.
+    extras_require={
+        'pandas': ['numpy', 'pandas'],
+    },
     classifiers=[
         'Development Status :: 3 - Alpha',
         'License :: OSI Approved :: Apache Software License',
@@ -12,6 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+import struct
 import unittest
 
 from perfetto.trace_processor.api import TraceProcessor
@@ -346,3 +347,110 @@ class TestQueryResultIterator(unittest.TestCase):
     # so we should raise a TraceProcessorException.
     with self.assertRaises(TraceProcessorException):
       _ = qr_iterator.as_pandas_dataframe()
+
+
+class TestColumnarQueryResult(unittest.TestCase):
+  Column = PROTO_FACTORY.ColumnarBatch().Column
+
+  @staticmethod
+  def make_batch(row_count, columns):
+    batch = PROTO_FACTORY.ColumnarBatch()
+    batch.row_count = row_count
+    batch.columns.extend(columns)
+    return batch
+
+  @staticmethod
+  def int64_column(values, validity=None):
+    col = TestColumnarQueryResult.Column()
+    col.type = col.COLUMN_INT64
+    col.values = struct.pack('<%dq' % len(values), *values)
+    if validity is not None:
+      col.validity = bytes([validity])
+    return col
+
+  @staticmethod
+  def float64_column(values):
+    col = TestColumnarQueryResult.Column()
+    col.type = col.COLUMN_FLOAT64
+    col.values = struct.pack('<%dd' % len(values), *values)
+    return col
+
+  @staticmethod
+  def string_column(indices, dictionary, validity=None):
+    col = TestColumnarQueryResult.Column()
+    col.type = col.COLUMN_STRING
+    col.values = struct.pack('<%dI' % len(indices), *indices)
+    col.dictionary = ''.join(s + '\0' for s in dictionary).encode()
+    if validity is not None:
+      col.validity = bytes([validity])
+    return col
+
+  @staticmethod
+  def null_column():
+    col = TestColumnarQueryResult.Column()
+    col.type = col.COLUMN_NULL
+    return col
+
+  def test_one_batch_as_pandas(self):
+    batch = self.make_batch(3, [
+        self.string_column([0, 1, 0], ['bar1', 'bar2']),
+        self.int64_column([100, 200, 300]),
+        self.float64_column([0.5, 1.5, 2.5]),
+        self.null_column(),
+    ])
+    result = TraceProcessor.ColumnarQueryResult(
+        ['foo_id', 'foo_num', 'foo_dur', 'foo_null'], [batch])
+    self.assertEqual(len(result), 3)
+
+    df = result.as_pandas_dataframe()
+    self.assertEqual(list(df['foo_id']), ['bar1', 'bar2', 'bar1'])
+    self.assertEqual(list(df['foo_num']), [100, 200, 300])
+    self.assertEqual(str(df['foo_num'].dtype), 'int64')
+    self.assertEqual(list(df['foo_dur']), [0.5, 1.5, 2.5])
+    self.assertEqual(list(df['foo_null']), [None, None, None])
+
+  def test_nulls_as_pandas(self):
+    batch = self.make_batch(3, [
+        self.string_column([0, 0, 1], ['bar1', 'bar2'], validity=0b101),
+        self.int64_column([100, 0, 300], validity=0b101),
+    ])
+    result = TraceProcessor.ColumnarQueryResult(['foo_id', 'foo_num'], [batch])
+
+    df = result.as_pandas_dataframe()
+    self.assertEqual(list(df['foo_id']), ['bar1', None, 'bar2'])
+    self.assertEqual(str(df['foo_num'].dtype), 'Int64')
+    self.assertEqual(df['foo_num'][0], 100)
+    self.assertTrue(df['foo_num'].isna()[1])
+    self.assertEqual(df['foo_num'][2], 300)
+
+  def test_many_batches_with_different_types_as_pandas(self):
+    batch_1 = self.make_batch(2, [
+        self.int64_column([1, 2]),
+        self.int64_column([3, 4]),
+        self.int64_column([5, 6]),
+    ])
+    batch_2 = self.make_batch(2, [
+        self.float64_column([0.5, 1.5]),
+        self.null_column(),
+        self.string_column([0, 0], ['bar']),
+    ])
+    batch_2.is_last_batch = True
+    result = TraceProcessor.ColumnarQueryResult(['a', 'b', 'c'],
+                                                [batch_1, batch_2])
+
+    df = result.as_pandas_dataframe()
+    self.assertEqual(len(df), 4)
+    self.assertEqual(list(df['a']), [1.0, 2.0, 0.5, 1.5])
+    self.assertEqual(str(df['b'].dtype), 'Int64')
+    self.assertEqual(list(df['b'][:2]), [3, 4])
+    self.assertTrue(df['b'].isna()[2:].all())
+    self.assertEqual(list(df['c']), [5, 6, 'bar', 'bar'])
+
+  def test_empty_as_pandas(self):
+    batch = self.make_batch(0, [])
+    batch.is_last_batch = True
+    result = TraceProcessor.ColumnarQueryResult(['foo_id'], [batch])
+
+    df = result.as_pandas_dataframe()
+    self.assertEqual(len(df), 0)
+    self.assertEqual(list(df.columns), ['foo_id'])
@@ -191,6 +191,46 @@ TYPED_TEST(FlatHashMapTest, FillWithTombstones) {
   }
 }
 
+// Continuously inserting and erasing distinct keys must not fill the table
+// with tombstones, nor make it grow.
+TYPED_TEST(FlatHashMapTest, ChurnPurgesTombstones) {
+  FlatHashMap<int, int, base::Hash<int>, typename TestFixture::Probe> fmap;
+
+  for (int i = 0; i < 100000; i++) {
+    ASSERT_TRUE(fmap.Insert(i, i).second);
+    if (i >= 16)
+      ASSERT_TRUE(fmap.Erase(i - 16));
+  }
+  ASSERT_EQ(fmap.size(), 16u);
+  ASSERT_EQ(fmap.capacity(), 1024u);
+  for (int i = 0; i < 100000 - 16; i++)
+    ASSERT_EQ(fmap.Find(i), nullptr);
+  for (int i = 100000 - 16; i < 100000; i++)
+    ASSERT_EQ(*fmap.Find(i), i);
+}
+
+// Erasing and re-inserting the same keys reuses their tombstones, which must
+// not be counted towards the load anymore.
+TYPED_TEST(FlatHashMapTest, ReinsertReusesTombstones) {
+  FlatHashMap<int, int, base::Hash<int>, typename TestFixture::Probe> fmap;
+
+  for (int i = 0; i < 512; i++)
+    ASSERT_TRUE(fmap.Insert(i, i).second);
+  const size_t capacity = fmap.capacity();
+
+  for (int rep = 0; rep < 1000; rep++) {
+    for (int i = 0; i < 512; i += 4)
+      ASSERT_TRUE(fmap.Erase(i));
+    ASSERT_EQ(fmap.size(), 384u);
+    for (int i = 0; i < 512; i += 4)
+      ASSERT_TRUE(fmap.Insert(i, rep).second);
+    ASSERT_EQ(fmap.size(), 512u);
+    ASSERT_EQ(fmap.capacity(), capacity);
+  }
+  for (int i = 0; i < 512; i++)
+    ASSERT_EQ(*fmap.Find(i), i % 4 ? i : 999);
+}
+
 TYPED_TEST(FlatHashMapTest, Collisions) {
   FlatHashMap<int, int, CollidingHasher, typename TestFixture::Probe> fmap(
       /*initial_capacity=*/0, /*load_limit_pct=*/100);
@@ -19,11 +19,17 @@
 
 #include <vector>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/base64.h"
 #include "perfetto/ext/base/endian.h"
 #include "perfetto/ext/base/http/sha1.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/string_view.h"
+#include "perfetto/ext/base/utils.h"
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#include <poll.h>
+#endif
 
 namespace perfetto {
 namespace base {
@@ -237,12 +243,14 @@ size_t HttpServer::ParseOneHttpRequest(HttpServerConnection* conn) {
     req_handler_->OnHttpRequest(http_req);
   }
 
-  // The handler is expected to send a response. If not, bail with a HTTP 500.
-  if (!conn->headers_sent_)
+  // The handler is expected to send a response or to defer it. If not, bail
+  // with a HTTP 500.
+  if (!conn->headers_sent_ && !conn->response_deferred_)
     conn->SendResponseAndClose("500 Internal Server Error");
 
   // Allow chaining multiple responses in the same HTTP-Keepalive connection.
   conn->headers_sent_ = false;
+  conn->response_deferred_ = false;
 
   return headers_size + body_size;
 }
@@ -514,6 +522,19 @@ void HttpServerConnection::Close() {
   sock->Shutdown(/*notify=*/true);
 }
 
+bool HttpServerConnection::CanSendWithoutBlocking() const {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  return true;
+#else
+  if (!sock->is_connected())
+    return true;  // Let the next Send() fail rather than waiting forever.
+  pollfd pfd{sock->fd(), POLLOUT, 0};
+  if (PERFETTO_EINTR(poll(&pfd, 1, 0)) <= 0)
+    return false;
+  return (pfd.revents & (POLLOUT | POLLERR | POLLHUP)) != 0;
+#endif
+}
+
 void HttpServerConnection::SendResponse(
     const char* http_code,
     std::initializer_list<const char*> headers,
@@ -133,6 +133,34 @@ TEST_F(HttpServerTest, GET) {
   }
 }
 
+TEST_F(HttpServerTest, CanSendWithoutBlocking) {
+  HttpCli cli(&task_runner_);
+  HttpServerConnection* conn = nullptr;
+  auto on_request = task_runner_.CreateCheckpoint("on_request");
+  EXPECT_CALL(handler_, OnHttpRequest(_))
+      .WillOnce(Invoke([&](const HttpRequest& req) {
+        conn = req.conn;
+        conn->SendResponseHeaders("200 OK", {},
+                                  HttpServerConnection::kOmitContentLength);
+        on_request();
+      }));
+  cli.SendHttpReq({"GET /stream HTTP/1.1"});
+  task_runner_.RunUntilCheckpoint("on_request");
+
+  // The client doesn't read anything: eventually the socket buffers fill up.
+  std::string chunk(4096, 'x');
+  size_t sent = 0;
+  while (conn->CanSendWithoutBlocking()) {
+    conn->SendResponseBody(chunk.data(), chunk.size());
+    sent += chunk.size();
+    ASSERT_LT(sent, 256u * 1024 * 1024);
+  }
+
+  // Once the client catches up, more data can be sent.
+  cli.Recv(sent);
+  EXPECT_TRUE(conn->CanSendWithoutBlocking());
+}
+
 TEST_F(HttpServerTest, GET_404) {
   HttpCli cli(&task_runner_);
   EXPECT_CALL(handler_, OnHttpRequest(_))
@@ -187,6 +215,25 @@ TEST_F(HttpServerTest, Unhadled_500) {
             "\r\n");
 }
 
+// A deferred request is replied to after OnHttpRequest() returns.
+TEST_F(HttpServerTest, DeferredResponse) {
+  HttpCli cli(&task_runner_);
+  EXPECT_CALL(handler_, OnHttpRequest(_))
+      .WillOnce(Invoke([&](const HttpRequest& req) {
+        HttpServerConnection* conn = req.conn;
+        conn->DeferResponse();
+        task_runner_.PostTask(
+            [conn] { conn->SendResponseAndClose("200 OK", {}, "later"); });
+      }));
+  cli.SendHttpReq({"GET /deferred HTTP/1.1"});
+  EXPECT_CALL(handler_, OnHttpConnectionClosed(_));
+  EXPECT_EQ(cli.RecvAndWaitConnClose(),
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Length: 5\r\n"
+            "Connection: close\r\n"
+            "\r\nlater");
+}
+
 // Send three requests within the same keepalive connection.
 TEST_F(HttpServerTest, POST_Keepalive) {
   HttpCli cli(&task_runner_);
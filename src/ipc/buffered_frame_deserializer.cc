@@ -166,6 +166,11 @@ std::unique_ptr<Frame> BufferedFrameDeserializer::PopNextFrame() {
 void BufferedFrameDeserializer::DecodeFrame(const char* data, size_t size) {
   if (size == 0)
     return;
+  if (frame_callback_) {
+    frame_callback_(
+        protozero::ConstBytes{reinterpret_cast<const uint8_t*>(data), size});
+    return;
+  }
   std::unique_ptr<Frame> frame(new Frame);
   if (frame->ParseFromArray(data, size))
     decoded_frames_.push_back(std::move(frame));
@@ -173,12 +178,27 @@ void BufferedFrameDeserializer::DecodeFrame(const char* data, size_t size) {
 
 // static
 std::string BufferedFrameDeserializer::Serialize(const Frame& frame) {
-  std::vector<uint8_t> payload = frame.SerializeAsArray();
-  const uint32_t payload_size = static_cast<uint32_t>(payload.size());
+  protozero::HeapBuffered<protozero::Message> msg;
+  frame.Serialize(msg.get());
+  return Serialize(&msg);
+}
+
+// static
+std::string BufferedFrameDeserializer::Serialize(
+    protozero::HeapBuffered<protozero::Message>* frame) {
+  const auto& slices = frame->GetSlices();
+  size_t payload_size = 0;
+  for (const auto& slice : slices)
+    payload_size += slice.size() - slice.unused_bytes();
+  const uint32_t header = static_cast<uint32_t>(payload_size);
   std::string buf;
-  buf.resize(kHeaderSize + payload_size);
-  memcpy(&buf[0], base::AssumeLittleEndian(&payload_size), kHeaderSize);
-  memcpy(&buf[kHeaderSize], payload.data(), payload.size());
+  buf.reserve(kHeaderSize + payload_size);
+  buf.resize(kHeaderSize);
+  memcpy(&buf[0], base::AssumeLittleEndian(&header), kHeaderSize);
+  for (const auto& slice : slices) {
+    protozero::ContiguousMemoryRange range = slice.GetUsedRange();
+    buf.append(reinterpret_cast<const char*>(range.begin), range.size());
+  }
   return buf;
 }
 
@@ -19,12 +19,17 @@
 
 #include <stddef.h>
 
+#include <functional>
 #include <list>
 #include <memory>
+#include <string>
 
 #include "perfetto/ext/base/paged_memory.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/ipc/basic_types.h"
+#include "perfetto/protozero/field.h"
+#include "perfetto/protozero/message.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
 
 namespace perfetto {
 
@@ -69,6 +74,9 @@ using Frame = ::perfetto::protos::gen::IPCFrame;
 //   ... process |frame|
 // }
 //
+// Alternatively, SetFrameCallback() allows to process the frames in place,
+// from within EndReceive(), without decoding them into a Frame first.
+//
 // Design goals:
 // -------------
 // - Optimize for the realistic case of each recv() receiving one or more
@@ -88,6 +96,11 @@ class BufferedFrameDeserializer {
     size_t size;
   };
 
+  // Invoked with the proto-encoded Frame, without the size header. |frame|
+  // points into the receive buffer and is valid only until the callback
+  // returns.
+  using FrameCallback = std::function<void(protozero::ConstBytes frame)>;
+
   // |max_capacity| is overridable only for tests.
   explicit BufferedFrameDeserializer(size_t max_capacity = kIPCBufferSize);
   ~BufferedFrameDeserializer();
@@ -97,6 +110,12 @@ class BufferedFrameDeserializer {
   // in common that doesn't justify having its own class.
   static std::string Serialize(const Frame&);
 
+  // Like the above, but for a frame written directly with protozero, using the
+  // field numbers of Frame. This allows to serialize large method arguments
+  // and replies as nested messages of the frame: the frame is copied only
+  // once, from the slices of |frame| into the returned buffer.
+  static std::string Serialize(protozero::HeapBuffered<protozero::Message>*);
+
   // Returns a buffer that can be passed to recv(). The buffer is deliberately
   // not initialized.
   ReceiveBuffer BeginReceive();
@@ -112,6 +131,15 @@ class BufferedFrameDeserializer {
   // if no further frames have been decoded.
   std::unique_ptr<Frame> PopNextFrame();
 
+  // When set, each complete frame is passed to |callback| synchronously from
+  // EndReceive(), before the buffer is compacted, instead of being decoded
+  // into a Frame for PopNextFrame(). This saves copying the (possibly large)
+  // method arguments and replies out of the receive buffer. The callback must
+  // not destroy this object.
+  void SetFrameCallback(FrameCallback callback) {
+    frame_callback_ = std::move(callback);
+  }
+
   size_t capacity() const { return capacity_; }
   size_t size() const { return size_; }
 
@@ -120,7 +148,8 @@ class BufferedFrameDeserializer {
   BufferedFrameDeserializer& operator=(const BufferedFrameDeserializer&) =
       delete;
 
-  // If a valid frame is decoded it is added to |decoded_frames_|.
+  // If a valid frame is decoded it is added to |decoded_frames_|, or passed
+  // to |frame_callback_| if set.
   void DecodeFrame(const char*, size_t);
 
   char* buf() { return reinterpret_cast<char*>(buf_.Get()); }
@@ -133,6 +162,7 @@ class BufferedFrameDeserializer {
   size_t size_ = 0;
 
   std::list<std::unique_ptr<Frame>> decoded_frames_;
+  FrameCallback frame_callback_;
 };
 
 }  // namespace ipc
@@ -0,0 +1,162 @@
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/protozero/message.h"
+#include "perfetto/protozero/proto_decoder.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "src/ipc/buffered_frame_deserializer.h"
+
+#include "protos/perfetto/ipc/wire_protocol.gen.h"
+
+namespace {
+
+using perfetto::ipc::BufferedFrameDeserializer;
+using perfetto::ipc::Frame;
+
+// Each chunk of the reply has roughly the size of a SMB chunk.
+constexpr size_t kChunkSize = 4096;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(kChunkSize);
+  } else {
+    b->RangeMultiplier(2)->Range(kChunkSize, 64 * 1024);
+  }
+}
+
+// A reply of |size| bytes, made of chunks of kChunkSize bytes.
+Frame MakeReply(size_t size) {
+  Frame reply;
+  for (size_t i = 0; i < size / kChunkSize; i++)
+    reply.add_data_for_testing(std::string(kChunkSize, 'x'));
+  return reply;
+}
+
+// Simulates the receiving end of the socket.
+void Receive(BufferedFrameDeserializer* bfd, const std::string& buf) {
+  BufferedFrameDeserializer::ReceiveBuffer rbuf = bfd->BeginReceive();
+  PERFETTO_CHECK(rbuf.size >= buf.size());
+  memcpy(rbuf.data, buf.data(), buf.size());
+  PERFETTO_CHECK(bfd->EndReceive(buf.size()));
+  std::unique_ptr<Frame> frame = bfd->PopNextFrame();
+  PERFETTO_CHECK(frame);
+  benchmark::DoNotOptimize(frame);
+}
+
+// Serializes a frame with |reply| nested as the reply of a method invocation.
+std::string SerializeReplyFrame(const Frame& reply) {
+  protozero::HeapBuffered<protozero::Message> frame;
+  frame->AppendVarInt(Frame::kRequestIdFieldNumber, 1);
+  auto* reply_msg = frame->BeginNestedMessage<protozero::Message>(
+      Frame::kMsgInvokeMethodReplyFieldNumber);
+  reply_msg->AppendTinyVarInt(Frame::InvokeMethodReply::kSuccessFieldNumber,
+                              true);
+  reply.Serialize(reply_msg->BeginNestedMessage<protozero::Message>(
+      Frame::InvokeMethodReply::kReplyProtoFieldNumber));
+  return BufferedFrameDeserializer::Serialize(&frame);
+}
+
+}  // namespace
+
+// Copies the serialized reply into the frame, as the IPC layer used to do.
+static void BM_IpcFrameRoundTrip_Copy(benchmark::State& state) {
+  const size_t size = static_cast<size_t>(state.range(0));
+  Frame reply = MakeReply(size);
+  BufferedFrameDeserializer bfd;
+  for (auto _ : state) {
+    Frame frame;
+    frame.set_request_id(1);
+    auto* reply_msg = frame.mutable_msg_invoke_method_reply();
+    reply_msg->set_success(true);
+    reply_msg->set_reply_proto(reply.SerializeAsString());
+    Receive(&bfd, BufferedFrameDeserializer::Serialize(frame));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_IpcFrameRoundTrip_Copy)->Apply(BenchmarkArgs);
+
+// Serializes the reply directly into the frame, as HostImpl does.
+static void BM_IpcFrameRoundTrip_Nested(benchmark::State& state) {
+  const size_t size = static_cast<size_t>(state.range(0));
+  Frame reply = MakeReply(size);
+  BufferedFrameDeserializer bfd;
+  for (auto _ : state) {
+    Receive(&bfd, SerializeReplyFrame(reply));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_IpcFrameRoundTrip_Nested)->Apply(BenchmarkArgs);
+
+// Receives a reply and walks its chunks after decoding the frame into a Frame,
+// as the IPC layer used to do.
+static void BM_IpcFrameReceive_Copy(benchmark::State& state) {
+  const size_t size = static_cast<size_t>(state.range(0));
+  const std::string buf = SerializeReplyFrame(MakeReply(size));
+  BufferedFrameDeserializer bfd;
+  for (auto _ : state) {
+    BufferedFrameDeserializer::ReceiveBuffer rbuf = bfd.BeginReceive();
+    memcpy(rbuf.data, buf.data(), buf.size());
+    PERFETTO_CHECK(bfd.EndReceive(buf.size()));
+    std::unique_ptr<Frame> frame = bfd.PopNextFrame();
+    Frame reply;
+    PERFETTO_CHECK(
+        reply.ParseFromString(frame->msg_invoke_method_reply().reply_proto()));
+    size_t chunks_size = 0;
+    for (const std::string& chunk : reply.data_for_testing())
+      chunks_size += chunk.size();
+    PERFETTO_CHECK(chunks_size == size);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_IpcFrameReceive_Copy)->Apply(BenchmarkArgs);
+
+// As above, but decodes the frame in place from the frame callback, as
+// ClientImpl does for ReadBuffers() replies.
+static void BM_IpcFrameReceive_InPlace(benchmark::State& state) {
+  const size_t size = static_cast<size_t>(state.range(0));
+  const std::string buf = SerializeReplyFrame(MakeReply(size));
+  BufferedFrameDeserializer bfd;
+  size_t chunks_size = 0;
+  bfd.SetFrameCallback([&chunks_size](protozero::ConstBytes frame_bytes) {
+    protozero::ProtoDecoder frame(frame_bytes.data, frame_bytes.size);
+    protozero::ProtoDecoder reply(
+        frame.FindField(Frame::kMsgInvokeMethodReplyFieldNumber).as_bytes());
+    protozero::ProtoDecoder reply_proto(
+        reply.FindField(Frame::InvokeMethodReply::kReplyProtoFieldNumber)
+            .as_bytes());
+    for (auto f = reply_proto.ReadField(); f; f = reply_proto.ReadField())
+      chunks_size += f.size();
+  });
+  for (auto _ : state) {
+    BufferedFrameDeserializer::ReceiveBuffer rbuf = bfd.BeginReceive();
+    memcpy(rbuf.data, buf.data(), buf.size());
+    chunks_size = 0;
+    PERFETTO_CHECK(bfd.EndReceive(buf.size()));
+    PERFETTO_CHECK(chunks_size == size);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_IpcFrameReceive_InPlace)->Apply(BenchmarkArgs);
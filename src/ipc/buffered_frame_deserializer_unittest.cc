@@ -21,6 +21,8 @@
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/utils.h"
+#include "perfetto/protozero/message.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
 #include "test/gtest_and_gmock.h"
 
 #include "protos/perfetto/ipc/wire_protocol.gen.h"
@@ -377,6 +379,92 @@ TEST(BufferedFrameDeserializerTest, FillCapacity) {
   }
 }
 
+// Tests that a frame written with protozero, with a message nested in place of
+// the args_proto bytes field, is decoded as if it was built through a Frame.
+TEST(BufferedFrameDeserializerTest, SerializeNestedArgs) {
+  Frame args;
+  args.add_data_for_testing(std::string(5000, 'a'));
+  args.add_data_for_testing("b");
+
+  protozero::HeapBuffered<protozero::Message> msg;
+  msg->AppendVarInt(Frame::kRequestIdFieldNumber, 42);
+  auto* invoke = msg->BeginNestedMessage<protozero::Message>(
+      Frame::kMsgInvokeMethodFieldNumber);
+  invoke->AppendVarInt(Frame::InvokeMethod::kMethodIdFieldNumber, 3);
+  args.Serialize(invoke->BeginNestedMessage<protozero::Message>(
+      Frame::InvokeMethod::kArgsProtoFieldNumber));
+  std::string buf = BufferedFrameDeserializer::Serialize(&msg);
+
+  Frame expected;
+  expected.set_request_id(42);
+  expected.mutable_msg_invoke_method()->set_method_id(3);
+  expected.mutable_msg_invoke_method()->set_args_proto(
+      args.SerializeAsString());
+  // The nested args use a redundant 4 bytes varint for their size, rather than
+  // the 2 bytes needed. The InvokeMethod message is nested in the same way in
+  // both frames.
+  ASSERT_EQ(BufferedFrameDeserializer::Serialize(expected).size() + 2,
+            buf.size());
+
+  BufferedFrameDeserializer bfd;
+  BufferedFrameDeserializer::ReceiveBuffer rbuf = bfd.BeginReceive();
+  ASSERT_GE(rbuf.size, buf.size());
+  memcpy(rbuf.data, buf.data(), buf.size());
+  ASSERT_TRUE(bfd.EndReceive(buf.size()));
+  std::unique_ptr<Frame> decoded_frame = bfd.PopNextFrame();
+  ASSERT_TRUE(decoded_frame);
+  EXPECT_EQ(*decoded_frame, expected);
+
+  Frame decoded_args;
+  ASSERT_TRUE(decoded_args.ParseFromString(
+      decoded_frame->msg_invoke_method().args_proto()));
+  EXPECT_EQ(decoded_args, args);
+  ASSERT_FALSE(bfd.PopNextFrame());
+}
+
+// Tests that, with a frame callback, the frames are passed in place as soon as
+// they are complete, also when followed by a partial frame (which has to be
+// moved at the beginning of the buffer after the callback returns).
+TEST(BufferedFrameDeserializerTest, FrameCallback) {
+  BufferedFrameDeserializer bfd;
+  std::vector<std::string> frames;
+  std::vector<const uint8_t*> frame_ptrs;
+  bfd.SetFrameCallback([&](protozero::ConstBytes frame) {
+    frames.push_back(frame.ToStdString());
+    frame_ptrs.push_back(frame.data);
+  });
+
+  std::vector<char> frame1 = GetSimpleFrame(32);
+  std::vector<char> frame2 = GetSimpleFrame(5000);
+  std::vector<char> frame3 = GetSimpleFrame(64);
+  const size_t frame3_part = 10;
+  BufferedFrameDeserializer::ReceiveBuffer rbuf = bfd.BeginReceive();
+  CheckedMemcpy(rbuf, frame1);
+  CheckedMemcpy(rbuf, frame2, frame1.size());
+  std::vector<char> frame3_begin(frame3.begin(), frame3.begin() + frame3_part);
+  CheckedMemcpy(rbuf, frame3_begin, frame1.size() + frame2.size());
+  ASSERT_TRUE(bfd.EndReceive(frame1.size() + frame2.size() + frame3_part));
+
+  ASSERT_EQ(2u, frames.size());
+  EXPECT_EQ(std::string(frame1.begin() + kHeaderSize, frame1.end()), frames[0]);
+  EXPECT_EQ(std::string(frame2.begin() + kHeaderSize, frame2.end()), frames[1]);
+  EXPECT_EQ(reinterpret_cast<uint8_t*>(rbuf.data) + kHeaderSize,
+            frame_ptrs[0]);
+  EXPECT_EQ(reinterpret_cast<uint8_t*>(rbuf.data) + frame1.size() + kHeaderSize,
+            frame_ptrs[1]);
+  ASSERT_EQ(frame3_part, bfd.size());
+  ASSERT_FALSE(bfd.PopNextFrame());
+
+  rbuf = bfd.BeginReceive();
+  std::vector<char> frame3_end(frame3.begin() + frame3_part, frame3.end());
+  CheckedMemcpy(rbuf, frame3_end);
+  ASSERT_TRUE(bfd.EndReceive(frame3_end.size()));
+  ASSERT_EQ(3u, frames.size());
+  EXPECT_EQ(std::string(frame3.begin() + kHeaderSize, frame3.end()), frames[2]);
+  ASSERT_EQ(0u, bfd.size());
+  ASSERT_FALSE(bfd.PopNextFrame());
+}
+
 }  // namespace
 }  // namespace ipc
 }  // namespace perfetto
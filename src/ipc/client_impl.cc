@@ -26,6 +26,9 @@
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/ipc/service_descriptor.h"
 #include "perfetto/ext/ipc/service_proxy.h"
+#include "perfetto/protozero/message.h"
+#include "perfetto/protozero/proto_decoder.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
 
 #include "protos/perfetto/ipc/wire_protocol.gen.h"
 
@@ -39,6 +42,14 @@ namespace ipc {
 namespace {
 constexpr base::SockFamily kClientSockFamily =
     kUseTCPSocket ? base::SockFamily::kInet : base::SockFamily::kUnix;
+
+// The frames and the method replies are decoded in place, in the receive
+// buffer. See BufferedFrameDeserializer::SetFrameCallback().
+using FrameDecoder =
+    protozero::TypedProtoDecoder<Frame::kSetPeerIdentityFieldNumber, false>;
+using InvokeMethodReplyDecoder = protozero::TypedProtoDecoder<
+    Frame::InvokeMethodReply::kReplyProtoFieldNumber,
+    false>;
 }  // namespace
 
 // static
@@ -54,6 +65,8 @@ ClientImpl::ClientImpl(ConnArgs conn_args, base::TaskRunner* task_runner)
       socket_retry_(conn_args.retry),
       task_runner_(task_runner),
       weak_ptr_factory_(this) {
+  frame_deserializer_.SetFrameCallback(
+      [this](protozero::ConstBytes frame) { OnFrameReceived(frame); });
   if (conn_args.socket_fd) {
     // Create the client using a connected socket. This code path will never hit
     // OnConnect().
@@ -116,14 +129,22 @@ RequestID ClientImpl::BeginInvoke(ServiceID service_id,
                                   base::WeakPtr<ServiceProxy> service_proxy,
                                   int fd) {
   RequestID request_id = ++last_request_id_;
-  Frame frame;
-  frame.set_request_id(request_id);
-  Frame::InvokeMethod* req = frame.mutable_msg_invoke_method();
-  req->set_service_id(service_id);
-  req->set_method_id(remote_method_id);
-  req->set_drop_reply(drop_reply);
-  req->set_args_proto(method_args.SerializeAsString());
-  if (!SendFrame(frame, fd)) {
+
+  // The arguments (e.g. the chunks of CommitData when SMB emulation is used)
+  // are serialized directly into the frame as a nested message, which has the
+  // same encoding of the args_proto bytes field. See
+  // HostImpl::ReplyToMethodInvocation().
+  using InvokeMethod = Frame::InvokeMethod;
+  protozero::HeapBuffered<protozero::Message> frame;
+  frame->AppendVarInt(Frame::kRequestIdFieldNumber, request_id);
+  auto* req = frame->BeginNestedMessage<protozero::Message>(
+      Frame::kMsgInvokeMethodFieldNumber);
+  req->AppendVarInt(InvokeMethod::kServiceIdFieldNumber, service_id);
+  req->AppendVarInt(InvokeMethod::kMethodIdFieldNumber, remote_method_id);
+  method_args.Serialize(req->BeginNestedMessage<protozero::Message>(
+      InvokeMethod::kArgsProtoFieldNumber));
+  req->AppendTinyVarInt(InvokeMethod::kDropReplyFieldNumber, drop_reply);
+  if (!SendSerializedFrame(BufferedFrameDeserializer::Serialize(&frame), fd)) {
     PERFETTO_DLOG("BeginInvoke() failed while sending the frame");
     return 0;
   }
@@ -140,8 +161,10 @@ RequestID ClientImpl::BeginInvoke(ServiceID service_id,
 
 bool ClientImpl::SendFrame(const Frame& frame, int fd) {
   // Serialize the frame into protobuf, add the size header, and send it.
-  std::string buf = BufferedFrameDeserializer::Serialize(frame);
+  return SendSerializedFrame(BufferedFrameDeserializer::Serialize(frame), fd);
+}
 
+bool ClientImpl::SendSerializedFrame(const std::string& buf, int fd) {
   // TODO(primiano): this should do non-blocking I/O. But then what if the
   // socket buffer is full? We might want to either drop the request or throttle
   // the send and PostTask the reply later? Right now we are making Send()
@@ -228,38 +251,54 @@ void ClientImpl::OnDataAvailable(base::UnixSocket*) {
       // TODO(fmayer): check this.
     }
   } while (rsize > 0);
-
-  while (std::unique_ptr<Frame> frame = frame_deserializer_.PopNextFrame())
-    OnFrameReceived(*frame);
+  // The frames have been dispatched to OnFrameReceived() by EndReceive().
 }
 
-void ClientImpl::OnFrameReceived(const Frame& frame) {
-  auto queued_requests_it = queued_requests_.find(frame.request_id());
+void ClientImpl::OnFrameReceived(protozero::ConstBytes frame_bytes) {
+  FrameDecoder frame(frame_bytes.data, frame_bytes.size);
+  if (frame.bytes_left() != 0) {
+    PERFETTO_DLOG("OnFrameReceived(): got malformed frame");
+    return;
+  }
+  const RequestID request_id =
+      frame.at<Frame::kRequestIdFieldNumber>().as_uint64();
+  auto queued_requests_it = queued_requests_.find(request_id);
   if (queued_requests_it == queued_requests_.end()) {
     PERFETTO_DLOG("OnFrameReceived(): got invalid request_id=%" PRIu64,
-                  static_cast<uint64_t>(frame.request_id()));
+                  static_cast<uint64_t>(request_id));
     return;
   }
   QueuedRequest req = std::move(queued_requests_it->second);
   queued_requests_.erase(queued_requests_it);
 
-  if (req.type == Frame::kMsgBindServiceFieldNumber &&
-      frame.has_msg_bind_service_reply()) {
-    return OnBindServiceReply(std::move(req), frame.msg_bind_service_reply());
+  // Only the replies to the method invocations can be large, the other frames
+  // are decoded into their gen classes.
+  auto bind_service_reply = frame.at<Frame::kMsgBindServiceReplyFieldNumber>();
+  if (req.type == Frame::kMsgBindServiceFieldNumber && bind_service_reply) {
+    Frame::BindServiceReply reply;
+    if (!reply.ParseFromArray(bind_service_reply.data(),
+                              bind_service_reply.size())) {
+      PERFETTO_DLOG("OnFrameReceived(): got malformed BindServiceReply");
+      return;
+    }
+    return OnBindServiceReply(std::move(req), reply);
   }
-  if (req.type == Frame::kMsgInvokeMethodFieldNumber &&
-      frame.has_msg_invoke_method_reply()) {
-    return OnInvokeMethodReply(std::move(req), frame.msg_invoke_method_reply());
+  auto invoke_method_reply =
+      frame.at<Frame::kMsgInvokeMethodReplyFieldNumber>();
+  if (req.type == Frame::kMsgInvokeMethodFieldNumber && invoke_method_reply) {
+    return OnInvokeMethodReply(std::move(req), invoke_method_reply.as_bytes());
   }
-  if (frame.has_msg_request_error()) {
-    PERFETTO_DLOG("Host error: %s", frame.msg_request_error().error().c_str());
+  if (auto request_error = frame.at<Frame::kMsgRequestErrorFieldNumber>()) {
+    Frame::RequestError error;
+    error.ParseFromArray(request_error.data(), request_error.size());
+    PERFETTO_DLOG("Host error: %s", error.error().c_str());
     return;
   }
 
   PERFETTO_DLOG(
       "OnFrameReceived() request type=%d, received unknown frame in reply to "
       "request_id=%" PRIu64,
-      req.type, static_cast<uint64_t>(frame.request_id()));
+      req.type, static_cast<uint64_t>(request_id));
 }
 
 void ClientImpl::OnBindServiceReply(QueuedRequest req,
@@ -299,29 +338,40 @@ void ClientImpl::OnBindServiceReply(QueuedRequest req,
 }
 
 void ClientImpl::OnInvokeMethodReply(QueuedRequest req,
-                                     const Frame::InvokeMethodReply& reply) {
+                                     protozero::ConstBytes reply_bytes) {
   base::WeakPtr<ServiceProxy> service_proxy = req.service_proxy;
   if (!service_proxy)
     return;
-  std::unique_ptr<ProtoMessage> decoded_reply;
-  if (reply.success()) {
-    // If this becomes a hotspot, optimize by maintaining a dedicated hashtable.
-    for (const auto& method : service_proxy->GetDescriptor().methods) {
-      if (req.method_name == method.name) {
-        decoded_reply = method.reply_proto_decoder(reply.reply_proto());
-        break;
+  InvokeMethodReplyDecoder reply(reply_bytes.data, reply_bytes.size);
+  const bool success =
+      reply.at<Frame::InvokeMethodReply::kSuccessFieldNumber>().as_bool();
+  const bool has_more =
+      reply.at<Frame::InvokeMethodReply::kHasMoreFieldNumber>().as_bool();
+  protozero::ConstBytes reply_proto =
+      reply.at<Frame::InvokeMethodReply::kReplyProtoFieldNumber>().as_bytes();
+  const RequestID request_id = req.request_id;
+  invoking_method_reply_ = true;
+  if (!service_proxy->EndInvokeRaw(request_id, success, reply_proto,
+                                   has_more)) {
+    std::unique_ptr<ProtoMessage> decoded_reply;
+    if (success) {
+      // If this becomes a hotspot, optimize by maintaining a dedicated
+      // hashtable.
+      for (const auto& method : service_proxy->GetDescriptor().methods) {
+        if (req.method_name == method.name) {
+          decoded_reply =
+              method.reply_proto_decoder(reply_proto.data, reply_proto.size);
+          break;
+        }
       }
     }
+    service_proxy->EndInvoke(request_id, std::move(decoded_reply), has_more);
   }
-  const RequestID request_id = req.request_id;
-  invoking_method_reply_ = true;
-  service_proxy->EndInvoke(request_id, std::move(decoded_reply),
-                           reply.has_more());
   invoking_method_reply_ = false;
 
   // If this is a streaming method and future replies will be resolved, put back
   // the |req| with the callback into the set of active requests.
-  if (reply.has_more())
+  if (has_more)
     queued_requests_.emplace(request_id, std::move(req));
 }
 
@@ -32,7 +32,6 @@ namespace perfetto {
 namespace protos {
 namespace gen {
 class IPCFrame_BindServiceReply;
-class IPCFrame_InvokeMethodReply;
 }  // namespace gen
 }  // namespace protos
 
@@ -85,11 +84,13 @@ class ClientImpl : public Client, public base::UnixSocket::EventListener {
 
   void TryConnect();
   bool SendFrame(const Frame&, int fd = -1);
-  void OnFrameReceived(const Frame&);
+  bool SendSerializedFrame(const std::string& frame_buf, int fd = -1);
+  void OnFrameReceived(protozero::ConstBytes frame);
   void OnBindServiceReply(QueuedRequest,
                           const protos::gen::IPCFrame_BindServiceReply&);
-  void OnInvokeMethodReply(QueuedRequest,
-                           const protos::gen::IPCFrame_InvokeMethodReply&);
+
+  // |reply| is the encoded InvokeMethodReply, in the receive buffer.
+  void OnInvokeMethodReply(QueuedRequest, protozero::ConstBytes reply);
 
   bool invoking_method_reply_ = false;
   const char* socket_name_ = nullptr;
@@ -19,6 +19,7 @@
 #include <stdio.h>
 
 #include <string>
+#include <vector>
 
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/temp_file.h"
@@ -41,6 +42,7 @@ namespace {
 using ::perfetto::ipc::gen::ReplyProto;
 using ::perfetto::ipc::gen::RequestProto;
 using ::testing::_;
+using ::testing::ElementsAre;
 using ::testing::InSequence;
 using ::testing::Invoke;
 using ::testing::Mock;
@@ -55,9 +57,9 @@ class FakeProxy : public ServiceProxy {
       : ServiceProxy(el), service_name_(service_name) {}
 
   const ServiceDescriptor& GetDescriptor() override {
-    auto reply_decoder = [](const std::string& proto) {
+    auto reply_decoder = [](const void* data, size_t size) {
       std::unique_ptr<ProtoMessage> reply(new ReplyProto());
-      EXPECT_TRUE(reply->ParseFromString(proto));
+      EXPECT_TRUE(reply->ParseFromArray(data, size));
       return reply;
     };
     if (!descriptor_.service_name) {
@@ -367,6 +369,48 @@ TEST_F(ClientImplTest, BindAndInvokeStreamingMethod) {
   ASSERT_EQ(kNumReplies, replies_seen);
 }
 
+// Like the above, but the replies are received without being decoded, through
+// BeginInvokeRaw().
+TEST_F(ClientImplTest, BindAndInvokeStreamingMethodRaw) {
+  auto* host_svc = host_->AddFakeService("FakeSvc");
+  auto* host_method = host_svc->AddFakeMethod("FakeMethod1");
+  const int kNumReplies = 3;
+
+  std::unique_ptr<FakeProxy> proxy(new FakeProxy("FakeSvc", &proxy_events_));
+  cli_->BindService(proxy->GetWeakPtr());
+  auto on_connect = task_runner_->CreateCheckpoint("on_connect");
+  EXPECT_CALL(proxy_events_, OnConnect()).WillOnce(Invoke(on_connect));
+  task_runner_->RunUntilCheckpoint("on_connect");
+
+  int replies_left = kNumReplies;
+  EXPECT_CALL(*host_method, OnInvoke(_, _))
+      .Times(kNumReplies)
+      .WillRepeatedly(Invoke([&replies_left](const Frame::InvokeMethod&,
+                                             Frame::InvokeMethodReply* reply) {
+        ReplyProto reply_args;
+        reply_args.set_data("reply_" + std::to_string(replies_left));
+        reply->set_reply_proto(reply_args.SerializeAsString());
+        reply->set_success(true);
+        reply->set_has_more(--replies_left > 0);
+      }));
+
+  auto on_last_reply = task_runner_->CreateCheckpoint("on_last_reply");
+  std::vector<std::string> replies_seen;
+  proxy->BeginInvokeRaw(
+      "FakeMethod1", RequestProto(),
+      [on_last_reply, &replies_seen](bool success, protozero::ConstBytes reply,
+                                     bool has_more) {
+        EXPECT_TRUE(success);
+        ReplyProto reply_args;
+        EXPECT_TRUE(reply_args.ParseFromArray(reply.data, reply.size));
+        replies_seen.push_back(reply_args.data());
+        if (!has_more)
+          on_last_reply();
+      });
+  task_runner_->RunUntilCheckpoint("on_last_reply");
+  EXPECT_THAT(replies_seen, ElementsAre("reply_3", "reply_2", "reply_1"));
+}
+
 #if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN) && \
     !PERFETTO_BUILDFLAG(PERFETTO_OS_FUCHSIA)
 // File descriptor sending over IPC is not supported on Windows or Fuchsia.
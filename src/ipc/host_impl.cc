@@ -31,6 +31,9 @@
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/ipc/service.h"
 #include "perfetto/ext/ipc/service_descriptor.h"
+#include "perfetto/protozero/message.h"
+#include "perfetto/protozero/proto_decoder.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
 
 #include "protos/perfetto/ipc/wire_protocol.gen.h"
 
@@ -46,6 +49,14 @@ constexpr base::SockFamily kHostSockFamily =
 
 base::CrashKey g_crash_key_uid("ipc_uid");
 
+// The frames and the method arguments are decoded in place, in the receive
+// buffer. See BufferedFrameDeserializer::SetFrameCallback().
+using FrameDecoder =
+    protozero::TypedProtoDecoder<Frame::kSetPeerIdentityFieldNumber, false>;
+using InvokeMethodDecoder =
+    protozero::TypedProtoDecoder<Frame::InvokeMethod::kDropReplyFieldNumber,
+                                 false>;
+
 base::MachineID GenerateMachineID(base::UnixSocket* sock,
                                   const std::string& machine_id_hint) {
   // The special value of base::kDefaultMachineID is reserved for local
@@ -212,6 +223,11 @@ void HostImpl::OnNewIncomingConnection(
   std::unique_ptr<ClientConnection> client(new ClientConnection());
   ClientID client_id = ++last_client_id_;
   clients_by_socket_[new_conn.get()] = client.get();
+  ClientConnection* client_ptr = client.get();
+  client->frame_deserializer.SetFrameCallback(
+      [this, client_ptr](protozero::ConstBytes frame) {
+        OnReceivedFrame(client_ptr, frame);
+      });
   client->id = client_id;
   client->sock = std::move(new_conn);
   client->sock->SetTxTimeout(socket_tx_timeout_ms_);
@@ -241,27 +257,36 @@ void HostImpl::OnDataAvailable(base::UnixSocket* sock) {
     if (!frame_deserializer.EndReceive(rsize))
       return OnDisconnect(client->sock.get());
   } while (rsize > 0);
-
-  for (;;) {
-    std::unique_ptr<Frame> frame = frame_deserializer.PopNextFrame();
-    if (!frame)
-      break;
-    OnReceivedFrame(client, *frame);
-  }
+  // The frames have been dispatched to OnReceivedFrame() by EndReceive().
 }
 
 void HostImpl::OnReceivedFrame(ClientConnection* client,
-                               const Frame& req_frame) {
+                               protozero::ConstBytes frame_bytes) {
+  FrameDecoder frame(frame_bytes.data, frame_bytes.size);
+  if (frame.bytes_left() != 0) {
+    PERFETTO_DLOG("Received malformed RPC frame from client %" PRIu64,
+                  client->id);
+    return;
+  }
+  const RequestID request_id =
+      frame.at<Frame::kRequestIdFieldNumber>().as_uint64();
+
+  // Only the method arguments can be large (e.g. CommitData), the other
+  // frames are decoded into a Frame.
+  if (auto invoke_method = frame.at<Frame::kMsgInvokeMethodFieldNumber>())
+    return OnInvokeMethod(client, request_id, invoke_method.as_bytes());
+
+  Frame req_frame;
+  if (!req_frame.ParseFromArray(frame_bytes.data, frame_bytes.size))
+    return;
   if (req_frame.has_msg_bind_service())
     return OnBindService(client, req_frame);
-  if (req_frame.has_msg_invoke_method())
-    return OnInvokeMethod(client, req_frame);
   if (req_frame.has_set_peer_identity())
     return OnSetPeerIdentity(client, req_frame);
 
   PERFETTO_DLOG("Received invalid RPC frame from client %" PRIu64, client->id);
   Frame reply_frame;
-  reply_frame.set_request_id(req_frame.request_id());
+  reply_frame.set_request_id(request_id);
   reply_frame.mutable_msg_request_error()->set_error("unknown request");
   SendFrame(client, reply_frame);
 }
@@ -288,26 +313,36 @@ void HostImpl::OnBindService(ClientConnection* client, const Frame& req_frame) {
 }
 
 void HostImpl::OnInvokeMethod(ClientConnection* client,
-                              const Frame& req_frame) {
-  const Frame::InvokeMethod& req = req_frame.msg_invoke_method();
+                              RequestID request_id,
+                              protozero::ConstBytes req_bytes) {
+  using InvokeMethod = Frame::InvokeMethod;
+  InvokeMethodDecoder req(req_bytes.data, req_bytes.size);
+  if (req.bytes_left() != 0) {
+    PERFETTO_DLOG("Received malformed InvokeMethod from client %" PRIu64,
+                  client->id);
+    return;
+  }
   Frame reply_frame;
-  RequestID request_id = req_frame.request_id();
   reply_frame.set_request_id(request_id);
   reply_frame.mutable_msg_invoke_method_reply()->set_success(false);
-  auto svc_it = services_.find(req.service_id());
+  auto svc_it = services_.find(
+      req.at<InvokeMethod::kServiceIdFieldNumber>().as_uint32());
   if (svc_it == services_.end())
     return SendFrame(client, reply_frame);  // |success| == false by default.
 
   Service* service = svc_it->second.instance.get();
   const ServiceDescriptor& svc = service->GetDescriptor();
   const auto& methods = svc.methods;
-  const uint32_t method_id = req.method_id();
+  const uint32_t method_id =
+      req.at<InvokeMethod::kMethodIdFieldNumber>().as_uint32();
   if (method_id == 0 || method_id > methods.size())
     return SendFrame(client, reply_frame);
 
   const ServiceDescriptor::Method& method = methods[method_id - 1];
+  protozero::ConstBytes args =
+      req.at<InvokeMethod::kArgsProtoFieldNumber>().as_bytes();
   std::unique_ptr<ProtoMessage> decoded_req_args(
-      method.request_proto_decoder(req.args_proto()));
+      method.request_proto_decoder(args.data, args.size));
   if (!decoded_req_args)
     return SendFrame(client, reply_frame);
 
@@ -315,7 +350,7 @@ void HostImpl::OnInvokeMethod(ClientConnection* client,
   base::WeakPtr<HostImpl> host_weak_ptr = weak_ptr_factory_.GetWeakPtr();
   ClientID client_id = client->id;
 
-  if (!req.drop_reply()) {
+  if (!req.at<InvokeMethod::kDropReplyFieldNumber>().as_bool()) {
     deferred_reply.Bind([host_weak_ptr, client_id,
                          request_id](AsyncResult<ProtoMessage> reply) {
       if (!host_weak_ptr)
@@ -365,29 +400,44 @@ void HostImpl::ReplyToMethodInvocation(ClientID client_id,
     return;  // client has disconnected by the time we got the async reply.
 
   ClientConnection* client = client_iter->second.get();
-  Frame reply_frame;
-  reply_frame.set_request_id(request_id);
+
+  // The frame is written with protozero rather than through a Frame object, so
+  // that the reply (e.g. the trace data of ReadBuffers) is serialized directly
+  // into it. The reply_proto bytes field and a nested message have the same
+  // encoding on the wire.
+  protozero::HeapBuffered<protozero::Message> reply_frame;
+  reply_frame->AppendVarInt(Frame::kRequestIdFieldNumber, request_id);
 
   // TODO(fmayer): add a test to guarantee that the reply is consumed within the
   // same call stack and not kept around. ConsumerIPCService::OnTraceData()
   // relies on this behavior.
-  auto* reply_frame_data = reply_frame.mutable_msg_invoke_method_reply();
-  reply_frame_data->set_has_more(reply.has_more());
+  using InvokeMethodReply = Frame::InvokeMethodReply;
+  auto* reply_frame_data = reply_frame->BeginNestedMessage<protozero::Message>(
+      Frame::kMsgInvokeMethodReplyFieldNumber);
+  reply_frame_data->AppendTinyVarInt(InvokeMethodReply::kHasMoreFieldNumber,
+                                     reply.has_more());
   if (reply.success()) {
-    std::string reply_proto = reply->SerializeAsString();
-    reply_frame_data->set_reply_proto(reply_proto);
-    reply_frame_data->set_success(true);
+    reply->Serialize(reply_frame_data->BeginNestedMessage<protozero::Message>(
+        InvokeMethodReply::kReplyProtoFieldNumber));
+    reply_frame_data->AppendTinyVarInt(InvokeMethodReply::kSuccessFieldNumber,
+                                       true);
   }
-  SendFrame(client, reply_frame, reply.fd());
+  std::string buf = BufferedFrameDeserializer::Serialize(&reply_frame);
+  SendSerializedFrame(client, buf, reply.fd());
 }
 
 // static
 void HostImpl::SendFrame(ClientConnection* client, const Frame& frame, int fd) {
+  SendSerializedFrame(client, BufferedFrameDeserializer::Serialize(frame), fd);
+}
+
+// static
+void HostImpl::SendSerializedFrame(ClientConnection* client,
+                                   const std::string& buf,
+                                   int fd) {
   auto peer_uid = client->GetPosixPeerUid();
   auto scoped_key = g_crash_key_uid.SetScoped(static_cast<int64_t>(peer_uid));
 
-  std::string buf = BufferedFrameDeserializer::Serialize(frame);
-
   // On Fuchsia, |send_fd_cb_fuchsia_| is used to send the FD to the client
   // and therefore must be set.
   PERFETTO_DCHECK(!PERFETTO_BUILDFLAG(PERFETTO_OS_FUCHSIA) ||
@@ -96,9 +96,11 @@ class HostImpl : public Host, public base::UnixSocket::EventListener {
   HostImpl& operator=(const HostImpl&) = delete;
 
   bool Initialize(const char* socket_name);
-  void OnReceivedFrame(ClientConnection*, const Frame&);
+  void OnReceivedFrame(ClientConnection*, protozero::ConstBytes frame);
   void OnBindService(ClientConnection*, const Frame&);
-  void OnInvokeMethod(ClientConnection*, const Frame&);
+  void OnInvokeMethod(ClientConnection*,
+                      RequestID,
+                      protozero::ConstBytes invoke_method);
   void OnSetPeerIdentity(ClientConnection*, const Frame&);
 
   void ReplyToMethodInvocation(ClientID, RequestID, AsyncResult<ProtoMessage>);
@@ -106,6 +108,11 @@ class HostImpl : public Host, public base::UnixSocket::EventListener {
 
   static void SendFrame(ClientConnection*, const Frame&, int fd = -1);
 
+  // Sends a frame already serialized with BufferedFrameDeserializer.
+  static void SendSerializedFrame(ClientConnection*,
+                                  const std::string& frame_buf,
+                                  int fd = -1);
+
   base::TaskRunner* const task_runner_;
   std::map<ServiceID, ExposedService> services_;
   std::unique_ptr<base::UnixSocket> sock_;  // The listening socket.
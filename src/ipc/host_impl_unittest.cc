@@ -61,10 +61,10 @@ class FakeService : public Service {
         static_cast<const RequestProto&>(req), &deferred_reply);
   }
 
-  static std::unique_ptr<ProtoMessage> RequestDecoder(
-      const std::string& proto) {
+  static std::unique_ptr<ProtoMessage> RequestDecoder(const void* data,
+                                                      size_t size) {
     std::unique_ptr<ProtoMessage> reply(new RequestProto());
-    EXPECT_TRUE(reply->ParseFromString(proto));
+    EXPECT_TRUE(reply->ParseFromArray(data, size));
     return reply;
   }
 
@@ -50,16 +50,43 @@ void ServiceProxy::BeginInvoke(const std::string& method_name,
                                DeferredBase reply,
                                int fd) {
   // |reply| will auto-resolve if it gets out of scope early.
+  const bool drop_reply = !reply.IsBound();
+  RequestID request_id = SendRequest(method_name, request, drop_reply, fd);
+  if (!request_id)
+    return;
+  PERFETTO_DCHECK(pending_callbacks_.count(request_id) == 0);
+  pending_callbacks_.emplace(request_id, std::move(reply));
+}
+
+void ServiceProxy::BeginInvokeRaw(const std::string& method_name,
+                                  const ProtoMessage& request,
+                                  RawReplyCallback reply,
+                                  int fd) {
+  RequestID request_id =
+      SendRequest(method_name, request, /*drop_reply=*/false, fd);
+  if (!request_id) {
+    // Behave like a Deferred that goes out of scope early.
+    reply(/*success=*/false, protozero::ConstBytes{nullptr, 0},
+          /*has_more=*/false);
+    return;
+  }
+  PERFETTO_DCHECK(pending_raw_callbacks_.count(request_id) == 0);
+  pending_raw_callbacks_.emplace(request_id, std::move(reply));
+}
+
+RequestID ServiceProxy::SendRequest(const std::string& method_name,
+                                    const ProtoMessage& request,
+                                    bool drop_reply,
+                                    int fd) {
   if (!connected()) {
     PERFETTO_DFATAL("Not connected.");
-    return;
+    return 0;
   }
   if (!client_)
-    return;  // The Client object has been destroyed in the meantime.
+    return 0;  // The Client object has been destroyed in the meantime.
 
   auto remote_method_it = remote_method_ids_.find(method_name);
   RequestID request_id = 0;
-  const bool drop_reply = !reply.IsBound();
   if (remote_method_it != remote_method_ids_.end()) {
     request_id =
         static_cast<ClientImpl*>(client_.get())
@@ -72,11 +99,7 @@ void ServiceProxy::BeginInvoke(const std::string& method_name,
 
   // When passing |drop_reply| == true, the returned |request_id| should be 0.
   PERFETTO_DCHECK(!drop_reply || !request_id);
-
-  if (!request_id)
-    return;
-  PERFETTO_DCHECK(pending_callbacks_.count(request_id) == 0);
-  pending_callbacks_.emplace(request_id, std::move(reply));
+  return request_id;
 }
 
 void ServiceProxy::EndInvoke(RequestID request_id,
@@ -97,6 +120,19 @@ void ServiceProxy::EndInvoke(RequestID request_id,
     pending_callbacks_.erase(callback_it);
 }
 
+bool ServiceProxy::EndInvokeRaw(RequestID request_id,
+                                bool success,
+                                protozero::ConstBytes reply,
+                                bool has_more) {
+  auto callback_it = pending_raw_callbacks_.find(request_id);
+  if (callback_it == pending_raw_callbacks_.end())
+    return false;
+  callback_it->second(success, reply, has_more);
+  if (!has_more)
+    pending_raw_callbacks_.erase(callback_it);
+  return true;
+}
+
 void ServiceProxy::OnConnect(bool success) {
   if (success) {
     PERFETTO_DCHECK(service_id_);
@@ -107,6 +143,12 @@ void ServiceProxy::OnConnect(bool success) {
 
 void ServiceProxy::OnDisconnect() {
   pending_callbacks_.clear();  // Will Reject() all the pending callbacks.
+  std::map<RequestID, RawReplyCallback> raw_callbacks;
+  raw_callbacks.swap(pending_raw_callbacks_);
+  for (auto& it : raw_callbacks) {
+    it.second(/*success=*/false, protozero::ConstBytes{nullptr, 0},
+              /*has_more=*/false);
+  }
   event_listener_->OnDisconnect();
 }
 
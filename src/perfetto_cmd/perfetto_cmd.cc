@@ -87,6 +87,11 @@ perfetto::PerfettoCmd* g_perfetto_cmd;
 const uint32_t kOnTraceDataTimeoutMs = 3000;
 const uint32_t kCloneTimeoutMs = 10000;
 
+// The size of the shared memory ring the service returns the trace data
+// through, when supported. The service reads back the buffers in tasks of
+// ~32KB, so this leaves plenty of headroom for the writes to the output file.
+const size_t kReadBuffersShmSize = 1024 * 1024;
+
 class LoggingErrorReporter : public ErrorReporter {
  public:
   LoggingErrorReporter(std::string file_name, const char* config)
@@ -1037,8 +1042,8 @@ int PerfettoCmd::ConnectToServiceAndRun() {
   }
 #endif
 
-  consumer_endpoint_ =
-      ConsumerIPCClient::Connect(GetConsumerSocket(), this, &task_runner_);
+  consumer_endpoint_ = ConsumerIPCClient::Connect(
+      GetConsumerSocket(), this, &task_runner_, kReadBuffersShmSize);
   SetupCtrlCSignalHandler();
   task_runner_.Run();
 
@@ -16,7 +16,9 @@
 
 #include "src/profiling/common/unwind_support.h"
 
+#include <algorithm>
 #include <cinttypes>
+#include <cstring>
 
 #include <procinfo/process_map.h>
 #include <unwindstack/Maps.h>
@@ -26,6 +28,19 @@
 
 namespace perfetto {
 namespace profiling {
+namespace {
+
+// JIT-compiled code can be replaced at the same addresses, so frames in it
+// can not be reused for later samples.
+bool IsCacheableFrame(const unwindstack::FrameData& frame) {
+  if (frame.map_info == nullptr)
+    return false;
+  const std::string& name = frame.map_info->name();
+  return name.find("jit-cache") == std::string::npos &&
+         name.find("jit-code-cache") == std::string::npos;
+}
+
+}  // namespace
 
 StackOverlayMemory::StackOverlayMemory(std::shared_ptr<unwindstack::Memory> mem,
                                        uint64_t sp,
@@ -37,6 +52,8 @@ size_t StackOverlayMemory::Read(uint64_t addr, void* dst, size_t size) {
   if (addr >= sp_ && addr + size <= stack_end_ && addr + size > sp_) {
     size_t offset = static_cast<size_t>(addr - sp_);
     memcpy(dst, stack_ + offset, size);
+    if (read_log_)
+      read_log_->push_back(StackRead{addr, size});
     return size;
   }
 
@@ -101,6 +118,7 @@ UnwindingMetadata::UnwindingMetadata(base::ScopedFile maps_fd,
 
 void UnwindingMetadata::ReparseMaps() {
   reparses++;
+  unwind_cache.Clear();
   fd_maps.Reset();
   fd_maps.Parse();
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
@@ -138,6 +156,129 @@ const std::string& UnwindingMetadata::GetBuildId(
   return empty_string_;
 }
 
+// static
+bool UnwindCache::MakeKey(const unwindstack::FrameData& frame,
+                          const StackOverlayMemory& memory,
+                          Key* key) {
+  if (frame.sp < memory.sp() || frame.sp > memory.stack_end())
+    return false;
+  key->pc = frame.pc;
+  key->sp = frame.sp;
+  key->stack_end = memory.stack_end();
+  return true;
+}
+
+// static
+bool UnwindCache::Matches(const Entry& entry,
+                          const StackOverlayMemory& memory) {
+  const uint8_t* data = entry.read_data.data();
+  for (const StackOverlayMemory::StackRead& read : entry.reads) {
+    // The reads are at or above the sp of the key, which is within the stack
+    // of |memory|, and the stack end is part of the key. Only the start of the
+    // copied stack can differ between samples with the same key.
+    if (read.addr < memory.sp())
+      return false;
+    const uint8_t* current =
+        memory.stack() + static_cast<size_t>(read.addr - memory.sp());
+    if (memcmp(current, data, read.size) != 0)
+      return false;
+    data += read.size;
+  }
+  return true;
+}
+
+const UnwindCache::Entry* UnwindCache::Find(const Key& key,
+                                            const StackOverlayMemory& memory) {
+  std::vector<Entry>* candidates = entries_.Find(key);
+  if (!candidates)
+    return nullptr;
+  for (const Entry& entry : *candidates) {
+    if (Matches(entry, memory))
+      return &entry;
+  }
+  return nullptr;
+}
+
+void UnwindCache::AppendCachedFrames(
+    const std::vector<unwindstack::FrameData>& cached,
+    std::vector<unwindstack::FrameData>* frames) {
+  frames->reserve(frames->size() + cached.size());
+  for (const unwindstack::FrameData& frame : cached) {
+    frames->emplace_back(frame);
+    frames->back().num = frames->size() - 1;
+  }
+}
+
+void UnwindCache::MaybeInsert(
+    const Key& key,
+    const UnwindOutcome& outcome,
+    const std::vector<unwindstack::FrameData>& frames,
+    std::vector<StackOverlayMemory::StackRead> reads,
+    const StackOverlayMemory& memory) {
+  // Only complete unwinds are cached. The innermost frames have to be the
+  // same as the ones the key was computed from, this only fails if the maps
+  // were reparsed by the unwinder in between.
+  if (outcome.error_code != unwindstack::ERROR_NONE || outcome.warnings != 0 ||
+      frames.size() < kInnerFrames || frames[kInnerFrames - 1].pc != key.pc ||
+      frames[kInnerFrames - 1].sp != key.sp) {
+    return;
+  }
+  auto outer_begin = frames.begin() + static_cast<ptrdiff_t>(kInnerFrames);
+  for (auto it = outer_begin; it != frames.end(); ++it) {
+    if (!IsCacheableFrame(*it))
+      return;
+  }
+
+  // Only the words above the sp of the key can influence the outer frames:
+  // the ones below belong to the inner frames, which are always unwound.
+  reads.erase(std::remove_if(reads.begin(), reads.end(),
+                             [&key](const StackOverlayMemory::StackRead& r) {
+                               return r.addr + r.size <= key.sp;
+                             }),
+              reads.end());
+  std::sort(reads.begin(), reads.end(),
+            [](const StackOverlayMemory::StackRead& a,
+               const StackOverlayMemory::StackRead& b) {
+              return a.addr < b.addr || (a.addr == b.addr && a.size < b.size);
+            });
+  reads.erase(std::unique(reads.begin(), reads.end(),
+                          [](const StackOverlayMemory::StackRead& a,
+                             const StackOverlayMemory::StackRead& b) {
+                            return a.addr == b.addr && a.size == b.size;
+                          }),
+              reads.end());
+
+  size_t num_outer_frames = frames.size() - kInnerFrames;
+  if (cached_frames_ + num_outer_frames > kMaxCachedFrames) {
+    stats_.evictions += cached_entries_;
+    Clear();
+  }
+  std::vector<Entry>& candidates = entries_[key];
+  if (candidates.size() >= kMaxEntriesPerKey) {
+    stats_.evictions++;
+    cached_frames_ -= candidates.front().frames.size();
+    cached_entries_--;
+    candidates.erase(candidates.begin());
+  }
+  Entry entry;
+  for (const StackOverlayMemory::StackRead& read : reads) {
+    const uint8_t* data =
+        memory.stack() + static_cast<size_t>(read.addr - memory.sp());
+    entry.read_data.insert(entry.read_data.end(), data, data + read.size);
+  }
+  entry.reads = std::move(reads);
+  entry.frames.assign(outer_begin, frames.end());
+  candidates.emplace_back(std::move(entry));
+  cached_frames_ += num_outer_frames;
+  cached_entries_++;
+}
+
+void UnwindCache::Clear() {
+  entries_.Clear();
+  cached_frames_ = 0;
+  cached_entries_ = 0;
+}
+
 std::string StringifyLibUnwindstackError(unwindstack::ErrorCode e) {
   switch (e) {
     case unwindstack::ERROR_NONE:
@@ -22,6 +22,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <unwindstack/Maps.h>
 #include <unwindstack/Unwinder.h>
@@ -32,6 +33,8 @@
 
 #include "perfetto/base/logging.h"
 #include "perfetto/base/time.h"
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/scoped_file.h"
 
 namespace perfetto {
@@ -77,19 +80,178 @@ class FDMemory : public unwindstack::Memory {
 // that opened /proc/[pid]/mem.
 class StackOverlayMemory : public unwindstack::Memory {
  public:
+  // A read served from the overlaid stack.
+  struct StackRead {
+    uint64_t addr;
+    size_t size;
+  };
+
   StackOverlayMemory(std::shared_ptr<unwindstack::Memory> mem,
                      uint64_t sp,
                      const uint8_t* stack,
                      size_t size);
   size_t Read(uint64_t addr, void* dst, size_t size) override;
 
+  // While |log| is set, every read served from the overlaid stack is appended
+  // to it.
+  void set_read_log(std::vector<StackRead>* log) { read_log_ = log; }
+
+  uint64_t sp() const { return sp_; }
+  uint64_t stack_end() const { return stack_end_; }
+  const uint8_t* stack() const { return stack_; }
+
  private:
   std::shared_ptr<unwindstack::Memory> mem_;
   const uint64_t sp_;
   const uint64_t stack_end_;
   const uint8_t* const stack_;
+  std::vector<StackRead>* read_log_ = nullptr;
+};
+
+// Outcome of a single unwind with libunwindstack.
+struct UnwindOutcome {
+  unwindstack::ErrorCode error_code = unwindstack::ERROR_NONE;
+  uint64_t warnings = 0;
+};
+
+enum class UnwindCacheResult {
+  // The stack was too shallow to use the cache, or the unwind stopped with
+  // an error or warning within its innermost frames.
+  kNotCached = 0,
+  kHit,
+  kMiss,
 };
 
+// Caches the outer frames of the stacks unwound in a process, so samples that
+// share them only need to unwind their innermost frames.
+//
+// After unwinding the first kInnerFrames frames of a sample, the cache is
+// looked up with the pc and sp of the last of those frames and the end of the
+// sampled stack. Each entry also holds the stack words that the unwinder read
+// above that sp while unwinding the outer frames: return addresses and saved
+// registers, but not the locals of the outer frames. If those words hold the
+// same values in the new sample, the unwinder would produce the same outer
+// frames, so they are copied from the cache instead of being unwound again.
+class UnwindCache {
+ public:
+  static constexpr size_t kInnerFrames = 8;
+  // Upper bound on the number of frames in the cache. The cache is cleared
+  // when inserting would exceed it.
+  static constexpr size_t kMaxCachedFrames = 16384;
+  // Upper bound on the number of entries with the same key, e.g. for a
+  // function called from several places at the same stack depth.
+  static constexpr size_t kMaxEntriesPerKey = 4;
+
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+  };
+
+  // Unwinds a sample whose stack is overlaid by |memory|.
+  // |unwind_fn(max_frames, frames)| has to unwind the sample from scratch
+  // reading the stack through |memory|, replacing the contents of |frames|
+  // with at most |max_frames| frames, and return its UnwindOutcome. It is
+  // called once or twice.
+  template <typename F>
+  UnwindOutcome Unwind(StackOverlayMemory* memory,
+                       size_t max_frames,
+                       F unwind_fn,
+                       std::vector<unwindstack::FrameData>* frames,
+                       UnwindCacheResult* cache_result);
+
+  // Has to be called whenever the maps of the process are reparsed, as the
+  // cached frames refer to them.
+  void Clear();
+
+  const Stats& stats() const { return stats_; }
+  size_t cached_frames() const { return cached_frames_; }
+
+ private:
+  struct Key {
+    uint64_t pc;
+    uint64_t sp;
+    uint64_t stack_end;
+
+    bool operator==(const Key& other) const {
+      return pc == other.pc && sp == other.sp && stack_end == other.stack_end;
+    }
+  };
+
+  struct KeyHasher {
+    size_t operator()(const Key& key) const {
+      return static_cast<size_t>(
+          base::Hasher::Combine(key.pc, key.sp, key.stack_end));
+    }
+  };
+
+  struct Entry {
+    // The stack words read to unwind |frames|, and their contents
+    // concatenated in the same order.
+    std::vector<StackOverlayMemory::StackRead> reads;
+    std::vector<uint8_t> read_data;
+    std::vector<unwindstack::FrameData> frames;
+  };
+
+  // Returns false if |frame| is not within the sampled stack.
+  static bool MakeKey(const unwindstack::FrameData& frame,
+                      const StackOverlayMemory& memory,
+                      Key* key);
+  static bool Matches(const Entry& entry, const StackOverlayMemory& memory);
+  const Entry* Find(const Key& key, const StackOverlayMemory& memory);
+  void AppendCachedFrames(const std::vector<unwindstack::FrameData>& cached,
+                          std::vector<unwindstack::FrameData>* frames);
+  void MaybeInsert(const Key& key,
+                   const UnwindOutcome& outcome,
+                   const std::vector<unwindstack::FrameData>& frames,
+                   std::vector<StackOverlayMemory::StackRead> reads,
+                   const StackOverlayMemory& memory);
+
+  base::FlatHashMap<Key, std::vector<Entry>, KeyHasher> entries_;
+  size_t cached_entries_ = 0;
+  size_t cached_frames_ = 0;
+  Stats stats_;
+};
+
+template <typename F>
+UnwindOutcome UnwindCache::Unwind(StackOverlayMemory* memory,
+                                  size_t max_frames,
+                                  F unwind_fn,
+                                  std::vector<unwindstack::FrameData>* frames,
+                                  UnwindCacheResult* cache_result) {
+  *cache_result = UnwindCacheResult::kNotCached;
+  if (max_frames <= kInnerFrames)
+    return unwind_fn(max_frames, frames);
+
+  UnwindOutcome inner = unwind_fn(kInnerFrames, frames);
+  // Any other error is deterministic, a full unwind would stop at the same
+  // frame.
+  if (inner.error_code != unwindstack::ERROR_MAX_FRAMES_EXCEEDED)
+    return inner;
+  Key key;
+  if (inner.warnings != 0 || frames->size() != kInnerFrames ||
+      !MakeKey(frames->back(), *memory, &key)) {
+    return unwind_fn(max_frames, frames);
+  }
+
+  const Entry* cached = Find(key, *memory);
+  if (cached) {
+    stats_.hits++;
+    *cache_result = UnwindCacheResult::kHit;
+    AppendCachedFrames(cached->frames, frames);
+    return UnwindOutcome{};
+  }
+
+  stats_.misses++;
+  *cache_result = UnwindCacheResult::kMiss;
+  std::vector<StackOverlayMemory::StackRead> reads;
+  memory->set_read_log(&reads);
+  UnwindOutcome outcome = unwind_fn(max_frames, frames);
+  memory->set_read_log(nullptr);
+  MaybeInsert(key, outcome, *frames, std::move(reads), *memory);
+  return outcome;
+}
+
 struct UnwindingMetadata {
   UnwindingMetadata(base::ScopedFile maps_fd, base::ScopedFile mem_fd);
 
@@ -115,6 +277,7 @@ struct UnwindingMetadata {
   std::shared_ptr<unwindstack::Memory> fd_mem;
   uint64_t reparses = 0;
   base::TimeMillis last_maps_reparse_time{0};
+  UnwindCache unwind_cache;
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
   std::unique_ptr<unwindstack::JitDebug> jit_debug;
   std::unique_ptr<unwindstack::DexFiles> dex_files;
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/common/unwind_support.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+constexpr uint64_t kSp = 0x7fff0000;
+constexpr uint64_t kFrameSize = 64;
+
+// A sampled stack with |depth| frames of kFrameSize bytes each, starting at
+// kSp. Frame i has its sp at the start of its bytes. Like a return address,
+// the pc of frame i > 0 is stored in the last 8 bytes of frame i - 1. The
+// other bytes are locals, which the unwinder does not read.
+struct FakeSample {
+  FakeSample(size_t d, uint64_t pc_offset = 0)
+      : depth(d), stack(depth * kFrameSize, 0), pc_offset_(pc_offset) {
+    for (size_t i = 0; i < stack.size(); ++i)
+      stack[i] = static_cast<uint8_t>(i);
+    for (size_t i = 1; i < depth; ++i)
+      set_return_address(i, 0x1000 + i);
+  }
+
+  // Sets the pc of frame |i| > 0.
+  void set_return_address(size_t i, uint64_t pc) {
+    memcpy(&stack[i * kFrameSize - sizeof(pc)], &pc, sizeof(pc));
+  }
+
+  // Unwinds the sample from scratch, like libunwindstack would, reading the
+  // return addresses through |memory|.
+  UnwindOutcome Unwind(unwindstack::Memory* memory,
+                       size_t max_frames,
+                       std::vector<unwindstack::FrameData>* frames) {
+    unwinds++;
+    frames->clear();
+    for (size_t i = 0; i < depth && i < max_frames; ++i) {
+      unwindstack::FrameData frame{};
+      frame.num = i;
+      frame.sp = kSp + i * kFrameSize;
+      if (i == 0) {
+        frame.pc = 0x1000 + pc_offset_;
+      } else if (memory->Read(frame.sp - sizeof(frame.pc), &frame.pc,
+                              sizeof(frame.pc)) != sizeof(frame.pc)) {
+        UnwindOutcome outcome;
+        outcome.error_code = unwindstack::ERROR_MEMORY_INVALID;
+        return outcome;
+      }
+      frame.function_name = "fun" + std::to_string(frame.pc);
+      frame.map_info = unwindstack::MapInfo::Create(0, 0, 0, 0, "libfoo.so");
+      frames->emplace_back(std::move(frame));
+    }
+    UnwindOutcome outcome;
+    if (depth > max_frames)
+      outcome.error_code = unwindstack::ERROR_MAX_FRAMES_EXCEEDED;
+    return outcome;
+  }
+
+  UnwindOutcome UnwindWithCache(UnwindCache* cache,
+                                std::vector<unwindstack::FrameData>* frames,
+                                UnwindCacheResult* result) {
+    StackOverlayMemory memory(/*mem=*/nullptr, kSp, stack.data(),
+                              stack.size());
+    return cache->Unwind(
+        &memory, /*max_frames=*/100,
+        [this, &memory](size_t max_frames,
+                        std::vector<unwindstack::FrameData>* out) {
+          return Unwind(&memory, max_frames, out);
+        },
+        frames, result);
+  }
+
+  // Unwinds the sample without the cache.
+  std::vector<unwindstack::FrameData> Expected() {
+    StackOverlayMemory memory(/*mem=*/nullptr, kSp, stack.data(),
+                              stack.size());
+    std::vector<unwindstack::FrameData> frames;
+    Unwind(&memory, 100, &frames);
+    return frames;
+  }
+
+  size_t depth;
+  std::vector<uint8_t> stack;
+  size_t unwinds = 0;
+
+ private:
+  uint64_t pc_offset_;
+};
+
+void AssertSameFrames(const std::vector<unwindstack::FrameData>& a,
+                      const std::vector<unwindstack::FrameData>& b) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    EXPECT_EQ(a[i].num, b[i].num);
+    EXPECT_EQ(a[i].pc, b[i].pc);
+    EXPECT_EQ(a[i].sp, b[i].sp);
+    EXPECT_EQ(a[i].function_name, b[i].function_name);
+  }
+}
+
+TEST(UnwindCacheTest, HitSplicesOuterFrames) {
+  UnwindCache cache;
+  FakeSample sample(20);
+  std::vector<unwindstack::FrameData> first;
+  UnwindCacheResult result;
+  UnwindOutcome outcome = sample.UnwindWithCache(&cache, &first, &result);
+  EXPECT_EQ(outcome.error_code, unwindstack::ERROR_NONE);
+  EXPECT_EQ(result, UnwindCacheResult::kMiss);
+  EXPECT_EQ(first.size(), 20u);
+  EXPECT_EQ(cache.cached_frames(), 20u - UnwindCache::kInnerFrames);
+
+  // The innermost frame differs, which is not part of the key.
+  FakeSample other(20, /*pc_offset=*/0x100);
+  std::vector<unwindstack::FrameData> second;
+  outcome = other.UnwindWithCache(&cache, &second, &result);
+  EXPECT_EQ(outcome.error_code, unwindstack::ERROR_NONE);
+  EXPECT_EQ(result, UnwindCacheResult::kHit);
+  EXPECT_EQ(other.unwinds, 1u);
+
+  AssertSameFrames(second, other.Expected());
+  EXPECT_EQ(cache.stats().hits, 1u);
+  EXPECT_EQ(cache.stats().misses, 1u);
+}
+
+TEST(UnwindCacheTest, HitOnDifferentLocals) {
+  UnwindCache cache;
+  FakeSample sample(20);
+  std::vector<unwindstack::FrameData> frames;
+  UnwindCacheResult result;
+  sample.UnwindWithCache(&cache, &frames, &result);
+  ASSERT_EQ(result, UnwindCacheResult::kMiss);
+
+  // Change a local of the outermost frame, which the unwinder does not read.
+  sample.stack[sample.stack.size() - kFrameSize] ^= 1;
+  sample.UnwindWithCache(&cache, &frames, &result);
+  EXPECT_EQ(result, UnwindCacheResult::kHit);
+  AssertSameFrames(frames, sample.Expected());
+}
+
+TEST(UnwindCacheTest, MissOnDifferentOuterStack) {
+  UnwindCache cache;
+  FakeSample sample(20);
+  std::vector<unwindstack::FrameData> frames;
+  UnwindCacheResult result;
+  sample.UnwindWithCache(&cache, &frames, &result);
+  ASSERT_EQ(result, UnwindCacheResult::kMiss);
+
+  // Change the pc of the outermost frame, far above the innermost frames.
+  sample.set_return_address(19, 0x2000);
+  sample.UnwindWithCache(&cache, &frames, &result);
+  EXPECT_EQ(result, UnwindCacheResult::kMiss);
+  AssertSameFrames(frames, sample.Expected());
+  EXPECT_EQ(frames.back().pc, 0x2000u);
+  EXPECT_EQ(cache.stats().misses, 2u);
+
+  // Both variants are kept.
+  sample.set_return_address(19, 0x1000 + 19);
+  sample.UnwindWithCache(&cache, &frames, &result);
+  EXPECT_EQ(result, UnwindCacheResult::kHit);
+  AssertSameFrames(frames, sample.Expected());
+}
+
+TEST(UnwindCacheTest, BoundedEntriesPerKey) {
+  UnwindCache cache;
+  std::vector<unwindstack::FrameData> frames;
+  UnwindCacheResult result;
+  FakeSample sample(20);
+  for (size_t i = 0; i <= UnwindCache::kMaxEntriesPerKey; ++i) {
+    sample.set_return_address(19, 0x2000 + i);
+    sample.UnwindWithCache(&cache, &frames, &result);
+    ASSERT_EQ(result, UnwindCacheResult::kMiss);
+  }
+  EXPECT_EQ(cache.stats().evictions, 1u);
+  EXPECT_EQ(cache.cached_frames(),
+            UnwindCache::kMaxEntriesPerKey * (20 - UnwindCache::kInnerFrames));
+
+  // The oldest variant was evicted, the newest is still there.
+  sample.UnwindWithCache(&cache, &frames, &result);
+  EXPECT_EQ(result, UnwindCacheResult::kHit);
+  sample.set_return_address(19, 0x2000);
+  sample.UnwindWithCache(&cache, &frames, &result);
+  EXPECT_EQ(result, UnwindCacheResult::kMiss);
+}
+
+TEST(UnwindCacheTest, ShallowStackNotCached) {
+  UnwindCache cache;
+  FakeSample sample(UnwindCache::kInnerFrames - 1);
+  std::vector<unwindstack::FrameData> frames;
+  UnwindCacheResult result;
+  UnwindOutcome outcome = sample.UnwindWithCache(&cache, &frames, &result);
+  EXPECT_EQ(outcome.error_code, unwindstack::ERROR_NONE);
+  EXPECT_EQ(result, UnwindCacheResult::kNotCached);
+  EXPECT_EQ(frames.size(), UnwindCache::kInnerFrames - 1);
+  EXPECT_EQ(sample.unwinds, 1u);
+  EXPECT_EQ(cache.cached_frames(), 0u);
+}
+
+TEST(UnwindCacheTest, ClearDropsEntries) {
+  UnwindCache cache;
+  FakeSample sample(20);
+  std::vector<unwindstack::FrameData> frames;
+  UnwindCacheResult result;
+  sample.UnwindWithCache(&cache, &frames, &result);
+  cache.Clear();
+  EXPECT_EQ(cache.cached_frames(), 0u);
+  sample.UnwindWithCache(&cache, &frames, &result);
+  EXPECT_EQ(result, UnwindCacheResult::kMiss);
+}
+
+TEST(UnwindCacheTest, Bounded) {
+  UnwindCache cache;
+  std::vector<unwindstack::FrameData> frames;
+  UnwindCacheResult result;
+  size_t outer_frames = 100 - UnwindCache::kInnerFrames;
+  size_t samples = 2 * UnwindCache::kMaxCachedFrames / outer_frames;
+  for (size_t i = 0; i < samples; ++i) {
+    FakeSample sample(100);
+    // Every sample gets its own key.
+    sample.set_return_address(UnwindCache::kInnerFrames - 1, 0x10000 + i);
+    sample.UnwindWithCache(&cache, &frames, &result);
+    ASSERT_EQ(result, UnwindCacheResult::kMiss);
+    ASSERT_LE(cache.cached_frames(), UnwindCache::kMaxCachedFrames);
+  }
+  EXPECT_GT(cache.stats().evictions, 0u);
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
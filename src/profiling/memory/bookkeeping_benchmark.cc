@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/profiling/common/callstack_trie.h"
+#include "src/profiling/memory/bookkeeping.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+constexpr size_t kNumCallstacks = 512;
+constexpr size_t kCallstackDepth = 12;
+// Operations of different client threads are not necessarily received in
+// order. Shuffle them within windows of this many sequence numbers.
+constexpr size_t kReorderWindow = 8;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+struct Operation {
+  bool is_malloc;
+  uint64_t address;
+  uint64_t size;
+  uint64_t sequence_number;
+  size_t callstack;
+};
+
+struct Stream {
+  std::vector<std::vector<unwindstack::FrameData>> callstacks;
+  std::vector<std::vector<std::string>> build_ids;
+  std::vector<Operation> operations;
+};
+
+// Builds a malloc/free stream with the shape of the ones recorded from apps:
+// the heap first grows to |live_allocations| allocations, then every malloc is
+// followed by a free of a random live allocation. Freed addresses are reused
+// by later mallocs, and 1 in 8 frees is for an address that was allocated
+// before the profile started.
+Stream MakeStream(size_t live_allocations, size_t churn_operations) {
+  std::minstd_rand rng(42);
+  Stream stream;
+  for (size_t i = 0; i < kNumCallstacks; ++i) {
+    std::vector<unwindstack::FrameData> callstack;
+    for (size_t depth = 0; depth < kCallstackDepth; ++depth) {
+      // Callstacks share their outermost frames, like they do in real apps.
+      uint64_t pc = depth < kCallstackDepth / 2
+                        ? depth + 1
+                        : (i + 1) * kCallstackDepth + depth;
+      unwindstack::FrameData frame{};
+      frame.pc = pc;
+      frame.function_name = "fun" + std::to_string(pc);
+      callstack.emplace_back(std::move(frame));
+    }
+    stream.build_ids.emplace_back(callstack.size(), "buildid");
+    stream.callstacks.emplace_back(std::move(callstack));
+  }
+
+  std::vector<uint64_t> live;
+  std::vector<uint64_t> freed;
+  uint64_t next_address = 0x7f0000000000;
+  uint64_t sequence_number = 0;
+  auto malloc_op = [&] {
+    uint64_t address;
+    if (!freed.empty() && rng() % 2) {
+      address = freed.back();
+      freed.pop_back();
+    } else {
+      address = next_address;
+      next_address += 16 * (1 + rng() % 64);
+    }
+    live.push_back(address);
+    stream.operations.push_back({true, address, 16 + rng() % 1024,
+                                 ++sequence_number, rng() % kNumCallstacks});
+  };
+  auto free_op = [&] {
+    uint64_t address;
+    if (rng() % 8 == 0) {
+      address = 0x100000000 + 16 * rng();
+    } else {
+      size_t idx = rng() % live.size();
+      address = live[idx];
+      live[idx] = live.back();
+      live.pop_back();
+      freed.push_back(address);
+    }
+    stream.operations.push_back({false, address, 0, ++sequence_number, 0});
+  };
+
+  for (size_t i = 0; i < live_allocations; ++i)
+    malloc_op();
+  for (size_t i = 0; i < churn_operations; ++i) {
+    malloc_op();
+    free_op();
+  }
+
+  for (size_t i = 0; i < stream.operations.size(); i += kReorderWindow) {
+    auto begin = stream.operations.begin() + static_cast<ptrdiff_t>(i);
+    auto end = stream.operations.begin() +
+               static_cast<ptrdiff_t>(std::min(
+                   i + kReorderWindow, stream.operations.size()));
+    std::shuffle(begin, end, rng);
+  }
+  return stream;
+}
+
+void Replay(const Stream& stream, HeapTracker* heap_tracker) {
+  for (const Operation& op : stream.operations) {
+    if (op.is_malloc) {
+      heap_tracker->RecordMalloc(stream.callstacks[op.callstack],
+                                 stream.build_ids[op.callstack], op.address,
+                                 op.size, op.size, op.sequence_number,
+                                 op.sequence_number);
+    } else {
+      heap_tracker->RecordFree(op.address, op.sequence_number,
+                               op.sequence_number);
+    }
+  }
+}
+
+// Measures the cost of replaying a malloc/free stream into a HeapTracker, and
+// dumping it at the end.
+void BM_HeapTrackerReplay(benchmark::State& state, bool dump_at_max) {
+  const size_t live_allocations = static_cast<size_t>(state.range(0));
+  const size_t churn_operations = 1024 * 1024;
+  Stream stream = MakeStream(live_allocations, churn_operations);
+
+  for (auto _ : state) {
+    GlobalCallstackTrie callsites;
+    HeapTracker heap_tracker(&callsites, dump_at_max);
+    Replay(stream, &heap_tracker);
+    uint64_t total = 0;
+    heap_tracker.GetCallstackAllocations(
+        [&total](const HeapTracker::CallstackAllocations& alloc) {
+          total += alloc.allocs;
+        });
+    heap_tracker.GetAllocations(
+        [&total](uint64_t, uint64_t size, uint64_t, uint64_t) {
+          total += size;
+        });
+    benchmark::DoNotOptimize(total);
+    if (IsBenchmarkFunctionalOnly())
+      break;
+  }
+  state.counters["ops/s"] = benchmark::Counter(
+      static_cast<double>(stream.operations.size()),
+      benchmark::Counter::kIsIterationInvariantRate);
+}
+
+void BM_HeapTrackerReplayTotals(benchmark::State& state) {
+  BM_HeapTrackerReplay(state, /*dump_at_max=*/false);
+}
+
+void BM_HeapTrackerReplayDumpAtMax(benchmark::State& state) {
+  BM_HeapTrackerReplay(state, /*dump_at_max=*/true);
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
+
+BENCHMARK(perfetto::profiling::BM_HeapTrackerReplayTotals)
+    ->RangeMultiplier(16)
+    ->Range(1024, 1024 * 1024)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(perfetto::profiling::BM_HeapTrackerReplayDumpAtMax)
+    ->RangeMultiplier(16)
+    ->Range(1024, 1024 * 1024)
+    ->Unit(benchmark::kMillisecond);
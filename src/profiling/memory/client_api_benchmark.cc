@@ -14,6 +14,8 @@
 
 #include <benchmark/benchmark.h>
 
+#include <optional>
+
 #include "perfetto/heap_profile.h"
 #include "src/profiling/memory/heap_profile_internal.h"
 
@@ -215,6 +217,37 @@ static void BM_ClientApiEnabledHeapFree(benchmark::State& state) {
 
 BENCHMARK(BM_ClientApiEnabledHeapFree);
 
+// Many threads concurrently reporting frees and sampled allocations, which
+// contend on the shared ring buffer.
+static void BM_ClientApiContended(benchmark::State& state) {
+  const uint32_t heap_id = GetHeapId();
+
+  std::optional<SharedRingBuffer> ringbuf;
+  if (state.thread_index() == 0) {
+    ClientConfiguration client_config{};
+    client_config.default_interval = 32000;
+    client_config.all_heaps = true;
+    g_client_config = client_config;
+    PERFETTO_CHECK(AHeapProfile_initSession(malloc, free));
+
+    PERFETTO_CHECK(g_shmem_fd);
+    ringbuf = SharedRingBuffer::Attach(base::ScopedFile(dup(g_shmem_fd)));
+  }
+
+  uint64_t id = static_cast<uint64_t>(state.thread_index()) << 32;
+  for (auto _ : state) {
+    AHeapProfile_reportAllocation(heap_id, ++id, 3200);
+    AHeapProfile_reportFree(heap_id, id);
+  }
+
+  if (state.thread_index() == 0) {
+    DisconnectGlobalServerSocket();
+    ringbuf->SetShuttingDown();
+  }
+}
+
+BENCHMARK(BM_ClientApiContended)->ThreadRange(1, 32)->UseRealTime();
+
 static void BM_ClientApiMallocFree(benchmark::State& state) {
   for (auto _ : state) {
     volatile char* x = static_cast<char*>(malloc(100));
@@ -692,6 +692,8 @@ void HeapprofdProducer::SetStats(
   stats->set_unwinding_errors(process_state.unwinding_errors);
   stats->set_heap_samples(process_state.heap_samples);
   stats->set_map_reparses(process_state.map_reparses);
+  stats->set_unwind_cache_hits(process_state.unwind_cache_hits);
+  stats->set_unwind_cache_misses(process_state.unwind_cache_misses);
   stats->set_total_unwinding_time_us(process_state.total_unwinding_time_us);
   stats->set_client_spinlock_blocked_us(
       process_state.client_spinlock_blocked_us);
@@ -1090,6 +1092,10 @@ void HeapprofdProducer::HandleAllocRecord(AllocRecord* alloc_rec) {
     process_state.unwinding_errors++;
   if (alloc_rec->reparsed_map)
     process_state.map_reparses++;
+  if (alloc_rec->unwind_cache_result == UnwindCacheResult::kHit)
+    process_state.unwind_cache_hits++;
+  else if (alloc_rec->unwind_cache_result == UnwindCacheResult::kMiss)
+    process_state.unwind_cache_misses++;
   process_state.heap_samples++;
   process_state.unwinding_time_us.Add(alloc_rec->unwinding_time_us);
   process_state.total_unwinding_time_us += alloc_rec->unwinding_time_us;
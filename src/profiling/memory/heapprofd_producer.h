@@ -192,6 +192,8 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
     uint64_t heap_samples = 0;
     uint64_t map_reparses = 0;
     uint64_t unwinding_errors = 0;
+    uint64_t unwind_cache_hits = 0;
+    uint64_t unwind_cache_misses = 0;
 
     uint64_t total_unwinding_time_us = 0;
     uint64_t client_spinlock_blocked_us = 0;
@@ -24,12 +24,12 @@
 
 #include <atomic>
 #include <cinttypes>
+#include <cstring>
 #include <type_traits>
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/temp_file.h"
-#include "src/profiling/memory/scoped_spinlock.h"
 
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
 #include <linux/memfd.h>
@@ -184,20 +184,9 @@ void SharedRingBuffer::Initialize(base::ScopedFile mem_fd) {
   mem_fd_ = std::move(mem_fd);
 }
 
-SharedRingBuffer::Buffer SharedRingBuffer::BeginWrite(
-    const ScopedSpinlock& spinlock,
-    size_t size) {
-  PERFETTO_DCHECK(spinlock.locked());
+SharedRingBuffer::Buffer SharedRingBuffer::BeginWrite(size_t size) {
   Buffer result;
 
-  std::optional<PointerPositions> opt_pos = GetPointerPositions();
-  if (!opt_pos) {
-    meta_->stats.num_writes_corrupt++;
-    errno = EBADF;
-    return result;
-  }
-  auto pos = opt_pos.value();
-
   const uint64_t size_with_header =
       base::AlignUp<kAlignment>(size + kHeaderSize);
 
@@ -207,29 +196,47 @@ SharedRingBuffer::Buffer SharedRingBuffer::BeginWrite(
     return result;
   }
 
-  if (size_with_header > write_avail(pos)) {
-    meta_->stats.num_writes_overflow++;
-    errno = EAGAIN;
-    return result;
+  PointerPositions pos;
+  for (;;) {
+    // The read_pos must be loaded before the write_pos: both only ever grow,
+    // so this guarantees read_pos <= write_pos for a non-corrupt buffer.
+    //
+    // We need to acquire load the read_pos to make sure we observe the zeroing
+    // of the records consumed by the reader. This is matched by the release
+    // in EndRead.
+    pos.read_pos = meta_->read_pos.load(std::memory_order_acquire);
+    pos.write_pos = meta_->write_pos.load(std::memory_order_relaxed);
+    if (IsCorrupt(pos)) {
+      IncrementWriteStat(&meta_->stats.num_writes_corrupt, 1);
+      errno = EBADF;
+      return result;
+    }
+
+    if (size_with_header > write_avail(pos)) {
+      IncrementWriteStat(&meta_->stats.num_writes_overflow, 1);
+      errno = EAGAIN;
+      return result;
+    }
+
+    // Reserve [write_pos, write_pos + size_with_header). If another writer got
+    // there first, try again after it.
+    uint64_t expected_write_pos = pos.write_pos;
+    if (meta_->write_pos.compare_exchange_weak(
+            expected_write_pos, pos.write_pos + size_with_header,
+            std::memory_order_release, std::memory_order_relaxed)) {
+      break;
+    }
   }
 
   uint8_t* wr_ptr = at(pos.write_pos);
 
+  // The header of the record is already zero (see EndRead), so the reader
+  // will not consume it until EndWrite.
   result.size = size;
   result.data = wr_ptr + kHeaderSize;
   result.bytes_free = write_avail(pos);
-  meta_->stats.bytes_written += size;
-  meta_->stats.num_writes_succeeded++;
-
-  // We can make this a relaxed store, as this gets picked up by the acquire
-  // load in GetPointerPositions (and the release store below).
-  reinterpret_cast<std::atomic<uint32_t>*>(wr_ptr)->store(
-      0, std::memory_order_relaxed);
-
-  // This needs to happen after the store above, so the reader never observes an
-  // incorrect byte count. This is matched by the acquire load in
-  // GetPointerPositions.
-  meta_->write_pos.fetch_add(size_with_header, std::memory_order_release);
+  IncrementWriteStat(&meta_->stats.bytes_written, size);
+  IncrementWriteStat(&meta_->stats.num_writes_succeeded, 1);
   return result;
 }
 
@@ -295,11 +302,43 @@ size_t SharedRingBuffer::EndRead(Buffer buf) {
   if (!buf)
     return 0;
   size_t size_with_header = base::AlignUp<kAlignment>(buf.size + kHeaderSize);
-  meta_->read_pos.fetch_add(size_with_header, std::memory_order_relaxed);
+  // Zero the record, so that the header of any record reserved by a writer
+  // over this space reads as zero until the writer calls EndWrite.
+  memset(buf.data - kHeaderSize, 0, size_with_header);
+  // This needs to release to make sure the writers observe the memset above
+  // before reusing the space.
+  //
+  // This is matched by the acquire load in BeginWrite.
+  meta_->read_pos.fetch_add(size_with_header, std::memory_order_release);
   meta_->stats.num_reads_succeeded++;
   return size_with_header;
 }
 
+SharedRingBuffer::Stats SharedRingBuffer::GetStats() {
+  // The write stats are concurrently incremented by the writers, so they
+  // cannot be copied together with the read stats.
+  Stats stats = {};
+  stats.num_reads_succeeded = meta_->stats.num_reads_succeeded;
+  stats.num_reads_corrupt = meta_->stats.num_reads_corrupt;
+  stats.num_reads_nodata = meta_->stats.num_reads_nodata;
+  auto load_write_stat = [](uint64_t* stat) {
+    return reinterpret_cast<std::atomic<uint64_t>*>(stat)->load(
+        std::memory_order_relaxed);
+  };
+  stats.bytes_written = load_write_stat(&meta_->stats.bytes_written);
+  stats.num_writes_succeeded =
+      load_write_stat(&meta_->stats.num_writes_succeeded);
+  stats.num_writes_corrupt = load_write_stat(&meta_->stats.num_writes_corrupt);
+  stats.num_writes_overflow =
+      load_write_stat(&meta_->stats.num_writes_overflow);
+  stats.failed_spinlocks =
+      meta_->failed_spinlocks.load(std::memory_order_relaxed);
+  stats.error_state = meta_->error_state.load(std::memory_order_relaxed);
+  stats.client_spinlock_blocked_us =
+      meta_->client_spinlock_blocked_us.load(std::memory_order_relaxed);
+  return stats;
+}
+
 bool SharedRingBuffer::IsCorrupt(const PointerPositions& pos) {
   if (pos.write_pos < pos.read_pos || pos.write_pos - pos.read_pos > size_ ||
       pos.write_pos % kAlignment || pos.read_pos % kAlignment) {
@@ -44,16 +44,20 @@ namespace profiling {
 // - Reads are atomic, no fragmentation.
 // - The reader sees writes in write order (% discarding).
 //
+// Writers don't take any lock: BeginWrite reserves space for a record by
+// advancing the write pointer with a compare-and-swap, and EndWrite commits it
+// by storing its size into its header. Until then the header is zero, and the
+// reader stops at the record. For this to work, the reader zeroes every record
+// it consumes before handing its space back to the writers, so the header of a
+// newly reserved record is always zero.
+//
 // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 // *IMPORTANT*: The ring buffer must be written under the assumption that the
-// other end modifies arbitrary shared memory without holding the spin-lock.
+// other end modifies arbitrary shared memory at any time.
 // This means we must make local copies of read and write pointers for doing
 // bounds checks followed by reads / writes, as they might change in the
 // meantime.
 // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-//
-// TODO:
-// - Write a benchmark.
 class SharedRingBuffer {
  public:
   class Buffer {
@@ -92,6 +96,7 @@ class SharedRingBuffer {
     PERFETTO_CROSS_ABI_ALIGNED(uint64_t) num_reads_nodata;
 
     // Fields below get set by GetStats as copies of atomics in MetadataPage.
+    // failed_spinlocks is always 0, as writers no longer take a lock.
     PERFETTO_CROSS_ABI_ALIGNED(uint64_t) failed_spinlocks;
     PERFETTO_CROSS_ABI_ALIGNED(uint64_t) client_spinlock_blocked_us;
     PERFETTO_CROSS_ABI_ALIGNED(ErrorState) error_state;
@@ -122,7 +127,8 @@ class SharedRingBuffer {
     return read_avail(*pos);
   }
 
-  Buffer BeginWrite(const ScopedSpinlock& spinlock, size_t size);
+  // Can be called concurrently from multiple threads.
+  Buffer BeginWrite(size_t size);
   void EndWrite(Buffer buf);
 
   Buffer BeginRead();
@@ -131,29 +137,10 @@ class SharedRingBuffer {
   // includes the header size.
   size_t EndRead(Buffer);
 
-  Stats GetStats(ScopedSpinlock& spinlock) {
-    PERFETTO_DCHECK(spinlock.locked());
-    Stats stats = meta_->stats;
-    stats.failed_spinlocks =
-        meta_->failed_spinlocks.load(std::memory_order_relaxed);
-    stats.error_state = meta_->error_state.load(std::memory_order_relaxed);
-    stats.client_spinlock_blocked_us =
-        meta_->client_spinlock_blocked_us.load(std::memory_order_relaxed);
-    return stats;
-  }
+  Stats GetStats();
 
   void SetErrorState(ErrorState error) { meta_->error_state.store(error); }
 
-  // This is used by the caller to be able to hold the SpinLock after
-  // BeginWrite has returned. This is so that additional bookkeeping can be
-  // done under the lock. This will be used to increment the sequence_number.
-  ScopedSpinlock AcquireLock(ScopedSpinlock::Mode mode) {
-    auto lock = ScopedSpinlock(&meta_->spinlock, mode);
-    if (PERFETTO_UNLIKELY(!lock.locked()))
-      meta_->failed_spinlocks.fetch_add(1, std::memory_order_relaxed);
-    return lock;
-  }
-
   void AddClientSpinlockBlockedUs(size_t n) {
     meta_->client_spinlock_blocked_us.fetch_add(n, std::memory_order_relaxed);
   }
@@ -186,6 +173,8 @@ class SharedRingBuffer {
 
   // Exposed for fuzzers.
   struct MetadataPage {
+    // Unused, writers used to reserve space under this lock. Kept to preserve
+    // the layout of the page.
     alignas(8) Spinlock spinlock;
     PERFETTO_CROSS_ABI_ALIGNED(std::atomic<uint64_t>) read_pos;
     PERFETTO_CROSS_ABI_ALIGNED(std::atomic<uint64_t>) write_pos;
@@ -196,9 +185,9 @@ class SharedRingBuffer {
     PERFETTO_CROSS_ABI_ALIGNED(std::atomic<ErrorState>) error_state;
     alignas(sizeof(uint64_t)) std::atomic<bool> shutting_down;
     alignas(sizeof(uint64_t)) std::atomic<bool> reader_paused;
-    // For stats that are only accessed by a single thread or under the
-    // spinlock, members of this struct are directly modified. Other stats use
-    // the atomics above this struct.
+    // Stats that are only accessed by the reader are directly modified. The
+    // write stats are atomically incremented by the writers (see
+    // IncrementWriteStat). Other stats use the atomics above this struct.
     //
     // When the user requests stats, the atomics above get copied into this
     // struct, which is then returned.
@@ -226,14 +215,17 @@ class SharedRingBuffer {
   void Initialize(base::ScopedFile mem_fd);
   bool IsCorrupt(const PointerPositions& pos);
 
+  static void IncrementWriteStat(uint64_t* stat, uint64_t n) {
+    reinterpret_cast<std::atomic<uint64_t>*>(stat)->fetch_add(
+        n, std::memory_order_relaxed);
+  }
+
   inline std::optional<PointerPositions> GetPointerPositions() {
     PointerPositions pos;
     // We need to acquire load the write_pos to make sure we observe a
-    // consistent ring buffer in BeginRead, otherwise it is possible that we
-    // observe the write_pos increment, but not the size field write of the
-    // payload.
+    // consistent ring buffer in BeginRead.
     //
-    // This is matched by a release at the end of BeginWrite.
+    // This is matched by the release compare-and-swap in BeginWrite.
     pos.write_pos = meta_->write_pos.load(std::memory_order_acquire);
     pos.read_pos = meta_->read_pos.load(std::memory_order_relaxed);
 
@@ -35,13 +35,7 @@ std::string ToString(const SharedRingBuffer::Buffer& buf_and_size) {
 }
 
 bool TryWrite(SharedRingBuffer* wr, const char* src, size_t size) {
-  SharedRingBuffer::Buffer buf;
-  {
-    auto lock = wr->AcquireLock(ScopedSpinlock::Mode::Try);
-    if (!lock.locked())
-      return false;
-    buf = wr->BeginWrite(lock, size);
-  }
+  SharedRingBuffer::Buffer buf = wr->BeginWrite(size);
   if (!buf)
     return false;
   memcpy(buf.data, src, size);
@@ -162,11 +156,7 @@ TEST(SharedRingBufferTest, WriteShutdown) {
   ASSERT_TRUE(rd);
   SharedRingBuffer wr =
       *SharedRingBuffer::Attach(base::ScopedFile(dup(rd->fd())));
-  SharedRingBuffer::Buffer buf;
-  {
-    auto lock = wr.AcquireLock(ScopedSpinlock::Mode::Blocking);
-    buf = wr.BeginWrite(lock, 10);
-  }
+  SharedRingBuffer::Buffer buf = wr.BeginWrite(10);
   rd = std::nullopt;
   memset(buf.data, 0, buf.size);
   wr.EndWrite(std::move(buf));
@@ -254,6 +244,51 @@ TEST(SharedRingBufferTest, MultiThreadingTest) {
   reader_thread.join();
 }
 
+TEST(SharedRingBufferTest, ReaderWaitsForUncommittedWrite) {
+  const size_t kBufSize = base::GetSysPageSize() * 4;
+  std::optional<SharedRingBuffer> wr = SharedRingBuffer::Create(kBufSize);
+  ASSERT_TRUE(wr);
+  SharedRingBuffer rd =
+      *SharedRingBuffer::Attach(base::ScopedFile(dup(wr->fd())));
+
+  // Fill the buffer with non-zero data and consume it, so that the following
+  // records are reserved over stale data.
+  std::string data(kBufSize - sizeof(uint64_t), '\xff');
+  ASSERT_TRUE(TryWrite(&*wr, data.data(), data.size()));
+  {
+    auto buf = rd.BeginRead();
+    ASSERT_EQ(ToString(buf), data);
+    rd.EndRead(std::move(buf));
+  }
+
+  // The reader must stop at the first uncommitted record, even if the records
+  // after it are committed.
+  SharedRingBuffer::Buffer first = wr->BeginWrite(4);
+  ASSERT_TRUE(first);
+  ASSERT_TRUE(TryWrite(&*wr, "bar", 4));
+  EXPECT_FALSE(rd.BeginRead());
+
+  memcpy(first.data, "foo", 4);
+  wr->EndWrite(std::move(first));
+  {
+    auto buf = rd.BeginRead();
+    ASSERT_EQ(buf.size, 4u);
+    EXPECT_STREQ(reinterpret_cast<const char*>(buf.data), "foo");
+    rd.EndRead(std::move(buf));
+  }
+  {
+    auto buf = rd.BeginRead();
+    ASSERT_EQ(buf.size, 4u);
+    EXPECT_STREQ(reinterpret_cast<const char*>(buf.data), "bar");
+    rd.EndRead(std::move(buf));
+  }
+  EXPECT_FALSE(rd.BeginRead());
+
+  SharedRingBuffer::Stats stats = rd.GetStats();
+  EXPECT_EQ(stats.num_writes_succeeded, 3u);
+  EXPECT_EQ(stats.num_reads_succeeded, 3u);
+}
+
 TEST(SharedRingBufferTest, InvalidSize) {
   const size_t kBufSize = base::GetSysPageSize() * 4 + 1;
   std::optional<SharedRingBuffer> wr = SharedRingBuffer::Create(kBufSize);
@@ -264,12 +299,7 @@ TEST(SharedRingBufferTest, EmptyWrite) {
   const size_t kBufSize = base::GetSysPageSize() * 4;
   std::optional<SharedRingBuffer> wr = SharedRingBuffer::Create(kBufSize);
   ASSERT_TRUE(wr);
-  SharedRingBuffer::Buffer buf;
-  {
-    auto lock = wr->AcquireLock(ScopedSpinlock::Mode::Try);
-    ASSERT_TRUE(lock.locked());
-    buf = wr->BeginWrite(lock, 0);
-  }
+  SharedRingBuffer::Buffer buf = wr->BeginWrite(0);
   EXPECT_TRUE(buf);
   wr->EndWrite(std::move(buf));
 }
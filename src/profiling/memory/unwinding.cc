@@ -120,6 +120,7 @@ std::unique_ptr<unwindstack::Regs> CreateRegsFromRawData(
 
 bool DoUnwind(WireMessage* msg, UnwindingMetadata* metadata, AllocRecord* out) {
   AllocMetadata* alloc_metadata = msg->alloc_header;
+  out->unwind_cache_result = UnwindCacheResult::kNotCached;
   std::unique_ptr<unwindstack::Regs> regs(CreateRegsFromRawData(
       alloc_metadata->arch, alloc_metadata->register_data));
   if (regs == nullptr) {
@@ -135,17 +136,29 @@ bool DoUnwind(WireMessage* msg, UnwindingMetadata* metadata, AllocRecord* out) {
     return false;
   }
   uint8_t* stack = reinterpret_cast<uint8_t*>(msg->payload);
-  std::shared_ptr<unwindstack::Memory> mems =
+  std::shared_ptr<StackOverlayMemory> mems =
       std::make_shared<StackOverlayMemory>(metadata->fd_mem,
                                            alloc_metadata->stack_pointer, stack,
                                            msg->payload_size);
 
-  unwindstack::Unwinder unwinder(kMaxFrames, &metadata->fd_maps, regs.get(),
-                                 mems);
+  auto unwind = [&regs, alloc_metadata, metadata, &mems](
+                    size_t max_frames,
+                    std::vector<unwindstack::FrameData>* frames) {
+    // Regs get invalidated by libunwindstack's speculative jump, and by
+    // earlier unwinds of the same sample. Reset.
+    ReadFromRawData(regs.get(), alloc_metadata->register_data);
+    unwindstack::Unwinder unwinder(max_frames, &metadata->fd_maps, regs.get(),
+                                   mems);
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
-  unwinder.SetJitDebug(metadata->GetJitDebug(regs->Arch()));
-  unwinder.SetDexFiles(metadata->GetDexFiles(regs->Arch()));
+    unwinder.SetJitDebug(metadata->GetJitDebug(regs->Arch()));
+    unwinder.SetDexFiles(metadata->GetDexFiles(regs->Arch()));
 #endif
+    frames->swap(unwinder.frames());  // Provide the unwinder buffer to use.
+    unwinder.Unwind(&kSkipMaps, /*map_suffixes_to_ignore=*/nullptr);
+    frames->swap(unwinder.frames());  // Take the buffer back.
+    return UnwindOutcome{unwinder.LastErrorCode(), unwinder.warnings()};
+  };
+
   // Suppress incorrect "variable may be uninitialized" error for if condition
   // after this loop. error_code = LastErrorCode gets run at least once.
   unwindstack::ErrorCode error_code = unwindstack::ERROR_NONE;
@@ -159,21 +172,14 @@ bool DoUnwind(WireMessage* msg, UnwindingMetadata* metadata, AllocRecord* out) {
       PERFETTO_DLOG("Reparsing maps");
       metadata->ReparseMaps();
       metadata->last_maps_reparse_time = base::GetWallTimeMs();
-      // Regs got invalidated by libuwindstack's speculative jump.
-      // Reset.
-      ReadFromRawData(regs.get(), alloc_metadata->register_data);
       out->reparsed_map = true;
-#if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
-      unwinder.SetJitDebug(metadata->GetJitDebug(regs->Arch()));
-      unwinder.SetDexFiles(metadata->GetDexFiles(regs->Arch()));
-#endif
     }
-    out->frames.swap(unwinder.frames());  // Provide the unwinder buffer to use.
-    unwinder.Unwind(&kSkipMaps, /*map_suffixes_to_ignore=*/nullptr);
-    out->frames.swap(unwinder.frames());  // Take the buffer back.
-    error_code = unwinder.LastErrorCode();
+    UnwindOutcome outcome = metadata->unwind_cache.Unwind(
+        mems.get(), kMaxFrames, unwind, &out->frames,
+        &out->unwind_cache_result);
+    error_code = outcome.error_code;
     if (error_code != unwindstack::ERROR_INVALID_MAP &&
-        (unwinder.warnings() & unwindstack::WARNING_DEX_PC_NOT_IN_MAP) == 0) {
+        (outcome.warnings & unwindstack::WARNING_DEX_PC_NOT_IN_MAP) == 0) {
       break;
     }
   }
@@ -258,14 +264,7 @@ void UnwindingWorker::FinishDisconnect(
     delegate_->PostFreeRecord(this, std::move(client_data.free_records));
   }
 
-  SharedRingBuffer::Stats stats = {};
-  {
-    auto lock = shmem.AcquireLock(ScopedSpinlock::Mode::Try);
-    if (lock.locked())
-      stats = shmem.GetStats(lock);
-    else
-      PERFETTO_ELOG("Failed to log shmem to get stats.");
-  }
+  SharedRingBuffer::Stats stats = shmem.GetStats();
   DataSourceInstanceID ds_id = client_data.data_source_instance_id;
 
   RemoveClientData(client_data_iterator);
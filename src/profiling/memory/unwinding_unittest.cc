@@ -182,6 +182,30 @@ TEST(UnwindingTest, DoUnwindReparse) {
                "namespace)::GetRecord(perfetto::profiling::WireMessage*)");
 }
 
+TEST(UnwindingTest, DoUnwindCached) {
+  base::ScopedFile proc_maps(base::OpenFile("/proc/self/maps", O_RDONLY));
+  base::ScopedFile proc_mem(base::OpenFile("/proc/self/mem", O_RDONLY));
+  UnwindingMetadata metadata(std::move(proc_maps), std::move(proc_mem));
+  WireMessage msg;
+  auto record = GetRecord(&msg);
+  AllocRecord first;
+  ASSERT_TRUE(DoUnwind(&msg, &metadata, &first));
+  if (first.error)
+    GTEST_SKIP() << "Only complete unwinds are cached.";
+  ASSERT_EQ(first.unwind_cache_result, UnwindCacheResult::kMiss);
+
+  AllocRecord second;
+  ASSERT_TRUE(DoUnwind(&msg, &metadata, &second));
+  EXPECT_EQ(second.unwind_cache_result, UnwindCacheResult::kHit);
+  EXPECT_FALSE(second.error);
+  ASSERT_EQ(first.frames.size(), second.frames.size());
+  for (size_t i = 0; i < first.frames.size(); ++i) {
+    EXPECT_EQ(first.frames[i].pc, second.frames[i].pc);
+    EXPECT_EQ(first.frames[i].function_name, second.frames[i].function_name);
+    EXPECT_EQ(first.build_ids[i], second.build_ids[i]);
+  }
+}
+
 TEST(AllocRecordArenaTest, Smoke) {
   AllocRecordArena a;
   auto borrowed = a.BorrowAllocRecord();
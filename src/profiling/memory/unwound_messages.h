@@ -31,6 +31,7 @@ struct AllocRecord {
   pid_t pid;
   bool error = false;
   bool reparsed_map = false;
+  UnwindCacheResult unwind_cache_result = UnwindCacheResult::kNotCached;
   uint64_t unwinding_time_us = 0;
   uint64_t data_source_instance_id;
   uint64_t timestamp;
@@ -88,6 +88,7 @@ struct CompletedSample {
   std::vector<unwindstack::FrameData> frames;
   std::vector<std::string> build_ids;
   unwindstack::ErrorCode unwind_error = unwindstack::ERROR_NONE;
+  UnwindCacheResult unwind_cache_result = UnwindCacheResult::kNotCached;
 };
 
 }  // namespace profiling
@@ -16,6 +16,7 @@
 
 #include "src/profiling/perf/perf_producer.h"
 
+#include <algorithm>
 #include <optional>
 #include <random>
 #include <utility>
@@ -366,12 +367,16 @@ bool PerfProducer::ShouldRejectDueToFilter(
 }
 
 PerfProducer::PerfProducer(ProcDescriptorGetter* proc_fd_getter,
-                           base::TaskRunner* task_runner)
+                           base::TaskRunner* task_runner,
+                           uint32_t num_unwinders)
     : task_runner_(task_runner),
       proc_fd_getter_(proc_fd_getter),
-      unwinding_worker_(this),
+      num_unwinders_(std::max(num_unwinders, 1u)),
       weak_factory_(this) {
   proc_fd_getter->SetDelegate(this);
+  for (uint32_t i = 0; i < num_unwinders_; i++)
+    unwinding_workers_.emplace_back(
+        std::make_unique<UnwinderHandle>(this, &kernel_symbolizer_));
 }
 
 void PerfProducer::SetupDataSource(DataSourceInstanceID,
@@ -458,6 +463,7 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
                             std::move(writer), std::move(per_cpu_readers)));
   PERFETTO_CHECK(inserted);
   DataSourceState& ds = ds_it->second;
+  ds.unwinder_stats.resize(unwinding_workers_.size());
 
   // Start the configured events.
   for (auto& per_cpu_reader : ds.per_cpu_readers) {
@@ -470,13 +476,17 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
       ds_it->second.trace_writer.get(),
       protos::pbzero::TracePacket::SEQ_NEEDS_INCREMENTAL_STATE);
 
-  // Inform unwinder of the new data source instance, and optionally start a
-  // periodic task to clear its cached state.
-  unwinding_worker_->PostStartDataSource(ds_id,
-                                         ds.event_config.kernel_frames());
-  if (ds.event_config.unwind_state_clear_period_ms()) {
-    unwinding_worker_->PostClearCachedStatePeriodic(
-        ds_id, ds.event_config.unwind_state_clear_period_ms());
+  // Inform the unwinders of the new data source instance, and optionally start
+  // a periodic task to clear their cached state. The libunwindstack cache is
+  // global, only the first unwinder resets it.
+  for (size_t i = 0; i < unwinding_workers_.size(); i++) {
+    Unwinder* unwinder = unwinding_workers_[i]->get();
+    unwinder->PostStartDataSource(ds_id, ds.event_config.kernel_frames());
+    if (ds.event_config.unwind_state_clear_period_ms()) {
+      unwinder->PostClearCachedStatePeriodic(
+          ds_id, ds.event_config.unwind_state_clear_period_ms(),
+          /*reset_unwindstack_cache=*/i == 0);
+    }
   }
 
   // Kick off periodic read task.
@@ -635,12 +645,14 @@ void PerfProducer::TickDataSourceRead(DataSourceInstanceID ds_id) {
     }
   }
 
-  // Wake up the unwinder as we've (likely) pushed samples into its queue.
-  unwinding_worker_->PostProcessQueue();
+  // Wake up the unwinders as we've (likely) pushed samples into their queues.
+  for (auto& unwinder : unwinding_workers_)
+    (*unwinder)->PostProcessQueue();
 
   if (PERFETTO_UNLIKELY(ds.status == DataSourceState::Status::kShuttingDown) &&
       !more_records_available) {
-    unwinding_worker_->PostInitiateDataSourceStop(ds_id);
+    for (auto& unwinder : unwinding_workers_)
+      (*unwinder)->PostInitiateDataSourceStop(ds_id);
   } else {
     // otherwise, keep reading
     auto tick_period_ms = it->second.event_config.read_tick_period_ms();
@@ -753,7 +765,7 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
         // Either a kernel thread (no need to obtain proc-fds), or a userspace
         // process but we're not recording userspace callstacks.
         process_state = ProcessTrackingStatus::kAccepted;
-        unwinding_worker_->PostRecordNoUserspaceProcess(ds_id, pid);
+        UnwinderForPid(pid)->PostRecordNoUserspaceProcess(ds_id, pid);
         // note: fallthrough
       }
     }
@@ -770,14 +782,19 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
       continue;
     }
 
+    size_t unwinder_index = UnwinderIndexForPid(pid);
+    Unwinder* unwinder = unwinding_workers_[unwinder_index]->get();
+    UnwinderQueueStats& queue_stats = ds->unwinder_stats[unwinder_index];
+
     // Optionally: drop sample if above a given threshold of sampled stacks
-    // that are waiting in the unwinding queue.
+    // that are waiting in the unwinding queues.
     uint64_t max_footprint_bytes = event_config.max_enqueued_footprint_bytes();
     uint64_t sample_stack_size = sample->stack.size();
     if (max_footprint_bytes) {
-      uint64_t footprint_bytes = unwinding_worker_->GetEnqueuedFootprint();
+      uint64_t footprint_bytes = GetEnqueuedFootprint();
       if (footprint_bytes + sample_stack_size >= max_footprint_bytes) {
         PERFETTO_DLOG("Skipping sample enqueueing due to footprint limit.");
+        queue_stats.samples_dropped++;
         EmitSkippedSample(ds_id, std::move(sample.value()),
                           SampleSkipReason::kUnwindEnqueue);
         continue;
@@ -785,15 +802,20 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
     }
 
     // Push the sample into the unwinding queue if there is room.
-    auto& queue = unwinding_worker_->unwind_queue();
+    auto& queue = unwinder->unwind_queue();
     WriteView write_view = queue.BeginWrite();
     if (write_view.valid) {
       queue.at(write_view.write_pos) =
           UnwindEntry{ds_id, std::move(sample.value())};
       queue.CommitWrite();
-      unwinding_worker_->IncrementEnqueuedFootprint(sample_stack_size);
+      unwinder->IncrementEnqueuedFootprint(sample_stack_size);
+      queue_stats.samples_enqueued++;
+      queue_stats.max_queue_occupancy =
+          std::max(queue_stats.max_queue_occupancy, queue.size());
     } else {
       PERFETTO_DLOG("Unwinder queue full, skipping sample");
+      queue_stats.samples_dropped++;
+      queue_stats.max_queue_occupancy = kUnwindQueueCapacity;
       EmitSkippedSample(ds_id, std::move(sample.value()),
                         SampleSkipReason::kUnwindEnqueue);
     }
@@ -837,7 +859,7 @@ void PerfProducer::OnProcDescriptors(pid_t pid,
                     static_cast<int>(pid), static_cast<size_t>(it.first));
 
       proc_status_it->second = ProcessTrackingStatus::kAccepted;
-      unwinding_worker_->PostAdoptProcDescriptors(
+      UnwinderForPid(pid)->PostAdoptProcDescriptors(
           it.first, pid, std::move(maps_fd), std::move(mem_fd));
       return;  // done
     }
@@ -900,10 +922,17 @@ void PerfProducer::EvaluateDescriptorLookupTimeout(DataSourceInstanceID ds_id,
     proc_status_it->second = ProcessTrackingStatus::kFdsTimedOut;
     // Also inform the unwinder of the state change (so that it can discard any
     // of the already-enqueued samples).
-    unwinding_worker_->PostRecordTimedOutProcDescriptors(ds_id, pid);
+    UnwinderForPid(pid)->PostRecordTimedOutProcDescriptors(ds_id, pid);
   }
 }
 
+uint64_t PerfProducer::GetEnqueuedFootprint() {
+  uint64_t footprint_bytes = 0;
+  for (auto& unwinder : unwinding_workers_)
+    footprint_bytes += (*unwinder)->GetEnqueuedFootprint();
+  return footprint_bytes;
+}
+
 void PerfProducer::PostEmitSample(DataSourceInstanceID ds_id,
                                   CompletedSample sample) {
   // hack: c++11 lambdas can't be moved into, so stash the sample on the heap.
@@ -926,6 +955,13 @@ void PerfProducer::EmitSample(DataSourceInstanceID ds_id,
   }
   DataSourceState& ds = ds_it->second;
 
+  UnwinderQueueStats& queue_stats =
+      ds.unwinder_stats[UnwinderIndexForPid(sample.common.pid)];
+  if (sample.unwind_cache_result == UnwindCacheResult::kHit)
+    queue_stats.unwind_cache_hits++;
+  else if (sample.unwind_cache_result == UnwindCacheResult::kMiss)
+    queue_stats.unwind_cache_misses++;
+
   // intern callsite
   GlobalCallstackTrie::Node* callstack_root =
       callstack_trie_.CreateCallsite(sample.frames, sample.build_ids);
@@ -1033,6 +1069,24 @@ void PerfProducer::EmitSkippedSample(DataSourceInstanceID ds_id,
   }
 }
 
+void PerfProducer::EmitUnwinderStats(DataSourceState* ds) {
+  for (size_t i = 0; i < ds->unwinder_stats.size(); i++) {
+    const UnwinderQueueStats& queue_stats = ds->unwinder_stats[i];
+    auto packet = StartTracePacket(ds->trace_writer.get());
+    packet->set_timestamp(static_cast<uint64_t>(base::GetBootTimeNs().count()));
+    packet->set_timestamp_clock_id(
+        protos::pbzero::BuiltinClock::BUILTIN_CLOCK_BOOTTIME);
+    auto* unwinder_stats = packet->set_perf_sample()->set_unwinder_stats();
+    unwinder_stats->set_unwinder_index(static_cast<uint32_t>(i));
+    unwinder_stats->set_samples_enqueued(queue_stats.samples_enqueued);
+    unwinder_stats->set_samples_dropped(queue_stats.samples_dropped);
+    unwinder_stats->set_max_queue_occupancy(queue_stats.max_queue_occupancy);
+    unwinder_stats->set_queue_capacity(kUnwindQueueCapacity);
+    unwinder_stats->set_unwind_cache_hits(queue_stats.unwind_cache_hits);
+    unwinder_stats->set_unwind_cache_misses(queue_stats.unwind_cache_misses);
+  }
+}
+
 void PerfProducer::InitiateReaderStop(DataSourceState* ds) {
   PERFETTO_DLOG("InitiateReaderStop");
   PERFETTO_CHECK(ds->status != DataSourceState::Status::kShuttingDown);
@@ -1062,6 +1116,11 @@ void PerfProducer::FinishDataSourceStop(DataSourceInstanceID ds_id) {
   DataSourceState& ds = ds_it->second;
   PERFETTO_CHECK(ds.status == DataSourceState::Status::kShuttingDown);
 
+  // Wait for all the unwinders to be done with the source.
+  if (!RecordUnwinderStopped(&ds.unwinders_stopped, unwinding_workers_.size()))
+    return;
+
+  EmitUnwinderStats(&ds);
   ds.trace_writer->Flush();
   data_sources_.erase(ds_it);
 
@@ -1092,7 +1151,8 @@ void PerfProducer::PurgeDataSource(DataSourceInstanceID ds_id) {
   PERFETTO_LOG("Stopping DataSource(%zu) prematurely",
                static_cast<size_t>(ds_id));
 
-  unwinding_worker_->PostPurgeDataSource(ds_id);
+  for (auto& unwinder : unwinding_workers_)
+    (*unwinder)->PostPurgeDataSource(ds_id);
 
   // Write a packet indicating the abrupt stop.
   {
@@ -1105,6 +1165,7 @@ void PerfProducer::PurgeDataSource(DataSourceInstanceID ds_id) {
     producer_event->set_source_stop_reason(
         protos::pbzero::PerfSample::ProducerEvent::PROFILER_STOP_GUARDRAIL);
   }
+  EmitUnwinderStats(&ds);
 
   ds.trace_writer->Flush();
   data_sources_.erase(ds_it);
@@ -1249,10 +1310,11 @@ void PerfProducer::Restart() {
   base::TaskRunner* task_runner = task_runner_;
   const char* socket_name = producer_socket_name_;
   ProcDescriptorGetter* proc_fd_getter = proc_fd_getter_;
+  uint32_t num_unwinders = num_unwinders_;
 
   // Invoke destructor and then the constructor again.
   this->~PerfProducer();
-  new (this) PerfProducer(proc_fd_getter, task_runner);
+  new (this) PerfProducer(proc_fd_getter, task_runner, num_unwinders);
 
   ConnectWithRetries(socket_name);
 }
@@ -21,6 +21,7 @@
 #include <map>
 #include <memory>
 #include <optional>
+#include <vector>
 
 #include <unwindstack/Error.h>
 #include <unwindstack/Regs.h>
@@ -52,13 +53,15 @@ namespace profiling {
 // summary in the mean time: three stages: (1) kernel buffer reader that parses
 // the samples -> (2) callstack unwinder -> (3) interning and serialization of
 // samples. This class handles stages (1) and (3) on the main thread. Unwinding
-// is done by |Unwinder| on a dedicated thread.
+// is done by one or more |Unwinder|s, each on a dedicated thread, with the
+// sampled processes sharded between them by pid.
 class PerfProducer : public Producer,
                      public ProcDescriptorDelegate,
                      public Unwinder::Delegate {
  public:
   PerfProducer(ProcDescriptorGetter* proc_fd_getter,
-               base::TaskRunner* task_runner);
+               base::TaskRunner* task_runner,
+               uint32_t num_unwinders = 1);
   ~PerfProducer() override = default;
 
   PerfProducer(const PerfProducer&) = delete;
@@ -109,6 +112,19 @@ class PerfProducer : public Producer,
       base::FlatSet<std::string>* additional_cmdlines,
       std::function<bool(std::string*)> read_proc_pid_cmdline);
 
+  // Returns which of the |num_unwinders| unwinders handles the samples (and
+  // the unwinding state) of the process.
+  static size_t UnwinderIndexForPid(pid_t pid, size_t num_unwinders) {
+    return static_cast<uint32_t>(pid) % num_unwinders;
+  }
+
+  // Counts the stop ack of one of the |num_unwinders| unwinders for a data
+  // source in |unwinders_stopped|. Returns true once all of them have acked.
+  static bool RecordUnwinderStopped(size_t* unwinders_stopped,
+                                    size_t num_unwinders) {
+    return ++*unwinders_stopped >= num_unwinders;
+  }
+
  private:
   // State of the producer's connection to tracing service (traced).
   enum State {
@@ -140,6 +156,16 @@ class PerfProducer : public Producer,
     kRejected       // process not considered relevant for the data source
   };
 
+  // Per-unwinder statistics of the unwinding queue, for a data source.
+  struct UnwinderQueueStats {
+    uint64_t samples_enqueued = 0;
+    uint64_t samples_dropped = 0;
+    uint64_t max_queue_occupancy = 0;
+    // Tallied from the completed samples, see |UnwindCacheResult|.
+    uint64_t unwind_cache_hits = 0;
+    uint64_t unwind_cache_misses = 0;
+  };
+
   struct DataSourceState {
     enum class Status { kActive, kShuttingDown };
 
@@ -168,6 +194,11 @@ class PerfProducer : public Producer,
     // Additional state for EventConfig.TargetFilter: command lines we have
     // decided to unwind, up to a total of additional_cmdline_count values.
     base::FlatSet<std::string> additional_cmdlines;
+    // Indexed by unwinder, see |unwinding_workers_|.
+    std::vector<UnwinderQueueStats> unwinder_stats;
+    // Number of unwinders that are done with the data source while it is
+    // shutting down.
+    size_t unwinders_stopped = 0;
   };
 
   // For |EmitSkippedSample|.
@@ -204,6 +235,16 @@ class PerfProducer : public Producer,
                              uint32_t timeout_ms);
   void EvaluateDescriptorLookupTimeout(DataSourceInstanceID ds_id, pid_t pid);
 
+  // Returns the unwinder that handles the samples of the process.
+  size_t UnwinderIndexForPid(pid_t pid) const {
+    return UnwinderIndexForPid(pid, unwinding_workers_.size());
+  }
+  Unwinder* UnwinderForPid(pid_t pid) {
+    return unwinding_workers_[UnwinderIndexForPid(pid)]->get();
+  }
+  // Total heap footprint of the samples in all the unwinding queues.
+  uint64_t GetEnqueuedFootprint();
+
   void EmitSample(DataSourceInstanceID ds_id, CompletedSample sample);
   void EmitRingBufferLoss(DataSourceInstanceID ds_id,
                           size_t cpu,
@@ -217,6 +258,8 @@ class PerfProducer : public Producer,
   void EmitSkippedSample(DataSourceInstanceID ds_id,
                          ParsedSample sample,
                          SampleSkipReason reason);
+  // Emits a packet with the |UnwinderQueueStats| of each unwinder.
+  void EmitUnwinderStats(DataSourceState* ds);
 
   // Starts the shutdown of the given data source instance, starting with
   // pausing the reader frontend. Once the reader reaches the point where all
@@ -275,8 +318,12 @@ class PerfProducer : public Producer,
   // State associated with perf-sampling data sources.
   std::map<DataSourceInstanceID, DataSourceState> data_sources_;
 
-  // Unwinding stage, running on a dedicated thread.
-  UnwinderHandle unwinding_worker_;
+  // Shared by the unwinders, must outlive them.
+  SharedKernelSymbolizer kernel_symbolizer_;
+
+  // Unwinding stage, each unwinder running on a dedicated thread. Never empty.
+  const uint32_t num_unwinders_;
+  std::vector<std::unique_ptr<UnwinderHandle>> unwinding_workers_;
 
   // Used for tracepoint name -> id lookups. Initialized lazily, and in general
   // best effort - can be null if tracefs isn't accessible.
@@ -17,9 +17,13 @@
 #include "src/profiling/perf/perf_producer.h"
 
 #include <stdint.h>
+#include <memory>
 #include <optional>
+#include <vector>
 
 #include "perfetto/base/logging.h"
+#include "src/base/test/test_task_runner.h"
+#include "src/profiling/perf/unwinding.h"
 #include "test/gtest_and_gmock.h"
 
 namespace perfetto {
@@ -197,6 +201,96 @@ TEST(TargetFilterTest, AdditionalCmdlines) {
   EXPECT_EQ(extra_cmds.count("/bin/top"), 0u);
 }
 
+TEST(UnwinderRoutingTest, SingleUnwinder) {
+  for (pid_t pid : {0, 1, 2, 42, 4194304})
+    EXPECT_EQ(PerfProducer::UnwinderIndexForPid(pid, 1), 0u);
+}
+
+TEST(UnwinderRoutingTest, ProcessesShardedAcrossUnwinders) {
+  const size_t kNumUnwinders = 3;
+  std::vector<size_t> pids_per_unwinder(kNumUnwinders);
+  for (pid_t pid = 1; pid <= 300; pid++) {
+    size_t index = PerfProducer::UnwinderIndexForPid(pid, kNumUnwinders);
+    ASSERT_LT(index, kNumUnwinders);
+    // All the samples of a process go to the same unwinder.
+    EXPECT_EQ(PerfProducer::UnwinderIndexForPid(pid, kNumUnwinders), index);
+    pids_per_unwinder[index]++;
+  }
+  // Consecutive pids are spread evenly.
+  for (size_t count : pids_per_unwinder)
+    EXPECT_EQ(count, 100u);
+}
+
+TEST(UnwinderStopTest, CountsAcksFromAllUnwinders) {
+  size_t unwinders_stopped = 0;
+  EXPECT_FALSE(PerfProducer::RecordUnwinderStopped(&unwinders_stopped, 3));
+  EXPECT_FALSE(PerfProducer::RecordUnwinderStopped(&unwinders_stopped, 3));
+  EXPECT_TRUE(PerfProducer::RecordUnwinderStopped(&unwinders_stopped, 3));
+
+  unwinders_stopped = 0;
+  EXPECT_TRUE(PerfProducer::RecordUnwinderStopped(&unwinders_stopped, 1));
+}
+
+// Forwards the unwinders' stop acks to the main thread, and counts them as the
+// producer does.
+class StopAckCountingDelegate : public Unwinder::Delegate {
+ public:
+  StopAckCountingDelegate(base::TestTaskRunner* task_runner,
+                          size_t num_unwinders,
+                          std::function<void()> all_stopped)
+      : task_runner_(task_runner),
+        num_unwinders_(num_unwinders),
+        all_stopped_(std::move(all_stopped)) {}
+
+  void PostEmitSample(DataSourceInstanceID, CompletedSample) override {}
+  void PostEmitUnwinderSkippedSample(DataSourceInstanceID,
+                                     ParsedSample) override {}
+  void PostFinishDataSourceStop(DataSourceInstanceID ds_id) override {
+    task_runner_->PostTask([this, ds_id] {
+      EXPECT_EQ(ds_id, 42u);
+      acks_++;
+      if (PerfProducer::RecordUnwinderStopped(&unwinders_stopped_,
+                                              num_unwinders_)) {
+        all_stopped_();
+      }
+    });
+  }
+
+  size_t acks() const { return acks_; }
+
+ private:
+  base::TestTaskRunner* const task_runner_;
+  const size_t num_unwinders_;
+  std::function<void()> all_stopped_;
+  size_t unwinders_stopped_ = 0;
+  size_t acks_ = 0;
+};
+
+TEST(UnwinderStopTest, StopFinishesOnceEveryUnwinderAcked) {
+  const size_t kNumUnwinders = 3;
+  base::TestTaskRunner task_runner;
+  StopAckCountingDelegate delegate(&task_runner, kNumUnwinders,
+                                   task_runner.CreateCheckpoint("stopped"));
+  SharedKernelSymbolizer kernel_symbolizer;
+  std::vector<std::unique_ptr<UnwinderHandle>> unwinders;
+  for (size_t i = 0; i < kNumUnwinders; i++) {
+    unwinders.emplace_back(
+        std::make_unique<UnwinderHandle>(&delegate, &kernel_symbolizer));
+  }
+
+  for (auto& unwinder : unwinders) {
+    (*unwinder)->PostStartDataSource(42, /*kernel_frames=*/false);
+    (*unwinder)->PostInitiateDataSourceStop(42);
+  }
+  task_runner.RunUntilCheckpoint("stopped");
+  EXPECT_EQ(delegate.acks(), kNumUnwinders);
+
+  // Join the unwinder threads before checking that no further ack arrives.
+  unwinders.clear();
+  task_runner.RunUntilIdle();
+  EXPECT_EQ(delegate.acks(), kNumUnwinders);
+}
+
 }  // namespace
 }  // namespace profiling
 }  // namespace perfetto
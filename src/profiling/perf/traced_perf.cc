@@ -15,7 +15,12 @@
  */
 
 #include "src/profiling/perf/traced_perf.h"
+
+#include <stdio.h>
+
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/getopt.h"
+#include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/unix_task_runner.h"
 #include "perfetto/tracing/default_socket.h"
 #include "src/profiling/perf/perf_producer.h"
@@ -24,6 +29,10 @@
 namespace perfetto {
 
 namespace {
+// Upper bound for --unwinder-threads, each unwinder has its own thread and
+// unwinding queue.
+constexpr uint32_t kMaxUnwinderThreads = 16;
+
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
 static constexpr char kTracedPerfSocketEnvVar[] = "ANDROID_SOCKET_traced_perf";
 
@@ -41,7 +50,41 @@ int GetRawInheritedListeningSocket() {
 }  // namespace
 
 // TODO(rsavitski): watchdog.
-int TracedPerfMain(int, char**) {
+int TracedPerfMain(int argc, char** argv) {
+  enum LongOption {
+    OPT_UNWINDER_THREADS = 1000,
+  };
+
+  // Number of threads used for unwinding. Samples are assigned to the
+  // unwinders by pid, so more than one is useful only when sampling many
+  // processes.
+  uint32_t num_unwinders = 1;
+
+  static const option long_options[] = {
+      {"unwinder-threads", required_argument, nullptr, OPT_UNWINDER_THREADS},
+      {nullptr, 0, nullptr, 0}};
+
+  for (;;) {
+    int option = getopt_long(argc, argv, "", long_options, nullptr);
+    if (option == -1)
+      break;
+    switch (option) {
+      case OPT_UNWINDER_THREADS: {
+        std::optional<uint32_t> value = base::CStringToUInt32(optarg);
+        if (!value || *value == 0 || *value > kMaxUnwinderThreads) {
+          fprintf(stderr, "--unwinder-threads must be between 1 and %u\n",
+                  kMaxUnwinderThreads);
+          return 1;
+        }
+        num_unwinders = *value;
+        break;
+      }
+      default:
+        fprintf(stderr, "Usage: %s [--unwinder-threads N]\n", argv[0]);
+        return 1;
+    }
+  }
+
   base::UnixTaskRunner task_runner;
 
 // TODO(rsavitski): support standalone --root or similar on android.
@@ -52,7 +95,8 @@ int TracedPerfMain(int, char**) {
   DirectDescriptorGetter proc_fd_getter;
 #endif
 
-  profiling::PerfProducer producer(&proc_fd_getter, &task_runner);
+  profiling::PerfProducer producer(&proc_fd_getter, &task_runner,
+                                   num_unwinders);
   const char* env_notif = getenv("TRACED_PERF_NOTIFY_FD");
   if (env_notif) {
     int notif_fd = atoi(env_notif);
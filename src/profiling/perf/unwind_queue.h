@@ -82,6 +82,14 @@ class UnwindQueue {
     rd_pos_.store(pos, std::memory_order_release);
   }
 
+  // Number of entries in the buffer (consumed or not by the reader). Can be
+  // called from either side, might be stale by the time it returns.
+  uint64_t size() {
+    uint64_t rd = rd_pos_.load(std::memory_order_acquire);
+    uint64_t wr = wr_pos_.load(std::memory_order_acquire);
+    return wr >= rd ? wr - rd : 0;
+  }
+
  private:
   std::array<T, QueueSize> data_;
   std::atomic<uint64_t> wr_pos_{0};
@@ -38,6 +38,7 @@ TEST(UnwindQueueTest, SinglePass) {
     WriteView v = queue.BeginWrite();
     ASSERT_FALSE(v.valid);
   }
+  ASSERT_EQ(queue.size(), kCapacity);
 
   // reader sees all four writes
   ReadView v = queue.BeginRead();
@@ -54,6 +55,7 @@ TEST(UnwindQueueTest, SinglePass) {
 
   // writer sees an available slot
   ASSERT_TRUE(queue.BeginWrite().valid);
+  ASSERT_EQ(queue.size(), 0u);
   // reader caught up
   ASSERT_TRUE(queue.BeginRead().read_pos == queue.BeginRead().write_pos);
 }
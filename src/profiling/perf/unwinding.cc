@@ -18,6 +18,7 @@
 
 #include <cinttypes>
 #include <mutex>
+#include <shared_mutex>
 
 #include <unwindstack/Unwinder.h>
 
@@ -29,19 +30,64 @@
 namespace {
 constexpr size_t kUnwindingMaxFrames = 1000;
 constexpr uint32_t kDataSourceShutdownRetryDelayMs = 400;
+
+// Libunwindstack's Elf cache is global, and resetting it frees the cache
+// (including its internal lock). Since there can be multiple unwinders, each
+// on its own thread, unwinding holds this lock in shared mode, while resetting
+// the cache holds it in exclusive mode.
+std::shared_mutex& UnwindstackCacheLock() {
+  static perfetto::base::NoDestructor<std::shared_mutex> lock;
+  return lock.ref();
+}
 }  // namespace
 
 namespace perfetto {
 namespace profiling {
 
+SharedKernelSymbolizer::SharedKernelSymbolizer() = default;
+
+SharedKernelSymbolizer::~SharedKernelSymbolizer() {
+  PERFETTO_DCHECK(refcount_ == 0);
+}
+
+KernelSymbolMap* SharedKernelSymbolizer::Acquire() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (refcount_++ == 0) {
+    // The LazyKernelSymbolizer is bound to the thread that creates it, so
+    // create a new one on the acquiring thread rather than reusing it.
+    symbolizer_ = std::make_unique<LazyKernelSymbolizer>();
+    symbol_map_ = symbolizer_->GetOrCreateKernelSymbolMap();
+  }
+  return symbol_map_;
+}
+
+void SharedKernelSymbolizer::Release() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  PERFETTO_DCHECK(refcount_ > 0);
+  if (--refcount_ > 0)
+    return;
+  symbol_map_ = nullptr;
+  symbolizer_.reset();
+  base::MaybeReleaseAllocatorMemToOS();
+}
+
 Unwinder::Delegate::~Delegate() = default;
 
-Unwinder::Unwinder(Delegate* delegate, base::UnixTaskRunner* task_runner)
-    : task_runner_(task_runner), delegate_(delegate) {
+Unwinder::Unwinder(Delegate* delegate,
+                   SharedKernelSymbolizer* kernel_symbolizer,
+                   base::UnixTaskRunner* task_runner)
+    : task_runner_(task_runner),
+      delegate_(delegate),
+      kernel_symbolizer_(kernel_symbolizer) {
   ResetAndEnableUnwindstackCache();
   base::MaybeSetThreadName("stack-unwinding");
 }
 
+Unwinder::~Unwinder() {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+  ReleaseKernelSymbolMap();
+}
+
 void Unwinder::PostStartDataSource(DataSourceInstanceID ds_id,
                                    bool kernel_frames) {
   // No need for a weak pointer as the associated task runner quits (stops
@@ -57,8 +103,8 @@ void Unwinder::StartDataSource(DataSourceInstanceID ds_id, bool kernel_frames) {
   auto it_and_inserted = data_sources_.emplace(ds_id, DataSourceState{});
   PERFETTO_DCHECK(it_and_inserted.second);
 
-  if (kernel_frames) {
-    kernel_symbolizer_.GetOrCreateKernelSymbolMap();
+  if (kernel_frames && !kernel_symbol_map_) {
+    kernel_symbol_map_ = kernel_symbolizer_->Acquire();
   }
 }
 
@@ -330,39 +376,23 @@ CompletedSample Unwinder::UnwindSample(const ParsedSample& sample,
   if (!opt_user_state)
     return ret;
 
+  std::shared_lock<std::shared_mutex> cache_lock(UnwindstackCacheLock());
+
   // Overlay the stack bytes over /proc/<pid>/mem.
   UnwindingMetadata* unwind_state = opt_user_state;
-  std::shared_ptr<unwindstack::Memory> overlay_memory =
+  std::shared_ptr<StackOverlayMemory> overlay_memory =
       std::make_shared<StackOverlayMemory>(
           unwind_state->fd_mem, sample.regs->sp(),
           reinterpret_cast<const uint8_t*>(sample.stack.data()),
           sample.stack.size());
 
-  struct UnwindResult {
-    unwindstack::ErrorCode error_code;
-    uint64_t warnings;
-    std::vector<unwindstack::FrameData> frames;
-
-    UnwindResult(unwindstack::ErrorCode e,
-                 uint64_t w,
-                 std::vector<unwindstack::FrameData> f)
-        : error_code(e), warnings(w), frames(std::move(f)) {}
-    UnwindResult(const UnwindResult&) = delete;
-    UnwindResult& operator=(const UnwindResult&) = delete;
-    UnwindResult(UnwindResult&&) __attribute__((unused)) = default;
-    UnwindResult& operator=(UnwindResult&&) = default;
-  };
-  auto attempt_unwind = [&sample, unwind_state, pid_unwound_before,
-                         &overlay_memory]() -> UnwindResult {
-    metatrace::ScopedEvent m(metatrace::TAG_PRODUCER,
-                             pid_unwound_before
-                                 ? metatrace::PROFILER_UNWIND_ATTEMPT
-                                 : metatrace::PROFILER_UNWIND_INITIAL_ATTEMPT);
-
+  auto unwind_from_scratch = [&sample, unwind_state, &overlay_memory](
+                                 size_t max_frames,
+                                 std::vector<unwindstack::FrameData>* frames) {
     // Unwindstack clobbers registers, so make a copy in case of retries.
     auto regs_copy = std::unique_ptr<unwindstack::Regs>{sample.regs->Clone()};
 
-    unwindstack::Unwinder unwinder(kUnwindingMaxFrames, &unwind_state->fd_maps,
+    unwindstack::Unwinder unwinder(max_frames, &unwind_state->fd_maps,
                                    regs_copy.get(), overlay_memory);
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
     unwinder.SetJitDebug(unwind_state->GetJitDebug(regs_copy->Arch()));
@@ -370,12 +400,25 @@ CompletedSample Unwinder::UnwindSample(const ParsedSample& sample,
 #endif
     unwinder.Unwind(/*initial_map_names_to_skip=*/nullptr,
                     /*map_suffixes_to_ignore=*/nullptr);
-    return {unwinder.LastErrorCode(), unwinder.warnings(),
-            unwinder.ConsumeFrames()};
+    *frames = unwinder.ConsumeFrames();
+    return UnwindOutcome{unwinder.LastErrorCode(), unwinder.warnings()};
+  };
+  std::vector<unwindstack::FrameData> frames;
+  auto attempt_unwind = [unwind_state, pid_unwound_before, &overlay_memory,
+                         &unwind_from_scratch, &frames,
+                         &ret]() -> UnwindOutcome {
+    metatrace::ScopedEvent m(metatrace::TAG_PRODUCER,
+                             pid_unwound_before
+                                 ? metatrace::PROFILER_UNWIND_ATTEMPT
+                                 : metatrace::PROFILER_UNWIND_INITIAL_ATTEMPT);
+    // Only the innermost frames are unwound if the rest are in the cache.
+    return unwind_state->unwind_cache.Unwind(
+        overlay_memory.get(), kUnwindingMaxFrames, unwind_from_scratch,
+        &frames, &ret.unwind_cache_result);
   };
 
   // first unwind attempt
-  UnwindResult unwind = attempt_unwind();
+  UnwindOutcome unwind = attempt_unwind();
 
   bool should_retry = unwind.error_code == unwindstack::ERROR_INVALID_MAP ||
                       unwind.warnings & unwindstack::WARNING_DEX_PC_NOT_IN_MAP;
@@ -403,9 +446,9 @@ CompletedSample Unwinder::UnwindSample(const ParsedSample& sample,
     unwind = attempt_unwind();
   }
 
-  ret.build_ids.reserve(kernel_frames_size + unwind.frames.size());
-  ret.frames.reserve(kernel_frames_size + unwind.frames.size());
-  for (unwindstack::FrameData& frame : unwind.frames) {
+  ret.build_ids.reserve(kernel_frames_size + frames.size());
+  ret.frames.reserve(kernel_frames_size + frames.size());
+  for (unwindstack::FrameData& frame : frames) {
     ret.build_ids.emplace_back(unwind_state->GetBuildId(frame));
     ret.frames.emplace_back(std::move(frame));
   }
@@ -445,11 +488,13 @@ std::vector<unwindstack::FrameData> Unwinder::SymbolizeKernelCallchain(
     return ret;
   }
 
-  auto* kernel_map = kernel_symbolizer_.GetOrCreateKernelSymbolMap();
-  PERFETTO_DCHECK(kernel_map);
+  if (!kernel_symbol_map_)
+    kernel_symbol_map_ = kernel_symbolizer_->Acquire();
+  PERFETTO_DCHECK(kernel_symbol_map_);
   ret.reserve(sample.kernel_ips.size());
   for (size_t i = 1; i < sample.kernel_ips.size(); i++) {
-    std::string function_name = kernel_map->Lookup(sample.kernel_ips[i]);
+    std::string function_name =
+        kernel_symbol_map_->Lookup(sample.kernel_ips[i]);
 
     // Synthesise a partially-valid libunwindstack frame struct for the kernel
     // frame. We reuse the type for convenience. The kernel frames are marked by
@@ -462,6 +507,13 @@ std::vector<unwindstack::FrameData> Unwinder::SymbolizeKernelCallchain(
   return ret;
 }
 
+void Unwinder::ReleaseKernelSymbolMap() {
+  if (!kernel_symbol_map_)
+    return;
+  kernel_symbol_map_ = nullptr;
+  kernel_symbolizer_->Release();
+}
+
 void Unwinder::PostInitiateDataSourceStop(DataSourceInstanceID ds_id) {
   task_runner_->PostTask([this, ds_id] { InitiateDataSourceStop(ds_id); });
 }
@@ -500,7 +552,7 @@ void Unwinder::FinishDataSourceStop(DataSourceInstanceID ds_id) {
 
   // Clean up state if there are no more active sources.
   if (data_sources_.empty()) {
-    kernel_symbolizer_.Destroy();
+    ReleaseKernelSymbolMap();
     ResetAndEnableUnwindstackCache();
   }
 
@@ -524,7 +576,7 @@ void Unwinder::PurgeDataSource(DataSourceInstanceID ds_id) {
 
   // Clean up state if there are no more active sources.
   if (data_sources_.empty()) {
-    kernel_symbolizer_.Destroy();
+    ReleaseKernelSymbolMap();
     ResetAndEnableUnwindstackCache();
     // Also purge scudo on Android, which would normally be done by the service
     // thread in |FinishDataSourceStop|. This is important as most of the scudo
@@ -534,15 +586,19 @@ void Unwinder::PurgeDataSource(DataSourceInstanceID ds_id) {
 }
 
 void Unwinder::PostClearCachedStatePeriodic(DataSourceInstanceID ds_id,
-                                            uint32_t period_ms) {
+                                            uint32_t period_ms,
+                                            bool reset_unwindstack_cache) {
   task_runner_->PostDelayedTask(
-      [this, ds_id, period_ms] { ClearCachedStatePeriodic(ds_id, period_ms); },
+      [this, ds_id, period_ms, reset_unwindstack_cache] {
+        ClearCachedStatePeriodic(ds_id, period_ms, reset_unwindstack_cache);
+      },
       period_ms);
 }
 
 // See header for rationale.
 void Unwinder::ClearCachedStatePeriodic(DataSourceInstanceID ds_id,
-                                        uint32_t period_ms) {
+                                        uint32_t period_ms,
+                                        bool reset_unwindstack_cache) {
   auto it = data_sources_.find(ds_id);
   if (it == data_sources_.end())
     return;  // stop the periodic task
@@ -558,10 +614,13 @@ void Unwinder::ClearCachedStatePeriodic(DataSourceInstanceID ds_id,
     if (pid_and_process.second.status == ProcessState::Status::kFdsResolved)
       pid_and_process.second.unwind_state->fd_maps.Reset();
   }
-  ResetAndEnableUnwindstackCache();
-  base::MaybeReleaseAllocatorMemToOS();
+  if (reset_unwindstack_cache) {
+    ResetAndEnableUnwindstackCache();
+    base::MaybeReleaseAllocatorMemToOS();
+  }
 
-  PostClearCachedStatePeriodic(ds_id, period_ms);  // repost
+  PostClearCachedStatePeriodic(ds_id, period_ms,
+                               reset_unwindstack_cache);  // repost
 }
 
 void Unwinder::ResetAndEnableUnwindstackCache() {
@@ -569,11 +628,11 @@ void Unwinder::ResetAndEnableUnwindstackCache() {
   // Libunwindstack uses an unsynchronized variable for setting/checking whether
   // the cache is enabled. Therefore unwinding and cache toggling should stay on
   // the same thread, but we might be moving unwinding across threads if we're
-  // recreating |Unwinder| instances (during a reconnect to traced). Therefore,
-  // use our own static lock to synchronize the cache toggling.
+  // recreating |Unwinder| instances (during a reconnect to traced), or there
+  // might be other unwinders on other threads. Therefore, use our own static
+  // lock to synchronize the cache toggling with the unwinding.
   // TODO(rsavitski): consider fixing this in libunwindstack itself.
-  static std::mutex* lock = new std::mutex{};
-  std::lock_guard<std::mutex> guard{*lock};
+  std::unique_lock<std::shared_mutex> guard(UnwindstackCacheLock());
   unwindstack::Elf::SetCachingEnabled(false);  // free any existing state
   unwindstack::Elf::SetCachingEnabled(true);   // reallocate a fresh cache
 }
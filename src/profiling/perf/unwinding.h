@@ -20,6 +20,8 @@
 #include <stdint.h>
 #include <condition_variable>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <thread>
 
@@ -42,12 +44,39 @@ namespace profiling {
 
 constexpr static uint32_t kUnwindQueueCapacity = 1024;
 
+// Kernel symbol map shared by all the unwinders of the producer, so that
+// /proc/kallsyms is parsed (and kept in memory) once rather than once per
+// unwinder. The map is created when the first unwinder acquires it, and
+// destroyed when the last one releases it. Lookups don't mutate the map, so
+// the unwinders can use it concurrently.
+class SharedKernelSymbolizer {
+ public:
+  SharedKernelSymbolizer();
+  ~SharedKernelSymbolizer();
+
+  // Returns the symbol map, parsing kallsyms if needed. Every call must be
+  // balanced by a call to |Release|.
+  KernelSymbolMap* Acquire();
+  void Release();
+
+ private:
+  std::mutex mutex_;
+  uint32_t refcount_ = 0;
+  std::unique_ptr<LazyKernelSymbolizer> symbolizer_;
+  KernelSymbolMap* symbol_map_ = nullptr;
+};
+
 // Unwinds and symbolises callstacks. For userspace this uses the sampled stack
 // and register state (see |ParsedSample|). For kernelspace, the kernel itself
 // unwinds the stack (recording a list of instruction pointers), so only
 // symbolisation using /proc/kallsyms is necessary. Has a single unwinding ring
 // queue, shared across all data sources.
 //
+// The producer can run multiple unwinders, each on its own thread, and assigns
+// the sampled processes to them by pid. All the samples (and the unwinding
+// state) of a process are therefore handled by a single unwinder, while every
+// unwinder tracks all the data sources.
+//
 // Userspace samples cannot be unwound without having /proc/<pid>/{maps,mem}
 // file descriptors for that process. This lookup can be asynchronous (e.g. on
 // Android), so the unwinder might have to wait before it can process (or
@@ -87,7 +116,7 @@ class Unwinder {
     virtual ~Delegate();
   };
 
-  ~Unwinder() { PERFETTO_DCHECK_THREAD(thread_checker_); }
+  ~Unwinder();
 
   void PostStartDataSource(DataSourceInstanceID ds_id, bool kernel_frames);
   void PostAdoptProcDescriptors(DataSourceInstanceID ds_id,
@@ -100,8 +129,11 @@ class Unwinder {
   void PostInitiateDataSourceStop(DataSourceInstanceID ds_id);
   void PostPurgeDataSource(DataSourceInstanceID ds_id);
 
+  // Only one of the unwinders should pass |reset_unwindstack_cache|, as the
+  // libunwindstack cache is shared by all of them.
   void PostClearCachedStatePeriodic(DataSourceInstanceID ds_id,
-                                    uint32_t period_ms);
+                                    uint32_t period_ms,
+                                    bool reset_unwindstack_cache);
 
   UnwindQueue<UnwindEntry, kUnwindQueueCapacity>& unwind_queue() {
     return unwind_queue_;
@@ -159,7 +191,9 @@ class Unwinder {
   };
 
   // Must be instantiated via the |UnwinderHandle|.
-  Unwinder(Delegate* delegate, base::UnixTaskRunner* task_runner);
+  Unwinder(Delegate* delegate,
+           SharedKernelSymbolizer* kernel_symbolizer,
+           base::UnixTaskRunner* task_runner);
 
   // Marks the data source as valid and active at the unwinding stage.
   // Initializes kernel address symbolization if needed.
@@ -190,6 +224,9 @@ class Unwinder {
   std::vector<unwindstack::FrameData> SymbolizeKernelCallchain(
       const ParsedSample& sample);
 
+  // Drops this unwinder's reference to the shared kernel symbol map, if any.
+  void ReleaseKernelSymbolMap();
+
   // Marks the data source as shutting down at the unwinding stage. It is known
   // that no new samples for this source will be pushed into the queue, but we
   // need to delay the unwinder state teardown until all previously-enqueued
@@ -209,9 +246,10 @@ class Unwinder {
                                                    std::memory_order_relaxed);
   }
 
-  // Clears the parsed maps for all previously-sampled processes, and resets the
-  // libunwindstack cache. This has the effect of deallocating the cached Elf
-  // objects within libunwindstack, which take up non-trivial amounts of memory.
+  // Clears the parsed maps for all previously-sampled processes, and
+  // optionally resets the libunwindstack cache. This has the effect of
+  // deallocating the cached Elf objects within libunwindstack, which take up
+  // non-trivial amounts of memory.
   //
   // There are two reasons for having this operation:
   // * over a longer trace, it's desireable to drop heavy state for processes
@@ -230,14 +268,18 @@ class Unwinder {
   // Elf objects alive through shared_ptrs.
   //
   // Note that this operation is heavy in terms of cpu%, and should therefore
-  // be called only for profiling configs that require it.
+  // be called only for profiling configs that require it. The cache is global,
+  // so with multiple unwinders only one of them resets it (and returns the
+  // freed memory to the OS), while all of them clear their parsed maps.
   //
   // TODO(rsavitski): dropping the full parsed maps is somewhat excessive, could
   // instead clear just the |MapInfo.elf| shared_ptr, but that's considered too
   // brittle as it's an implementation detail of libunwindstack.
   // TODO(rsavitski): improve libunwindstack cache's architecture (it is still
   // worth having at the moment to speed up unwinds across map reparses).
-  void ClearCachedStatePeriodic(DataSourceInstanceID ds_id, uint32_t period_ms);
+  void ClearCachedStatePeriodic(DataSourceInstanceID ds_id,
+                                uint32_t period_ms,
+                                bool reset_unwindstack_cache);
 
   void ResetAndEnableUnwindstackCache();
 
@@ -246,7 +288,9 @@ class Unwinder {
   UnwindQueue<UnwindEntry, kUnwindQueueCapacity> unwind_queue_;
   QueueFootprintTracker footprint_tracker_;
   std::map<DataSourceInstanceID, DataSourceState> data_sources_;
-  LazyKernelSymbolizer kernel_symbolizer_;
+  SharedKernelSymbolizer* const kernel_symbolizer_;
+  // Non-null while this unwinder holds a reference to the shared map.
+  KernelSymbolMap* kernel_symbol_map_ = nullptr;
 
   PERFETTO_THREAD_CHECKER(thread_checker_)
 };
@@ -257,7 +301,9 @@ class Unwinder {
 // owned state, and consolidate.
 class UnwinderHandle {
  public:
-  explicit UnwinderHandle(Unwinder::Delegate* delegate) {
+  // |kernel_symbolizer| must outlive the handle.
+  UnwinderHandle(Unwinder::Delegate* delegate,
+                 SharedKernelSymbolizer* kernel_symbolizer) {
     std::mutex init_lock;
     std::condition_variable init_cv;
 
@@ -275,7 +321,7 @@ class UnwinderHandle {
         };
 
     thread_ = std::thread(&UnwinderHandle::RunTaskThread, this,
-                          std::move(initializer), delegate);
+                          std::move(initializer), delegate, kernel_symbolizer);
 
     std::unique_lock<std::mutex> lock(init_lock);
     init_cv.wait(lock, [this] { return !!task_runner_ && !!unwinder_; });
@@ -293,13 +339,15 @@ class UnwinderHandle {
   }
 
   Unwinder* operator->() { return unwinder_; }
+  Unwinder* get() { return unwinder_; }
 
  private:
   void RunTaskThread(
       std::function<void(base::UnixTaskRunner*, Unwinder*)> initializer,
-      Unwinder::Delegate* delegate) {
+      Unwinder::Delegate* delegate,
+      SharedKernelSymbolizer* kernel_symbolizer) {
     base::UnixTaskRunner task_runner;
-    Unwinder unwinder(delegate, &task_runner);
+    Unwinder unwinder(delegate, kernel_symbolizer, &task_runner);
     task_runner.PostTask(
         std::bind(std::move(initializer), &task_runner, &unwinder));
     task_runner.Run();
@@ -230,6 +230,58 @@ void TypedProtoDecoderBase::ParseAllFields() {
   read_ptr_ = res.next;
 }
 
+void TypedProtoDecoderBase::ParseAllFieldsIntoSlots(
+    const uint16_t* field_slots,
+    uint32_t max_field_id,
+    bool has_nonpacked_repeated_fields) {
+  // The on-stack storage always has room for all the slots, so the expansion
+  // can only happen for the repeated fields storage.
+  PERFETTO_DCHECK(num_fields_ <= capacity_);
+  size_ = num_fields_;
+
+  const uint8_t* cur = begin_;
+  ParseFieldResult res;
+  for (;;) {
+    res = ParseOneField(cur, end_);
+    PERFETTO_DCHECK(res.parse_res != ParseFieldResult::kOk || res.next != cur);
+    cur = res.next;
+    if (PERFETTO_UNLIKELY(res.parse_res == ParseFieldResult::kSkip))
+      continue;
+    if (PERFETTO_UNLIKELY(res.parse_res == ParseFieldResult::kAbort))
+      break;
+
+    PERFETTO_DCHECK(res.parse_res == ParseFieldResult::kOk);
+    PERFETTO_DCHECK(res.field.valid());
+    auto field_id = res.field.id();
+    if (PERFETTO_UNLIKELY(field_id > max_field_id))
+      continue;
+    uint32_t slot = field_slots[field_id];
+    if (PERFETTO_UNLIKELY(slot == 0))
+      continue;  // The id is not known by the .proto.
+
+    PERFETTO_DCHECK(slot < num_fields_);
+    Field* fld = &fields_[slot];
+    // The slot is overwritten the first time we see the field, when the slot
+    // holds another field of the same oneof and, if the message has no
+    // repeated fields, when a field is seen twice (the last value wins).
+    if (PERFETTO_LIKELY(!has_nonpacked_repeated_fields ||
+                        fld->id() != field_id)) {
+      *fld = std::move(res.field);
+      continue;
+    }
+
+    // Repeated field case. See the comment in ParseAllFields().
+    if (PERFETTO_UNLIKELY(size_ >= capacity_)) {
+      ExpandHeapStorage();
+      fld = &fields_[slot];
+    }
+    PERFETTO_DCHECK(size_ < capacity_);
+    fields_[size_++] = *fld;
+    *fld = std::move(res.field);
+  }
+  read_ptr_ = res.next;
+}
+
 void TypedProtoDecoderBase::ExpandHeapStorage() {
   // When we expand the heap we must ensure that we have at very last capacity
   // to deal with all known fields plus at least one repeated field. We go +2048
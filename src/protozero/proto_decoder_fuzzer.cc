@@ -23,6 +23,9 @@
 namespace protozero {
 namespace {
 
+// Fields 1 and 3 in the same oneof, 2 repeated.
+constexpr uint16_t kFieldSlots[] = {0, 1, 2, 1};
+
 int FuzzProtoDecoder(const uint8_t* data, size_t size) {
   volatile uint64_t value = 0;
   ProtoDecoder dec(data, size);
@@ -31,6 +34,10 @@ int FuzzProtoDecoder(const uint8_t* data, size_t size) {
   }
   TypedProtoDecoder<1, 0> typed_decoder_1(data, size);
   TypedProtoDecoder<999, 0> typed_decoder_2(data, size);
+  SpecializedProtoDecoder<3, true> specialized_decoder(kFieldSlots, 3, data,
+                                                       size);
+  for (auto it = specialized_decoder.GetRepeated<uint64_t>(2); it; ++it)
+    value += *it;
   return 0;
 }
 
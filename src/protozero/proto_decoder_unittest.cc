@@ -624,5 +624,143 @@ TEST(ProtoDecoderTest, PacketRepeatedWireTypeMismatch) {
   EXPECT_FALSE(it);
 }
 
+// The decoder generated by the pbzero plugin for:
+// message M {
+//   optional int32 f1 = 1;
+//   repeated int32 f3 = 3;
+//   oneof o {
+//     int32 f5 = 5;
+//     string f7 = 7;
+//   }
+// }
+class SpecializedTestDecoder
+    : public SpecializedProtoDecoder</*NUM_FIELD_SLOTS=*/4,
+                                     /*HAS_NONPACKED_REPEATED_FIELDS=*/true> {
+ public:
+  static constexpr uint32_t kMaxFieldId = 7;
+  static constexpr uint16_t kFieldSlots[] = {0, 1, 0, 2, 0, 3, 0, 3};
+  SpecializedTestDecoder(const uint8_t* data, size_t len)
+      : SpecializedProtoDecoder(kFieldSlots, kMaxFieldId, data, len) {}
+};
+
+// As above, without the repeated field.
+class SpecializedTestDecoderNoRepeated
+    : public SpecializedProtoDecoder</*NUM_FIELD_SLOTS=*/3,
+                                     /*HAS_NONPACKED_REPEATED_FIELDS=*/false> {
+ public:
+  static constexpr uint32_t kMaxFieldId = 7;
+  static constexpr uint16_t kFieldSlots[] = {0, 1, 0, 0, 0, 2, 0, 2};
+  SpecializedTestDecoderNoRepeated(const uint8_t* data, size_t len)
+      : SpecializedProtoDecoder(kFieldSlots, kMaxFieldId, data, len) {}
+};
+
+TEST(ProtoDecoderTest, SpecializedDecoder) {
+  HeapBuffered<Message> message;
+  message->AppendVarInt(1, 10);
+  message->AppendVarInt(2, 20);  // Unknown.
+  message->AppendVarInt(3, 30);
+  message->AppendVarInt(5, 50);
+  message->AppendVarInt(3, 31);
+  message->AppendVarInt(100, 1000);  // Unknown, > kMaxFieldId.
+  message->AppendVarInt(3, 32);
+  auto data = message.SerializeAsArray();
+
+  SpecializedTestDecoder decoder(data.data(), data.size());
+  EXPECT_EQ(decoder.at<1>().as_int32(), 10);
+  EXPECT_EQ(decoder.Get(1).as_int32(), 10);
+  EXPECT_FALSE(decoder.at<2>().valid());
+  EXPECT_FALSE(decoder.Get(2).valid());
+  EXPECT_FALSE(decoder.Get(100).valid());
+  EXPECT_EQ(decoder.at<5>().as_int32(), 50);
+  EXPECT_EQ((decoder.at<5, 3>().as_int32()), 50);
+  EXPECT_FALSE(decoder.at<7>().valid());
+  EXPECT_FALSE((decoder.at<7, 3>().valid()));
+  EXPECT_FALSE(decoder.Get(7).valid());
+
+  // Get() returns the last value of a repeated field, the iteration follows
+  // the original order.
+  EXPECT_EQ(decoder.Get(3).as_int32(), 32);
+  auto it = decoder.GetRepeated<int32_t>(3);
+  EXPECT_EQ(*it++, 30);
+  EXPECT_EQ(*it++, 31);
+  EXPECT_EQ(*it++, 32);
+  EXPECT_FALSE(it);
+
+  EXPECT_EQ(*decoder.GetRepeated<int32_t>(1), 10);
+  EXPECT_FALSE(decoder.GetRepeated<int32_t>(2));
+  EXPECT_FALSE(decoder.GetRepeated<int32_t>(7));
+  EXPECT_EQ(decoder.bytes_left(), 0u);
+}
+
+TEST(ProtoDecoderTest, SpecializedDecoderOneof) {
+  HeapBuffered<Message> message;
+  message->AppendVarInt(5, 50);
+  message->AppendString(7, "foo");
+  auto data = message.SerializeAsArray();
+
+  // The last field of the oneof wins, and doesn't end up in the repeated
+  // fields storage.
+  SpecializedTestDecoder decoder(data.data(), data.size());
+  EXPECT_FALSE(decoder.at<5>().valid());
+  EXPECT_FALSE((decoder.at<5, 3>().valid()));
+  EXPECT_FALSE(decoder.GetRepeated<int32_t>(5));
+  EXPECT_EQ(decoder.at<7>().as_std_string(), "foo");
+  EXPECT_EQ((decoder.at<7, 3>().as_std_string()), "foo");
+  EXPECT_EQ(decoder.Get(7).as_std_string(), "foo");
+  EXPECT_FALSE(decoder.at<1>().valid());
+}
+
+TEST(ProtoDecoderTest, SpecializedDecoderNoRepeatedFields) {
+  HeapBuffered<Message> message;
+  message->AppendVarInt(1, 10);
+  message->AppendVarInt(1, 11);
+  message->AppendVarInt(3, 30);  // Unknown.
+  message->AppendVarInt(5, 50);
+  auto data = message.SerializeAsArray();
+
+  SpecializedTestDecoderNoRepeated decoder(data.data(), data.size());
+  EXPECT_EQ(decoder.at<1>().as_int32(), 11);
+  EXPECT_FALSE(decoder.Get(3).valid());
+  EXPECT_EQ(decoder.at<5>().as_int32(), 50);
+}
+
+TEST(ProtoDecoderTest, SpecializedDecoderManyRepeatedFields) {
+  HeapBuffered<Message> message;
+  message->AppendVarInt(1, 1);
+  for (int i = 0; i < 1000; i++)
+    message->AppendVarInt(3, i);
+  message->AppendVarInt(5, 5);
+  auto data = message.SerializeAsArray();
+
+  // Exceeds the on-stack capacity and falls back on the heap.
+  SpecializedTestDecoder decoder(data.data(), data.size());
+  int expected = 0;
+  for (auto it = decoder.GetRepeated<int32_t>(3); it; ++it)
+    EXPECT_EQ(*it, expected++);
+  EXPECT_EQ(expected, 1000);
+
+  // Moving the decoder keeps the heap storage.
+  SpecializedTestDecoder moved(std::move(decoder));
+  EXPECT_EQ(moved.at<1>().as_int32(), 1);
+  EXPECT_EQ(moved.at<3>().as_int32(), 999);
+  EXPECT_EQ(moved.at<5>().as_int32(), 5);
+}
+
+TEST(ProtoDecoderTest, SpecializedDecoderMoveOnStack) {
+  HeapBuffered<Message> message;
+  message->AppendVarInt(1, 10);
+  message->AppendVarInt(3, 30);
+  message->AppendVarInt(3, 31);
+  auto data = message.SerializeAsArray();
+
+  SpecializedTestDecoder decoder(data.data(), data.size());
+  SpecializedTestDecoder moved(std::move(decoder));
+  EXPECT_EQ(moved.at<1>().as_int32(), 10);
+  auto it = moved.GetRepeated<int32_t>(3);
+  EXPECT_EQ(*it++, 30);
+  EXPECT_EQ(*it++, 31);
+  EXPECT_FALSE(it);
+}
+
 }  // namespace
 }  // namespace protozero
@@ -577,7 +577,7 @@ void CppObjGenerator::GenClassDecl(const Descriptor* msg, Printer* p) const {
   p->Print("bool ParseFromArray(const void*, size_t) override;\n");
   p->Print("std::string SerializeAsString() const override;\n");
   p->Print("std::vector<uint8_t> SerializeAsArray() const override;\n");
-  p->Print("void Serialize(::protozero::Message*) const;\n");
+  p->Print("void Serialize(::protozero::Message*) const override;\n");
 
   // Generate accessors.
   for (int i = 0; i < msg->field_count(); i++) {
@@ -21,6 +21,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <google/protobuf/compiler/code_generator.h>
 #include <google/protobuf/compiler/plugin.h>
@@ -39,6 +40,7 @@ using google::protobuf::EnumDescriptor;
 using google::protobuf::EnumValueDescriptor;
 using google::protobuf::FieldDescriptor;
 using google::protobuf::FileDescriptor;
+using google::protobuf::OneofDescriptor;
 using google::protobuf::compiler::GeneratorContext;
 using google::protobuf::io::Printer;
 using google::protobuf::io::ZeroCopyOutputStream;
@@ -110,6 +112,8 @@ class GeneratorJob {
       wrapper_namespace_ = value;
     } else if (name == "sdk") {
       sdk_mode_ = (value == "true" || value == "1");
+    } else if (name == "specialized_decoders") {
+      specialized_decoders_ = (value == "true" || value == "1");
     } else {
       Abort(std::string() + "Unknown plugin option '" + name + "'.");
     }
@@ -693,6 +697,33 @@ case $full_class$::$value_name$:
     }
   }
 
+  // Assigns a slot of SpecializedProtoDecoder to each field id up to
+  // |max_field_id|. Slot 0 is reserved for unknown ids and all the fields of a
+  // oneof share the same slot. Returns the number of slots, including slot 0.
+  uint32_t ComputeFieldSlots(const Descriptor* message,
+                             int max_field_id,
+                             std::vector<uint32_t>* slots) {
+    slots->assign(static_cast<size_t>(max_field_id) + 1, 0);
+    std::map<const OneofDescriptor*, uint32_t> oneof_slots;
+    uint32_t num_slots = 1;
+    for (int i = 0; i < message->field_count(); ++i) {
+      const FieldDescriptor* field = message->field(i);
+      if (field->number() > max_field_id)
+        continue;
+      uint32_t slot;
+      const OneofDescriptor* oneof = field->containing_oneof();
+      if (oneof && oneof_slots.count(oneof)) {
+        slot = oneof_slots[oneof];
+      } else {
+        slot = num_slots++;
+        if (oneof)
+          oneof_slots[oneof] = slot;
+      }
+      (*slots)[static_cast<size_t>(field->number())] = slot;
+    }
+    return num_slots;
+  }
+
   void GenerateDecoder(const Descriptor* message) {
     int max_field_id = 0;
     bool has_nonpacked_repeated_fields = false;
@@ -706,27 +737,53 @@ case $full_class$::$value_name$:
     }
 
     std::string class_name = GetCppClassName(message) + "_Decoder";
-    stub_h_->Print(
-        "class $name$ : public "
-        "::protozero::TypedProtoDecoder</*MAX_FIELD_ID=*/$max$, "
-        "/*HAS_NONPACKED_REPEATED_FIELDS=*/$rep$> {\n",
-        "name", class_name, "max", std::to_string(max_field_id), "rep",
-        has_nonpacked_repeated_fields ? "true" : "false");
+    std::string base_class;
+    std::string base_args;
+    std::vector<uint32_t> slots;
+    if (specialized_decoders_) {
+      uint32_t num_slots = ComputeFieldSlots(message, max_field_id, &slots);
+      base_class = "SpecializedProtoDecoder";
+      base_args = "kFieldSlots, kMaxFieldId, ";
+      stub_h_->Print(
+          "class $name$ : public "
+          "::protozero::SpecializedProtoDecoder</*NUM_FIELD_SLOTS=*/$num$, "
+          "/*HAS_NONPACKED_REPEATED_FIELDS=*/$rep$> {\n",
+          "name", class_name, "num", std::to_string(num_slots), "rep",
+          has_nonpacked_repeated_fields ? "true" : "false");
+    } else {
+      base_class = "TypedProtoDecoder";
+      stub_h_->Print(
+          "class $name$ : public "
+          "::protozero::TypedProtoDecoder</*MAX_FIELD_ID=*/$max$, "
+          "/*HAS_NONPACKED_REPEATED_FIELDS=*/$rep$> {\n",
+          "name", class_name, "max", std::to_string(max_field_id), "rep",
+          has_nonpacked_repeated_fields ? "true" : "false");
+    }
     stub_h_->Print(" public:\n");
     stub_h_->Indent();
+    if (specialized_decoders_) {
+      stub_h_->Print("static constexpr uint32_t kMaxFieldId = $max$;\n", "max",
+                     std::to_string(max_field_id));
+      stub_h_->Print("static constexpr uint16_t kFieldSlots[] = {");
+      for (size_t i = 0; i < slots.size(); ++i) {
+        stub_h_->Print(i % 16 == 0 ? "\n  " : " ");
+        stub_h_->Print("$slot$,", "slot", std::to_string(slots[i]));
+      }
+      stub_h_->Print("\n};\n");
+    }
     stub_h_->Print(
         "$name$(const uint8_t* data, size_t len) "
-        ": TypedProtoDecoder(data, len) {}\n",
-        "name", class_name);
+        ": $base$($args$data, len) {}\n",
+        "name", class_name, "base", base_class, "args", base_args);
     stub_h_->Print(
         "explicit $name$(const std::string& raw) : "
-        "TypedProtoDecoder(reinterpret_cast<const uint8_t*>(raw.data()), "
+        "$base$($args$reinterpret_cast<const uint8_t*>(raw.data()), "
         "raw.size()) {}\n",
-        "name", class_name);
+        "name", class_name, "base", base_class, "args", base_args);
     stub_h_->Print(
         "explicit $name$(const ::protozero::ConstBytes& raw) : "
-        "TypedProtoDecoder(raw.data, raw.size) {}\n",
-        "name", class_name);
+        "$base$($args$raw.data, raw.size) {}\n",
+        "name", class_name, "base", base_class, "args", base_args);
 
     for (int i = 0; i < message->field_count(); ++i) {
       const FieldDescriptor* field = message->field(i);
@@ -795,9 +852,16 @@ case $full_class$::$value_name$:
           continue;
       }
 
-      stub_h_->Print("bool has_$name$() const { return at<$id$>().valid(); }\n",
-                     "name", field->lowercase_name(), "id",
-                     std::to_string(field->number()));
+      // The slot of the field is known here, so the specialized decoders don't
+      // need to look it up in kFieldSlots.
+      const size_t field_id = static_cast<size_t>(field->number());
+      std::string at = "at<" + std::to_string(field_id);
+      if (specialized_decoders_)
+        at += ", " + std::to_string(slots[field_id]);
+      at += ">()";
+
+      stub_h_->Print("bool has_$name$() const { return $at$.valid(); }\n",
+                     "name", field->lowercase_name(), "at", at);
 
       if (field->is_packed()) {
         const char* protozero_wire_type =
@@ -818,9 +882,8 @@ case $full_class$::$value_name$:
             std::to_string(field->number()));
       } else {
         stub_h_->Print(
-            "$cpp_type$ $name$() const { return at<$id$>().$getter$(); }\n",
-            "name", field->lowercase_name(), "id",
-            std::to_string(field->number()), "cpp_type", cpp_type, "getter",
+            "$cpp_type$ $name$() const { return $at$.$getter$(); }\n", "name",
+            field->lowercase_name(), "at", at, "cpp_type", cpp_type, "getter",
             getter);
       }
     }
@@ -1024,6 +1087,10 @@ static constexpr $field_metadata_type$ $field_metadata_var${};
   // Generate headers that can be used with the Perfetto SDK.
   bool sdk_mode_ = false;
 
+  // Generate decoders based on SpecializedProtoDecoder rather than
+  // TypedProtoDecoder. See proto_decoder.h.
+  bool specialized_decoders_ = true;
+
   // The custom *Comp comparators are to ensure determinism of the generator.
   std::set<const FileDescriptor*, FileDescriptorComp> public_imports_;
   std::set<const FileDescriptor*, FileDescriptorComp> private_imports_;
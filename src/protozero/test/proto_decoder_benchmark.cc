@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/protozero/proto_decoder.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "protos/perfetto/trace/ftrace/power.pbzero.h"
+#include "protos/perfetto/trace/ftrace/sched.pbzero.h"
+
+namespace {
+
+using perfetto::protos::pbzero::CpuFrequencyFtraceEvent;
+using perfetto::protos::pbzero::FtraceEvent;
+using perfetto::protos::pbzero::FtraceEventBundle;
+using perfetto::protos::pbzero::SchedSwitchFtraceEvent;
+using perfetto::protos::pbzero::SchedWakingFtraceEvent;
+
+// The decoders that the pbzero plugin generated before SpecializedProtoDecoder:
+// one slot per field id, up to the highest one.
+using TypedBundleDecoder =
+    protozero::TypedProtoDecoder<FtraceEventBundle::Decoder::kMaxFieldId,
+                                 /*HAS_NONPACKED_REPEATED_FIELDS=*/true>;
+using TypedEventDecoder =
+    protozero::TypedProtoDecoder<FtraceEvent::Decoder::kMaxFieldId, false>;
+using TypedSchedSwitchDecoder =
+    protozero::TypedProtoDecoder<SchedSwitchFtraceEvent::Decoder::kMaxFieldId,
+                                 false>;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(16);
+  } else {
+    b->RangeMultiplier(4)->Range(16, 4096);
+  }
+}
+
+// Writes a bundle of |num_events| events, with a mix of event types similar to
+// a trace recorded with the sched and power categories.
+std::vector<uint8_t> WriteBundle(size_t num_events) {
+  protozero::HeapBuffered<FtraceEventBundle> bundle;
+  bundle->set_cpu(1);
+  uint64_t ts = 1000000;
+  for (size_t i = 0; i < num_events; i++) {
+    FtraceEvent* event = bundle->add_event();
+    event->set_timestamp(ts);
+    event->set_pid(static_cast<uint32_t>(100 + i % 7));
+    ts += 1000 + i % 13;
+    switch (i % 4) {
+      case 0:
+      case 1: {
+        auto* sched_switch = event->set_sched_switch();
+        sched_switch->set_prev_comm("surfaceflinger");
+        sched_switch->set_prev_pid(static_cast<int32_t>(100 + i % 7));
+        sched_switch->set_prev_prio(120);
+        sched_switch->set_prev_state(1);
+        sched_switch->set_next_comm("RenderThread");
+        sched_switch->set_next_pid(static_cast<int32_t>(200 + i % 5));
+        sched_switch->set_next_prio(110);
+        break;
+      }
+      case 2: {
+        auto* sched_waking = event->set_sched_waking();
+        sched_waking->set_comm("RenderThread");
+        sched_waking->set_pid(static_cast<int32_t>(200 + i % 5));
+        sched_waking->set_prio(110);
+        sched_waking->set_success(1);
+        sched_waking->set_target_cpu(2);
+        break;
+      }
+      case 3: {
+        auto* cpu_frequency = event->set_cpu_frequency();
+        cpu_frequency->set_state(static_cast<uint32_t>(300000 + i));
+        cpu_frequency->set_cpu_id(1);
+        break;
+      }
+    }
+  }
+  return bundle.SerializeAsArray();
+}
+
+}  // namespace
+
+// Decodes the bundles with the generated decoders, which are based on
+// SpecializedProtoDecoder.
+static void BM_ProtoDecoder_FtraceBundle_Specialized(benchmark::State& state) {
+  const size_t num_events = static_cast<size_t>(state.range(0));
+  std::vector<uint8_t> buf = WriteBundle(num_events);
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    FtraceEventBundle::Decoder bundle(buf.data(), buf.size());
+    sum += bundle.cpu();
+    for (auto it = bundle.event(); it; ++it) {
+      FtraceEvent::Decoder event(*it);
+      sum += event.timestamp() + event.pid();
+      if (event.has_sched_switch()) {
+        SchedSwitchFtraceEvent::Decoder sched_switch(event.sched_switch());
+        sum += static_cast<uint64_t>(sched_switch.prev_pid() +
+                                     sched_switch.next_pid());
+        sum += sched_switch.prev_comm().size + sched_switch.next_comm().size;
+      } else if (event.has_sched_waking()) {
+        SchedWakingFtraceEvent::Decoder sched_waking(event.sched_waking());
+        sum += static_cast<uint64_t>(sched_waking.pid());
+      } else if (event.has_cpu_frequency()) {
+        CpuFrequencyFtraceEvent::Decoder cpu_frequency(event.cpu_frequency());
+        sum += cpu_frequency.state();
+      }
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * num_events));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * buf.size()));
+}
+BENCHMARK(BM_ProtoDecoder_FtraceBundle_Specialized)->Apply(BenchmarkArgs);
+
+// As above, but decodes the messages with TypedProtoDecoder. The smaller
+// messages (SchedWaking, CpuFrequency) are decoded with the generated decoders
+// as their cost is similar with both.
+static void BM_ProtoDecoder_FtraceBundle_Typed(benchmark::State& state) {
+  const size_t num_events = static_cast<size_t>(state.range(0));
+  std::vector<uint8_t> buf = WriteBundle(num_events);
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    TypedBundleDecoder bundle(buf.data(), buf.size());
+    sum += bundle.at<FtraceEventBundle::kCpuFieldNumber>().as_uint32();
+    for (auto it = bundle.GetRepeated<protozero::ConstBytes>(
+             FtraceEventBundle::kEventFieldNumber);
+         it; ++it) {
+      protozero::ConstBytes event_bytes = *it;
+      TypedEventDecoder event(event_bytes.data, event_bytes.size);
+      sum += event.at<FtraceEvent::kTimestampFieldNumber>().as_uint64() +
+             event.at<FtraceEvent::kPidFieldNumber>().as_uint32();
+      if (auto f = event.at<FtraceEvent::kSchedSwitchFieldNumber>()) {
+        TypedSchedSwitchDecoder sched_switch(f.data(), f.size());
+        sum += static_cast<uint64_t>(
+            sched_switch.at<SchedSwitchFtraceEvent::kPrevPidFieldNumber>()
+                .as_int32() +
+            sched_switch.at<SchedSwitchFtraceEvent::kNextPidFieldNumber>()
+                .as_int32());
+        sum += sched_switch.at<SchedSwitchFtraceEvent::kPrevCommFieldNumber>()
+                   .size() +
+               sched_switch.at<SchedSwitchFtraceEvent::kNextCommFieldNumber>()
+                   .size();
+      } else if (auto g = event.Get(FtraceEvent::kSchedWakingFieldNumber)) {
+        SchedWakingFtraceEvent::Decoder sched_waking(g.as_bytes());
+        sum += static_cast<uint64_t>(sched_waking.pid());
+      } else if (auto h = event.Get(FtraceEvent::kCpuFrequencyFieldNumber)) {
+        CpuFrequencyFtraceEvent::Decoder cpu_frequency(h.as_bytes());
+        sum += cpu_frequency.state();
+      }
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * num_events));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * buf.size()));
+}
+BENCHMARK(BM_ProtoDecoder_FtraceBundle_Typed)->Apply(BenchmarkArgs);
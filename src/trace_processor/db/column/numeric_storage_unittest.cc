@@ -309,6 +309,48 @@ TEST(NumericStorage, SearchFast) {
   ASSERT_EQ(bv.IndexOfNthSet(0), 100u);
 }
 
+// Checks the word-at-a-time search against a scalar computation for every
+// FilterOp on ranges which do not start or end on a word boundary.
+template <typename T>
+void CheckSearchAllOps(ColumnType type,
+                       const std::vector<T>& data_vec,
+                       SqlValue val) {
+  NumericStorage<T> storage(&data_vec, type, false);
+  auto chain = storage.MakeChain();
+  Range range(3, static_cast<uint32_t>(data_vec.size()) - 5);
+  T typed_val = type == ColumnType::kDouble ? static_cast<T>(val.AsDouble())
+                                            : static_cast<T>(val.AsLong());
+  for (FilterOp op : {FilterOp::kEq, FilterOp::kNe, FilterOp::kGt,
+                      FilterOp::kLt, FilterOp::kGe, FilterOp::kLe}) {
+    std::vector<uint32_t> expected;
+    for (uint32_t i = range.start; i < range.end; ++i) {
+      if (utils::SingleSearchNumeric(op, data_vec[i], typed_val) ==
+          SingleSearchResult::kMatch) {
+        expected.push_back(i);
+      }
+    }
+    auto res = chain->Search(op, val, range);
+    ASSERT_EQ(utils::ToIndexVectorForTests(res), expected)
+        << static_cast<int>(op);
+  }
+}
+
+TEST(NumericStorage, SearchFastAllOps) {
+  std::vector<int64_t> i64(300);
+  std::vector<uint32_t> u32(300);
+  std::vector<double> dbl(300);
+  for (uint32_t i = 0; i < 300; ++i) {
+    i64[i] = static_cast<int64_t>(i % 7) - 3;
+    // Half of the values are above INT32_MAX to check the unsigned ordering.
+    u32[i] = (i % 7) + (i % 2 ? 0x80000000u : 0u);
+    dbl[i] = static_cast<double>(i % 7) - 3.5;
+  }
+  CheckSearchAllOps(ColumnType::kInt64, i64, SqlValue::Long(1));
+  CheckSearchAllOps(ColumnType::kUint32, u32,
+                    SqlValue::Long(static_cast<int64_t>(0x80000002u)));
+  CheckSearchAllOps(ColumnType::kDouble, dbl, SqlValue::Double(0.5));
+}
+
 TEST(NumericStorage, SearchSorted) {
   std::vector<uint32_t> data_vec(128);
   std::iota(data_vec.begin(), data_vec.end(), 0);
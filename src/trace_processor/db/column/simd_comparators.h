@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DB_COLUMN_SIMD_COMPARATORS_H_
+#define SRC_TRACE_PROCESSOR_DB_COLUMN_SIMD_COMPARATORS_H_
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <type_traits>
+
+#include "perfetto/base/build_config.h"
+#include "src/trace_processor/containers/bit_vector.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+#include <immintrin.h>
+#endif
+
+namespace perfetto::trace_processor::column::simd {
+
+// Helpers to compare a whole BitVector word worth of contiguous values
+// against a constant using AVX2.
+//
+// As with the rest of the codebase, the availability of AVX2 is decided at
+// compile time by PERFETTO_X64_CPU_OPT: binaries built with it verify at
+// startup that the CPU supports it (see CheckCpuOptimizations() in
+// base/utils.cc). Without it, |kHasWordComparator| is false for all types and
+// callers should fall back to a scalar loop.
+
+enum class CompareOp { kEq, kNe, kLt, kLe, kGt, kGe };
+
+// Maps the std comparator classes used by the column code to CompareOp.
+template <typename Comparator>
+struct CompareOpFor;
+template <typename T>
+struct CompareOpFor<std::equal_to<T>> {
+  static constexpr CompareOp kOp = CompareOp::kEq;
+};
+template <typename T>
+struct CompareOpFor<std::not_equal_to<T>> {
+  static constexpr CompareOp kOp = CompareOp::kNe;
+};
+template <typename T>
+struct CompareOpFor<std::less<T>> {
+  static constexpr CompareOp kOp = CompareOp::kLt;
+};
+template <typename T>
+struct CompareOpFor<std::less_equal<T>> {
+  static constexpr CompareOp kOp = CompareOp::kLe;
+};
+template <typename T>
+struct CompareOpFor<std::greater<T>> {
+  static constexpr CompareOp kOp = CompareOp::kGt;
+};
+template <typename T>
+struct CompareOpFor<std::greater_equal<T>> {
+  static constexpr CompareOp kOp = CompareOp::kGe;
+};
+
+template <typename Comparator, typename = void>
+struct IsStdComparator : std::false_type {};
+template <typename Comparator>
+struct IsStdComparator<Comparator,
+                       std::void_t<decltype(CompareOpFor<Comparator>::kOp)>>
+    : std::true_type {};
+
+#if PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+
+template <typename T>
+constexpr bool kHasWordComparator =
+    std::is_same_v<T, int64_t> || std::is_same_v<T, int32_t> ||
+    std::is_same_v<T, uint32_t> || std::is_same_v<T, double>;
+
+// Compares 4 (int64) or 8 (int32/uint32) values. |v| is |val| broadcast to all
+// lanes. Returns one bit per value in the low bits of the result.
+template <CompareOp op, typename T>
+inline uint32_t CompareIntLanes(__m256i x, __m256i v) {
+  if constexpr (std::is_same_v<T, uint32_t>) {
+    // AVX2 has no unsigned comparisons: flip the sign bit of both sides to
+    // map the unsigned order onto the signed one.
+    if constexpr (op != CompareOp::kEq && op != CompareOp::kNe) {
+      const __m256i bias = _mm256_set1_epi32(std::numeric_limits<int>::min());
+      x = _mm256_xor_si256(x, bias);
+      v = _mm256_xor_si256(v, bias);
+    }
+  }
+  __m256i mask;
+  if constexpr (op == CompareOp::kEq || op == CompareOp::kNe) {
+    mask = std::is_same_v<T, int64_t> ? _mm256_cmpeq_epi64(x, v)
+                                      : _mm256_cmpeq_epi32(x, v);
+  } else if constexpr (op == CompareOp::kGt || op == CompareOp::kLe) {
+    mask = std::is_same_v<T, int64_t> ? _mm256_cmpgt_epi64(x, v)
+                                      : _mm256_cmpgt_epi32(x, v);
+  } else {
+    mask = std::is_same_v<T, int64_t> ? _mm256_cmpgt_epi64(v, x)
+                                      : _mm256_cmpgt_epi32(v, x);
+  }
+  uint32_t bits =
+      std::is_same_v<T, int64_t>
+          ? static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(mask)))
+          : static_cast<uint32_t>(
+                _mm256_movemask_ps(_mm256_castsi256_ps(mask)));
+
+  // kNe, kLe and kGe are the negation of kEq, kGt and kLt respectively.
+  if constexpr (op == CompareOp::kNe || op == CompareOp::kLe ||
+                op == CompareOp::kGe) {
+    bits = ~bits & (std::is_same_v<T, int64_t> ? 0xfu : 0xffu);
+  }
+  return bits;
+}
+
+template <CompareOp op>
+inline uint32_t CompareDoubleLanes(__m256d x, __m256d v) {
+  // The predicates are chosen to match the std comparators for NaN: all the
+  // comparisons are false except for kNe.
+  __m256d mask;
+  if constexpr (op == CompareOp::kEq) {
+    mask = _mm256_cmp_pd(x, v, _CMP_EQ_OQ);
+  } else if constexpr (op == CompareOp::kNe) {
+    mask = _mm256_cmp_pd(x, v, _CMP_NEQ_UQ);
+  } else if constexpr (op == CompareOp::kLt) {
+    mask = _mm256_cmp_pd(x, v, _CMP_LT_OQ);
+  } else if constexpr (op == CompareOp::kLe) {
+    mask = _mm256_cmp_pd(x, v, _CMP_LE_OQ);
+  } else if constexpr (op == CompareOp::kGt) {
+    mask = _mm256_cmp_pd(x, v, _CMP_GT_OQ);
+  } else {
+    mask = _mm256_cmp_pd(x, v, _CMP_GE_OQ);
+  }
+  return static_cast<uint32_t>(_mm256_movemask_pd(mask));
+}
+
+// Compares the |BitVector::kBitsInWord| values starting at |data| with |val|
+// and returns the results packed in a word, with the result for data[i] in
+// bit i.
+template <typename Comparator, typename T>
+inline uint64_t CompareWord(const T* data, T val) {
+  static_assert(kHasWordComparator<T>, "Type not supported");
+  constexpr CompareOp op = CompareOpFor<Comparator>::kOp;
+  constexpr uint32_t kLanes = sizeof(__m256i) / sizeof(T);
+
+  uint64_t word = 0;
+  if constexpr (std::is_same_v<T, double>) {
+    const __m256d v = _mm256_set1_pd(val);
+    for (uint32_t i = 0; i < BitVector::kBitsInWord; i += kLanes) {
+      __m256d x = _mm256_loadu_pd(data + i);
+      word |= static_cast<uint64_t>(CompareDoubleLanes<op>(x, v)) << i;
+    }
+  } else {
+    const __m256i v = std::is_same_v<T, int64_t>
+                          ? _mm256_set1_epi64x(static_cast<int64_t>(val))
+                          : _mm256_set1_epi32(static_cast<int32_t>(val));
+    for (uint32_t i = 0; i < BitVector::kBitsInWord; i += kLanes) {
+      __m256i x =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+      word |= static_cast<uint64_t>(CompareIntLanes<op, T>(x, v)) << i;
+    }
+  }
+  return word;
+}
+
+#else  // PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+
+template <typename T>
+constexpr bool kHasWordComparator = false;
+
+template <typename Comparator, typename T>
+inline uint64_t CompareWord(const T*, T) {
+  static_assert(kHasWordComparator<T>, "Not supported on this platform");
+  return 0;
+}
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+
+}  // namespace perfetto::trace_processor::column::simd
+
+#endif  // SRC_TRACE_PROCESSOR_DB_COLUMN_SIMD_COMPARATORS_H_
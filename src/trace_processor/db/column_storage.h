@@ -46,6 +46,13 @@ class ColumnStorageBase {
   virtual const BitVector* bv() const = 0;
   virtual uint32_t size() const = 0;
   virtual uint32_t non_null_size() const = 0;
+
+  // Returns the number of times a value in this storage was changed with
+  // Set(). Used to detect indices which are out of date.
+  uint32_t mutation_count() const { return mutation_count_; }
+
+ protected:
+  uint32_t mutation_count_ = 0;
 };
 
 // Class used for implementing storage for non-null columns.
@@ -62,7 +69,10 @@ class ColumnStorage final : public ColumnStorageBase {
 
   T Get(uint32_t idx) const { return vector_[idx]; }
   void Append(T val) { vector_.emplace_back(val); }
-  void Set(uint32_t idx, T val) { vector_[idx] = val; }
+  void Set(uint32_t idx, T val) {
+    vector_[idx] = val;
+    ++mutation_count_;
+  }
   PERFETTO_NO_INLINE void ShrinkToFit() { vector_.shrink_to_fit(); }
   const std::vector<T>& vector() const { return vector_; }
 
@@ -136,6 +146,7 @@ class ColumnStorage<std::optional<T>> final : public ColumnStorageBase {
         data_.insert(data_.begin() + static_cast<ptrdiff_t>(row), val);
       }
     }
+    ++mutation_count_;
   }
   bool IsDense() const { return mode_ == Mode::kDense; }
   PERFETTO_NO_INLINE void ShrinkToFit() {
@@ -34,6 +34,26 @@ namespace {
 
 using Range = RowMap::Range;
 
+// Returns whether the result of filtering a column with |op| is a contiguous
+// range of rows when the rows are ordered by the value of the column.
+bool IsOrderedIndexSearchSupported(FilterOp op) {
+  switch (op) {
+    case FilterOp::kEq:
+    case FilterOp::kLt:
+    case FilterOp::kLe:
+    case FilterOp::kGt:
+    case FilterOp::kGe:
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+      return true;
+    case FilterOp::kNe:
+    case FilterOp::kGlob:
+    case FilterOp::kRegex:
+      return false;
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
 }  // namespace
 
 void QueryExecutor::FilterColumn(const Constraint& c,
@@ -163,11 +183,48 @@ void QueryExecutor::IndexSearch(const Constraint& c,
   *rm = RowMap(std::move(res_as_iv));
 }
 
+void QueryExecutor::ColumnIndexSearch(const Constraint& c,
+                                      const column::DataLayerChain& chain,
+                                      const std::vector<uint32_t>& index,
+                                      RowMap* rm) {
+  // Comparison of NULL with any operation apart from |IS_NULL| and
+  // |IS_NOT_NULL| should return no rows.
+  if (index.empty() || (c.value.is_null() && c.op != FilterOp::kIsNull &&
+                        c.op != FilterOp::kIsNotNull)) {
+    rm->Clear();
+    return;
+  }
+
+  Range res = chain.OrderedIndexSearch(
+      c.op, c.value,
+      Indices{index.data(), static_cast<uint32_t>(index.size()),
+              Indices::State::kNonmonotonic});
+  std::vector<uint32_t> res_as_iv(index.begin() + static_cast<int>(res.start),
+                                  index.begin() + static_cast<int>(res.end));
+  std::sort(res_as_iv.begin(), res_as_iv.end());
+  *rm = RowMap(std::move(res_as_iv));
+}
+
 RowMap QueryExecutor::FilterLegacy(const Table* table,
                                    const std::vector<Constraint>& c_vec) {
   RowMap rm(0, table->row_count());
-  for (const auto& c : c_vec) {
-    FilterColumn(c, table->ChainForColumn(c.col_idx), &rm);
+
+  // If any of the constraints is on a column with an index, use the index to
+  // cut down the number of rows before applying the other constraints.
+  auto indexed_it = std::find_if(
+      c_vec.begin(), c_vec.end(), [table](const Constraint& c) {
+        return IsOrderedIndexSearchSupported(c.op) &&
+               table->GetIndexForColumn(c.col_idx);
+      });
+  if (indexed_it != c_vec.end()) {
+    ColumnIndexSearch(*indexed_it, table->ChainForColumn(indexed_it->col_idx),
+                      table->GetIndexForColumn(indexed_it->col_idx)->index,
+                      &rm);
+  }
+  for (auto it = c_vec.begin(); it != c_vec.end(); ++it) {
+    if (it != indexed_it) {
+      FilterColumn(*it, table->ChainForColumn(it->col_idx), &rm);
+    }
   }
   return rm;
 }
@@ -83,6 +83,14 @@ class QueryExecutor {
                           const column::DataLayerChain&,
                           RowMap*);
 
+  // Filters the column using an index created with CREATE PERFETTO INDEX: the
+  // rows in |index| are ordered by the value of the column so the matching rows
+  // can be found using binary search. Replaces the contents of |rm|.
+  static void ColumnIndexSearch(const Constraint&,
+                                const column::DataLayerChain&,
+                                const std::vector<uint32_t>& index,
+                                RowMap*);
+
   std::vector<column::DataLayerChain*> columns_;
 
   // Number of rows in the outmost overlay.
@@ -18,8 +18,10 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <initializer_list>
 #include <optional>
+#include <random>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -30,8 +32,10 @@
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "src/base/test/utils.h"
+#include "src/trace_processor/containers/bit_vector.h"
 #include "src/trace_processor/containers/string_pool.h"
 #include "src/trace_processor/db/column/types.h"
+#include "src/trace_processor/db/column/utils.h"
 #include "src/trace_processor/db/table.h"
 #include "src/trace_processor/tables/metadata_tables_py.h"
 #include "src/trace_processor/tables/profiler_tables_py.h"
@@ -504,5 +508,106 @@ void BM_QEFtraceEventSortSelectorNumericDesc(benchmark::State& state) {
 
 BENCHMARK(BM_QEFtraceEventSortSelectorNumericDesc);
 
+// Runs a linear search of |data| with |comparator|. When |vectorized| is
+// false, |comparator| is hidden behind a lambda which forces the scalar
+// comparison loop; this allows reporting the speedup of the vectorized
+// kernels.
+template <typename T, typename Comparator>
+void NumericLinearSearch(const std::vector<T>& data,
+                         T val,
+                         Comparator comparator,
+                         bool vectorized,
+                         BitVector::Builder& builder) {
+  if (vectorized) {
+    column::utils::LinearSearchWithComparator(val, data.data(), comparator,
+                                              builder);
+  } else {
+    column::utils::LinearSearchWithComparator(
+        val, data.data(), [comparator](T a, T b) { return comparator(a, b); },
+        builder);
+  }
+}
+
+// Benchmarks the linear search of a numeric column of type |T| with the
+// FilterOp in range(0). range(1) is 1 for the vectorized search and 0 for the
+// scalar one.
+template <typename T>
+void BenchmarkNumericLinearSearch(benchmark::State& state) {
+  constexpr uint32_t kSize = 1024 * 1024;
+  std::minstd_rand0 rnd(0);
+  std::vector<T> data(kSize);
+  for (T& v : data) {
+    v = static_cast<T>(rnd() % 1000);
+  }
+  T val = static_cast<T>(500);
+
+  auto op = static_cast<FilterOp>(state.range(0));
+  bool vectorized = state.range(1) != 0;
+  for (auto _ : state) {
+    BitVector::Builder builder(kSize);
+    switch (op) {
+      case FilterOp::kEq:
+        NumericLinearSearch(data, val, std::equal_to<T>(), vectorized, builder);
+        break;
+      case FilterOp::kNe:
+        NumericLinearSearch(data, val, std::not_equal_to<T>(), vectorized,
+                            builder);
+        break;
+      case FilterOp::kGt:
+        NumericLinearSearch(data, val, std::greater<T>(), vectorized, builder);
+        break;
+      case FilterOp::kLt:
+        NumericLinearSearch(data, val, std::less<T>(), vectorized, builder);
+        break;
+      case FilterOp::kGe:
+        NumericLinearSearch(data, val, std::greater_equal<T>(), vectorized,
+                            builder);
+        break;
+      case FilterOp::kLe:
+        NumericLinearSearch(data, val, std::less_equal<T>(), vectorized,
+                            builder);
+        break;
+      case FilterOp::kIsNull:
+      case FilterOp::kIsNotNull:
+      case FilterOp::kGlob:
+      case FilterOp::kRegex:
+        PERFETTO_FATAL("Invalid filter operation");
+    }
+    benchmark::DoNotOptimize(std::move(builder).Build());
+  }
+  state.counters["s/row"] =
+      benchmark::Counter(static_cast<double>(kSize),
+                         benchmark::Counter::kIsIterationInvariantRate |
+                             benchmark::Counter::kInvert);
+}
+
+void NumericLinearSearchArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"op", "simd"});
+  for (FilterOp op : {FilterOp::kEq, FilterOp::kNe, FilterOp::kGt,
+                      FilterOp::kLt, FilterOp::kGe, FilterOp::kLe}) {
+    for (int vectorized : {0, 1}) {
+      b->Args({static_cast<int>(op), vectorized});
+    }
+  }
+}
+
+void BM_QENumericLinearSearchInt64(benchmark::State& state) {
+  BenchmarkNumericLinearSearch<int64_t>(state);
+}
+
+BENCHMARK(BM_QENumericLinearSearchInt64)->Apply(NumericLinearSearchArgs);
+
+void BM_QENumericLinearSearchUint32(benchmark::State& state) {
+  BenchmarkNumericLinearSearch<uint32_t>(state);
+}
+
+BENCHMARK(BM_QENumericLinearSearchUint32)->Apply(NumericLinearSearchArgs);
+
+void BM_QENumericLinearSearchDouble(benchmark::State& state) {
+  BenchmarkNumericLinearSearch<double>(state);
+}
+
+BENCHMARK(BM_QENumericLinearSearchDouble)->Apply(NumericLinearSearchArgs);
+
 }  // namespace
 }  // namespace perfetto::trace_processor
@@ -19,6 +19,7 @@
 #include <algorithm>
 #include <cstdint>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -62,6 +63,7 @@ Table& Table::operator=(Table&& other) noexcept {
   null_layers_ = std::move(other.null_layers_);
   overlay_layers_ = std::move(other.overlay_layers_);
   chains_ = std::move(other.chains_);
+  indexes_ = std::move(other.indexes_);
 
   for (ColumnLegacy& col : columns_) {
     col.table_ = this;
@@ -75,6 +77,7 @@ Table Table::Copy() const {
     table.overlays_.emplace_back(overlay.Copy());
   }
   table.OnConstructionCompleted(storage_layers_, null_layers_, overlay_layers_);
+  table.indexes_ = indexes_;
   return table;
 }
 
@@ -171,6 +174,60 @@ Table Table::Sort(const std::vector<Order>& ob) const {
   return table;
 }
 
+void Table::CreateIndex(const std::string& name, uint32_t col_idx) const {
+  PERFETTO_CHECK(col_idx < columns_.size());
+  ColumnIndex col_index{name, col_idx,
+                        QueryToRowMap({}, {Order{col_idx, false}})
+                            .TakeAsIndexVector(),
+                        row_count_, ColumnMutationCount(col_idx)};
+  auto it = std::find_if(indexes_.begin(), indexes_.end(),
+                         [&name](const ColumnIndex& i) { return i.name == name; });
+  if (it == indexes_.end()) {
+    indexes_.emplace_back(std::move(col_index));
+  } else {
+    *it = std::move(col_index);
+  }
+}
+
+bool Table::DropIndex(const std::string& name) const {
+  auto it = std::find_if(indexes_.begin(), indexes_.end(),
+                         [&name](const ColumnIndex& i) { return i.name == name; });
+  if (it == indexes_.end()) {
+    return false;
+  }
+  indexes_.erase(it);
+  return true;
+}
+
+const Table::ColumnIndex* Table::GetIndex(const std::string& name) const {
+  auto it = std::find_if(indexes_.begin(), indexes_.end(),
+                         [&name](const ColumnIndex& i) { return i.name == name; });
+  return it == indexes_.end() ? nullptr : &*it;
+}
+
+const Table::ColumnIndex* Table::GetIndexForColumn(uint32_t col_idx) const {
+  for (const ColumnIndex& index : indexes_) {
+    if (index.col_idx == col_idx && index.row_count == row_count_ &&
+        index.mutation_count == ColumnMutationCount(col_idx)) {
+      return &index;
+    }
+  }
+  return nullptr;
+}
+
+uint32_t Table::ColumnMutationCount(uint32_t col_idx) const {
+  const ColumnLegacy& col = columns_[col_idx];
+  return col.IsId() ? 0 : col.storage_base().mutation_count();
+}
+
+uint64_t Table::IndexMemoryBytes() const {
+  uint64_t bytes = 0;
+  for (const ColumnIndex& index : indexes_) {
+    bytes += index.index.capacity() * sizeof(uint32_t);
+  }
+  return bytes;
+}
+
 void Table::OnConstructionCompleted(
     std::vector<RefPtr<column::DataLayer>> storage_layers,
     std::vector<RefPtr<column::DataLayer>> null_layers,
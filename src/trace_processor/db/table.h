@@ -118,6 +118,22 @@ class Table {
     std::vector<Column> columns;
   };
 
+  // A secondary index on a single column, created with
+  // CREATE PERFETTO INDEX. Stores the indices of all the rows in the table
+  // stably sorted by the value of the column so constraints on the column can
+  // be solved using binary search.
+  struct ColumnIndex {
+    std::string name;
+    uint32_t col_idx;
+    std::vector<uint32_t> index;
+
+    // The number of rows in the table and the mutation count of the column's
+    // storage when the index was built: if rows are added to the table or
+    // values of the column are changed afterwards, the index is ignored.
+    uint32_t row_count;
+    uint32_t mutation_count;
+  };
+
   virtual ~Table();
 
   // We explicitly define the move constructor here because we need to update
@@ -150,6 +166,32 @@ class Table {
   // Creates a copy of this table.
   Table Copy() const;
 
+  // Builds an index named |name| on the column |col_idx|, replacing any
+  // existing index with the same name.
+  //
+  // Note: this function is const as indices do not change the contents of the
+  // table, only how fast it can be queried.
+  void CreateIndex(const std::string& name, uint32_t col_idx) const;
+
+  // Drops the index named |name|. Returns false if no such index exists.
+  //
+  // Note: this function is const for the same reason as CreateIndex.
+  bool DropIndex(const std::string& name) const;
+
+  // Drops all the indices on this table.
+  void DropAllIndexes() const { indexes_.clear(); }
+
+  // Returns the index with the given name or nullptr if none exists.
+  const ColumnIndex* GetIndex(const std::string& name) const;
+
+  // Returns an up-to-date index on the column |col_idx| or nullptr if none
+  // exists. Indices which are out of date are kept (and count towards
+  // IndexMemoryBytes) until they are dropped or replaced.
+  const ColumnIndex* GetIndexForColumn(uint32_t col_idx) const;
+
+  // Returns the number of bytes used by all the indices on this table.
+  uint64_t IndexMemoryBytes() const;
+
   uint32_t row_count() const { return row_count_; }
   StringPool* string_pool() const { return string_pool_; }
   const std::vector<ColumnLegacy>& columns() const { return columns_; }
@@ -201,6 +243,8 @@ class Table {
 
   Table CopyExceptOverlays() const;
 
+  uint32_t ColumnMutationCount(uint32_t col_idx) const;
+
   StringPool* string_pool_ = nullptr;
   uint32_t row_count_ = 0;
   std::vector<ColumnStorageOverlay> overlays_;
@@ -210,6 +254,7 @@ class Table {
   std::vector<RefPtr<column::DataLayer>> null_layers_;
   std::vector<RefPtr<column::DataLayer>> overlay_layers_;
   mutable std::vector<std::unique_ptr<column::DataLayerChain>> chains_;
+  mutable std::vector<ColumnIndex> indexes_;
 };
 
 }  // namespace perfetto::trace_processor
@@ -225,6 +225,25 @@ void ProfileModule::ParsePerfSample(
     return;
   }
 
+  // Not a sample, but the statistics of one of the producer's unwinders.
+  if (sample.has_unwinder_stats()) {
+    PerfSample::UnwinderStats::Decoder unwinder_stats(sample.unwinder_stats());
+    int index = static_cast<int>(unwinder_stats.unwinder_index());
+    context_->storage->IncrementIndexedStats(
+        stats::perf_unwinder_samples_dropped, index,
+        static_cast<int64_t>(unwinder_stats.samples_dropped()));
+    int64_t max_occupancy =
+        static_cast<int64_t>(unwinder_stats.max_queue_occupancy());
+    std::optional<int64_t> prev_max_occupancy =
+        context_->storage->GetIndexedStats(
+            stats::perf_unwinder_max_queue_occupancy, index);
+    if (!prev_max_occupancy || *prev_max_occupancy < max_occupancy) {
+      context_->storage->SetIndexedStats(
+          stats::perf_unwinder_max_queue_occupancy, index, max_occupancy);
+    }
+    return;
+  }
+
   // Not a sample, but an event from the producer.
   // TODO(rsavitski): this stat is indexed by the session id, but the older
   // stats (see above) aren't. The indexing is relevant if a trace contains more
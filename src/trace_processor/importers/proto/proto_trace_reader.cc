@@ -16,6 +16,7 @@
 
 #include "src/trace_processor/importers/proto/proto_trace_reader.h"
 
+#include <algorithm>
 #include <optional>
 #include <string>
 
@@ -56,7 +57,16 @@ ProtoTraceReader::ProtoTraceReader(TraceProcessorContext* ctx)
     : context_(ctx),
       skipped_packet_key_id_(ctx->storage->InternString("skipped_packet")),
       invalid_incremental_state_key_id_(
-          ctx->storage->InternString("invalid_incremental_state")) {}
+          ctx->storage->InternString("invalid_incremental_state")) {
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  uint32_t thread_count = std::min(ctx->config.tokenizer_thread_count,
+                                   Config::kMaxTokenizerThreadCount);
+  if (thread_count > 1) {
+    decompression_pool_.reset(new base::ThreadPool(thread_count));
+    tokenizer_.SetDecompressionThreadPool(decompression_pool_.get());
+  }
+#endif
+}
 ProtoTraceReader::~ProtoTraceReader() = default;
 
 util::Status ProtoTraceReader::Parse(TraceBlobView blob) {
@@ -84,7 +94,8 @@ util::Status ProtoTraceReader::ParsePacket(TraceBlobView packet) {
   }
 
   // Any compressed packets should have been handled by the tokenizer.
-  PERFETTO_CHECK(!decoder.has_compressed_packets());
+  PERFETTO_CHECK(!decoder.has_compressed_packets() &&
+                 !decoder.has_zstd_compressed_packets());
 
   const uint32_t seq_id = decoder.trusted_packet_sequence_id();
   auto* state = GetIncrementalStateForPacketSequence(seq_id);
@@ -21,6 +21,7 @@
 
 #include <memory>
 
+#include "perfetto/ext/base/threading/thread_pool.h"
 #include "src/trace_processor/importers/common/chunked_trace_reader.h"
 #include "src/trace_processor/importers/proto/proto_incremental_state.h"
 #include "src/trace_processor/importers/proto/proto_trace_tokenizer.h"
@@ -87,6 +88,10 @@ class ProtoTraceReader : public ChunkedTraceReader {
 
   TraceProcessorContext* context_;
 
+  // Only created if Config::tokenizer_thread_count > 1. Declared before
+  // |tokenizer_| as the latter holds a pointer to it.
+  std::unique_ptr<base::ThreadPool> decompression_pool_;
+
   ProtoTraceTokenizer tokenizer_;
 
   // Temporary. Currently trace packets do not have a timestamp, so the
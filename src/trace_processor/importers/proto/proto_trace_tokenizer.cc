@@ -24,25 +24,43 @@ namespace trace_processor {
 
 ProtoTraceTokenizer::ProtoTraceTokenizer() = default;
 
-util::Status ProtoTraceTokenizer::Decompress(TraceBlobView input,
-                                             TraceBlobView* output) {
-  PERFETTO_DCHECK(util::IsGzipSupported());
-
+// static
+util::Status ProtoTraceTokenizer::Decompress(
+    util::GzipDecompressor* decompressor,
+    Codec codec,
+    TraceBlobView input,
+    TraceBlobView* output) {
+  PERFETTO_DCHECK(codec != Codec::kNone);
   std::vector<uint8_t> data;
   data.reserve(input.length());
 
-  // Ensure that the decompressor is able to cope with a new stream of data.
-  decompressor_.Reset();
-  using ResultCode = util::GzipDecompressor::ResultCode;
-  ResultCode ret = decompressor_.FeedAndExtract(
-      input.data(), input.length(),
-      [&data](const uint8_t* buffer, size_t buffer_len) {
-        data.insert(data.end(), buffer, buffer + buffer_len);
-      });
-
-  if (ret == ResultCode::kError || ret == ResultCode::kNeedsMoreInput) {
-    return util::ErrStatus("Failed to decompress (error code: %d)",
-                           static_cast<int>(ret));
+  if (codec == Codec::kZstd) {
+    if (!util::IsZstdSupported()) {
+      return util::ErrStatus(
+          "Cannot decode zstd compressed packets. Zstd not enabled");
+    }
+    if (!util::ZstdDecompressFully(input.data(), input.length(), &data)) {
+      return util::ErrStatus("Failed to decompress zstd stream");
+    }
+  } else {
+    if (!util::IsGzipSupported()) {
+      return util::ErrStatus(
+          "Cannot decode compressed packets. Zlib not enabled");
+    }
+
+    // Ensure that the decompressor is able to cope with a new stream of data.
+    decompressor->Reset();
+    using ResultCode = util::GzipDecompressor::ResultCode;
+    ResultCode ret = decompressor->FeedAndExtract(
+        input.data(), input.length(),
+        [&data](const uint8_t* buffer, size_t buffer_len) {
+          data.insert(data.end(), buffer, buffer + buffer_len);
+        });
+
+    if (ret == ResultCode::kError || ret == ResultCode::kNeedsMoreInput) {
+      return util::ErrStatus("Failed to decompress (error code: %d)",
+                             static_cast<int>(ret));
+    }
   }
 
   TraceBlob out_blob = TraceBlob::CopyFrom(data.data(), data.size());
@@ -21,6 +21,9 @@
 #include <vector>
 
 #include "perfetto/base/status.h"
+#include "perfetto/ext/base/threading/thread_pool.h"
+#include "perfetto/ext/base/waitable_event.h"
+#include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "perfetto/public/compiler.h"
 #include "perfetto/trace_processor/status.h"
@@ -28,6 +31,7 @@
 #include "perfetto/trace_processor/trace_blob_view.h"
 #include "src/trace_processor/util/gzip_utils.h"
 #include "src/trace_processor/util/status_macros.h"
+#include "src/trace_processor/util/zstd_utils.h"
 
 #include "protos/perfetto/trace/trace.pbzero.h"
 #include "protos/perfetto/trace/trace_packet.pbzero.h"
@@ -41,6 +45,13 @@ class ProtoTraceTokenizer {
  public:
   ProtoTraceTokenizer();
 
+  // Offloads the decompression of |compressed_packets| and
+  // |zstd_compressed_packets| to |pool|. Packets are
+  // still passed to the Tokenize() callback on the calling thread and in the
+  // same order as without a pool: only the inflating of the compressed bundles
+  // happens concurrently. |pool| must outlive this object.
+  void SetDecompressionThreadPool(base::ThreadPool* pool) { pool_ = pool; }
+
   template <typename Callback = util::Status(TraceBlobView)>
   util::Status Tokenize(TraceBlobView blob, Callback callback) {
     const uint8_t* data = blob.data();
@@ -113,11 +124,34 @@ class ProtoTraceTokenizer {
       protozero::proto_utils::MakeTagLengthDelimited(
           protos::pbzero::Trace::kPacketFieldNumber);
 
+  // Upper bound on the number of compressed bundles which are decompressed
+  // concurrently before their packets are handed to the callback. This bounds
+  // the amount of decompressed data held in memory at any time.
+  static constexpr size_t kMaxCompressedPacketsInFlight = 64;
+
+  // How the nested packets of a TracePacket are compressed, i.e. which of
+  // |compressed_packets| and |zstd_compressed_packets| is set.
+  enum class Codec { kNone, kGzip, kZstd };
+
+  // State of a single top-level packet while it goes through the parallel
+  // decompression pipeline.
+  struct PendingPacket {
+    TraceBlobView packet;
+    Codec codec = Codec::kNone;
+    TraceBlobView compressed;
+    util::Status status;
+    TraceBlobView decompressed;
+  };
+
   template <typename Callback = util::Status(TraceBlobView)>
   util::Status ParseInternal(TraceBlobView whole_buf, Callback callback) {
     static constexpr auto kLengthDelimited =
         protozero::proto_utils::ProtoWireType::kLengthDelimited;
     const uint8_t* const start = whole_buf.data();
+    const bool parallel =
+        pool_ && (util::IsGzipSupported() || util::IsZstdSupported());
+    std::vector<PendingPacket> pending;
+    size_t compressed_count = 0;
     protos::pbzero::Trace::Decoder decoder(whole_buf.data(), whole_buf.size());
     for (auto it = decoder.packet(); it; ++it) {
       if (PERFETTO_UNLIKELY(it->type() != kLengthDelimited)) {
@@ -125,8 +159,34 @@ class ProtoTraceTokenizer {
       }
       protozero::ConstBytes packet = *it;
       TraceBlobView sliced = whole_buf.slice(packet.data, packet.size);
-      RETURN_IF_ERROR(ParsePacket(std::move(sliced), callback));
+      if (!parallel) {
+        RETURN_IF_ERROR(ParsePacket(std::move(sliced), callback));
+        continue;
+      }
+      // Only scan the field headers here: a full TracePacket decode is done
+      // later on anyway by the callback.
+      PendingPacket pending_packet;
+      protozero::ProtoDecoder packet_decoder(sliced.data(), sliced.length());
+      for (auto f = packet_decoder.ReadField(); f.valid();
+           f = packet_decoder.ReadField()) {
+        Codec codec = CodecForField(f.id());
+        if (codec != Codec::kNone) {
+          pending_packet.codec = codec;
+          pending_packet.compressed = sliced.slice(f.data(), f.size());
+          break;
+        }
+      }
+      const bool is_compressed = pending_packet.codec != Codec::kNone;
+      pending_packet.packet = std::move(sliced);
+      pending.emplace_back(std::move(pending_packet));
+      if (is_compressed &&
+          ++compressed_count == kMaxCompressedPacketsInFlight) {
+        RETURN_IF_ERROR(ParsePendingInParallel(&pending, callback));
+        compressed_count = 0;
+      }
     }
+    if (!pending.empty())
+      RETURN_IF_ERROR(ParsePendingInParallel(&pending, callback));
 
     const size_t bytes_left = decoder.bytes_left();
     if (bytes_left > 0) {
@@ -141,42 +201,103 @@ class ProtoTraceTokenizer {
   util::Status ParsePacket(TraceBlobView packet, Callback callback) {
     protos::pbzero::TracePacket::Decoder decoder(packet.data(),
                                                  packet.length());
+    Codec codec = Codec::kNone;
+    protozero::ConstBytes field{};
     if (decoder.has_compressed_packets()) {
-      if (!util::IsGzipSupported()) {
-        return util::Status(
-            "Cannot decode compressed packets. Zlib not enabled");
-      }
-
-      protozero::ConstBytes field = decoder.compressed_packets();
+      codec = Codec::kGzip;
+      field = decoder.compressed_packets();
+    } else if (decoder.has_zstd_compressed_packets()) {
+      codec = Codec::kZstd;
+      field = decoder.zstd_compressed_packets();
+    }
+    if (codec != Codec::kNone) {
       TraceBlobView compressed_packets = packet.slice(field.data, field.size);
       TraceBlobView packets;
 
-      RETURN_IF_ERROR(Decompress(std::move(compressed_packets), &packets));
-
-      const uint8_t* start = packets.data();
-      const uint8_t* end = packets.data() + packets.length();
-      const uint8_t* ptr = start;
-      while ((end - ptr) > 2) {
-        const uint8_t* packet_outer = ptr;
-        if (PERFETTO_UNLIKELY(*ptr != kTracePacketTag))
-          return util::ErrStatus("Expected TracePacket tag");
-        uint64_t packet_size = 0;
-        ptr = protozero::proto_utils::ParseVarInt(++ptr, end, &packet_size);
-        const uint8_t* packet_start = ptr;
-        ptr += packet_size;
-        if (PERFETTO_UNLIKELY((ptr - packet_outer) < 2 || ptr > end))
-          return util::ErrStatus("Invalid packet size");
-
-        TraceBlobView sliced =
-            packets.slice(packet_start, static_cast<size_t>(packet_size));
-        RETURN_IF_ERROR(ParsePacket(std::move(sliced), callback));
-      }
-      return util::OkStatus();
+      RETURN_IF_ERROR(Decompress(&decompressor_, codec,
+                                 std::move(compressed_packets), &packets));
+      return ParseDecompressedPackets(std::move(packets), callback);
     }
     return callback(std::move(packet));
   }
 
-  util::Status Decompress(TraceBlobView input, TraceBlobView* output);
+  template <typename Callback = util::Status(TraceBlobView)>
+  util::Status ParseDecompressedPackets(TraceBlobView packets,
+                                        Callback callback) {
+    const uint8_t* start = packets.data();
+    const uint8_t* end = packets.data() + packets.length();
+    const uint8_t* ptr = start;
+    while ((end - ptr) > 2) {
+      const uint8_t* packet_outer = ptr;
+      if (PERFETTO_UNLIKELY(*ptr != kTracePacketTag))
+        return util::ErrStatus("Expected TracePacket tag");
+      uint64_t packet_size = 0;
+      ptr = protozero::proto_utils::ParseVarInt(++ptr, end, &packet_size);
+      const uint8_t* packet_start = ptr;
+      ptr += packet_size;
+      if (PERFETTO_UNLIKELY((ptr - packet_outer) < 2 || ptr > end))
+        return util::ErrStatus("Invalid packet size");
+
+      TraceBlobView sliced =
+          packets.slice(packet_start, static_cast<size_t>(packet_size));
+      RETURN_IF_ERROR(ParsePacket(std::move(sliced), callback));
+    }
+    return util::OkStatus();
+  }
+
+  // Decompresses all the compressed packets in |pending| on |pool_| and then
+  // passes every packet to |callback| in the original order. Clears |pending|.
+  template <typename Callback = util::Status(TraceBlobView)>
+  util::Status ParsePendingInParallel(std::vector<PendingPacket>* pending,
+                                      Callback callback) {
+    base::WaitableEvent all_done;
+    uint64_t posted = 0;
+    for (PendingPacket& p : *pending) {
+      if (p.codec == Codec::kNone)
+        continue;
+      PendingPacket* p_ptr = &p;
+      pool_->PostTask([p_ptr, &all_done] {
+        util::GzipDecompressor decompressor;
+        p_ptr->status =
+            Decompress(&decompressor, p_ptr->codec,
+                       std::move(p_ptr->compressed), &p_ptr->decompressed);
+        all_done.Notify();
+      });
+      posted++;
+    }
+    all_done.Wait(posted);
+
+    util::Status status = util::OkStatus();
+    for (PendingPacket& p : *pending) {
+      if (!status.ok())
+        break;
+      if (p.codec == Codec::kNone) {
+        status = callback(std::move(p.packet));
+      } else if (!p.status.ok()) {
+        status = p.status;
+      } else {
+        status = ParseDecompressedPackets(std::move(p.decompressed), callback);
+      }
+    }
+    pending->clear();
+    return status;
+  }
+
+  static Codec CodecForField(uint32_t field_id) {
+    switch (field_id) {
+      case protos::pbzero::TracePacket::kCompressedPacketsFieldNumber:
+        return Codec::kGzip;
+      case protos::pbzero::TracePacket::kZstdCompressedPacketsFieldNumber:
+        return Codec::kZstd;
+    }
+    return Codec::kNone;
+  }
+
+  // |decompressor| is only used for Codec::kGzip.
+  static util::Status Decompress(util::GzipDecompressor* decompressor,
+                                 Codec codec,
+                                 TraceBlobView input,
+                                 TraceBlobView* output);
 
   // Used to glue together trace packets that span across two (or more)
   // Parse() boundaries.
@@ -184,6 +305,9 @@ class ProtoTraceTokenizer {
 
   // Allows support for compressed trace packets.
   util::GzipDecompressor decompressor_;
+
+  // Not owned. When set, compressed packets are decompressed on this pool.
+  base::ThreadPool* pool_ = nullptr;
 };
 
 }  // namespace trace_processor
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/threading/thread_pool.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "perfetto/trace_processor/trace_blob.h"
+#include "perfetto/trace_processor/trace_blob_view.h"
+#include "src/trace_processor/importers/proto/proto_trace_tokenizer.h"
+
+#include "protos/perfetto/trace/test_event.pbzero.h"
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// Each compressed bundle inflates to roughly the size of the bundles the
+// tracing service emits with compression_type = DEFLATE.
+constexpr uint32_t kPacketsPerBundle = 2000;
+constexpr uint32_t kBundles = 256;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void TokenizerArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(2);
+    return;
+  }
+  for (int threads : {1, 2, 4, 8, 16})
+    b->Arg(threads);
+}
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+// Builds a trace made of |kBundles| TracePackets, each containing a zlib
+// compressed bundle of |kPacketsPerBundle| packets.
+std::vector<uint8_t> CreateCompressedTrace(uint32_t bundles) {
+  std::minstd_rand0 rnd(42);
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  uint64_t ts = 0;
+  for (uint32_t b = 0; b < bundles; ++b) {
+    protozero::HeapBuffered<protos::pbzero::Trace> bundle;
+    for (uint32_t i = 0; i < kPacketsPerBundle; ++i) {
+      auto* packet = bundle->add_packet();
+      ts += rnd() % 1000;
+      packet->set_timestamp(ts);
+      packet->set_trusted_packet_sequence_id(1 + rnd() % 16);
+      auto* event = packet->set_for_testing();
+      event->set_seq_value(static_cast<uint32_t>(rnd()));
+      event->set_counter(rnd() % 100);
+      event->set_str("sched_switch: prev_comm=" + std::to_string(rnd() % 64) +
+                     " next_comm=" + std::to_string(rnd() % 64));
+    }
+    std::vector<uint8_t> raw = bundle.SerializeAsArray();
+    uLongf compressed_size = compressBound(static_cast<uLong>(raw.size()));
+    std::vector<uint8_t> compressed(compressed_size);
+    int res = compress2(compressed.data(), &compressed_size, raw.data(),
+                        static_cast<uLong>(raw.size()), Z_BEST_SPEED);
+    PERFETTO_CHECK(res == Z_OK);
+    trace->add_packet()->set_compressed_packets(compressed.data(),
+                                                compressed_size);
+  }
+  return trace.SerializeAsArray();
+}
+#endif
+
+}  // namespace
+
+static void BM_ProtoTraceTokenizerCompressed(benchmark::State& state) {
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+  const uint32_t threads = static_cast<uint32_t>(state.range(0));
+  const uint32_t bundles = IsBenchmarkFunctionalOnly() ? 4 : kBundles;
+  std::vector<uint8_t> trace = CreateCompressedTrace(bundles);
+
+  std::unique_ptr<base::ThreadPool> pool;
+  if (threads > 1)
+    pool.reset(new base::ThreadPool(threads));
+
+  uint64_t packets = 0;
+  for (auto _ : state) {
+    ProtoTraceTokenizer tokenizer;
+    tokenizer.SetDecompressionThreadPool(pool.get());
+    TraceBlobView blob(TraceBlob::CopyFrom(trace.data(), trace.size()));
+    auto status =
+        tokenizer.Tokenize(std::move(blob), [&packets](TraceBlobView packet) {
+          benchmark::DoNotOptimize(packet.data());
+          packets++;
+          return util::OkStatus();
+        });
+    PERFETTO_CHECK(status.ok());
+  }
+  PERFETTO_CHECK(packets ==
+                 static_cast<uint64_t>(state.iterations()) * bundles *
+                     kPacketsPerBundle);
+
+  state.counters["packets/s"] = benchmark::Counter(
+      static_cast<double>(packets), benchmark::Counter::kIsRate);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(trace.size()));
+#else
+  state.SkipWithError("zlib not supported in this build");
+#endif
+}
+BENCHMARK(BM_ProtoTraceTokenizerCompressed)
+    ->Apply(TokenizerArgs)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -36,6 +36,7 @@
 #include "perfetto/base/logging.h"
 #include "perfetto/base/status.h"
 #include "perfetto/ext/base/status_or.h"
+#include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/field.h"
@@ -106,6 +107,12 @@ base::StatusOr<protozero::ConstBytes> ValidateSingleNonEmptyMessage(
   return single.protobuf();
 }
 
+// SQLite reports the writes to its schema tables when creating or dropping any
+// table: these must not be treated as dependencies.
+bool IsSchemaTable(const char* name) {
+  return base::StartsWith(name, "sqlite_");
+}
+
 }  // namespace
 
 ProtoBuilder::ProtoBuilder(const DescriptorPool* pool,
@@ -624,6 +631,130 @@ base::Status BuildProto::Run(BuildProto::Context* ctx,
   return base::OkStatus();
 }
 
+RunMetricCache::RunMetricCache() = default;
+
+RunMetricCache::~RunMetricCache() {
+  End();
+}
+
+void RunMetricCache::Begin(sqlite3* db) {
+  PERFETTO_DCHECK(!active());
+  db_ = db;
+  hits_ = 0;
+  sqlite3_set_authorizer(db_, &RunMetricCache::Authorize, this);
+}
+
+void RunMetricCache::End() {
+  if (!db_)
+    return;
+  sqlite3_set_authorizer(db_, nullptr, nullptr);
+  db_ = nullptr;
+  running_.clear();
+  completed_.clear();
+}
+
+bool RunMetricCache::Lookup(const std::string& key) {
+  auto it = completed_.find(key);
+  if (it == completed_.end())
+    return false;
+  // The invocations running now would have executed this one, so they depend
+  // on everything it does.
+  for (Run& run : running_) {
+    run.objects.insert(run.objects.end(), it->second.begin(),
+                       it->second.end());
+  }
+  hits_++;
+  return true;
+}
+
+void RunMetricCache::BeginRun(const std::string& key) {
+  running_.push_back(Run{key, {}});
+}
+
+void RunMetricCache::EndRun(bool success) {
+  PERFETTO_DCHECK(!running_.empty());
+  Run run = std::move(running_.back());
+  running_.pop_back();
+  if (!success)
+    return;
+  std::sort(run.objects.begin(), run.objects.end());
+  run.objects.erase(std::unique(run.objects.begin(), run.objects.end()),
+                    run.objects.end());
+  completed_[run.key] = std::move(run.objects);
+}
+
+void RunMetricCache::OnDefinition(const std::string& name,
+                                  const std::string& definition) {
+  auto it_and_inserted = definitions_.emplace(name, definition);
+  if (it_and_inserted.second || it_and_inserted.first->second == definition)
+    return;
+  it_and_inserted.first->second = definition;
+  completed_.clear();
+}
+
+// static
+int RunMetricCache::Authorize(void* self,
+                              int action,
+                              const char* arg1,
+                              const char* arg2,
+                              const char*,
+                              const char* trigger_or_view) {
+  auto* cache = static_cast<RunMetricCache*>(self);
+  switch (action) {
+    case SQLITE_READ:
+      cache->OnAccess(arg1);
+      cache->OnAccess(trigger_or_view);
+      break;
+    case SQLITE_CREATE_TABLE:
+    case SQLITE_CREATE_TEMP_TABLE:
+    case SQLITE_CREATE_VIEW:
+    case SQLITE_CREATE_TEMP_VIEW:
+    case SQLITE_CREATE_VTABLE:
+    case SQLITE_DROP_TABLE:
+    case SQLITE_DROP_TEMP_TABLE:
+    case SQLITE_DROP_VIEW:
+    case SQLITE_DROP_TEMP_VIEW:
+    case SQLITE_DROP_VTABLE:
+    case SQLITE_INSERT:
+    case SQLITE_UPDATE:
+    case SQLITE_DELETE:
+      cache->OnChange(arg1);
+      cache->OnAccess(arg1);
+      break;
+    case SQLITE_CREATE_INDEX:
+    case SQLITE_CREATE_TEMP_INDEX:
+    case SQLITE_DROP_INDEX:
+    case SQLITE_DROP_TEMP_INDEX:
+    case SQLITE_ALTER_TABLE:
+      // The table is the second argument for these.
+      cache->OnChange(arg2);
+      cache->OnAccess(arg2);
+      break;
+  }
+  return SQLITE_OK;
+}
+
+void RunMetricCache::OnAccess(const char* object) {
+  if (!object || running_.empty() || IsSchemaTable(object))
+    return;
+  std::string name = base::ToLower(object);
+  for (Run& run : running_)
+    run.objects.push_back(name);
+}
+
+void RunMetricCache::OnChange(const char* object) {
+  if (!object || completed_.empty() || IsSchemaTable(object))
+    return;
+  std::string name = base::ToLower(object);
+  for (auto it = completed_.begin(); it != completed_.end();) {
+    if (std::binary_search(it->second.begin(), it->second.end(), name)) {
+      it = completed_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
 base::Status RunMetric::Run(RunMetric::Context* ctx,
                             size_t argc,
                             sqlite3_value** argv,
@@ -667,7 +798,19 @@ base::Status RunMetric::Run(RunMetric::Context* ctx,
         metric_it->sql.c_str());
   }
 
+  RunMetricCache* cache = ctx->cache;
+  if (!cache->active()) {
+    auto res =
+        ctx->engine->Execute(SqlSource::FromMetricFile(subbed_sql, path));
+    return res.status();
+  }
+
+  std::string key = std::string(path) + '\0' + subbed_sql;
+  if (cache->Lookup(key))
+    return base::OkStatus();
+  cache->BeginRun(key);
   auto res = ctx->engine->Execute(SqlSource::FromMetricFile(subbed_sql, path));
+  cache->EndRun(res.ok());
   return res.status();
 }
 
@@ -721,11 +864,17 @@ base::Status UnwrapMetricProto::Run(Context*,
 }
 
 base::Status ComputeMetrics(PerfettoSqlEngine* engine,
+                            RunMetricCache* cache,
                             const std::vector<std::string>& metrics_to_compute,
                             const std::vector<SqlMetricFile>& sql_metrics,
                             const DescriptorPool& pool,
                             const ProtoDescriptor& root_descriptor,
                             std::vector<uint8_t>* metrics_proto) {
+  // The files run with RUN_METRIC by several of the metrics are only executed
+  // once across all of them.
+  cache->Begin(engine->sqlite_engine()->db());
+  auto end_cache = base::OnScopeExit([cache] { cache->End(); });
+
   ProtoBuilder metric_builder(&pool, &root_descriptor);
   for (const auto& name : metrics_to_compute) {
     auto metric_it =
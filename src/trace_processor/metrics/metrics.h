@@ -170,11 +170,77 @@ struct BuildProto : public SqlFunction {
                           Destructors&);
 };
 
+// Remembers the RUN_METRIC invocations executed while computing metrics, so
+// that files shared by many metrics (e.g. android/process_metadata.sql) are
+// executed once per ComputeMetrics() call rather than once per metric.
+//
+// An invocation is identified by its path and its SQL after substitutions.
+// It is only skipped while none of the tables and views it created or read
+// has been created, dropped or modified by the SQL which ran after it: this is
+// tracked with a SQLite authorizer on the connection. Uses of functions and
+// macros are not all visible to the authorizer, so redefining one of them
+// differently forgets all the invocations.
+// Visible for testing.
+class RunMetricCache {
+ public:
+  RunMetricCache();
+  ~RunMetricCache();
+
+  // Starts tracking the statements prepared on |db|: until End() is called,
+  // invocations which complete successfully are remembered.
+  void Begin(sqlite3* db);
+  void End();
+
+  bool active() const { return db_ != nullptr; }
+
+  // Returns true if the invocation identified by |key| can be skipped, as it
+  // already ran and nothing it depends on changed since.
+  bool Lookup(const std::string& key);
+
+  // Marks the start and the end of the execution of the invocation |key|.
+  // Invocations can nest, e.g. when a file calls RUN_METRIC.
+  void BeginRun(const std::string& key);
+  void EndRun(bool success);
+
+  // Called with the name and the definition of every function and macro
+  // created, whether or not the cache is active.
+  void OnDefinition(const std::string& name, const std::string& definition);
+
+  // Returns the number of invocations skipped since the last Begin().
+  uint32_t hits() const { return hits_; }
+
+ private:
+  struct Run {
+    std::string key;
+    std::vector<std::string> objects;
+  };
+
+  static int Authorize(void* self,
+                       int action,
+                       const char* arg1,
+                       const char* arg2,
+                       const char* db_name,
+                       const char* trigger_or_view);
+
+  // Records that the invocations currently running depend on |object|.
+  void OnAccess(const char* object);
+
+  // Forgets all the completed invocations which depend on |object|.
+  void OnChange(const char* object);
+
+  sqlite3* db_ = nullptr;
+  std::vector<Run> running_;
+  std::unordered_map<std::string, std::vector<std::string>> completed_;
+  std::unordered_map<std::string, std::string> definitions_;
+  uint32_t hits_ = 0;
+};
+
 // Implements the RUN_METRIC SQL function.
 struct RunMetric : public SqlFunction {
   struct Context {
     PerfettoSqlEngine* engine;
     std::vector<SqlMetricFile>* metrics;
+    RunMetricCache* cache;
   };
   static constexpr bool kVoidReturn = true;
   static base::Status Run(Context* ctx,
@@ -198,6 +264,7 @@ void RepeatedFieldStep(sqlite3_context* ctx, int argc, sqlite3_value** argv);
 void RepeatedFieldFinal(sqlite3_context* ctx);
 
 base::Status ComputeMetrics(PerfettoSqlEngine*,
+                            RunMetricCache*,
                             const std::vector<std::string>& metrics_to_compute,
                             const std::vector<SqlMetricFile>& metrics,
                             const DescriptorPool& pool,
@@ -17,6 +17,7 @@
 #include "src/trace_processor/metrics/metrics.h"
 
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -28,6 +29,9 @@
 #include "perfetto/trace_processor/basic_types.h"
 #include "protos/perfetto/common/descriptor.pbzero.h"
 #include "src/base/test/status_matchers.h"
+#include "src/trace_processor/containers/string_pool.h"
+#include "src/trace_processor/perfetto_sql/engine/perfetto_sql_engine.h"
+#include "src/trace_processor/sqlite/sql_source.h"
 #include "src/trace_processor/util/descriptors.h"
 #include "test/gtest_and_gmock.h"
 
@@ -320,5 +324,147 @@ TEST_F(ProtoBuilderTest, AppendEnums) {
   ASSERT_EQ(str_proto.Get(1).as_int32(), 2);
 }
 
+class RunMetricCacheTest : public ::testing::Test {
+ protected:
+  RunMetricCacheTest() {
+    engine_.set_definition_listener(
+        [this](const std::string& name, const std::string& definition) {
+          cache_.OnDefinition(name, definition);
+        });
+    auto status = engine_.RegisterStaticFunction<RunMetric>(
+        "RUN_METRIC", -1,
+        std::make_unique<RunMetric::Context>(
+            RunMetric::Context{&engine_, &metrics_, &cache_}));
+    PERFETTO_CHECK(status.ok());
+    Exec("CREATE PERFETTO TABLE src AS SELECT 1 AS x");
+    cache_.Begin(engine_.sqlite_engine()->db());
+  }
+
+  void AddMetric(const std::string& path, const std::string& sql) {
+    metrics_.push_back(SqlMetricFile{path, std::nullopt, std::nullopt, sql});
+  }
+
+  void Exec(const std::string& sql) {
+    auto res = engine_.Execute(SqlSource::FromExecuteQuery(sql));
+    ASSERT_TRUE(res.ok()) << res.status().c_message();
+  }
+
+  // Runs the metric file |path| and returns whether it was skipped.
+  bool RunAndCheckSkipped(const std::string& path) {
+    uint32_t hits = cache_.hits();
+    auto res = engine_.Execute(SqlSource::FromExecuteQuery(
+        "SELECT RUN_METRIC('" + path + "')"));
+    EXPECT_TRUE(res.ok()) << res.status().c_message();
+    return cache_.hits() > hits;
+  }
+
+  int64_t QueryLong(const std::string& sql) {
+    auto res = engine_.ExecuteUntilLastStatement(SqlSource::FromExecuteQuery(sql));
+    PERFETTO_CHECK(res.ok() && !res->stmt.IsDone());
+    return sqlite3_column_int64(res->stmt.sqlite_stmt(), 0);
+  }
+
+  StringPool pool_;
+  PerfettoSqlEngine engine_{&pool_};
+  std::vector<SqlMetricFile> metrics_;
+  RunMetricCache cache_;
+};
+
+TEST_F(RunMetricCacheTest, SkipsRepeatedRuns) {
+  AddMetric("a.sql",
+            "CREATE PERFETTO TABLE a_out AS SELECT x FROM src;"
+            "CREATE PERFETTO VIEW a_view AS SELECT x FROM a_out;");
+  ASSERT_FALSE(RunAndCheckSkipped("a.sql"));
+  ASSERT_TRUE(RunAndCheckSkipped("a.sql"));
+  ASSERT_TRUE(RunAndCheckSkipped("a.sql"));
+  ASSERT_EQ(cache_.hits(), 2u);
+
+  // Reading what the invocation created does not invalidate it.
+  ASSERT_EQ(QueryLong("SELECT x FROM a_view"), 1);
+  ASSERT_TRUE(RunAndCheckSkipped("a.sql"));
+}
+
+TEST_F(RunMetricCacheTest, InvalidatedByTableChanges) {
+  AddMetric("a.sql",
+            "DROP VIEW IF EXISTS a_view;"
+            "CREATE PERFETTO VIEW a_view AS SELECT x FROM src;");
+  ASSERT_FALSE(RunAndCheckSkipped("a.sql"));
+  Exec("DROP VIEW a_view");
+  ASSERT_FALSE(RunAndCheckSkipped("a.sql"));
+  ASSERT_EQ(QueryLong("SELECT x FROM a_view"), 1);
+
+  // Replacing a table the invocation read also invalidates it.
+  AddMetric("b.sql", "CREATE OR REPLACE PERFETTO TABLE b_out AS SELECT x FROM src;");
+  ASSERT_FALSE(RunAndCheckSkipped("b.sql"));
+  ASSERT_TRUE(RunAndCheckSkipped("b.sql"));
+  Exec("CREATE OR REPLACE PERFETTO TABLE src AS SELECT 2 AS x");
+  ASSERT_FALSE(RunAndCheckSkipped("b.sql"));
+  ASSERT_EQ(QueryLong("SELECT x FROM b_out"), 2);
+}
+
+TEST_F(RunMetricCacheTest, InvalidatedByFunctionChanges) {
+  AddMetric("f.sql",
+            "CREATE OR REPLACE PERFETTO FUNCTION f() RETURNS INT AS SELECT 1;");
+  AddMetric("g.sql", "CREATE OR REPLACE PERFETTO TABLE g_out AS SELECT f() AS x;");
+  ASSERT_FALSE(RunAndCheckSkipped("f.sql"));
+  ASSERT_FALSE(RunAndCheckSkipped("g.sql"));
+  ASSERT_TRUE(RunAndCheckSkipped("f.sql"));
+  ASSERT_TRUE(RunAndCheckSkipped("g.sql"));
+
+  // Defining the function again in the same way changes nothing.
+  Exec("CREATE OR REPLACE PERFETTO FUNCTION f() RETURNS INT AS SELECT 1");
+  ASSERT_TRUE(RunAndCheckSkipped("f.sql"));
+
+  // Redefining it differently forgets both the invocation which defined it and
+  // the one which used it.
+  Exec("CREATE OR REPLACE PERFETTO FUNCTION f() RETURNS INT AS SELECT 2");
+  ASSERT_FALSE(RunAndCheckSkipped("g.sql"));
+  ASSERT_EQ(QueryLong("SELECT x FROM g_out"), 2);
+  ASSERT_FALSE(RunAndCheckSkipped("f.sql"));
+  ASSERT_EQ(QueryLong("SELECT f()"), 1);
+}
+
+TEST_F(RunMetricCacheTest, InvalidatedByMacroChanges) {
+  AddMetric("m.sql",
+            "CREATE OR REPLACE PERFETTO MACRO m() RETURNS Expr AS 1;"
+            "CREATE OR REPLACE PERFETTO TABLE m_out AS SELECT m!() AS x;");
+  ASSERT_FALSE(RunAndCheckSkipped("m.sql"));
+  ASSERT_TRUE(RunAndCheckSkipped("m.sql"));
+  Exec("CREATE OR REPLACE PERFETTO MACRO m() RETURNS Expr AS 2");
+  ASSERT_FALSE(RunAndCheckSkipped("m.sql"));
+  ASSERT_EQ(QueryLong("SELECT x FROM m_out"), 1);
+}
+
+TEST_F(RunMetricCacheTest, NestedRuns) {
+  AddMetric("inner.sql",
+            "CREATE OR REPLACE PERFETTO TABLE inner_out AS SELECT x FROM src;");
+  AddMetric("outer.sql",
+            "SELECT RUN_METRIC('inner.sql');"
+            "CREATE OR REPLACE PERFETTO TABLE outer_out AS "
+            "SELECT x FROM inner_out;");
+  ASSERT_FALSE(RunAndCheckSkipped("outer.sql"));
+  ASSERT_TRUE(RunAndCheckSkipped("inner.sql"));
+  ASSERT_TRUE(RunAndCheckSkipped("outer.sql"));
+
+  // The outer invocation also depends on the tables created by the inner one.
+  Exec("DROP TABLE inner_out");
+  ASSERT_FALSE(RunAndCheckSkipped("outer.sql"));
+  ASSERT_EQ(QueryLong("SELECT x FROM outer_out"), 1);
+}
+
+TEST_F(RunMetricCacheTest, FailedRunsAndEnd) {
+  AddMetric("bad.sql", "SELECT * FROM does_not_exist;");
+  auto res = engine_.Execute(
+      SqlSource::FromExecuteQuery("SELECT RUN_METRIC('bad.sql')"));
+  ASSERT_FALSE(res.ok());
+  AddMetric("a.sql", "CREATE OR REPLACE PERFETTO TABLE a_out AS SELECT 1 AS x;");
+  ASSERT_FALSE(RunAndCheckSkipped("a.sql"));
+  ASSERT_EQ(cache_.hits(), 0u);
+
+  cache_.End();
+  ASSERT_FALSE(cache_.active());
+  ASSERT_FALSE(cache_.Lookup("a.sql"));
+}
+
 }  // namespace
 }  // namespace perfetto::trace_processor::metrics
@@ -16,6 +16,7 @@
 
 #include "src/trace_processor/perfetto_sql/engine/perfetto_sql_engine.h"
 
+#include <algorithm>
 #include <cctype>
 #include <cstddef>
 #include <cstdint>
@@ -182,8 +183,10 @@ PerfettoSqlEngine::PerfettoSqlEngine(StringPool* pool)
         return table->get();
       },
       [this](const std::string& name) {
-        bool res = runtime_tables_.Erase(name);
-        PERFETTO_CHECK(res);
+        auto* table = runtime_tables_.Find(name);
+        PERFETTO_CHECK(table);
+        OnIndexMemoryChanged((*table)->IndexMemoryBytes(), 0);
+        runtime_tables_.Erase(name);
       });
   engine_->RegisterVirtualTableModule<DbSqliteTable>(
       "runtime_table", std::move(context),
@@ -198,6 +201,14 @@ PerfettoSqlEngine::~PerfettoSqlEngine() {
   PERFETTO_CHECK(runtime_tables_.size() == 0);
 }
 
+void PerfettoSqlEngine::DropStaticTableIndexes() {
+  for (auto it = static_tables_.GetIterator(); it; ++it) {
+    uint64_t before = it.value()->IndexMemoryBytes();
+    it.value()->DropAllIndexes();
+    OnIndexMemoryChanged(before, 0);
+  }
+}
+
 void PerfettoSqlEngine::RegisterStaticTable(const Table& table,
                                             const std::string& table_name,
                                             Table::Schema schema) {
@@ -293,6 +304,16 @@ PerfettoSqlEngine::ExecuteUntilLastStatement(SqlSource sql_source) {
       auto sql = macro->sql;
       RETURN_IF_ERROR(ExecuteCreateMacro(*macro));
       source = RewriteToDummySql(sql);
+    } else if (auto* create_index = std::get_if<PerfettoSqlParser::CreateIndex>(
+                   &parser.statement())) {
+      RETURN_IF_ERROR(AddTracebackIfNeeded(ExecuteCreateIndex(*create_index),
+                                           parser.statement_sql()));
+      source = RewriteToDummySql(parser.statement_sql());
+    } else if (auto* drop_index = std::get_if<PerfettoSqlParser::DropIndex>(
+                   &parser.statement())) {
+      RETURN_IF_ERROR(AddTracebackIfNeeded(ExecuteDropIndex(*drop_index),
+                                           parser.statement_sql()));
+      source = RewriteToDummySql(parser.statement_sql());
     } else {
       // If none of the above matched, this must just be an SQL statement
       // directly executable by SQLite.
@@ -403,8 +424,12 @@ base::Status PerfettoSqlEngine::RegisterRuntimeFunction(
         std::move(created_fn_ctx)));
     runtime_function_count_++;
   }
-  return CreatedFunction::Prepare(ctx, std::move(prototype),
-                                  std::move(*opt_return_type), std::move(sql));
+  std::string definition = sql.sql();
+  RETURN_IF_ERROR(CreatedFunction::Prepare(
+      ctx, prototype, std::move(*opt_return_type), std::move(sql)));
+  NotifyDefinition(prototype.function_name,
+                   {prototype.ToString(), return_type_str, definition});
+  return base::OkStatus();
 }
 
 base::Status PerfettoSqlEngine::ExecuteCreateTable(
@@ -707,6 +732,8 @@ base::StatusOr<SqlSource> PerfettoSqlEngine::ExecuteCreateFunction(
       std::make_unique<RuntimeTableFunction::State>(std::move(state)));
   PERFETTO_CHECK(it_and_inserted.second);
 
+  NotifyDefinition(fn_name, {cf.prototype.ToString(), cf.returns, cf.sql.sql()});
+
   base::StackString<1024> create(
       "CREATE VIRTUAL TABLE %s USING runtime_table_function", fn_name.c_str());
   return cf.sql.RewriteAllIgnoreExisting(
@@ -736,8 +763,10 @@ base::Status PerfettoSqlEngine::ExecuteCreateMacro(
   }
 
   std::vector<std::string> args;
+  std::string args_definition;
   for (const auto& arg : create_macro.args) {
     args.push_back(arg.first.sql());
+    args_definition += arg.first.sql() + ' ' + arg.second.sql() + ',';
   }
   PerfettoSqlPreprocessor::Macro macro{
       create_macro.replace,
@@ -752,11 +781,14 @@ base::Status PerfettoSqlEngine::ExecuteCreateMacro(
                              create_macro.name.AsTraceback(0).c_str());
     }
     *it = std::move(macro);
-    return base::OkStatus();
+  } else {
+    std::string name = macro.name;
+    auto it_and_inserted = macros_.Insert(std::move(name), std::move(macro));
+    PERFETTO_CHECK(it_and_inserted.second);
   }
-  std::string name = macro.name;
-  auto it_and_inserted = macros_.Insert(std::move(name), std::move(macro));
-  PERFETTO_CHECK(it_and_inserted.second);
+  NotifyDefinition(create_macro.name.sql(),
+                   {args_definition, create_macro.returns.sql(),
+                    create_macro.sql.sql()});
   return base::OkStatus();
 }
 
@@ -858,6 +890,95 @@ base::Status PerfettoSqlEngine::ValidateColumnNames(
       base::Join(columns_missing_from_schema, ", ").c_str());
 }
 
+base::Status PerfettoSqlEngine::ExecuteCreateIndex(
+    const PerfettoSqlParser::CreateIndex& index) {
+  PERFETTO_TP_TRACE(metatrace::Category::QUERY_TIMELINE,
+                    "CREATE_PERFETTO_INDEX",
+                    [&index](metatrace::Record* record) {
+                      record->AddArg("Index", index.name);
+                      record->AddArg("Table", index.table_name);
+                    });
+  const Table* table = GetRuntimeTableOrNull(index.table_name);
+  if (!table) {
+    table = GetStaticTableOrNull(index.table_name);
+  }
+  if (!table) {
+    return base::ErrStatus("CREATE PERFETTO INDEX: table '%s' not found",
+                           index.table_name.c_str());
+  }
+  if (!index.replace && table->GetIndex(index.name)) {
+    return base::ErrStatus(
+        "CREATE PERFETTO INDEX: index '%s' already exists on table '%s'",
+        index.name.c_str(), index.table_name.c_str());
+  }
+
+  const auto& cols = table->columns();
+  auto it = std::find_if(cols.begin(), cols.end(), [&index](const auto& col) {
+    return base::CaseInsensitiveEqual(col.name(), index.column_name);
+  });
+  if (it == cols.end()) {
+    return base::ErrStatus(
+        "CREATE PERFETTO INDEX: column '%s' not found in table '%s'",
+        index.column_name.c_str(), index.table_name.c_str());
+  }
+  if (it->IsDummy()) {
+    return base::ErrStatus(
+        "CREATE PERFETTO INDEX: column '%s' in table '%s' cannot be indexed",
+        index.column_name.c_str(), index.table_name.c_str());
+  }
+  uint64_t before = table->IndexMemoryBytes();
+  table->CreateIndex(index.name, it->index_in_table());
+  OnIndexMemoryChanged(before, table->IndexMemoryBytes());
+  return base::OkStatus();
+}
+
+base::Status PerfettoSqlEngine::ExecuteDropIndex(
+    const PerfettoSqlParser::DropIndex& index) {
+  PERFETTO_TP_TRACE(metatrace::Category::QUERY_TIMELINE, "DROP_PERFETTO_INDEX",
+                    [&index](metatrace::Record* record) {
+                      record->AddArg("Index", index.name);
+                      record->AddArg("Table", index.table_name);
+                    });
+  const Table* table = GetRuntimeTableOrNull(index.table_name);
+  if (!table) {
+    table = GetStaticTableOrNull(index.table_name);
+  }
+  if (!table) {
+    return base::ErrStatus("DROP PERFETTO INDEX: table '%s' not found",
+                           index.table_name.c_str());
+  }
+  uint64_t before = table->IndexMemoryBytes();
+  if (!table->DropIndex(index.name)) {
+    return base::ErrStatus(
+        "DROP PERFETTO INDEX: index '%s' not found on table '%s'",
+        index.name.c_str(), index.table_name.c_str());
+  }
+  OnIndexMemoryChanged(before, table->IndexMemoryBytes());
+  return base::OkStatus();
+}
+
+void PerfettoSqlEngine::NotifyDefinition(
+    const std::string& name,
+    std::initializer_list<std::string> parts) {
+  if (!definition_listener_) {
+    return;
+  }
+  std::string definition;
+  for (const std::string& part : parts) {
+    definition += part;
+    definition += '\0';
+  }
+  definition_listener_(base::ToLower(name), definition);
+}
+
+void PerfettoSqlEngine::OnIndexMemoryChanged(uint64_t before, uint64_t after) {
+  PERFETTO_DCHECK(index_memory_bytes_ >= before);
+  index_memory_bytes_ = index_memory_bytes_ - before + after;
+  if (index_memory_listener_) {
+    index_memory_listener_(index_memory_bytes_);
+  }
+}
+
 const RuntimeTable* PerfettoSqlEngine::GetRuntimeTableOrNull(
     std::string_view name) const {
   auto table_ptr = runtime_tables_.Find(name.data());
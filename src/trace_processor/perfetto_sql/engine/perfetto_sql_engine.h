@@ -18,6 +18,8 @@
 #define SRC_TRACE_PROCESSOR_PERFETTO_SQL_ENGINE_PERFETTO_SQL_ENGINE_H_
 
 #include <cstdint>
+#include <functional>
+#include <initializer_list>
 #include <memory>
 #include <optional>
 #include <string>
@@ -175,6 +177,28 @@ class PerfettoSqlEngine {
   // Find static table registered with engine with provided name.
   const Table* GetStaticTableOrNull(std::string_view) const;
 
+  // Returns the number of bytes used by all indices created with
+  // CREATE PERFETTO INDEX.
+  uint64_t IndexMemoryBytes() const { return index_memory_bytes_; }
+
+  // Sets a function which is called with the name and the definition of
+  // every function and macro created (or replaced) by SQL.
+  void set_definition_listener(
+      std::function<void(const std::string& name,
+                         const std::string& definition)> listener) {
+    definition_listener_ = std::move(listener);
+  }
+
+  // Drops all the indices created on static tables. Static tables outlive
+  // the engine so this needs to be called before replacing it with a new one.
+  void DropStaticTableIndexes();
+
+  // Sets a function which is called with the value of IndexMemoryBytes()
+  // every time an index is created or dropped.
+  void set_index_memory_listener(std::function<void(uint64_t)> listener) {
+    index_memory_listener_ = std::move(listener);
+  }
+
  private:
   base::StatusOr<SqlSource> ExecuteCreateFunction(
       const PerfettoSqlParser::CreateFunction&,
@@ -191,6 +215,21 @@ class PerfettoSqlEngine {
 
   base::Status ExecuteCreateMacro(const PerfettoSqlParser::CreateMacro&);
 
+  // Builds an index on a column of a static or runtime table.
+  base::Status ExecuteCreateIndex(const PerfettoSqlParser::CreateIndex&);
+
+  // Drops an index created with CREATE PERFETTO INDEX.
+  base::Status ExecuteDropIndex(const PerfettoSqlParser::DropIndex&);
+
+  // Calls the definition listener, if any, with |parts| joined as the
+  // definition.
+  void NotifyDefinition(const std::string& name,
+                        std::initializer_list<std::string> parts);
+
+  // Updates IndexMemoryBytes() after the indices of a table changed from
+  // using |before| bytes to using |after| bytes.
+  void OnIndexMemoryChanged(uint64_t before, uint64_t after);
+
   template <typename Function>
   base::Status RegisterFunctionWithSqlite(
       const char* name,
@@ -229,6 +268,10 @@ class PerfettoSqlEngine {
 
   uint64_t static_function_count_ = 0;
   uint64_t runtime_function_count_ = 0;
+  uint64_t index_memory_bytes_ = 0;
+  std::function<void(uint64_t)> index_memory_listener_;
+  std::function<void(const std::string&, const std::string&)>
+      definition_listener_;
 
   base::FlatHashMap<std::string, std::unique_ptr<RuntimeTableFunction::State>>
       runtime_table_fn_states_;
@@ -172,6 +172,86 @@ TEST_F(PerfettoSqlEngineTest, Table_Duplicates) {
   ASSERT_TRUE(res.ok()) << res.status().c_message();
 }
 
+TEST_F(PerfettoSqlEngineTest, Index_Create) {
+  auto res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO TABLE foo AS SELECT 1 as bar UNION ALL SELECT 2;"
+      "CREATE PERFETTO INDEX foo_bar ON foo(bar)"));
+  ASSERT_TRUE(res.ok()) << res.status().c_message();
+  ASSERT_GT(engine_.IndexMemoryBytes(), 0u);
+
+  auto stmt = engine_.ExecuteUntilLastStatement(
+      SqlSource::FromExecuteQuery("SELECT bar FROM foo WHERE bar > 1"));
+  ASSERT_TRUE(stmt.ok()) << stmt.status().c_message();
+  ASSERT_FALSE(stmt->stmt.IsDone());
+  ASSERT_EQ(sqlite3_column_int64(stmt->stmt.sqlite_stmt(), 0), 2);
+  ASSERT_FALSE(stmt->stmt.Step());
+}
+
+TEST_F(PerfettoSqlEngineTest, Index_Duplicates) {
+  auto res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO TABLE foo AS SELECT 1 as bar;"
+      "CREATE PERFETTO INDEX foo_bar ON foo(bar)"));
+  ASSERT_TRUE(res.ok()) << res.status().c_message();
+
+  res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO INDEX foo_bar ON foo(bar)"));
+  ASSERT_FALSE(res.ok());
+
+  res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE OR REPLACE PERFETTO INDEX foo_bar ON foo(bar)"));
+  ASSERT_TRUE(res.ok()) << res.status().c_message();
+}
+
+TEST_F(PerfettoSqlEngineTest, Index_Drop) {
+  uint64_t reported_bytes = 0;
+  engine_.set_index_memory_listener(
+      [&reported_bytes](uint64_t bytes) { reported_bytes = bytes; });
+
+  auto res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO TABLE foo AS SELECT 1 as bar UNION ALL SELECT 2;"
+      "CREATE PERFETTO INDEX foo_bar ON foo(bar)"));
+  ASSERT_TRUE(res.ok()) << res.status().c_message();
+  ASSERT_GT(reported_bytes, 0u);
+  ASSERT_EQ(reported_bytes, engine_.IndexMemoryBytes());
+
+  res = engine_.Execute(
+      SqlSource::FromExecuteQuery("DROP PERFETTO INDEX foo_bar ON foo"));
+  ASSERT_TRUE(res.ok()) << res.status().c_message();
+  ASSERT_EQ(reported_bytes, 0u);
+  ASSERT_EQ(engine_.IndexMemoryBytes(), 0u);
+
+  res = engine_.Execute(
+      SqlSource::FromExecuteQuery("DROP PERFETTO INDEX foo_bar ON foo"));
+  ASSERT_FALSE(res.ok());
+}
+
+TEST_F(PerfettoSqlEngineTest, Index_DropTable) {
+  uint64_t reported_bytes = 0;
+  engine_.set_index_memory_listener(
+      [&reported_bytes](uint64_t bytes) { reported_bytes = bytes; });
+
+  auto res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO TABLE foo AS SELECT 1 as bar;"
+      "CREATE PERFETTO INDEX foo_bar ON foo(bar)"));
+  ASSERT_TRUE(res.ok()) << res.status().c_message();
+  ASSERT_GT(reported_bytes, 0u);
+
+  res = engine_.Execute(SqlSource::FromExecuteQuery("DROP TABLE foo"));
+  ASSERT_TRUE(res.ok()) << res.status().c_message();
+  ASSERT_EQ(reported_bytes, 0u);
+}
+
+TEST_F(PerfettoSqlEngineTest, Index_Invalid) {
+  auto res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO INDEX foo_bar ON foo(bar)"));
+  ASSERT_FALSE(res.ok());
+
+  res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO TABLE foo AS SELECT 1 as bar;"
+      "CREATE PERFETTO INDEX foo_baz ON foo(baz)"));
+  ASSERT_FALSE(res.ok());
+}
+
 TEST_F(PerfettoSqlEngineTest, View_Create) {
   auto res = engine_.Execute(SqlSource::FromExecuteQuery(
       "CREATE PERFETTO VIEW foo AS SELECT 42 AS bar"));
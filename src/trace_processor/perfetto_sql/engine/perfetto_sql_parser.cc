@@ -48,6 +48,8 @@ enum class State {
   kCreateOrReplace,
   kCreateOrReplacePerfetto,
   kCreatePerfetto,
+  kDrop,
+  kDropPerfetto,
   kPassthrough,
 };
 
@@ -153,6 +155,8 @@ bool PerfettoSqlParser::Next() {
           state = State::kCreate;
         } else if (TokenIsCustomKeyword("include", token)) {
           state = State::kInclude;
+        } else if (TokenIsSqliteKeyword("drop", token)) {
+          state = State::kDrop;
         } else {
           state = State::kPassthrough;
         }
@@ -172,6 +176,19 @@ bool PerfettoSqlParser::Next() {
           return ErrorAtToken(token,
                               "Use 'INCLUDE PERFETTO MODULE {include_key}'.");
         }
+      case State::kDrop:
+        state = TokenIsCustomKeyword("perfetto", token) ? State::kDropPerfetto
+                                                        : State::kPassthrough;
+        break;
+      case State::kDropPerfetto:
+        if (TokenIsSqliteKeyword("index", token)) {
+          return ParseDropPerfettoIndex(*first_non_space_token);
+        } else {
+          base::StackString<1024> err(
+              "Expected 'INDEX' after 'DROP PERFETTO', received '%*s'.",
+              static_cast<int>(token.str.size()), token.str.data());
+          return ErrorAtToken(token, err.c_str());
+        }
       case State::kCreate:
         if (TokenIsSqliteKeyword("trigger", token)) {
           // TODO(lalitm): add this to the "errors" documentation page
@@ -213,9 +230,12 @@ bool PerfettoSqlParser::Next() {
         if (TokenIsCustomKeyword("macro", token)) {
           return ParseCreatePerfettoMacro(replace);
         }
+        if (TokenIsSqliteKeyword("index", token)) {
+          return ParseCreatePerfettoIndex(replace, *first_non_space_token);
+        }
         base::StackString<1024> err(
-            "Expected 'FUNCTION', 'TABLE' or 'MACRO' after 'CREATE PERFETTO', "
-            "received '%*s'.",
+            "Expected 'FUNCTION', 'TABLE', 'VIEW', 'MACRO' or 'INDEX' after "
+            "'CREATE PERFETTO', received '%*s'.",
             static_cast<int>(token.str.size()), token.str.data());
         return ErrorAtToken(token, err.c_str());
     }
@@ -367,6 +387,97 @@ bool PerfettoSqlParser::ParseCreatePerfettoFunction(
   return true;
 }
 
+bool PerfettoSqlParser::ParseCreatePerfettoIndex(bool replace,
+                                                 Token first_non_space_token) {
+  Token index_name = tokenizer_.NextNonWhitespace();
+  if (index_name.token_type != SqliteTokenType::TK_ID) {
+    base::StackString<1024> err("Invalid index name %.*s",
+                                static_cast<int>(index_name.str.size()),
+                                index_name.str.data());
+    return ErrorAtToken(index_name, err.c_str());
+  }
+
+  if (Token on = tokenizer_.NextNonWhitespace();
+      !TokenIsSqliteKeyword("on", on)) {
+    return ErrorAtToken(on, "Expected keyword 'ON'");
+  }
+
+  Token table_name = tokenizer_.NextNonWhitespace();
+  if (table_name.token_type != SqliteTokenType::TK_ID) {
+    base::StackString<1024> err("Invalid table name %.*s",
+                                static_cast<int>(table_name.str.size()),
+                                table_name.str.data());
+    return ErrorAtToken(table_name, err.c_str());
+  }
+
+  // TK_LP == '(' (i.e. left parenthesis).
+  if (Token lp = tokenizer_.NextNonWhitespace();
+      lp.token_type != SqliteTokenType::TK_LP) {
+    return ErrorAtToken(lp, "Malformed index definition: '(' expected");
+  }
+
+  Token column_name = tokenizer_.NextNonWhitespace();
+  if (column_name.token_type != SqliteTokenType::TK_ID) {
+    base::StackString<1024> err("Invalid column name %.*s",
+                                static_cast<int>(column_name.str.size()),
+                                column_name.str.data());
+    return ErrorAtToken(column_name, err.c_str());
+  }
+
+  // TK_RP == ')' (i.e. right parenthesis).
+  if (Token rp = tokenizer_.NextNonWhitespace();
+      rp.token_type != SqliteTokenType::TK_RP) {
+    return ErrorAtToken(
+        rp, "Malformed index definition: only one column can be indexed");
+  }
+
+  Token terminal = tokenizer_.NextNonWhitespace();
+  if (!terminal.IsTerminal()) {
+    return ErrorAtToken(terminal,
+                        "Unexpected token after index definition: expected ';'");
+  }
+
+  statement_ = CreateIndex{replace, std::string(index_name.str),
+                           std::string(table_name.str),
+                           std::string(column_name.str)};
+  statement_sql_ = tokenizer_.Substr(first_non_space_token, terminal);
+  return true;
+}
+
+bool PerfettoSqlParser::ParseDropPerfettoIndex(Token first_non_space_token) {
+  Token index_name = tokenizer_.NextNonWhitespace();
+  if (index_name.token_type != SqliteTokenType::TK_ID) {
+    base::StackString<1024> err("Invalid index name %.*s",
+                                static_cast<int>(index_name.str.size()),
+                                index_name.str.data());
+    return ErrorAtToken(index_name, err.c_str());
+  }
+
+  if (Token on = tokenizer_.NextNonWhitespace();
+      !TokenIsSqliteKeyword("on", on)) {
+    return ErrorAtToken(on, "Expected keyword 'ON'");
+  }
+
+  Token table_name = tokenizer_.NextNonWhitespace();
+  if (table_name.token_type != SqliteTokenType::TK_ID) {
+    base::StackString<1024> err("Invalid table name %.*s",
+                                static_cast<int>(table_name.str.size()),
+                                table_name.str.data());
+    return ErrorAtToken(table_name, err.c_str());
+  }
+
+  Token terminal = tokenizer_.NextNonWhitespace();
+  if (!terminal.IsTerminal()) {
+    return ErrorAtToken(terminal,
+                        "Unexpected token after index name: expected ';'");
+  }
+
+  statement_ = DropIndex{std::string(index_name.str),
+                         std::string(table_name.str)};
+  statement_sql_ = tokenizer_.Substr(first_non_space_token, terminal);
+  return true;
+}
+
 bool PerfettoSqlParser::ParseCreatePerfettoMacro(bool replace) {
   Token name = tokenizer_.NextNonWhitespace();
   if (name.token_type != SqliteTokenType::TK_ID) {
@@ -91,12 +91,28 @@ class PerfettoSqlParser {
     SqlSource returns;
     SqlSource sql;
   };
+  // Indicates that the specified SQL was a CREATE PERFETTO INDEX statement
+  // with the following parameters.
+  struct CreateIndex {
+    bool replace;
+    std::string name;
+    std::string table_name;
+    std::string column_name;
+  };
+  // Indicates that the specified SQL was a DROP PERFETTO INDEX statement
+  // with the following parameters.
+  struct DropIndex {
+    std::string name;
+    std::string table_name;
+  };
   using Statement = std::variant<SqliteSql,
                                  CreateFunction,
                                  CreateTable,
                                  CreateView,
                                  Include,
-                                 CreateMacro>;
+                                 CreateMacro,
+                                 CreateIndex,
+                                 DropIndex>;
 
   // Creates a new SQL parser with the a block of PerfettoSQL statements.
   // Concretely, the passed string can contain >1 statement.
@@ -162,6 +178,11 @@ class PerfettoSqlParser {
 
   bool ParseCreatePerfettoMacro(bool replace);
 
+  bool ParseCreatePerfettoIndex(bool replace,
+                                SqliteTokenizer::Token first_non_space_token);
+
+  bool ParseDropPerfettoIndex(SqliteTokenizer::Token first_non_space_token);
+
   // Convert a "raw" argument (i.e. one that points to specific tokens) to the
   // argument definition consumed by the rest of the SQL code.
   // Guarantees to call ErrorAtToken if std::nullopt is returned.
@@ -16,6 +16,7 @@
 
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/connected_flow.h"
 
+#include <algorithm>
 #include <cinttypes>
 #include <cstddef>
 #include <cstdint>
@@ -32,8 +33,8 @@
 #include "perfetto/trace_processor/basic_types.h"
 #include "src/trace_processor/db/column_storage.h"
 #include "src/trace_processor/db/table.h"
-#include "src/trace_processor/db/typed_column.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/ancestor.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/csr_graph.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/descendant.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/tables_py.h"
 #include "src/trace_processor/storage/trace_storage.h"
@@ -70,7 +71,7 @@ enum RelativesVisitMode : uint8_t {
 
 // Searches through the slice table recursively to find connected flows.
 // Usage:
-//  BFS bfs = BFS(context);
+//  BFS bfs = BFS(storage, outgoing_flows, incoming_flows);
 //  bfs
 //    // Add list of slices to start with.
 //    .Start(start_id).Start(start_id2)
@@ -82,7 +83,12 @@ enum RelativesVisitMode : uint8_t {
 //  bfs.TakeResultingFlows();
 class BFS {
  public:
-  explicit BFS(const TraceStorage* storage) : storage_(storage) {}
+  BFS(const TraceStorage* storage,
+      const CsrGraph& outgoing_flows,
+      const CsrGraph& incoming_flows)
+      : storage_(storage),
+        outgoing_flows_(&outgoing_flows),
+        incoming_flows_(&incoming_flows) {}
 
   std::vector<tables::FlowTable::RowNumber> TakeResultingFlows() && {
     return std::move(flow_rows_);
@@ -154,18 +160,18 @@ class BFS {
   void GoByFlow(SliceId slice_id, FlowDirection flow_direction) {
     PERFETTO_DCHECK(known_slices_.count(slice_id) != 0);
 
-    const auto& flow = storage_->flow_table();
-
-    const TypedColumn<SliceId>& start_col =
-        flow_direction == FlowDirection::OUTGOING ? flow.slice_out()
-                                                  : flow.slice_in();
-    auto it = flow.FilterToIterator({start_col.eq(slice_id.value)});
-    for (; it; ++it) {
-      flow_rows_.push_back(it.row_number());
+    const CsrGraph& flows = flow_direction == FlowDirection::OUTGOING
+                                ? *outgoing_flows_
+                                : *incoming_flows_;
+    if (slice_id.value >= flows.node_count()) {
+      // The slice is not connected to any flow.
+      return;
+    }
+    CsrGraph::EdgeRange edges = flows.OutgoingEdges(slice_id.value);
+    for (size_t i = 0; i < edges.size(); ++i) {
+      flow_rows_.push_back(tables::FlowTable::RowNumber(edges.edge(i)));
 
-      SliceId next_slice_id = flow_direction == FlowDirection::OUTGOING
-                                  ? it.slice_in()
-                                  : it.slice_out();
+      SliceId next_slice_id(edges.node(i));
       if (known_slices_.count(next_slice_id))
         continue;
 
@@ -194,6 +200,8 @@ class BFS {
   std::vector<tables::FlowTable::RowNumber> flow_rows_;
 
   const TraceStorage* storage_;
+  const CsrGraph* outgoing_flows_;
+  const CsrGraph* incoming_flows_;
 };
 
 }  // namespace
@@ -219,7 +227,8 @@ base::StatusOr<std::unique_ptr<Table>> ConnectedFlow::ComputeTable(
                            static_cast<uint32_t>(start_id.value));
   }
 
-  BFS bfs(storage_);
+  const FlowGraph& flow_graph = GetFlowGraph();
+  BFS bfs(storage_, flow_graph.outgoing, flow_graph.incoming);
   switch (mode_) {
     case Mode::kDirectlyConnectedFlow:
       bfs.Start(start_id).VisitAll(VISIT_INCOMING_AND_OUTGOING,
@@ -245,6 +254,28 @@ base::StatusOr<std::unique_ptr<Table>> ConnectedFlow::ComputeTable(
       flow, result_rows, std::move(start_ids));
 }
 
+const ConnectedFlow::FlowGraph& ConnectedFlow::GetFlowGraph() {
+  const auto& flow = storage_->flow_table();
+  if (flow_graph_ && flow_graph_->flow_row_count == flow.row_count()) {
+    return *flow_graph_;
+  }
+
+  std::vector<uint32_t> slice_out(flow.row_count());
+  std::vector<uint32_t> slice_in(flow.row_count());
+  uint32_t node_count = 0;
+  for (uint32_t i = 0; i < flow.row_count(); ++i) {
+    slice_out[i] = flow.slice_out()[i].value;
+    slice_in[i] = flow.slice_in()[i].value;
+    node_count = std::max(node_count, std::max(slice_out[i], slice_in[i]) + 1);
+  }
+  FlowGraph graph;
+  graph.outgoing = CsrGraph::FromEdges(slice_out, slice_in, node_count);
+  graph.incoming = graph.outgoing.Reverse();
+  graph.flow_row_count = flow.row_count();
+  flow_graph_ = std::move(graph);
+  return *flow_graph_;
+}
+
 Table::Schema ConnectedFlow::CreateSchema() {
   return tables::ConnectedFlowTable::ComputeStaticSchema();
 }
@@ -19,12 +19,14 @@
 
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 #include "perfetto/ext/base/status_or.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "src/trace_processor/db/table.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/csr_graph.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/static_table_function.h"
 #include "src/trace_processor/storage/trace_storage.h"
 
@@ -60,8 +62,23 @@ class ConnectedFlow : public StaticTableFunction {
       const std::vector<SqlValue>& arguments) override;
 
  private:
+  // The slices connected by flows, with one edge per row of the flow table
+  // (i.e. the index of each edge is the row number of the flow).
+  struct FlowGraph {
+    CsrGraph outgoing;
+    CsrGraph incoming;
+    // The number of rows of the flow table when the graph was built: as the
+    // table is append only, the graph is up-to-date as long as this matches.
+    uint32_t flow_row_count = 0;
+  };
+
+  // Returns the flow graph, building it if it doesn't exist yet or if flows
+  // were added since it was built.
+  const FlowGraph& GetFlowGraph();
+
   Mode mode_;
   const TraceStorage* storage_ = nullptr;
+  std::optional<FlowGraph> flow_graph_;
 };
 
 }  // namespace perfetto::trace_processor
@@ -45,5 +45,25 @@ TEST(ConnectedFlow, SliceTableNullConstraint) {
   ASSERT_EQ(res->get()->row_count(), 0u);
 }
 
+TEST(ConnectedFlow, SeesFlowsAddedAfterFirstQuery) {
+  TraceStorage storage;
+  SliceId s0 = storage.mutable_slice_table()->Insert({}).id;
+  SliceId s1 = storage.mutable_slice_table()->Insert({}).id;
+  SliceId s2 = storage.mutable_slice_table()->Insert({}).id;
+  storage.mutable_flow_table()->Insert({s0, s1, 0});
+
+  ConnectedFlow generator{ConnectedFlow::Mode::kDirectlyConnectedFlow,
+                          &storage};
+  base::StatusOr<std::unique_ptr<Table>> res =
+      generator.ComputeTable({SqlValue::Long(s0.value)});
+  ASSERT_OK(res);
+  ASSERT_EQ(res->get()->row_count(), 1u);
+
+  storage.mutable_flow_table()->Insert({s1, s2, 0});
+  res = generator.ComputeTable({SqlValue::Long(s0.value)});
+  ASSERT_OK(res);
+  ASSERT_EQ(res->get()->row_count(), 2u);
+}
+
 }  // namespace
 }  // namespace perfetto::trace_processor
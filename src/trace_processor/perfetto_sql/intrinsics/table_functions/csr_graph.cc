@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/csr_graph.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto::trace_processor {
+
+CsrGraph::CsrGraph() : offsets_(1, 0) {}
+CsrGraph::~CsrGraph() = default;
+
+CsrGraph::CsrGraph(CsrGraph&&) noexcept = default;
+CsrGraph& CsrGraph::operator=(CsrGraph&&) noexcept = default;
+
+// static
+CsrGraph CsrGraph::FromEdges(const std::vector<uint32_t>& sources,
+                             const std::vector<uint32_t>& dests,
+                             uint32_t node_count) {
+  PERFETTO_DCHECK(sources.size() == dests.size());
+
+  // Counting sort of the edges by source node: as the edges are placed in
+  // index order, the edges of each node stay in the order they were given in.
+  CsrGraph graph;
+  graph.offsets_.assign(node_count + 1, 0);
+  for (uint32_t source : sources) {
+    PERFETTO_DCHECK(source < node_count);
+    graph.offsets_[source + 1]++;
+  }
+  for (uint32_t i = 0; i < node_count; ++i) {
+    graph.offsets_[i + 1] += graph.offsets_[i];
+  }
+
+  graph.dest_nodes_.resize(sources.size());
+  graph.edge_indices_.resize(sources.size());
+  std::vector<uint32_t> next(graph.offsets_.begin(), graph.offsets_.end() - 1);
+  for (uint32_t i = 0; i < sources.size(); ++i) {
+    PERFETTO_DCHECK(dests[i] < node_count);
+    uint32_t pos = next[sources[i]]++;
+    graph.dest_nodes_[pos] = dests[i];
+    graph.edge_indices_[pos] = i;
+  }
+  return graph;
+}
+
+CsrGraph CsrGraph::Reverse() const {
+  // Rebuild the edge list in index order, so the incoming edges of each node
+  // also end up in index order.
+  std::vector<uint32_t> sources(edge_count());
+  std::vector<uint32_t> dests(edge_count());
+  for (uint32_t n = 0; n < node_count(); ++n) {
+    EdgeRange edges = OutgoingEdges(n);
+    for (size_t i = 0; i < edges.size(); ++i) {
+      sources[edges.edge(i)] = edges.node(i);
+      dests[edges.edge(i)] = n;
+    }
+  }
+  return FromEdges(sources, dests, node_count());
+}
+
+}  // namespace perfetto::trace_processor
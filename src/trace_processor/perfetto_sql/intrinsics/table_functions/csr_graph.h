@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_CSR_GRAPH_H_
+#define SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_CSR_GRAPH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto::trace_processor {
+
+// A directed graph stored in compressed sparse row form: the outgoing edges
+// of all the nodes are kept in two flat arrays, sorted by source node and,
+// for the same source, in the order they were given in.
+//
+// This is the representation used by the graph table functions (dfs,
+// dominator_tree, the *_flow functions...) as, compared to a vector of
+// neighbours per node, it needs two allocations in total and all the edges of
+// a node are contiguous in memory.
+//
+// Nodes are identified by integers in the range [0, node_count()) and edges
+// by their index in the list the graph was built from: this allows callers to
+// keep any payload for the edges (e.g. the row of the table defining the edge)
+// in a separate array.
+class CsrGraph {
+ public:
+  // The edges going out of a node.
+  class EdgeRange {
+   public:
+    EdgeRange(const uint32_t* nodes, const uint32_t* edges, size_t size)
+        : nodes_(nodes), edges_(edges), size_(size) {}
+
+    // Returns the number of edges.
+    size_t size() const { return size_; }
+
+    // Returns the node at the other end of the |i|-th edge.
+    uint32_t node(size_t i) const { return nodes_[i]; }
+
+    // Returns the index of the |i|-th edge in the list the graph was built
+    // from.
+    uint32_t edge(size_t i) const { return edges_[i]; }
+
+    // Allows iterating over the neighbouring nodes with a range-based for.
+    const uint32_t* begin() const { return nodes_; }
+    const uint32_t* end() const { return nodes_ + size_; }
+
+   private:
+    const uint32_t* nodes_;
+    const uint32_t* edges_;
+    size_t size_;
+  };
+
+  // Builds the graph with the edges |sources[i]| -> |dests[i]|. All the node
+  // ids must be smaller than |node_count|.
+  static CsrGraph FromEdges(const std::vector<uint32_t>& sources,
+                            const std::vector<uint32_t>& dests,
+                            uint32_t node_count);
+
+  CsrGraph();
+  ~CsrGraph();
+
+  CsrGraph(CsrGraph&&) noexcept;
+  CsrGraph& operator=(CsrGraph&&) noexcept;
+
+  // Returns the graph with the direction of all the edges reversed, keeping
+  // their indices.
+  CsrGraph Reverse() const;
+
+  // Returns the edges going out of |node|.
+  EdgeRange OutgoingEdges(uint32_t node) const {
+    PERFETTO_DCHECK(node < node_count());
+    uint32_t begin = offsets_[node];
+    return EdgeRange(dest_nodes_.data() + begin, edge_indices_.data() + begin,
+                     offsets_[node + 1] - begin);
+  }
+
+  uint32_t node_count() const {
+    return static_cast<uint32_t>(offsets_.size() - 1);
+  }
+  size_t edge_count() const { return dest_nodes_.size(); }
+
+ private:
+  // The outgoing edges of node |n| are at [offsets_[n], offsets_[n + 1]) in
+  // the arrays below.
+  std::vector<uint32_t> offsets_;
+  std::vector<uint32_t> dest_nodes_;
+  std::vector<uint32_t> edge_indices_;
+};
+
+}  // namespace perfetto::trace_processor
+
+#endif  // SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_CSR_GRAPH_H_
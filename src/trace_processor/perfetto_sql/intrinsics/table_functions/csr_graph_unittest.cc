@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/csr_graph.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto::trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+std::vector<uint32_t> Nodes(const CsrGraph::EdgeRange& edges) {
+  return std::vector<uint32_t>(edges.begin(), edges.end());
+}
+
+std::vector<uint32_t> Edges(const CsrGraph::EdgeRange& edges) {
+  std::vector<uint32_t> res;
+  for (size_t i = 0; i < edges.size(); ++i) {
+    res.push_back(edges.edge(i));
+  }
+  return res;
+}
+
+TEST(CsrGraph, Empty) {
+  CsrGraph graph = CsrGraph::FromEdges({}, {}, 0);
+  ASSERT_EQ(graph.node_count(), 0u);
+  ASSERT_EQ(graph.edge_count(), 0u);
+  ASSERT_EQ(CsrGraph().node_count(), 0u);
+}
+
+TEST(CsrGraph, KeepsEdgeOrder) {
+  //         0     1     2     3     4
+  std::vector<uint32_t> sources = {2, 0, 2, 0, 3};
+  std::vector<uint32_t> dests = {1, 3, 0, 1, 3};
+  CsrGraph graph = CsrGraph::FromEdges(sources, dests, 5);
+  ASSERT_EQ(graph.node_count(), 5u);
+  ASSERT_EQ(graph.edge_count(), 5u);
+
+  ASSERT_THAT(Nodes(graph.OutgoingEdges(0)), ElementsAre(3, 1));
+  ASSERT_THAT(Edges(graph.OutgoingEdges(0)), ElementsAre(1, 3));
+  ASSERT_THAT(Nodes(graph.OutgoingEdges(1)), IsEmpty());
+  ASSERT_THAT(Nodes(graph.OutgoingEdges(2)), ElementsAre(1, 0));
+  ASSERT_THAT(Edges(graph.OutgoingEdges(2)), ElementsAre(0, 2));
+  ASSERT_THAT(Nodes(graph.OutgoingEdges(3)), ElementsAre(3));
+  ASSERT_THAT(Nodes(graph.OutgoingEdges(4)), IsEmpty());
+}
+
+TEST(CsrGraph, Reverse) {
+  //         0     1     2     3     4
+  std::vector<uint32_t> sources = {2, 0, 2, 0, 3};
+  std::vector<uint32_t> dests = {1, 3, 0, 1, 3};
+  CsrGraph graph = CsrGraph::FromEdges(sources, dests, 5).Reverse();
+  ASSERT_EQ(graph.node_count(), 5u);
+  ASSERT_EQ(graph.edge_count(), 5u);
+
+  ASSERT_THAT(Nodes(graph.OutgoingEdges(0)), ElementsAre(2));
+  ASSERT_THAT(Edges(graph.OutgoingEdges(0)), ElementsAre(2));
+  ASSERT_THAT(Nodes(graph.OutgoingEdges(1)), ElementsAre(2, 0));
+  ASSERT_THAT(Edges(graph.OutgoingEdges(1)), ElementsAre(0, 3));
+  ASSERT_THAT(Nodes(graph.OutgoingEdges(2)), IsEmpty());
+  ASSERT_THAT(Nodes(graph.OutgoingEdges(3)), ElementsAre(0, 3));
+  ASSERT_THAT(Edges(graph.OutgoingEdges(3)), ElementsAre(1, 4));
+}
+
+}  // namespace
+}  // namespace perfetto::trace_processor
@@ -34,6 +34,7 @@
 #include "src/trace_processor/containers/string_pool.h"
 #include "src/trace_processor/db/column.h"
 #include "src/trace_processor/db/table.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/csr_graph.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/tables_py.h"
 #include "src/trace_processor/util/status_macros.h"
 
@@ -44,22 +45,21 @@ DfsTable::~DfsTable() = default;
 
 namespace {
 
-using Destinations = std::vector<uint32_t>;
-
-base::StatusOr<std::vector<Destinations>> ParseSourceToDestionationsMap(
+base::StatusOr<CsrGraph> ParseGraph(
     protos::pbzero::RepeatedBuilderResult::Decoder& source,
     protos::pbzero::RepeatedBuilderResult::Decoder& dest) {
-  std::vector<Destinations> source_to_destinations_map;
+  std::vector<uint32_t> sources;
+  std::vector<uint32_t> dests;
+  uint32_t node_count = 0;
   bool parse_error = false;
   auto source_node_ids = source.int_values(&parse_error);
   auto dest_node_ids = dest.int_values(&parse_error);
   for (; source_node_ids && dest_node_ids; ++source_node_ids, ++dest_node_ids) {
-    source_to_destinations_map.resize(
-        std::max(source_to_destinations_map.size(),
-                 std::max(static_cast<size_t>(*source_node_ids + 1),
-                          static_cast<size_t>(*dest_node_ids + 1))));
-    source_to_destinations_map[static_cast<uint32_t>(*source_node_ids)]
-        .push_back(static_cast<uint32_t>(*dest_node_ids));
+    auto s = static_cast<uint32_t>(*source_node_ids);
+    auto d = static_cast<uint32_t>(*dest_node_ids);
+    sources.push_back(s);
+    dests.push_back(d);
+    node_count = std::max(node_count, std::max(s + 1, d + 1));
   }
   if (parse_error) {
     return base::ErrStatus("Failed while parsing source or dest ids");
@@ -68,11 +68,11 @@ base::StatusOr<std::vector<Destinations>> ParseSourceToDestionationsMap(
     return base::ErrStatus(
         "dfs: length of source and destination columns is not the same");
   }
-  return source_to_destinations_map;
+  return CsrGraph::FromEdges(sources, dests, node_count);
 }
 
 void DfsImpl(tables::DfsTable* table,
-             const std::vector<Destinations>& source_to_destinations_map,
+             const CsrGraph& graph,
              std::vector<uint8_t>& seen_node_ids,
              uint32_t start_id) {
   struct StackState {
@@ -95,10 +95,9 @@ void DfsImpl(tables::DfsTable* table,
     row.parent_node_id = stack_state.parent_id;
     table->Insert(row);
 
-    PERFETTO_DCHECK(stack_state.id < source_to_destinations_map.size());
-    const auto& children = source_to_destinations_map[stack_state.id];
-    for (auto it = children.rbegin(); it != children.rend(); ++it) {
-      stack.emplace_back(StackState{*it, stack_state.id});
+    auto children = graph.OutgoingEdges(stack_state.id);
+    for (const uint32_t* it = children.end(); it != children.begin();) {
+      stack.emplace_back(StackState{*--it, stack_state.id});
     }
   }
 }
@@ -167,16 +166,15 @@ base::StatusOr<std::unique_ptr<Table>> Dfs::ComputeTable(
   protos::pbzero::RepeatedBuilderResult::Decoder dest_ids(
       proto_dest_ids.repeated());
 
-  ASSIGN_OR_RETURN(auto map,
-                   ParseSourceToDestionationsMap(source_ids, dest_ids));
+  ASSIGN_OR_RETURN(CsrGraph graph, ParseGraph(source_ids, dest_ids));
   uint32_t start_node_id = static_cast<uint32_t>(raw_start_node.AsLong());
-  if (start_node_id >= map.size()) {
+  if (start_node_id >= graph.node_count()) {
     return std::unique_ptr<Table>(std::make_unique<tables::DfsTable>(pool_));
   }
 
-  std::vector<uint8_t> seen_node_ids(map.size());
+  std::vector<uint8_t> seen_node_ids(graph.node_count());
   auto table = std::make_unique<tables::DfsTable>(pool_);
-  DfsImpl(table.get(), map, seen_node_ids, start_node_id);
+  DfsImpl(table.get(), graph, seen_node_ids, start_node_id);
   return std::unique_ptr<Table>(std::move(table));
 }
 
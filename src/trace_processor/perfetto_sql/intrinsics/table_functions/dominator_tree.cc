@@ -19,6 +19,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <string>
@@ -29,12 +30,12 @@
 #include "perfetto/base/status.h"
 #include "perfetto/ext/base/status_or.h"
 #include "perfetto/protozero/proto_decoder.h"
-#include "perfetto/protozero/proto_utils.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "protos/perfetto/trace_processor/metrics_impl.pbzero.h"
 #include "src/trace_processor/containers/string_pool.h"
 #include "src/trace_processor/db/column.h"
 #include "src/trace_processor/db/table.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/csr_graph.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/tables_py.h"
 #include "src/trace_processor/util/status_macros.h"
 
@@ -45,26 +46,14 @@ DominatorTreeTable::~DominatorTreeTable() = default;
 
 namespace {
 
-class Forest;
-using NodeIterator = protozero::PackedRepeatedFieldIterator<
-    protozero::proto_utils::ProtoWireType::kFixed64,
-    int64_t>;
+// Sentinel for "no node" in the arrays below.
+constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
 
-// Represents a node in the graph which the dominator tree is being computed on.
-struct Node {
-  uint32_t id;
-  bool operator==(const Node& v) const { return id == v.id; }
-};
-
-// Represents the "number" (i.e. index) of a node in the spanning tree computed
-// by a DFS on the graph.
-struct TreeNumber {
-  uint32_t i;
-  bool operator<(const TreeNumber& o) const { return i < o.i; }
-};
-
-// Helper class containing the "global state" used by the Lengauer-Tarjan
-// algorithm.
+// Computes the dominator tree of a graph with the Lengauer-Tarjan algorithm.
+//
+// Apart from the edges, all the state is kept in flat arrays indexed by the
+// "tree number" of the nodes (i.e. their index in the DFS spanning tree), as
+// that is what all the steps of the algorithm operate on.
 class Graph {
  public:
   static base::StatusOr<Graph> Create(
@@ -73,11 +62,16 @@ class Graph {
     bool parse_error = false;
     auto source_node_ids = source.int_values(&parse_error);
     auto dest_node_ids = dest.int_values(&parse_error);
-    Graph graph;
+    std::vector<uint32_t> sources;
+    std::vector<uint32_t> dests;
+    uint32_t node_id_range = 0;
     for (; source_node_ids && dest_node_ids;
          ++source_node_ids, ++dest_node_ids) {
-      graph.AddEdge(Node{static_cast<uint32_t>(*source_node_ids)},
-                    Node{static_cast<uint32_t>(*dest_node_ids)});
+      auto s = static_cast<uint32_t>(*source_node_ids);
+      auto d = static_cast<uint32_t>(*dest_node_ids);
+      sources.push_back(s);
+      dests.push_back(d);
+      node_id_range = std::max(node_id_range, std::max(s + 1, d + 1));
     }
     if (parse_error) {
       return base::ErrStatus("Failed while parsing source or dest ids");
@@ -88,228 +82,183 @@ class Graph {
           "dominator_tree: length of source and destination columns is not the "
           "same");
     }
+    Graph graph;
+    graph.node_id_range_ = node_id_range;
+    graph.successors_ = CsrGraph::FromEdges(sources, dests, node_id_range);
+    graph.predecessors_ = CsrGraph::FromEdges(dests, sources, node_id_range);
     return graph;
   }
 
   // Lengauer-Tarjan Dominators: Step 1.
-  void RunDfs(Node root_node);
+  void RunDfs(uint32_t root);
 
   // Lengauer-Tarjan Dominators: Step 2 and 3.
-  void ComputeSemiDominatorAndPartialDominator(Forest&);
+  void ComputeSemiDominatorAndPartialDominator();
 
   // Lengauer-Tarjan Dominators: Step 4.
   void ComputeDominators();
 
   // Converts the dominator tree to a table.
-  std::unique_ptr<Table> ToTable(StringPool* pool, Node root_node) && {
+  std::unique_ptr<Table> ToTable(StringPool* pool) && {
     auto table = std::make_unique<tables::DominatorTreeTable>(pool);
     for (uint32_t i = 0; i < node_count_in_tree(); ++i) {
-      Node v = GetNodeForTreeNumber(TreeNumber{i});
-      NodeState& v_state = GetStateForNode(v);
       tables::DominatorTreeTable::Row r;
-      r.node_id = v.id;
-      r.dominator_node_id = v == root_node
-                                ? std::nullopt
-                                : std::make_optional(v_state.dominator.id);
+      r.node_id = node_by_tree_number_[i];
+      // The root (tree number 0) is the only node without a dominator.
+      r.dominator_node_id =
+          i == 0 ? std::nullopt
+                 : std::make_optional(node_by_tree_number_[dominator_[i]]);
       table->Insert(r);
     }
     return std::move(table);
   }
 
-  // Returns the TreeNumber for a given Node.
-  TreeNumber GetSemiDominator(Node v) const {
-    // Note: if you happen to see this check failing, it's likely a problem that
-    // the graph has nodes which are not reachable from the root node.
-    return *GetStateForNode(v).semi_dominator;
-  }
-
-  // Returns the number of nodes in the tree (== the number of nodes in
-  // the graph.)
+  // Returns the number of nodes in the tree (== the number of nodes reachable
+  // from the root.)
   uint32_t node_count_in_tree() const {
     return static_cast<uint32_t>(node_by_tree_number_.size());
   }
 
   // Returns the "range" of the ids of the range (i.e. max(node id) + 1).
-  //
-  // This is useful for creating vectors which are indexed by node id.
-  uint32_t node_id_range() const {
-    return static_cast<uint32_t>(state_by_node_.size());
-  }
+  uint32_t node_id_range() const { return node_id_range_; }
 
  private:
-  // Struct containing the state needed for each node.
-  struct NodeState {
-    std::vector<Node> successors;
-    std::vector<Node> predecessors;
-    std::optional<TreeNumber> tree_parent;
-    std::vector<Node> self_as_semi_dominator;
-    std::optional<TreeNumber> semi_dominator;
-    Node dominator{0};
-  };
-
-  void AddEdge(Node source, Node dest) {
-    state_by_node_.resize(std::max<size_t>(
-        state_by_node_.size(), std::max(source.id + 1, dest.id + 1)));
-    GetStateForNode(source).successors.push_back(dest);
-    GetStateForNode(dest).predecessors.push_back(source);
-  }
-
-  const NodeState& GetStateForNode(Node v) const {
-    return state_by_node_[v.id];
-  }
-  NodeState& GetStateForNode(Node v) { return state_by_node_[v.id]; }
-  Node& GetNodeForTreeNumber(TreeNumber d) { return node_by_tree_number_[d.i]; }
-
-  std::vector<NodeState> state_by_node_;
-  std::vector<Node> node_by_tree_number_;
-};
-
-// Implementation of the "union-find" like helper data structure used by the
-// Lengauer-Tarjan algorithm.
-//
-// This corresponds to the "Link" and "Eval" functions in the paper.
-class Forest {
- public:
-  explicit Forest(uint32_t vertices_count) : state_by_node_(vertices_count) {
-    for (uint32_t i = 0; i < vertices_count; ++i) {
-      state_by_node_[i].min_semi_dominator_until_ancestor = Node{i};
+  // Corresponds to the "Eval" function in the paper: returns the tree number
+  // of the node with the minimum semi-dominator on the path from |v| to the
+  // root of its tree in the forest.
+  uint32_t Eval(uint32_t v) {
+    if (ancestor_[v] == kNone) {
+      return v;
     }
+    Compress(v);
+    return label_[v];
   }
 
   // Corresponds to the "Link" function in the paper.
-  void Link(Node ancestor, Node descendant) {
-    std::optional<Node>& a = state_by_node_[descendant.id].ancestor;
-    PERFETTO_DCHECK(!a);
-    a = ancestor;
+  void Link(uint32_t ancestor, uint32_t descendant) {
+    PERFETTO_DCHECK(ancestor_[descendant] == kNone);
+    ancestor_[descendant] = ancestor;
   }
 
-  // Corresponds to the "Eval" function in the paper.
-  Node GetMinSemiDominatorToAncestor(Node vertex, const Graph& graph) {
-    NodeState& state = GetStateForNode(vertex);
-    if (!state.ancestor) {
-      return vertex;
+  // Implements the O(log(n)) path-compression algorithm in the paper: note
+  // that we use an explicit stack instead of recursion to avoid
+  // stack-overflows with very large heap graphs.
+  void Compress(uint32_t v) {
+    compress_stack_.clear();
+    for (uint32_t x = v; ancestor_[ancestor_[x]] != kNone; x = ancestor_[x]) {
+      compress_stack_.push_back(x);
     }
-    Compress(vertex, graph);
-    return state.min_semi_dominator_until_ancestor;
-  }
-
- private:
-  struct NodeState {
-    std::optional<Node> ancestor;
-    Node min_semi_dominator_until_ancestor;
-  };
-
-  // Implements the O(log(n)) path-compression algorithm in the paper: note that
-  // we use stack-based recursion to avoid stack-overflows with very large heap
-  // graphs.
-  void Compress(Node vertex, const Graph& graph) {
-    struct CompressState {
-      Node current;
-      bool recurse_done;
-    };
-    std::vector<CompressState> states{CompressState{vertex, false}};
-    while (!states.empty()) {
-      CompressState& s = states.back();
-      NodeState& state = GetStateForNode(s.current);
-      PERFETTO_CHECK(state.ancestor);
-      NodeState& ancestor_state = GetStateForNode(*state.ancestor);
-      if (s.recurse_done) {
-        states.pop_back();
-        Node ancestor_min = ancestor_state.min_semi_dominator_until_ancestor;
-        Node self_min = state.min_semi_dominator_until_ancestor;
-        if (graph.GetSemiDominator(ancestor_min) <
-            graph.GetSemiDominator(self_min)) {
-          state.min_semi_dominator_until_ancestor = ancestor_min;
-        }
-        state.ancestor = ancestor_state.ancestor;
-      } else {
-        s.recurse_done = true;
-        if (auto grand_ancestor = ancestor_state.ancestor; grand_ancestor) {
-          states.push_back(CompressState{*state.ancestor, false});
-        } else {
-          states.pop_back();
-        }
+    for (auto it = compress_stack_.rbegin(); it != compress_stack_.rend();
+         ++it) {
+      uint32_t x = *it;
+      uint32_t a = ancestor_[x];
+      if (semi_dominator_[label_[a]] < semi_dominator_[label_[x]]) {
+        label_[x] = label_[a];
       }
+      ancestor_[x] = ancestor_[a];
     }
   }
 
-  NodeState& GetStateForNode(Node v) { return state_by_node_[v.id]; }
-
-  std::vector<NodeState> state_by_node_;
+  uint32_t node_id_range_ = 0;
+  CsrGraph successors_;
+  CsrGraph predecessors_;
+
+  // Indexed by node id.
+  std::vector<uint32_t> tree_number_by_node_;
+
+  // Indexed by tree number.
+  std::vector<uint32_t> node_by_tree_number_;
+  std::vector<uint32_t> tree_parent_;
+  std::vector<uint32_t> semi_dominator_;
+  std::vector<uint32_t> dominator_;
+  std::vector<uint32_t> ancestor_;
+  std::vector<uint32_t> label_;
+  // Intrusive linked lists of the nodes which have a given node as their
+  // semi-dominator ("bucket" in the paper).
+  std::vector<uint32_t> bucket_head_;
+  std::vector<uint32_t> bucket_next_;
+
+  std::vector<uint32_t> compress_stack_;
 };
 
 // Lengauer-Tarjan Dominators: Step 1.
-void Graph::RunDfs(Node root) {
+void Graph::RunDfs(uint32_t root) {
   struct StackState {
-    Node node;
-    std::optional<TreeNumber> parent;
+    uint32_t node;
+    uint32_t parent;
   };
 
-  std::vector<StackState> stack{{root, std::nullopt}};
+  tree_number_by_node_.assign(node_id_range_, kNone);
+  std::vector<StackState> stack{{root, kNone}};
   while (!stack.empty()) {
     StackState stack_state = stack.back();
     stack.pop_back();
 
-    NodeState& s = GetStateForNode(stack_state.node);
-    if (s.semi_dominator) {
+    uint32_t& tree_number = tree_number_by_node_[stack_state.node];
+    if (tree_number != kNone) {
       continue;
     }
-
-    TreeNumber tree_number{static_cast<uint32_t>(node_by_tree_number_.size())};
-    s.tree_parent = stack_state.parent;
-    s.semi_dominator = tree_number;
+    tree_number = node_count_in_tree();
     node_by_tree_number_.push_back(stack_state.node);
+    tree_parent_.push_back(stack_state.parent);
 
-    for (auto it = s.successors.rbegin(); it != s.successors.rend(); ++it) {
-      stack.emplace_back(StackState{*it, tree_number});
+    // Push in reverse so the successors are visited in the order of the
+    // edges.
+    auto successors = successors_.OutgoingEdges(stack_state.node);
+    for (const uint32_t* it = successors.end(); it != successors.begin();) {
+      stack.push_back(StackState{*--it, tree_number});
     }
   }
+
+  uint32_t n = node_count_in_tree();
+  semi_dominator_.resize(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    semi_dominator_[i] = i;
+  }
+  label_ = semi_dominator_;
+  dominator_.assign(n, 0);
+  ancestor_.assign(n, kNone);
+  bucket_head_.assign(n, kNone);
+  bucket_next_.assign(n, kNone);
 }
 
 // Lengauer-Tarjan Dominators: Step 2 & 3.
-void Graph::ComputeSemiDominatorAndPartialDominator(Forest& forest) {
+void Graph::ComputeSemiDominatorAndPartialDominator() {
   // Note the >0 is *intentional* as we do *not* want to process the root.
-  for (uint32_t i = node_count_in_tree() - 1; i > 0; --i) {
-    Node w = GetNodeForTreeNumber(TreeNumber{i});
-    NodeState& w_state = GetStateForNode(w);
-    for (Node v : w_state.predecessors) {
-      Node u = forest.GetMinSemiDominatorToAncestor(v, *this);
-      w_state.semi_dominator =
-          std::min(*w_state.semi_dominator, GetSemiDominator(u));
+  for (uint32_t w = node_count_in_tree() - 1; w > 0; --w) {
+    uint32_t w_node = node_by_tree_number_[w];
+    for (uint32_t predecessor : predecessors_.OutgoingEdges(w_node)) {
+      uint32_t v = tree_number_by_node_[predecessor];
+      // Predecessors which are not reachable from the root do not take part
+      // in the dominator tree.
+      if (v == kNone) {
+        continue;
+      }
+      uint32_t u = Eval(v);
+      semi_dominator_[w] = std::min(semi_dominator_[w], semi_dominator_[u]);
     }
-    NodeState& semi_dominator_state =
-        GetStateForNode(GetNodeForTreeNumber(*w_state.semi_dominator));
-    semi_dominator_state.self_as_semi_dominator.push_back(w);
-    PERFETTO_CHECK(w_state.tree_parent);
-
-    Node w_parent = GetNodeForTreeNumber(*w_state.tree_parent);
-    forest.Link(w_parent, w);
+    uint32_t semi = semi_dominator_[w];
+    bucket_next_[w] = bucket_head_[semi];
+    bucket_head_[semi] = w;
 
-    NodeState& w_parent_state = GetStateForNode(w_parent);
-    for (Node v : w_parent_state.self_as_semi_dominator) {
-      NodeState& v_state = GetStateForNode(v);
+    uint32_t w_parent = tree_parent_[w];
+    Link(w_parent, w);
 
-      Node u = forest.GetMinSemiDominatorToAncestor(v, *this);
-      NodeState& u_state = GetStateForNode(u);
-
-      u_state.dominator =
-          u_state.semi_dominator < v_state.semi_dominator ? u : w_parent;
+    for (uint32_t v = bucket_head_[w_parent]; v != kNone; v = bucket_next_[v]) {
+      uint32_t u = Eval(v);
+      dominator_[v] = semi_dominator_[u] < semi_dominator_[v] ? u : w_parent;
     }
-    w_parent_state.self_as_semi_dominator.clear();
+    bucket_head_[w_parent] = kNone;
   }
 }
 
 // Lengauer-Tarjan Dominators: Step 4.
 void Graph::ComputeDominators() {
   // Starting from 1 is intentional as we don't want to process the root node.
-  for (uint32_t i = 1; i < node_count_in_tree(); ++i) {
-    Node w = GetNodeForTreeNumber(TreeNumber{i});
-    NodeState& w_state = GetStateForNode(w);
-    Node semi_dominator = GetNodeForTreeNumber(*w_state.semi_dominator);
-    if (w_state.dominator == semi_dominator) {
-      continue;
+  for (uint32_t w = 1; w < node_count_in_tree(); ++w) {
+    if (dominator_[w] != semi_dominator_[w]) {
+      dominator_[w] = dominator_[dominator_[w]];
     }
-    w_state.dominator = GetStateForNode(w_state.dominator).dominator;
   }
 }
 
@@ -382,12 +331,11 @@ base::StatusOr<std::unique_ptr<Table>> DominatorTree::ComputeTable(
   protos::pbzero::RepeatedBuilderResult::Decoder dest_ids(
       proto_dest_ids.repeated());
 
-  Node start_node{static_cast<uint32_t>(raw_start_node.AsLong())};
+  auto start_node = static_cast<uint32_t>(raw_start_node.AsLong());
   ASSIGN_OR_RETURN(Graph graph, Graph::Create(source_ids, dest_ids));
-  if (start_node.id >= graph.node_id_range()) {
+  if (start_node >= graph.node_id_range()) {
     return base::ErrStatus("dominator_tree: root node is not in the graph");
   }
-  Forest forest(graph.node_id_range());
 
   // Execute the Lengauer-Tarjan Dominators algorithm to compute the dominator
   // tree.
@@ -396,11 +344,11 @@ base::StatusOr<std::unique_ptr<Table>> DominatorTree::ComputeTable(
     return base::ErrStatus(
         "dominator_tree: non empty graph must contain root and another node");
   }
-  graph.ComputeSemiDominatorAndPartialDominator(forest);
+  graph.ComputeSemiDominatorAndPartialDominator();
   graph.ComputeDominators();
 
   // Take the computed dominator tree and convert it to a table.
-  return std::move(graph).ToTable(pool_, start_node);
+  return std::move(graph).ToTable(pool_);
 }
 
 }  // namespace perfetto::trace_processor
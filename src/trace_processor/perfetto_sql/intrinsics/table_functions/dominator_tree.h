@@ -57,6 +57,11 @@ namespace perfetto::trace_processor {
 // large tables (i.e. tables containing Java heap graphs), it's important that
 // the code is efficient.
 //
+// For the same reason, the edges are stored in compressed sparse row form and
+// all the per-node state of the algorithm lives in flat arrays indexed by DFS
+// number, rather than in per-node objects: on graphs with millions of nodes
+// the algorithm is dominated by memory accesses rather than computation.
+//
 // As Lengauer-Tarjan Dominators is not the most intuitive algorithm [3] might
 // be a useful resource for grasping the key principles behind it.
 //
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/trace_processor/basic_types.h"
+#include "src/trace_processor/containers/string_pool.h"
+#include "src/trace_processor/metrics/metrics.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/dominator_tree.h"
+
+namespace perfetto::trace_processor {
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Builds a graph with the shape of a Java heap graph: every object is
+// referenced by an object created before it (so all of them are reachable from
+// the root) and half of them also by a random other object.
+void BM_DominatorTree(benchmark::State& state) {
+  const auto node_count =
+      static_cast<uint32_t>(IsBenchmarkFunctionalOnly() ? 1024
+                                                        : state.range(0));
+  std::minstd_rand rng(42);
+  auto random_node = [&rng](uint32_t range) {
+    return static_cast<int64_t>(rng() % range);
+  };
+  metrics::RepeatedFieldBuilder sources;
+  metrics::RepeatedFieldBuilder dests;
+  for (uint32_t i = 1; i < node_count; ++i) {
+    PERFETTO_CHECK(sources.AddSqlValue(SqlValue::Long(random_node(i))).ok());
+    PERFETTO_CHECK(dests.AddSqlValue(SqlValue::Long(i)).ok());
+    if (rng() % 2) {
+      PERFETTO_CHECK(
+          sources.AddSqlValue(SqlValue::Long(random_node(node_count))).ok());
+      PERFETTO_CHECK(dests.AddSqlValue(SqlValue::Long(i)).ok());
+    }
+  }
+  std::vector<uint8_t> raw_sources = sources.SerializeToProtoBuilderResult();
+  std::vector<uint8_t> raw_dests = dests.SerializeToProtoBuilderResult();
+  std::vector<SqlValue> args{
+      SqlValue::Bytes(raw_sources.data(), raw_sources.size()),
+      SqlValue::Bytes(raw_dests.data(), raw_dests.size()),
+      SqlValue::Long(0),
+  };
+
+  StringPool pool;
+  DominatorTree dominator_tree(&pool);
+  for (auto _ : state) {
+    auto table = dominator_tree.ComputeTable(args);
+    PERFETTO_CHECK(table.ok());
+    benchmark::DoNotOptimize(table);
+  }
+  state.counters["nodes/s"] =
+      benchmark::Counter(static_cast<double>(node_count),
+                         benchmark::Counter::kIsIterationInvariantRate);
+}
+
+}  // namespace
+}  // namespace perfetto::trace_processor
+
+BENCHMARK(perfetto::trace_processor::BM_DominatorTree)
+    ->RangeMultiplier(10)
+    ->Range(10 * 1000, 10 * 1000 * 1000)
+    ->Unit(benchmark::kMillisecond);
@@ -31,6 +31,7 @@
 #include "src/trace_processor/read_trace_internal.h"
 #include "src/trace_processor/util/gzip_utils.h"
 #include "src/trace_processor/util/status_macros.h"
+#include "src/trace_processor/util/zstd_utils.h"
 
 #include "protos/perfetto/trace/trace.pbzero.h"
 #include "protos/perfetto/trace/trace_packet.pbzero.h"
@@ -118,13 +119,24 @@ util::Status DecompressTrace(const uint8_t* data,
   }
   for (auto it = decoder.packet(); it; ++it) {
     protos::pbzero::TracePacket::Decoder packet(*it);
+    if (packet.has_zstd_compressed_packets()) {
+      if (!util::IsZstdSupported()) {
+        return util::ErrStatus(
+            "Cannot decompress zstd compressed packets. Zstd not enabled");
+      }
+      auto bytes = packet.zstd_compressed_packets();
+      if (!util::ZstdDecompressFully(bytes.data, bytes.size, output)) {
+        return util::ErrStatus("Failed while decompressing zstd stream");
+      }
+      continue;
+    }
     if (!packet.has_compressed_packets()) {
       it->SerializeAndAppendTo(output);
       continue;
     }
 
-    // Make sure that to reset the stream between the gzip streams.
     auto bytes = packet.compressed_packets();
+    // Make sure that to reset the stream between the gzip streams.
     decompressor.Reset();
     using ResultCode = util::GzipDecompressor::ResultCode;
     ResultCode ret = decompressor.FeedAndExtract(
@@ -20,14 +20,18 @@
 
 #include "src/trace_processor/rpc/httpd.h"
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 #include "perfetto/ext/base/http/http_server.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/unix_task_runner.h"
 #include "perfetto/ext/base/utils.h"
+#include "perfetto/ext/trace_processor/rpc/query_result_serializer.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "perfetto/trace_processor/trace_processor.h"
-#include "src/trace_processor/rpc/rpc.h"
 
 #include "protos/perfetto/trace_processor/trace_processor.pbzero.h"
 
@@ -38,6 +42,16 @@ namespace {
 
 constexpr int kBindPort = 9001;
 
+// While a client is not reading the results of a /query fast enough, the
+// streaming is paused and the socket is polled again after this delay, which
+// doubles on every failed attempt up to kMaxQueryStreamRetryMs.
+constexpr uint32_t kMinQueryStreamRetryMs = 1;
+constexpr uint32_t kMaxQueryStreamRetryMs = 64;
+
+// Max number of batches sent in one go before yielding to the task runner, so
+// other connections are served while a large result is being streamed.
+constexpr uint32_t kQueryBatchesPerTask = 8;
+
 // Sets the Access-Control-Allow-Origin: $origin on the following origins.
 // This affects only browser clients that use CORS. Other HTTP clients (e.g. the
 // python API) don't look at CORS headers.
@@ -47,23 +61,11 @@ const char* kAllowedCORSOrigins[] = {
     "http://127.0.0.1:10000",
 };
 
-class Httpd : public base::HttpRequestHandler {
- public:
-  explicit Httpd(std::unique_ptr<TraceProcessor>);
-  ~Httpd() override;
-  void Run(int port);
-
- private:
-  // HttpRequestHandler implementation.
-  void OnHttpRequest(const base::HttpRequest&) override;
-  void OnWebsocketMessage(const base::WebsocketMessage&) override;
-
-  void ServeHelpPage(const base::HttpRequest&);
-
-  Rpc trace_processor_rpc_;
-  base::UnixTaskRunner task_runner_;
-  base::HttpServer http_srv_;
-};
+// Endpoints which don't touch the state of the trace processor, and can
+// therefore be served while queries are being streamed.
+bool IsStatelessEndpoint(base::StringView uri) {
+  return uri == "/" || uri == "/status" || uri == "/websocket";
+}
 
 base::HttpServerConnection* g_cur_conn;
 
@@ -90,12 +92,34 @@ void SendRpcChunk(const void* data, uint32_t len) {
   }
 }
 
-Httpd::Httpd(std::unique_ptr<TraceProcessor> preloaded_instance)
+// Sends the next batch of |serializer| as a chunk of the reply. Returns false
+// once the last batch (and the end of the chunked reply) has been sent.
+bool SendQueryResultChunk(base::HttpServerConnection* conn,
+                          QueryResultSerializer* serializer) {
+  std::vector<uint8_t> batch;
+  bool has_more = serializer->Serialize(&batch);
+  PERFETTO_DLOG("Sending response chunk, len=%zu eof=%d", batch.size(),
+                !has_more);
+  base::StackString<32> chunk_hdr("%zx\r\n", batch.size());
+  conn->SendResponseBody(chunk_hdr.c_str(), chunk_hdr.len());
+  conn->SendResponseBody(batch.data(), batch.size());
+  conn->SendResponseBody("\r\n", 2);
+  if (!has_more)
+    conn->SendResponseBody("0\r\n\r\n", 5);
+  return has_more;
+}
+
+}  // namespace
+
+Httpd::Httpd(std::unique_ptr<TraceProcessor> preloaded_instance,
+             base::TaskRunner* task_runner)
     : trace_processor_rpc_(std::move(preloaded_instance)),
-      http_srv_(&task_runner_, this) {}
+      task_runner_(task_runner),
+      http_srv_(task_runner, this),
+      weak_factory_(this) {}
 Httpd::~Httpd() = default;
 
-void Httpd::Run(int port) {
+void Httpd::Start(int port) {
   PERFETTO_ILOG("[HTTP] Starting RPC server on localhost:%d", port);
   PERFETTO_LOG(
       "[HTTP] This server can be used by reloading https://ui.perfetto.dev and "
@@ -106,24 +130,51 @@ void Httpd::Run(int port) {
   for (size_t i = 0; i < base::ArraySize(kAllowedCORSOrigins); ++i)
     http_srv_.AddAllowedOrigin(kAllowedCORSOrigins[i]);
   http_srv_.Start(port);
-  task_runner_.Run();
 }
 
 void Httpd::OnHttpRequest(const base::HttpRequest& req) {
-  base::HttpServerConnection& conn = *req.conn;
-  if (req.uri == "/") {
+  // Serve the request right away unless it conflicts with a query stream (see
+  // the class comment in httpd.h) or it would overtake a queued request.
+  auto seq_hdr = req.GetHeader("x-seq-id").value_or(base::StringView());
+  if (!ConflictsWithQueryStreams(req.conn, req.uri) &&
+      !HasPendingRequests(req.conn) &&
+      (pending_requests_.empty() || IsStatelessEndpoint(req.uri))) {
+    if (req.uri == "/websocket" && req.is_websocket_handshake) {
+      // Will trigger OnWebsocketMessage() when is received.
+      // It returns a 403 if the origin is not in kAllowedCORSOrigins.
+      return req.conn->UpgradeToWebsocket(req);
+    }
+    return ServeHttpRequest(req.conn, req.uri, req.body, seq_hdr);
+  }
+
+  if (req.is_websocket_handshake) {
+    // The upgrade needs the original request, so it can't be deferred. The
+    // client is not supposed to upgrade a connection with a reply in flight.
+    PERFETTO_ELOG("[HTTP] Websocket handshake with a reply in flight");
+    return req.conn->Close();
+  }
+  req.conn->DeferResponse();
+  pending_requests_.push_back(PendingRequest{
+      req.conn, /*is_websocket_message=*/false, req.uri.ToStdString(),
+      req.body.ToStdString(), seq_hdr.ToStdString()});
+}
+
+void Httpd::ServeHttpRequest(base::HttpServerConnection* conn_ptr,
+                             base::StringView uri,
+                             base::StringView body,
+                             base::StringView seq_hdr) {
+  base::HttpServerConnection& conn = *conn_ptr;
+  if (uri == "/") {
     // If a user tries to open http://127.0.0.1:9001/ show a minimal help page.
-    return ServeHelpPage(req);
+    return ServeHelpPage(conn_ptr);
   }
 
-  static int last_req_id = 0;
-  auto seq_hdr = req.GetHeader("x-seq-id").value_or(base::StringView());
   int seq_id = base::StringToInt32(seq_hdr.ToStdString()).value_or(0);
 
   if (seq_id) {
-    if (last_req_id && seq_id != last_req_id + 1 && seq_id != 1)
+    if (last_req_id_ && seq_id != last_req_id_ + 1 && seq_id != 1)
       PERFETTO_ELOG("HTTP Request out of order");
-    last_req_id = seq_id;
+    last_req_id_ = seq_id;
   }
 
   // This is the default.
@@ -138,17 +189,11 @@ void Httpd::OnHttpRequest(const base::HttpRequest& req) {
       "Transfer-Encoding: chunked",            //
   };
 
-  if (req.uri == "/status") {
+  if (uri == "/status") {
     auto status = trace_processor_rpc_.GetStatus();
     return conn.SendResponse("200 OK", default_headers, Vec2Sv(status));
   }
 
-  if (req.uri == "/websocket" && req.is_websocket_handshake) {
-    // Will trigger OnWebsocketMessage() when is received.
-    // It returns a 403 if the origin is not in kAllowedCORSOrigins.
-    return conn.UpgradeToWebsocket(req);
-  }
-
   // --- Everything below this line is a legacy endpoint not used by the UI.
   // There are two generations of pre-websocket legacy-ness:
   // 1. The /rpc based endpoint. This is based on a chunked transfer, doing one
@@ -157,15 +202,15 @@ void Httpd::OnHttpRequest(const base::HttpRequest& req) {
   // 2. The REST API, with one enpoint per RPC method (/parse, /query, ...).
   //    This is unused and will be removed at some point.
 
-  if (req.uri == "/rpc") {
+  if (uri == "/rpc") {
     // Start the chunked reply.
     conn.SendResponseHeaders("200 OK", chunked_headers,
                              base::HttpServerConnection::kOmitContentLength);
     PERFETTO_CHECK(g_cur_conn == nullptr);
-    g_cur_conn = req.conn;
+    g_cur_conn = conn_ptr;
     trace_processor_rpc_.SetRpcResponseFunction(SendRpcChunk);
     // OnRpcRequest() will call SendRpcChunk() one or more times.
-    trace_processor_rpc_.OnRpcRequest(req.body.data(), req.body.size());
+    trace_processor_rpc_.OnRpcRequest(body.data(), body.size());
     trace_processor_rpc_.SetRpcResponseFunction(nullptr);
     g_cur_conn = nullptr;
 
@@ -174,9 +219,9 @@ void Httpd::OnHttpRequest(const base::HttpRequest& req) {
     return;
   }
 
-  if (req.uri == "/parse") {
+  if (uri == "/parse") {
     base::Status status = trace_processor_rpc_.Parse(
-        reinterpret_cast<const uint8_t*>(req.body.data()), req.body.size());
+        reinterpret_cast<const uint8_t*>(body.data()), body.size());
     protozero::HeapBuffered<protos::pbzero::AppendTraceDataResult> result;
     if (!status.ok()) {
       result->set_error(status.c_message());
@@ -185,57 +230,50 @@ void Httpd::OnHttpRequest(const base::HttpRequest& req) {
                              Vec2Sv(result.SerializeAsArray()));
   }
 
-  if (req.uri == "/notify_eof") {
+  if (uri == "/notify_eof") {
     trace_processor_rpc_.NotifyEndOfFile();
     return conn.SendResponse("200 OK", default_headers);
   }
 
-  if (req.uri == "/restore_initial_tables") {
+  if (uri == "/restore_initial_tables") {
     trace_processor_rpc_.RestoreInitialTables();
     return conn.SendResponse("200 OK", default_headers);
   }
 
   // New endpoint, returns data in batches using chunked transfer encoding.
   // The batch size is determined by |cells_per_batch_| and
-  // |batch_split_threshold_| in query_result_serializer.h.
+  // |batch_split_threshold_| in query_result_serializer.h, and can be lowered
+  // by the client through QueryArgs.cells_per_batch.
+  // The query is stepped only when the client is ready to receive more data,
+  // so slow clients don't make the whole result pile up in the socket buffers.
   // This is temporary, it will be switched to WebSockets soon.
-  if (req.uri == "/query") {
-    std::vector<uint8_t> response;
-
+  if (uri == "/query") {
     // Start the chunked reply.
     conn.SendResponseHeaders("200 OK", chunked_headers,
                              base::HttpServerConnection::kOmitContentLength);
-
-    // |on_result_chunk| will be called nested within the same callstack of the
-    // rpc.Query() call. No further calls will be made once Query() returns.
-    auto on_result_chunk = [&](const uint8_t* buf, size_t len, bool has_more) {
-      PERFETTO_DLOG("Sending response chunk, len=%zu eof=%d", len, !has_more);
-      base::StackString<32> chunk_hdr("%zx\r\n", len);
-      conn.SendResponseBody(chunk_hdr.c_str(), chunk_hdr.len());
-      conn.SendResponseBody(buf, len);
-      conn.SendResponseBody("\r\n", 2);
-      if (!has_more)
-        conn.SendResponseBody("0\r\n\r\n", 5);
-    };
-    trace_processor_rpc_.Query(
-        reinterpret_cast<const uint8_t*>(req.body.data()), req.body.size(),
-        on_result_chunk);
+    uint64_t id = ++last_query_stream_id_;
+    query_streams_.push_back(QueryStream{
+        id, conn_ptr,
+        trace_processor_rpc_.StartQuery(
+            reinterpret_cast<const uint8_t*>(body.data()), body.size()),
+        kMinQueryStreamRetryMs});
+    PumpQueryStream(id);
     return;
   }
 
-  if (req.uri == "/compute_metric") {
+  if (uri == "/compute_metric") {
     std::vector<uint8_t> res = trace_processor_rpc_.ComputeMetric(
-        reinterpret_cast<const uint8_t*>(req.body.data()), req.body.size());
+        reinterpret_cast<const uint8_t*>(body.data()), body.size());
     return conn.SendResponse("200 OK", default_headers, Vec2Sv(res));
   }
 
-  if (req.uri == "/enable_metatrace") {
+  if (uri == "/enable_metatrace") {
     trace_processor_rpc_.EnableMetatrace(
-        reinterpret_cast<const uint8_t*>(req.body.data()), req.body.size());
+        reinterpret_cast<const uint8_t*>(body.data()), body.size());
     return conn.SendResponse("200 OK", default_headers);
   }
 
-  if (req.uri == "/disable_and_read_metatrace") {
+  if (uri == "/disable_and_read_metatrace") {
     std::vector<uint8_t> res = trace_processor_rpc_.DisableAndReadMetatrace();
     return conn.SendResponse("200 OK", default_headers, Vec2Sv(res));
   }
@@ -244,26 +282,132 @@ void Httpd::OnHttpRequest(const base::HttpRequest& req) {
 }
 
 void Httpd::OnWebsocketMessage(const base::WebsocketMessage& msg) {
+  // See the comment in OnHttpRequest(). The RPC can run arbitrary queries.
+  if (!pending_requests_.empty() || ConflictsWithQueryStreams(msg.conn, "")) {
+    pending_requests_.push_back(PendingRequest{
+        msg.conn, /*is_websocket_message=*/true, "", msg.data.ToStdString(),
+        ""});
+    return;
+  }
+  ServeWebsocketMessage(msg.conn, msg.data);
+}
+
+void Httpd::ServeWebsocketMessage(base::HttpServerConnection* conn,
+                                  base::StringView data) {
   PERFETTO_CHECK(g_cur_conn == nullptr);
-  g_cur_conn = msg.conn;
+  g_cur_conn = conn;
   trace_processor_rpc_.SetRpcResponseFunction(SendRpcChunk);
   // OnRpcRequest() will call SendRpcChunk() one or more times.
-  trace_processor_rpc_.OnRpcRequest(msg.data.data(), msg.data.size());
+  trace_processor_rpc_.OnRpcRequest(data.data(), data.size());
   trace_processor_rpc_.SetRpcResponseFunction(nullptr);
   g_cur_conn = nullptr;
 }
 
-}  // namespace
+void Httpd::OnHttpConnectionClosed(base::HttpServerConnection* conn) {
+  // Nobody will read the rest of the results: just drop them, together with
+  // the requests that were waiting for them.
+  query_streams_.remove_if(
+      [conn](const QueryStream& stream) { return stream.conn == conn; });
+  pending_requests_.remove_if(
+      [conn](const PendingRequest& req) { return req.conn == conn; });
+  PostServePendingRequests();
+}
+
+bool Httpd::ConflictsWithQueryStreams(base::HttpServerConnection* conn,
+                                      base::StringView uri) const {
+  // A connection can only have one reply in flight.
+  for (const QueryStream& stream : query_streams_) {
+    if (stream.conn == conn)
+      return true;
+  }
+  // Everything else (including /query, which can run arbitrary SQL) can change
+  // the state of the trace processor, which isn't safe while any query is
+  // being stepped.
+  return !IsStatelessEndpoint(uri) && !query_streams_.empty();
+}
+
+bool Httpd::HasPendingRequests(base::HttpServerConnection* conn) const {
+  for (const PendingRequest& req : pending_requests_) {
+    if (req.conn == conn)
+      return true;
+  }
+  return false;
+}
+
+void Httpd::ServePendingRequests() {
+  while (!pending_requests_.empty()) {
+    PendingRequest& front = pending_requests_.front();
+    if (ConflictsWithQueryStreams(front.conn, base::StringView(front.uri)))
+      return;
+    PendingRequest req = std::move(front);
+    pending_requests_.pop_front();
+    if (req.is_websocket_message) {
+      ServeWebsocketMessage(req.conn, base::StringView(req.body));
+    } else {
+      ServeHttpRequest(req.conn, base::StringView(req.uri),
+                       base::StringView(req.body),
+                       base::StringView(req.seq_id));
+    }
+  }
+}
+
+void Httpd::PostServePendingRequests() {
+  if (pending_requests_.empty())
+    return;
+  auto weak_this = weak_factory_.GetWeakPtr();
+  task_runner_->PostTask([weak_this] {
+    if (weak_this)
+      weak_this->ServePendingRequests();
+  });
+}
+
+void Httpd::PumpQueryStream(uint64_t id) {
+  auto it = std::find_if(
+      query_streams_.begin(), query_streams_.end(),
+      [id](const QueryStream& stream) { return stream.id == id; });
+  if (it == query_streams_.end())
+    return;  // The client disconnected in the meantime.
+
+  for (uint32_t i = 0; i < kQueryBatchesPerTask; ++i) {
+    if (!it->conn->CanSendWithoutBlocking()) {
+      // There is no way to watch for the socket becoming writable on the task
+      // runner, so poll it again later.
+      uint32_t retry_ms = it->retry_ms;
+      it->retry_ms = std::min(retry_ms * 2, kMaxQueryStreamRetryMs);
+      PostPumpQueryStream(id, retry_ms);
+      return;
+    }
+    it->retry_ms = kMinQueryStreamRetryMs;
+    if (!SendQueryResultChunk(it->conn, it->serializer.get())) {
+      query_streams_.erase(it);
+      PostServePendingRequests();
+      return;
+    }
+  }
+  PostPumpQueryStream(id, 0);
+}
+
+void Httpd::PostPumpQueryStream(uint64_t id, uint32_t delay_ms) {
+  auto weak_this = weak_factory_.GetWeakPtr();
+  task_runner_->PostDelayedTask(
+      [weak_this, id] {
+        if (weak_this)
+          weak_this->PumpQueryStream(id);
+      },
+      delay_ms);
+}
 
 void RunHttpRPCServer(std::unique_ptr<TraceProcessor> preloaded_instance,
                       std::string port_number) {
-  Httpd srv(std::move(preloaded_instance));
+  base::UnixTaskRunner task_runner;
+  Httpd srv(std::move(preloaded_instance), &task_runner);
   std::optional<int> port_opt = base::StringToInt32(port_number);
   int port = port_opt.has_value() ? *port_opt : kBindPort;
-  srv.Run(port);
+  srv.Start(port);
+  task_runner.Run();
 }
 
-void Httpd::ServeHelpPage(const base::HttpRequest& req) {
+void Httpd::ServeHelpPage(base::HttpServerConnection* conn) {
   static const char kPage[] = R"(Perfetto Trace Processor RPC Server
 
 
@@ -288,7 +432,7 @@ https://perfetto.dev/docs/contributing/getting-started#community
 )";
 
   std::initializer_list<const char*> headers{"Content-Type: text/plain"};
-  req.conn->SendResponse("200 OK", headers, kPage);
+  conn->SendResponse("200 OK", headers, kPage);
 }
 
 }  // namespace trace_processor
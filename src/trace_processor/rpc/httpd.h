@@ -17,12 +17,26 @@
 #ifndef SRC_TRACE_PROCESSOR_RPC_HTTPD_H_
 #define SRC_TRACE_PROCESSOR_RPC_HTTPD_H_
 
+#include <stdint.h>
+
+#include <list>
 #include <memory>
 #include <string>
 
+#include "perfetto/ext/base/http/http_server.h"
+#include "perfetto/ext/base/string_view.h"
+#include "perfetto/ext/base/weak_ptr.h"
+#include "src/trace_processor/rpc/rpc.h"
+
 namespace perfetto {
+
+namespace base {
+class TaskRunner;
+}  // namespace base
+
 namespace trace_processor {
 
+class QueryResultSerializer;
 class TraceProcessor;
 
 // Starts a RPC server that handles requests using protobuf-over-HTTP.
@@ -32,6 +46,82 @@ class TraceProcessor;
 // instance when pushing data into the /parse endpoint.
 void RunHttpRPCServer(std::unique_ptr<TraceProcessor>, std::string);
 
+// The server behind RunHttpRPCServer(). Exposed for testing.
+//
+// The results of a /query are streamed to the client as fast as it reads them.
+// While a query is being streamed, the trace processor is being stepped, so
+// any request which could change its state (i.e. anything but the help page,
+// /status and websocket handshakes) is queued until all the streams complete.
+// Requests on a connection which has a reply in flight are queued as well, as
+// a connection can only have one reply in flight.
+class Httpd : public base::HttpRequestHandler {
+ public:
+  Httpd(std::unique_ptr<TraceProcessor>, base::TaskRunner*);
+  ~Httpd() override;
+
+  // Starts listening on |port|. Requests are served on the task runner.
+  void Start(int port);
+
+ private:
+  // HttpRequestHandler implementation.
+  void OnHttpRequest(const base::HttpRequest&) override;
+  void OnWebsocketMessage(const base::WebsocketMessage&) override;
+  void OnHttpConnectionClosed(base::HttpServerConnection*) override;
+
+  // The results of a /query which are sent to the client as fast as it reads
+  // them, rather than as fast as the query produces them.
+  struct QueryStream {
+    uint64_t id;
+    base::HttpServerConnection* conn;
+    std::unique_ptr<QueryResultSerializer> serializer;
+    uint32_t retry_ms;
+  };
+
+  // A request (or websocket message) which has to wait for the query streams
+  // it conflicts with. Owns a copy of the parts of the request that are used,
+  // as the original one is valid only within OnHttpRequest().
+  struct PendingRequest {
+    base::HttpServerConnection* conn;
+    bool is_websocket_message;
+    std::string uri;
+    std::string body;
+    std::string seq_id;
+  };
+
+  // Returns true if serving a request for |uri| (empty for websocket messages)
+  // on |conn| now would conflict with a query stream.
+  bool ConflictsWithQueryStreams(base::HttpServerConnection* conn,
+                                 base::StringView uri) const;
+  bool HasPendingRequests(base::HttpServerConnection* conn) const;
+
+  void ServeHttpRequest(base::HttpServerConnection* conn,
+                        base::StringView uri,
+                        base::StringView body,
+                        base::StringView seq_id);
+  void ServeWebsocketMessage(base::HttpServerConnection* conn,
+                             base::StringView data);
+  void ServeHelpPage(base::HttpServerConnection* conn);
+
+  // Serves the queued requests, in order, until the first one which still
+  // conflicts with a query stream.
+  void ServePendingRequests();
+  void PostServePendingRequests();
+
+  // Sends the next batches of the stream with the given id, until either the
+  // client stops keeping up (and the stream is paused) or the query is done.
+  void PumpQueryStream(uint64_t id);
+  void PostPumpQueryStream(uint64_t id, uint32_t delay_ms);
+
+  Rpc trace_processor_rpc_;
+  base::TaskRunner* const task_runner_;
+  base::HttpServer http_srv_;
+  std::list<QueryStream> query_streams_;
+  std::list<PendingRequest> pending_requests_;
+  uint64_t last_query_stream_id_ = 0;
+  int last_req_id_ = 0;
+  base::WeakPtrFactory<Httpd> weak_factory_;  // Keep last.
+};
+
 }  // namespace trace_processor
 }  // namespace perfetto
 
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/rpc/httpd.h"
+
+#include <poll.h>
+
+#include <initializer_list>
+#include <string>
+
+#include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/unix_socket.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "src/base/test/test_task_runner.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/trace_processor/trace_processor.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+constexpr int kTestPort = 5128;
+
+// Large enough for the results not to fit in the socket buffers of a client
+// which doesn't read them.
+constexpr int64_t kNumRows = 100000;
+constexpr char kLargeQuery[] =
+    "with recursive r(x) as (select 1 union all select x + 1 from r "
+    "where x < 100000) select x, printf('%0200d', x) as s from r";
+
+class HttpCli {
+ public:
+  explicit HttpCli(base::TestTaskRunner* ttr) : task_runner_(ttr) {
+    sock_ = base::UnixSocketRaw::CreateMayFail(base::SockFamily::kInet,
+                                               base::SockType::kStream);
+    sock_.SetBlocking(true);
+    sock_.Connect("127.0.0.1:" + std::to_string(kTestPort));
+    sock_.SetBlocking(false);
+  }
+
+  void SendHttpReq(const std::string& method_and_uri,
+                   const std::string& body = "") {
+    std::string req = method_and_uri + " HTTP/1.1\r\n";
+    req += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    req += body;
+    sock_.SetBlocking(true);
+    sock_.SendStr(req);
+    sock_.SetBlocking(false);
+  }
+
+  void SendQuery(const std::string& sql) {
+    protozero::HeapBuffered<protos::pbzero::QueryArgs> args;
+    args->set_sql_query(sql);
+    args->set_cells_per_batch(1000);
+    SendHttpReq("POST /query", args.SerializeAsString());
+  }
+
+  // Runs the task runner until a whole reply has been received, and returns it.
+  // Chunked replies are complete once the terminating chunk is received.
+  std::string RecvReply() {
+    static int n = 0;
+    auto checkpoint_name = "reply_" + std::to_string(n++);
+    auto checkpoint = task_runner_->CreateCheckpoint(checkpoint_name);
+    task_runner_->AddFileDescriptorWatch(sock_.watch_handle(), [&] {
+      char buf[64 * 1024];
+      auto rsize = PERFETTO_EINTR(sock_.Receive(buf, sizeof(buf)));
+      if (rsize <= 0)
+        return;
+      rxbuf_.append(buf, static_cast<size_t>(rsize));
+      if (HasWholeReply())
+        checkpoint();
+    });
+    task_runner_->RunUntilCheckpoint(checkpoint_name, 30000);
+    task_runner_->RemoveFileDescriptorWatch(sock_.watch_handle());
+    std::string reply = std::move(rxbuf_);
+    rxbuf_.clear();
+    return reply;
+  }
+
+  // Returns true if the server sent anything which hasn't been received yet.
+  bool HasDataToRead() {
+    pollfd pfd{sock_.fd(), POLLIN, 0};
+    return PERFETTO_EINTR(poll(&pfd, 1, 0)) > 0;
+  }
+
+ private:
+  bool HasWholeReply() const {
+    size_t hdr_end = rxbuf_.find("\r\n\r\n");
+    if (hdr_end == std::string::npos)
+      return false;
+    std::string headers = rxbuf_.substr(0, hdr_end);
+    if (headers.find("Transfer-Encoding: chunked") != std::string::npos)
+      return base::EndsWith(rxbuf_, "\r\n0\r\n\r\n");
+    size_t len_pos = headers.find("Content-Length: ");
+    if (len_pos == std::string::npos)
+      return true;
+    size_t content_length = static_cast<size_t>(
+        atoll(headers.c_str() + len_pos + strlen("Content-Length: ")));
+    return rxbuf_.size() >= hdr_end + 4 + content_length;
+  }
+
+  base::TestTaskRunner* task_runner_;
+  base::UnixSocketRaw sock_;
+  std::string rxbuf_;
+};
+
+// Decodes the chunked reply of a /query, and returns the number of rows of its
+// first (integer) column.
+int64_t CountQueryRows(const std::string& reply) {
+  size_t pos = reply.find("\r\n\r\n");
+  EXPECT_NE(pos, std::string::npos);
+  pos += 4;
+  int64_t rows = 0;
+  bool saw_last_batch = false;
+  for (;;) {
+    size_t hdr_end = reply.find("\r\n", pos);
+    EXPECT_NE(hdr_end, std::string::npos);
+    size_t chunk_size = static_cast<size_t>(
+        strtoull(reply.substr(pos, hdr_end - pos).c_str(), nullptr, 16));
+    pos = hdr_end + 2;
+    if (chunk_size == 0)
+      break;
+    protos::pbzero::QueryResult::Decoder result(
+        reinterpret_cast<const uint8_t*>(reply.data() + pos), chunk_size);
+    EXPECT_FALSE(result.has_error()) << result.error().ToStdString();
+    for (auto it = result.batch(); it; ++it) {
+      protos::pbzero::QueryResult::CellsBatch::Decoder batch(*it);
+      bool parse_error = false;
+      for (auto cell = batch.varint_cells(&parse_error); cell; ++cell)
+        rows++;
+      EXPECT_FALSE(parse_error);
+      saw_last_batch |= batch.is_last_batch();
+    }
+    pos += chunk_size + 2;
+  }
+  EXPECT_TRUE(saw_last_batch);
+  return rows;
+}
+
+class HttpdTest : public ::testing::Test {
+ public:
+  HttpdTest()
+      : httpd_(TraceProcessor::CreateInstance(Config()), &task_runner_) {
+    httpd_.Start(kTestPort);
+  }
+
+  // Runs the task runner for |ms|, serving whatever can be served meanwhile.
+  void RunFor(uint32_t ms) {
+    static int n = 0;
+    auto checkpoint_name = "timeout_" + std::to_string(n++);
+    task_runner_.PostDelayedTask(task_runner_.CreateCheckpoint(checkpoint_name),
+                                 ms);
+    task_runner_.RunUntilCheckpoint(checkpoint_name);
+  }
+
+  base::TestTaskRunner task_runner_;
+  Httpd httpd_;
+};
+
+TEST_F(HttpdTest, QueryIsStreamedAtThePaceOfTheClient) {
+  HttpCli cli(&task_runner_);
+  cli.SendQuery(kLargeQuery);
+  RunFor(100);
+
+  // The client isn't reading: the streaming is paused rather than blocking the
+  // server, and the rest of the results are sent once it reads.
+  EXPECT_TRUE(cli.HasDataToRead());
+  EXPECT_EQ(CountQueryRows(cli.RecvReply()), kNumRows);
+}
+
+TEST_F(HttpdTest, StatusIsServedWhileStreaming) {
+  HttpCli slow_cli(&task_runner_);
+  slow_cli.SendQuery(kLargeQuery);
+  RunFor(100);
+
+  HttpCli cli(&task_runner_);
+  cli.SendHttpReq("GET /status");
+  std::string reply = cli.RecvReply();
+  EXPECT_TRUE(base::StartsWith(reply, "HTTP/1.1 200 OK\r\n"));
+
+  EXPECT_EQ(CountQueryRows(slow_cli.RecvReply()), kNumRows);
+}
+
+TEST_F(HttpdTest, ConflictingQueryWaitsForStreams) {
+  HttpCli slow_cli(&task_runner_);
+  slow_cli.SendQuery(kLargeQuery);
+  RunFor(100);
+
+  // A query could change the state of the trace processor while the first one
+  // is being stepped: it is queued rather than served.
+  HttpCli cli(&task_runner_);
+  cli.SendQuery("drop table if exists foo");
+  RunFor(100);
+  EXPECT_FALSE(cli.HasDataToRead());
+
+  // Once the first query is done, the queued one is served.
+  EXPECT_EQ(CountQueryRows(slow_cli.RecvReply()), kNumRows);
+  EXPECT_EQ(CountQueryRows(cli.RecvReply()), 0);
+}
+
+TEST_F(HttpdTest, QueuedRequestServedWhenStreamingClientLeaves) {
+  std::unique_ptr<HttpCli> slow_cli(new HttpCli(&task_runner_));
+  slow_cli->SendQuery(kLargeQuery);
+  RunFor(100);
+
+  HttpCli cli(&task_runner_);
+  cli.SendQuery("select 1 as x");
+  RunFor(100);
+  EXPECT_FALSE(cli.HasDataToRead());
+
+  // The client of the first query goes away: the queued query is served.
+  slow_cli.reset();
+  EXPECT_EQ(CountQueryRows(cli.RecvReply()), 1);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -16,8 +16,16 @@
 
 #include "perfetto/ext/trace_processor/rpc/query_result_serializer.h"
 
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <deque>
+#include <string>
 #include <vector>
 
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/string_view.h"
 #include "perfetto/protozero/packed_repeated_fields.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
@@ -33,6 +41,8 @@ namespace {
 namespace pu = ::protozero::proto_utils;
 using BatchProto = protos::pbzero::QueryResult::CellsBatch;
 using ResultProto = protos::pbzero::QueryResult;
+using ColumnarBatchProto = protos::pbzero::QueryResult::ColumnarBatch;
+using ColumnProto = protos::pbzero::QueryResult::ColumnarBatch::Column;
 
 // The reserved field in trace_processor.proto.
 static constexpr uint32_t kPaddingFieldId = 7;
@@ -43,6 +53,226 @@ uint8_t MakeLenDelimTag(uint32_t field_num) {
   return static_cast<uint8_t>(tag);
 }
 
+// Appends |data| as the length-delimited field |field_id| of |msg|, so that
+// the payload starts at a 64-bit aligned offset of |writer|. This allows
+// clients to overlay a typed array on top of it, without extra copies.
+// |msg| must have |kPaddingFieldId| reserved for the padding.
+void AppendAlignedBytes(const protozero::ScatteredStreamWriter& writer,
+                        protozero::Message* msg,
+                        uint32_t field_id,
+                        const void* data,
+                        uint32_t size) {
+  uint8_t preamble[16];
+  uint8_t* preamble_end = &preamble[0];
+  *(preamble_end++) = MakeLenDelimTag(field_id);
+  preamble_end = pu::WriteVarInt(size, preamble_end);
+  uint32_t preamble_size = static_cast<uint32_t>(preamble_end - &preamble[0]);
+
+  // The byte after the preamble must start at a 64bit-aligned offset.
+  // The padding needs to be > 1 Byte because of proto encoding.
+  const uint32_t off = static_cast<uint32_t>(writer.written() + preamble_size);
+  const uint32_t aligned_off = (off + 7) & ~7u;
+  uint32_t padding = aligned_off - off;
+  padding = padding == 1 ? 9 : padding;
+  if (padding > 0) {
+    uint8_t pad_buf[10];
+    uint8_t* pad = pad_buf;
+    *(pad++) = pu::MakeTagVarInt(kPaddingFieldId);
+    for (uint32_t i = 0; i < padding - 2; i++)
+      *(pad++) = 0x80;
+    *(pad++) = 0;
+    msg->AppendRawProtoBytes(pad_buf, static_cast<size_t>(pad - pad_buf));
+  }
+  msg->AppendRawProtoBytes(preamble, preamble_size);
+  PERFETTO_CHECK(writer.written() % 8 == 0);
+  msg->AppendRawProtoBytes(data, size);
+}
+
+// Accumulates the values of one column of a ColumnarBatch. Strings are
+// deduplicated into the dictionary of the column as they are appended, as
+// the pointers returned by the iterator are valid only until the next row.
+class ColumnBuilder {
+ public:
+  // Appends the value of the next row. Returns a rough estimate of the bytes
+  // this adds to the serialized batch.
+  uint32_t Append(const SqlValue& value) {
+    types_.push_back(static_cast<uint8_t>(value.type));
+    type_mask_ |= 1u << value.type;
+    switch (value.type) {
+      case SqlValue::Type::kNull:
+        values_.push_back(0);
+        return 1;
+      case SqlValue::Type::kLong:
+        values_.push_back(static_cast<uint64_t>(value.long_value));
+        return sizeof(int64_t);
+      case SqlValue::Type::kDouble: {
+        uint64_t bits;
+        memcpy(&bits, &value.double_value, sizeof(bits));
+        values_.push_back(bits);
+        return sizeof(double);
+      }
+      case SqlValue::Type::kString: {
+        uint32_t dictionary_size = dictionary_size_;
+        values_.push_back(InternString(base::StringView(value.string_value)));
+        return sizeof(uint32_t) + (dictionary_size_ - dictionary_size);
+      }
+      case SqlValue::Type::kBytes: {
+        const auto* src = static_cast<const uint8_t*>(value.bytes_value);
+        values_.push_back(blobs_.size());
+        blobs_.emplace_back(src, src + value.bytes_count);
+        return static_cast<uint32_t>(value.bytes_count) + 4;
+      }
+    }
+    PERFETTO_FATAL("For GCC");
+  }
+
+  // Returns false if the column mixes blobs with other types of values, which
+  // ColumnarBatch cannot represent.
+  bool IsRepresentable() const {
+    uint32_t non_null = type_mask_ & ~kNullMask;
+    return !(non_null & kBytesMask) || non_null == kBytesMask;
+  }
+
+  void Serialize(const protozero::ScatteredStreamWriter& writer,
+                 ColumnProto* col) {
+    PERFETTO_DCHECK(IsRepresentable());
+    const uint32_t non_null = type_mask_ & ~kNullMask;
+    if (non_null == 0) {
+      col->set_type(ColumnProto::COLUMN_NULL);
+      return;
+    }
+    if (non_null == kBytesMask) {
+      col->set_type(ColumnProto::COLUMN_BLOB);
+      MaybeSerializeValidity(col);
+      for (const auto& blob : blobs_)
+        col->add_blobs(blob.data(), blob.size());
+      return;
+    }
+    if (non_null & kStringMask) {
+      SerializeStrings(writer, col);
+      return;
+    }
+    if (non_null & kDoubleMask) {
+      col->set_type(ColumnProto::COLUMN_FLOAT64);
+      for (size_t i = 0; i < values_.size(); ++i) {
+        if (types_[i] != SqlValue::Type::kLong)
+          continue;
+        double value = static_cast<double>(static_cast<int64_t>(values_[i]));
+        memcpy(&values_[i], &value, sizeof(value));
+      }
+    } else {
+      col->set_type(ColumnProto::COLUMN_INT64);
+    }
+    MaybeSerializeValidity(col);
+    SerializeValues(writer, col, values_.data(),
+                    static_cast<uint32_t>(values_.size() * sizeof(uint64_t)));
+  }
+
+ private:
+  static constexpr uint32_t kNullMask = 1u << SqlValue::Type::kNull;
+  static constexpr uint32_t kDoubleMask = 1u << SqlValue::Type::kDouble;
+  static constexpr uint32_t kStringMask = 1u << SqlValue::Type::kString;
+  static constexpr uint32_t kBytesMask = 1u << SqlValue::Type::kBytes;
+
+  uint32_t InternString(base::StringView str) {
+    uint32_t* idx = dictionary_index_.Find(str);
+    if (idx)
+      return *idx;
+    strings_.emplace_back(str.data(), str.size());
+    uint32_t new_idx = static_cast<uint32_t>(strings_.size() - 1);
+    dictionary_index_.Insert(base::StringView(strings_.back()), new_idx);
+    dictionary_size_ += static_cast<uint32_t>(str.size()) + 1;
+    return new_idx;
+  }
+
+  void SerializeStrings(const protozero::ScatteredStreamWriter& writer,
+                        ColumnProto* col) {
+    // Numbers mixed with strings are converted to strings, so that the whole
+    // column can be decoded through the dictionary.
+    std::vector<uint32_t> indices(values_.size());
+    for (size_t i = 0; i < values_.size(); ++i) {
+      switch (types_[i]) {
+        case SqlValue::Type::kString:
+          indices[i] = static_cast<uint32_t>(values_[i]);
+          break;
+        case SqlValue::Type::kLong:
+          indices[i] = InternString(
+              base::StackString<32>("%" PRId64,
+                                    static_cast<int64_t>(values_[i]))
+                  .string_view());
+          break;
+        case SqlValue::Type::kDouble: {
+          double value;
+          memcpy(&value, &values_[i], sizeof(value));
+          indices[i] =
+              InternString(base::StackString<32>("%.15g", value).string_view());
+          break;
+        }
+        case SqlValue::Type::kNull:
+        case SqlValue::Type::kBytes:
+          break;
+      }
+    }
+    col->set_type(ColumnProto::COLUMN_STRING);
+    MaybeSerializeValidity(col);
+    SerializeValues(writer, col, indices.data(),
+                    static_cast<uint32_t>(indices.size() * sizeof(uint32_t)));
+
+    // As for CellsBatch.string_cells, the strings are NUL-separated in a
+    // single field rather than being a repeated field, which is much faster
+    // to decode in JS and Python.
+    auto* dictionary = col->BeginNestedMessage<protozero::Message>(
+        ColumnProto::kDictionaryFieldNumber);
+    for (const std::string& str : strings_)
+      dictionary->AppendRawProtoBytes(str.c_str(), str.size() + 1);
+    dictionary->Finalize();
+  }
+
+  static void SerializeValues(const protozero::ScatteredStreamWriter& writer,
+                              ColumnProto* col,
+                              const void* data,
+                              uint32_t size) {
+    // Messages shorter than 128 bytes are compacted by protozero when they
+    // are finalized, moving their payload by a few bytes: only larger
+    // payloads can be aligned (for the smaller ones it doesn't matter).
+    if (size > pu::kMaxOneByteMessageLength) {
+      AppendAlignedBytes(writer, col, ColumnProto::kValuesFieldNumber, data,
+                         size);
+    } else {
+      col->AppendBytes(ColumnProto::kValuesFieldNumber, data, size);
+    }
+  }
+
+  void MaybeSerializeValidity(ColumnProto* col) const {
+    if (!(type_mask_ & kNullMask))
+      return;
+    std::vector<uint8_t> validity((types_.size() + 7) / 8);
+    for (size_t i = 0; i < types_.size(); ++i) {
+      if (types_[i] != SqlValue::Type::kNull)
+        validity[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+    }
+    col->set_validity(validity.data(), validity.size());
+  }
+
+  // The SqlValue::Type of each row.
+  std::vector<uint8_t> types_;
+
+  // The value of each row: the bits of the int64 or double, the index in
+  // |strings_| for strings and the index in |blobs_| for blobs.
+  std::vector<uint64_t> values_;
+
+  // Bitmask of the SqlValue::Type of the values appended so far.
+  uint32_t type_mask_ = 0;
+
+  // |strings_| is a deque so that the StringViews in |dictionary_index_|
+  // remain valid as it grows.
+  std::deque<std::string> strings_;
+  base::FlatHashMap<base::StringView, uint32_t> dictionary_index_;
+  uint32_t dictionary_size_ = 0;
+
+  std::vector<std::vector<uint8_t>> blobs_;
+};
+
 }  // namespace
 
 QueryResultSerializer::QueryResultSerializer(Iterator iter)
@@ -50,6 +280,16 @@ QueryResultSerializer::QueryResultSerializer(Iterator iter)
 
 QueryResultSerializer::~QueryResultSerializer() = default;
 
+void QueryResultSerializer::set_cells_per_batch(uint32_t cells_per_batch) {
+  cells_per_batch_ = std::max(std::min(cells_per_batch, kMaxCellsPerBatch),
+                              std::max(num_cols_, 1u));
+}
+
+void QueryResultSerializer::set_result_format(ResultFormat format) {
+  PERFETTO_DCHECK(!did_write_metadata_);
+  result_format_ = format;
+}
+
 bool QueryResultSerializer::Serialize(std::vector<uint8_t>* buf) {
   const size_t slice = batch_split_threshold_ + 4096;
   protozero::HeapBuffered<protos::pbzero::QueryResult> result(slice, slice);
@@ -71,7 +311,11 @@ bool QueryResultSerializer::Serialize(protos::pbzero::QueryResult* res) {
   // write an empty batch with the EOF marker. Errors can happen also in the
   // middle of a query, not just before starting it.
 
-  SerializeBatch(res);
+  if (result_format_ == ResultFormat::kColumnar) {
+    SerializeColumnarBatch(res);
+  } else {
+    SerializeBatch(res);
+  }
   MaybeSerializeError(res);
   return !eof_reached_;
 }
@@ -208,32 +452,9 @@ void QueryResultSerializer::SerializeBatch(protos::pbzero::QueryResult* res) {
   // a TypedArray, without extra copies.
   const uint32_t doubles_size = static_cast<uint32_t>(doubles.size());
   if (doubles_size > 0) {
-    uint8_t preamble[16];
-    uint8_t* preamble_end = &preamble[0];
-    *(preamble_end++) = MakeLenDelimTag(BatchProto::kFloat64CellsFieldNumber);
-    preamble_end = pu::WriteVarInt(doubles_size, preamble_end);
-    uint32_t preamble_size = static_cast<uint32_t>(preamble_end - &preamble[0]);
-
-    // The byte after the preamble must start at a 64bit-aligned offset.
-    // The padding needs to be > 1 Byte because of proto encoding.
-    const uint32_t off =
-        static_cast<uint32_t>(writer.written() + preamble_size);
-    const uint32_t aligned_off = (off + 7) & ~7u;
-    uint32_t padding = aligned_off - off;
-    padding = padding == 1 ? 9 : padding;
-    if (padding > 0) {
-      uint8_t pad_buf[10];
-      uint8_t* pad = pad_buf;
-      *(pad++) = pu::MakeTagVarInt(kPaddingFieldId);
-      for (uint32_t i = 0; i < padding - 2; i++)
-        *(pad++) = 0x80;
-      *(pad++) = 0;
-      batch->AppendRawProtoBytes(pad_buf, static_cast<size_t>(pad - pad_buf));
-    }
-    batch->AppendRawProtoBytes(preamble, preamble_size);
-    PERFETTO_CHECK(writer.written() % 8 == 0);
-    batch->AppendRawProtoBytes(doubles.data(), doubles_size);
-  }  // if (doubles_size > 0)
+    AppendAlignedBytes(writer, batch, BatchProto::kFloat64CellsFieldNumber,
+                       doubles.data(), doubles_size);
+  }
 
   // Append the blobs.
   if (blobs.size() > 0) {
@@ -250,8 +471,65 @@ void QueryResultSerializer::SerializeBatch(protos::pbzero::QueryResult* res) {
   batch->Finalize();
 }
 
+void QueryResultSerializer::SerializeColumnarBatch(
+    protos::pbzero::QueryResult* res) {
+  const auto& writer = *res->stream_writer();
+
+  // The rows are split in batches with the same criteria of SerializeBatch().
+  std::vector<ColumnBuilder> columns(num_cols_);
+  uint32_t approx_batch_size = 16;
+  uint32_t row_count = 0;
+  bool batch_full = false;
+  for (;; ++row_count) {
+    // As in SerializeBatch(), if |col_| < |num_cols_| the iterator is already
+    // on a row which didn't fit in the previous batch.
+    if (col_ >= num_cols_) {
+      col_ = 0;
+      if (!iter_->Next())
+        break;  // EOF or error.
+      PERFETTO_DCHECK(num_cols_ > 0);
+    }
+    if (row_count > 0 && ((row_count + 1) * num_cols_ > cells_per_batch_ ||
+                          approx_batch_size > batch_split_threshold_)) {
+      batch_full = true;
+      break;
+    }
+    for (; col_ < num_cols_; ++col_)
+      approx_batch_size += columns[col_].Append(iter_->Get(col_));
+  }
+
+  auto* batch = res->add_columnar_batch();
+  for (uint32_t c = 0; c < num_cols_; ++c) {
+    if (columns[c].IsRepresentable())
+      continue;
+    // End the query with an empty batch, the error is reported by
+    // MaybeSerializeError().
+    format_error_ = "Column '" + iter_->GetColumnName(c) +
+                    "' mixes blobs with values of other types, which is not "
+                    "supported by the columnar result format";
+    row_count = 0;
+    columns.clear();
+    batch_full = false;
+    break;
+  }
+
+  batch->set_row_count(row_count);
+  for (ColumnBuilder& column : columns)
+    column.Serialize(writer, batch->add_columns());
+
+  if (!batch_full) {
+    eof_reached_ = true;
+    batch->set_is_last_batch(true);
+  }
+  batch->Finalize();
+}
+
 void QueryResultSerializer::MaybeSerializeError(
     protos::pbzero::QueryResult* res) {
+  if (!format_error_.empty()) {
+    res->set_error(format_error_);
+    return;
+  }
   if (iter_->Status().ok())
     return;
   std::string err = iter_->Status().message();
@@ -18,6 +18,20 @@
 
 #include <benchmark/benchmark.h>
 
+#include <fcntl.h>
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/string_splitter.h"
+#include "perfetto/ext/base/unix_socket.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/trace_processor.h"
 
@@ -46,51 +60,216 @@ void RunQueryChecked(TraceProcessor* tp, const std::string& query) {
   PERFETTO_CHECK(iter.Status().ok());
 }
 
-}  // namespace
-
-static void BM_QueryResultSerializer_Mixed(benchmark::State& state) {
-  auto tp = TraceProcessor::CreateInstance(Config());
-  RunQueryChecked(tp.get(), "create virtual table win using window;");
-  RunQueryChecked(tp.get(),
-                  "update win set window_start=0, window_dur=50000, quantum=1 "
-                  "where rowid = 0");
+// Serializes the whole result of |query| in |format| and reports the size of
+// the serialized result.
+void SerializeQuery(benchmark::State& state,
+                    TraceProcessor* tp,
+                    const std::string& query,
+                    QueryResultSerializer::ResultFormat format) {
   VectorType buf;
+  size_t bytes = 0;
   for (auto _ : state) {
-    auto iter = tp->ExecuteQuery(
-        "select dur || dur as x, ts, dur * 1.0 as dur, quantum_ts from win");
+    auto iter = tp->ExecuteQuery(query);
     QueryResultSerializer serializer(std::move(iter));
+    serializer.set_result_format(format);
     serializer.set_batch_size_for_testing(
         static_cast<uint32_t>(state.range(0)),
         static_cast<uint32_t>(state.range(1)));
     while (serializer.Serialize(&buf)) {
     }
     benchmark::DoNotOptimize(buf.data());
+    bytes = buf.size();
     buf.clear();
   }
   benchmark::ClobberMemory();
+  state.counters["bytes"] = static_cast<double>(bytes);
 }
 
-static void BM_QueryResultSerializer_Strings(benchmark::State& state) {
+void BM_QueryResultSerializer_MixedImpl(
+    benchmark::State& state,
+    QueryResultSerializer::ResultFormat format) {
+  auto tp = TraceProcessor::CreateInstance(Config());
+  RunQueryChecked(tp.get(), "create virtual table win using window;");
+  RunQueryChecked(tp.get(),
+                  "update win set window_start=0, window_dur=50000, quantum=1 "
+                  "where rowid = 0");
+  SerializeQuery(
+      state, tp.get(),
+      "select dur || dur as x, ts, dur * 1.0 as dur, quantum_ts from win",
+      format);
+}
+
+void BM_QueryResultSerializer_StringsImpl(
+    benchmark::State& state,
+    QueryResultSerializer::ResultFormat format) {
   auto tp = TraceProcessor::CreateInstance(Config());
   RunQueryChecked(tp.get(), "create virtual table win using window;");
   RunQueryChecked(tp.get(),
                   "update win set window_start=0, window_dur=100000, quantum=1 "
                   "where rowid = 0");
+  SerializeQuery(state, tp.get(),
+                 "select  ts || '-' || ts , (dur * 1.0) || dur from win",
+                 format);
+}
+
+// Resets the peak RSS of the process, so that GetPeakRssKb() measures the
+// peak since this call. Only supported on Linux and Android.
+void ResetPeakRss() {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  perfetto::base::ScopedFile fd(
+      perfetto::base::OpenFile("/proc/self/clear_refs", O_WRONLY));
+  if (fd)
+    perfetto::base::WriteAll(*fd, "5", 1);
+#endif
+}
+
+std::optional<uint64_t> GetPeakRssKb() {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  std::string status;
+  if (!perfetto::base::ReadFile("/proc/self/status", &status))
+    return std::nullopt;
+  for (perfetto::base::StringSplitter lines(status, '\n'); lines.Next();) {
+    uint64_t peak_rss_kb = 0;
+    if (sscanf(lines.cur_token(), "VmHWM: %" SCNu64, &peak_rss_kb) == 1)
+      return peak_rss_kb;
+  }
+#endif
+  return std::nullopt;
+}
+
+// A client which reads the results of a query over a slow link: it reads at
+// most 64 KB per ms.
+class ThrottledReader {
+ public:
+  explicit ThrottledReader(perfetto::base::UnixSocketRaw sock)
+      : sock_(std::move(sock)), thread_([this] { Run(); }) {}
+  ~ThrottledReader() {
+    done_ = true;
+    thread_.join();
+  }
+
+ private:
+  void Run() {
+    char buf[64 * 1024];
+    sock_.SetBlocking(false);
+    while (!done_) {
+      while (sock_.Receive(buf, sizeof(buf)) > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  perfetto::base::UnixSocketRaw sock_;
+  std::atomic<bool> done_{false};
+  std::thread thread_;
+};
+
+void SendAll(perfetto::base::UnixSocketRaw* sock, const VectorType& buf) {
+  for (size_t off = 0; off < buf.size();) {
+    ssize_t res = sock->Send(buf.data() + off, buf.size() - off);
+    PERFETTO_CHECK(res > 0);
+    off += static_cast<size_t>(res);
+  }
+}
+
+constexpr uint32_t kThrottledRows = 200000;
+
+// Serializes the results of a query for a client which reads them slowly,
+// either by materializing all of them first (|stream| == false) or by
+// serializing each batch only once the previous one was sent (|stream| ==
+// true), and reports the rows/s and the peak RSS.
+void BM_QueryResultSerializer_ThrottledReader(benchmark::State& state,
+                                              bool stream) {
+  auto tp = TraceProcessor::CreateInstance(Config());
+  RunQueryChecked(tp.get(), "create virtual table win using window;");
+  RunQueryChecked(tp.get(), "update win set window_start=0, window_dur=" +
+                                std::to_string(kThrottledRows) +
+                                ", quantum=1 where rowid = 0");
+  auto sock_pair = perfetto::base::UnixSocketRaw::CreatePairPosix(
+      perfetto::base::SockFamily::kUnix, perfetto::base::SockType::kStream);
+  perfetto::base::UnixSocketRaw& tx = sock_pair.first;
+  tx.SetBlocking(true);
+  ThrottledReader reader(std::move(sock_pair.second));
+
+  ResetPeakRss();
+  std::optional<uint64_t> rss_before = GetPeakRssKb();
   VectorType buf;
   for (auto _ : state) {
     auto iter = tp->ExecuteQuery(
-        "select  ts || '-' || ts , (dur * 1.0) || dur from win");
+        "select dur || dur as x, ts, dur * 1.0 as dur, quantum_ts from win");
     QueryResultSerializer serializer(std::move(iter));
-    serializer.set_batch_size_for_testing(
-        static_cast<uint32_t>(state.range(0)),
-        static_cast<uint32_t>(state.range(1)));
-    while (serializer.Serialize(&buf)) {
+    serializer.set_cells_per_batch(static_cast<uint32_t>(state.range(0)));
+    for (bool has_more = true; has_more;) {
+      has_more = serializer.Serialize(&buf);
+      if (stream) {
+        SendAll(&tx, buf);
+        buf.clear();
+      }
     }
-    benchmark::DoNotOptimize(buf.data());
+    SendAll(&tx, buf);
     buf.clear();
+    buf.shrink_to_fit();
+    if (IsBenchmarkFunctionalOnly())
+      break;
   }
-  benchmark::ClobberMemory();
+  std::optional<uint64_t> rss_after = GetPeakRssKb();
+
+  state.counters["rows/s"] =
+      benchmark::Counter(kThrottledRows,
+                         benchmark::Counter::kIsIterationInvariantRate);
+  if (rss_before && rss_after) {
+    state.counters["peak_rss_kb"] =
+        static_cast<double>(*rss_after - *rss_before);
+  }
+}
+
+void ThrottledArgs(benchmark::internal::Benchmark* b) {
+  b->Arg(QueryResultSerializer::kDefaultCellsPerBatch);
+  if (!IsBenchmarkFunctionalOnly())
+    b->Arg(1024);
+  b->Unit(benchmark::kMillisecond);
+}
+
+}  // namespace
+
+static void BM_QueryResultSerializer_Mixed(benchmark::State& state) {
+  BM_QueryResultSerializer_MixedImpl(
+      state, QueryResultSerializer::ResultFormat::kCells);
+}
+
+static void BM_QueryResultSerializer_MixedColumnar(benchmark::State& state) {
+  BM_QueryResultSerializer_MixedImpl(
+      state, QueryResultSerializer::ResultFormat::kColumnar);
+}
+
+static void BM_QueryResultSerializer_Strings(benchmark::State& state) {
+  BM_QueryResultSerializer_StringsImpl(
+      state, QueryResultSerializer::ResultFormat::kCells);
+}
+
+static void BM_QueryResultSerializer_StringsColumnar(benchmark::State& state) {
+  BM_QueryResultSerializer_StringsImpl(
+      state, QueryResultSerializer::ResultFormat::kColumnar);
+}
+
+static void BM_QueryResultSerializer_ThrottledReaderBuffered(
+    benchmark::State& state) {
+  BM_QueryResultSerializer_ThrottledReader(state, /*stream=*/false);
+}
+
+static void BM_QueryResultSerializer_ThrottledReaderStreamed(
+    benchmark::State& state) {
+  BM_QueryResultSerializer_ThrottledReader(state, /*stream=*/true);
 }
 
 BENCHMARK(BM_QueryResultSerializer_Mixed)->Apply(BenchmarkArgs);
+BENCHMARK(BM_QueryResultSerializer_MixedColumnar)->Apply(BenchmarkArgs);
 BENCHMARK(BM_QueryResultSerializer_Strings)->Apply(BenchmarkArgs);
+BENCHMARK(BM_QueryResultSerializer_StringsColumnar)->Apply(BenchmarkArgs);
+BENCHMARK(BM_QueryResultSerializer_ThrottledReaderBuffered)
+    ->Apply(ThrottledArgs);
+BENCHMARK(BM_QueryResultSerializer_ThrottledReaderStreamed)
+    ->Apply(ThrottledArgs);
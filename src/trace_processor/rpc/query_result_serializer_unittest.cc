@@ -71,6 +71,7 @@ namespace {
 
 using ::testing::ElementsAre;
 using BatchProto = protos::pbzero::QueryResult::CellsBatch;
+using ColumnProto = protos::pbzero::QueryResult::ColumnarBatch::Column;
 using ResultProto = protos::pbzero::QueryResult;
 
 void RunQueryChecked(TraceProcessor* tp, const std::string& query) {
@@ -89,8 +90,12 @@ class TestDeserializer {
   std::vector<SqlValue> cells;
   std::string error;
   bool eof_reached = false;
+  uint32_t num_batches = 0;
 
  private:
+  void DeserializeColumnarBatch(const uint8_t* start, size_t size);
+  SqlValue CopyString(const std::string&);
+
   std::vector<std::unique_ptr<char[]>> copied_buf_;
 };
 
@@ -114,6 +119,7 @@ void TestDeserializer::DeserializeBuffer(const uint8_t* start, size_t size) {
   for (auto batch_it = result.batch(); batch_it; ++batch_it) {
     ASSERT_FALSE(eof_reached);
     auto batch_bytes = batch_it->as_bytes();
+    num_batches++;
 
     ResultProto::CellsBatch::Decoder batch(batch_bytes.data, batch_bytes.size);
     eof_reached = batch.is_last_batch();
@@ -161,11 +167,7 @@ void TestDeserializer::DeserializeBuffer(const uint8_t* start, size_t size) {
           break;
         case BatchProto::CELL_STRING: {
           ASSERT_GT(strings.size(), 0u);
-          const std::string& str = strings.front();
-          copied_buf_.emplace_back(new char[str.size() + 1]);
-          char* new_buf = copied_buf_.back().get();
-          memcpy(new_buf, str.c_str(), str.size() + 1);
-          cells.emplace_back(SqlValue::String(new_buf));
+          cells.emplace_back(CopyString(strings.front()));
           strings.pop_front();
           break;
         }
@@ -193,6 +195,103 @@ void TestDeserializer::DeserializeBuffer(const uint8_t* start, size_t size) {
   }
 }
 
+  for (auto batch_it = result.columnar_batch(); batch_it; ++batch_it) {
+    ASSERT_FALSE(eof_reached);
+    num_batches++;
+    auto batch_bytes = batch_it->as_bytes();
+    DeserializeColumnarBatch(batch_bytes.data, batch_bytes.size);
+  }
+}
+
+// Converts the batch back to row-major cells, as for CellsBatch.
+void TestDeserializer::DeserializeColumnarBatch(const uint8_t* start,
+                                                size_t size) {
+  ResultProto::ColumnarBatch::Decoder batch(start, size);
+  eof_reached = batch.is_last_batch();
+  const uint32_t num_rows = batch.row_count();
+
+  std::vector<std::vector<SqlValue>> values;
+  for (auto col_it = batch.columns(); col_it; ++col_it) {
+    auto col_bytes = col_it->as_bytes();
+    ColumnProto::Decoder col(col_bytes.data, col_bytes.size);
+    values.emplace_back();
+    std::vector<SqlValue>& col_values = values.back();
+
+    auto validity = col.validity();
+    if (col.has_validity())
+      ASSERT_EQ(validity.size, (num_rows + 7) / 8);
+    auto vals = col.values();
+    std::vector<std::string> dictionary;
+    std::string merged_strings = col.dictionary().ToStdString();
+    for (size_t pos = 0; pos < merged_strings.size();) {
+      size_t next_sep = merged_strings.find('\0', pos);
+      dictionary.emplace_back(merged_strings.substr(pos, next_sep - pos));
+      pos = next_sep == std::string::npos ? next_sep : next_sep + 1;
+    }
+    auto blob_it = col.blobs();
+
+    for (uint32_t row = 0; row < num_rows; ++row) {
+      bool is_null = col.type() == ColumnProto::COLUMN_NULL ||
+                     (col.has_validity() &&
+                      !((validity.data[row / 8] >> (row % 8)) & 1));
+      if (is_null) {
+        col_values.emplace_back(SqlValue());
+        continue;
+      }
+      switch (col.type()) {
+        case ColumnProto::COLUMN_INT64: {
+          ASSERT_EQ(vals.size, num_rows * sizeof(int64_t));
+          int64_t value;
+          memcpy(&value, vals.data + row * sizeof(int64_t), sizeof(value));
+          col_values.emplace_back(SqlValue::Long(value));
+          break;
+        }
+        case ColumnProto::COLUMN_FLOAT64: {
+          ASSERT_EQ(vals.size, num_rows * sizeof(double));
+          double value;
+          memcpy(&value, vals.data + row * sizeof(double), sizeof(value));
+          col_values.emplace_back(SqlValue::Double(value));
+          break;
+        }
+        case ColumnProto::COLUMN_STRING: {
+          ASSERT_EQ(vals.size, num_rows * sizeof(uint32_t));
+          uint32_t idx;
+          memcpy(&idx, vals.data + row * sizeof(uint32_t), sizeof(idx));
+          ASSERT_LT(idx, dictionary.size());
+          col_values.emplace_back(CopyString(dictionary[idx]));
+          break;
+        }
+        case ColumnProto::COLUMN_BLOB: {
+          ASSERT_TRUE(blob_it);
+          auto bytes = *blob_it;
+          copied_buf_.emplace_back(new char[bytes.size]);
+          memcpy(copied_buf_.back().get(), bytes.data, bytes.size);
+          col_values.emplace_back(
+              SqlValue::Bytes(copied_buf_.back().get(), bytes.size));
+          ++blob_it;
+          break;
+        }
+        default:
+          FAIL() << "Unknown column type " << col.type();
+      }
+    }
+  }
+
+  if (num_rows > 0)
+    ASSERT_EQ(values.size(), columns.size());
+  for (uint32_t row = 0; row < num_rows; ++row) {
+    for (const auto& col_values : values)
+      cells.emplace_back(col_values[row]);
+  }
+}
+
+SqlValue TestDeserializer::CopyString(const std::string& str) {
+  copied_buf_.emplace_back(new char[str.size() + 1]);
+  char* new_buf = copied_buf_.back().get();
+  memcpy(new_buf, str.c_str(), str.size() + 1);
+  return SqlValue::String(new_buf);
+}
+
 TEST(QueryResultSerializerTest, ShortBatch) {
   auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
 
@@ -452,6 +551,112 @@ TEST(QueryResultSerializerTest, NoResultQuery) {
   }
 }
 
+TEST(QueryResultSerializerTest, ColumnarShortBatch) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+
+  auto iter = tp->ExecuteQuery(
+      "select 1 as i8, 42001001001 as i64, 1e9 as f64, 'a_string' as str, "
+      "cast('a_blob' as blob) as blb, null as nul");
+  QueryResultSerializer ser(std::move(iter));
+  ser.set_result_format(QueryResultSerializer::ResultFormat::kColumnar);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+
+  EXPECT_EQ(deser.error, "");
+  EXPECT_THAT(deser.columns,
+              ElementsAre("i8", "i64", "f64", "str", "blb", "nul"));
+  EXPECT_THAT(deser.cells,
+              ElementsAre(SqlValue::Long(1), SqlValue::Long(42001001001),
+                          SqlValue::Double(1e9), SqlValue::String("a_string"),
+                          SqlValue::Bytes("a_blob", 6), SqlValue()));
+}
+
+TEST(QueryResultSerializerTest, ColumnarLongBatch) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+
+  RunQueryChecked(tp.get(), "create virtual table win using window;");
+  RunQueryChecked(tp.get(),
+                  "update win set window_start=0, window_dur=8192, quantum=1 "
+                  "where rowid = 0");
+
+  auto iter = tp->ExecuteQuery(
+      "select 'x' as x, ts, dur * 1.0 as dur, iif(ts % 3, ts, null) as n "
+      "from win");
+  QueryResultSerializer ser(std::move(iter));
+  ser.set_result_format(QueryResultSerializer::ResultFormat::kColumnar);
+  ser.set_batch_size_for_testing(1000, 1024 * 1024);
+
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+
+  ASSERT_THAT(deser.columns, ElementsAre("x", "ts", "dur", "n"));
+  ASSERT_EQ(deser.cells.size(), 4 * 8192u);
+  EXPECT_EQ(deser.num_batches, 33u);  // 250 rows per batch.
+  for (uint32_t row = 0; row < 8192; row++) {
+    uint32_t cell = row * 4;
+    ASSERT_EQ(deser.cells[cell], SqlValue::String("x"));
+    ASSERT_EQ(deser.cells[cell + 1], SqlValue::Long(row));
+    ASSERT_EQ(deser.cells[cell + 2].type, SqlValue::kDouble);
+    ASSERT_EQ(deser.cells[cell + 2].double_value, 1.0);
+    ASSERT_EQ(deser.cells[cell + 3],
+              row % 3 ? SqlValue::Long(row) : SqlValue());
+  }
+}
+
+TEST(QueryResultSerializerTest, ColumnarMixedTypes) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+  RunQueryChecked(tp.get(), "create table tab (a, b, c)");
+  RunQueryChecked(tp.get(),
+                  "insert into tab values (1, 'foo', null), (2.5, 42, null), "
+                  "(null, 'foo', null)");
+
+  auto iter = tp->ExecuteQuery("select a, b, c from tab");
+  QueryResultSerializer ser(std::move(iter));
+  ser.set_result_format(QueryResultSerializer::ResultFormat::kColumnar);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+
+  // Integers mixed with doubles are converted to doubles, numbers mixed with
+  // strings are converted to strings.
+  EXPECT_EQ(deser.error, "");
+  EXPECT_THAT(deser.cells,
+              ElementsAre(SqlValue::Double(1), SqlValue::String("foo"),
+                          SqlValue(), SqlValue::Double(2.5),
+                          SqlValue::String("42"), SqlValue(), SqlValue(),
+                          SqlValue::String("foo"), SqlValue()));
+}
+
+TEST(QueryResultSerializerTest, ColumnarBlobsMixedWithOtherTypes) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+  RunQueryChecked(tp.get(), "create table tab (x)");
+  RunQueryChecked(tp.get(),
+                  "insert into tab values (cast('a_blob' as blob)), (1)");
+
+  auto iter = tp->ExecuteQuery("select x from tab");
+  QueryResultSerializer ser(std::move(iter));
+  ser.set_result_format(QueryResultSerializer::ResultFormat::kColumnar);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+  EXPECT_NE(deser.error, "");
+  EXPECT_EQ(deser.cells.size(), 0u);
+  EXPECT_TRUE(deser.eof_reached);
+}
+
+TEST(QueryResultSerializerTest, ColumnarErrorAfterSomeResults) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+  RunQueryChecked(tp.get(), "create table tab (x)");
+  RunQueryChecked(tp.get(), "insert into tab (x) values (0), (1), ('error')");
+  auto iter = tp->ExecuteQuery("select str_split('a;b', ';', x) as s from tab");
+  QueryResultSerializer ser(std::move(iter));
+  ser.set_result_format(QueryResultSerializer::ResultFormat::kColumnar);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+  EXPECT_NE(deser.error, "");
+  EXPECT_THAT(deser.cells,
+              ElementsAre(SqlValue::String("a"), SqlValue::String("b")));
+  EXPECT_TRUE(deser.eof_reached);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -18,6 +18,7 @@
 
 #include <string.h>
 
+#include <memory>
 #include <vector>
 
 #include "perfetto/base/logging.h"
@@ -215,11 +216,10 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
         resp.Send(rpc_response_fn_);
       } else {
         protozero::ConstBytes args = req.query_args();
-        auto it = QueryInternal(args.data, args.size);
-        QueryResultSerializer serializer(std::move(it));
+        auto serializer = StartQuery(args.data, args.size);
         for (bool has_more = true; has_more;) {
           Response resp(tx_seq_id_++, req_type);
-          has_more = serializer.Serialize(resp->set_query_result());
+          has_more = serializer->Serialize(resp->set_query_result());
           resp.Send(rpc_response_fn_);
         }
       }
@@ -366,17 +366,31 @@ void Rpc::MaybePrintProgress() {
 void Rpc::Query(const uint8_t* args,
                 size_t len,
                 QueryResultBatchCallback result_callback) {
-  auto it = QueryInternal(args, len);
-  QueryResultSerializer serializer(std::move(it));
+  auto serializer = StartQuery(args, len);
 
   std::vector<uint8_t> res;
   for (bool has_more = true; has_more;) {
-    has_more = serializer.Serialize(&res);
+    has_more = serializer->Serialize(&res);
     result_callback(res.data(), res.size(), has_more);
     res.clear();
   }
 }
 
+std::unique_ptr<QueryResultSerializer> Rpc::StartQuery(const uint8_t* args,
+                                                      size_t len) {
+  auto serializer =
+      std::make_unique<QueryResultSerializer>(QueryInternal(args, len));
+  protos::pbzero::QueryArgs::Decoder query(args, len);
+  if (query.has_cells_per_batch()) {
+    serializer->set_cells_per_batch(query.cells_per_batch());
+  }
+  if (query.result_format() == protos::pbzero::QueryArgs::COLUMNAR) {
+    serializer->set_result_format(
+        QueryResultSerializer::ResultFormat::kColumnar);
+  }
+  return serializer;
+}
+
 Iterator Rpc::QueryInternal(const uint8_t* args, size_t len) {
   protos::pbzero::QueryArgs::Decoder query(args, len);
   std::string sql = query.sql_query().ToStdString();
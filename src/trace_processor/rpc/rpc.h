@@ -40,6 +40,7 @@ class DisableAndReadMetatraceResult;
 namespace trace_processor {
 
 class Iterator;
+class QueryResultSerializer;
 class TraceProcessor;
 
 // This class handles the binary {,un}marshalling for the Trace Processor RPC
@@ -131,6 +132,16 @@ class Rpc {
       void(const uint8_t* /*buf*/, size_t /*len*/, bool /*has_more*/)>;
   void Query(const uint8_t* args, size_t len, QueryResultBatchCallback);
 
+  // Like Query(), but returns the serializer for the results rather than
+  // pushing all the batches inline: the caller pulls the batches at its own
+  // pace (e.g. only when the client is ready to receive more data), which
+  // addresses the re-entrancy problem described above for a single query.
+  // The query is stepped lazily, so the serializer must be destroyed before
+  // calling any other method that changes the state of the trace processor
+  // (Parse(), RestoreInitialTables(), ResetTraceProcessor()...).
+  std::unique_ptr<QueryResultSerializer> StartQuery(const uint8_t* args,
+                                                    size_t len);
+
  private:
   void ParseRpcRequest(const uint8_t* data, size_t len);
   void ResetTraceProcessorInternal(const Config& config);
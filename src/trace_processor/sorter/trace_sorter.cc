@@ -15,6 +15,7 @@
  */
 
 #include <algorithm>
+#include <functional>
 #include <memory>
 #include <utility>
 
@@ -33,7 +34,9 @@ TraceSorter::TraceSorter(TraceProcessorContext* context,
                          SortingMode sorting_mode)
     : context_(context),
       parser_(std::move(parser)),
-      sorting_mode_(sorting_mode) {
+      sorting_mode_(sorting_mode),
+      token_buffer_(context->config.sorter_memory_budget_bytes,
+                    context->config.sorter_spill_dir) {
   const char* env = getenv("TRACE_PROCESSOR_SORT_ONLY");
   bypass_next_stage_for_testing_ = env && !strcmp(env, "1");
   if (bypass_next_stage_for_testing_)
@@ -45,13 +48,15 @@ TraceSorter::~TraceSorter() {
   // to have been pushed without evicting them by pushing to the next stage. Do
   // that now.
   for (auto& queue : queues_) {
-    for (const auto& event : queue.events_) {
-      ExtractAndDiscardTokenizedObject(event);
+    for (auto& sub_queue : queue.sub_queues_) {
+      for (const auto& event : sub_queue.events_) {
+        ExtractAndDiscardTokenizedObject(event);
+      }
     }
   }
 }
 
-void TraceSorter::Queue::Sort() {
+void TraceSorter::SubQueue::Sort() {
   PERFETTO_DCHECK(needs_sorting());
   PERFETTO_DCHECK(sort_start_idx_ < events_.size());
 
@@ -88,90 +93,157 @@ void TraceSorter::Queue::Sort() {
 //  q2              {min_ts: 12    max_ts: 40}
 //
 // We know that we can extract all events from q1 until we hit ts=10 without
-// looking at any other queue. After hitting ts=10, we need to re-look to all of
-// them to figure out the next min-event.
-// There are more suitable data structures to do this (e.g. keeping a min-heap
-// to avoid re-scanning all the queues all the times) but doesn't seem worth it.
-// With Android traces (that have 8 CPUs) this function accounts for ~1-3% cpu
-// time in a profiler.
+// looking at any other queue. After hitting ts=10, we need to find the next
+// min-queue again.
+// The queues are kept in a min-heap keyed by their min_ts so that finding the
+// top-2 queues does not require re-scanning all of them on every iteration.
+// This matters as every CPU contributes up to kNumEventClasses sub-queues and
+// traces from big machines have hundreds of CPUs.
 void TraceSorter::SortAndExtractEventsUntilAllocId(
     BumpAllocator::AllocId limit_alloc_id) {
   constexpr int64_t kTsMax = std::numeric_limits<int64_t>::max();
-  for (;;) {
-    size_t min_queue_idx = 0;  // The index of the queue with the min(ts).
-
-    // The top-2 min(ts) among all queues.
-    // queues_[min_queue_idx].events.timestamp == min_queue_ts[0].
-    int64_t min_queue_ts[2]{kTsMax, kTsMax};
-
-    // This loop identifies the queue which starts with the earliest event and
-    // also remembers the earliest event of the 2nd queue (in min_queue_ts[1]).
-    bool all_queues_empty = true;
-    for (size_t i = 0; i < queues_.size(); i++) {
-      auto& queue = queues_[i];
-      if (queue.events_.empty())
-        continue;
-      all_queues_empty = false;
-
-      PERFETTO_DCHECK(queue.max_ts_ <= append_max_ts_);
-      if (queue.min_ts_ < min_queue_ts[0]) {
-        min_queue_ts[1] = min_queue_ts[0];
-        min_queue_ts[0] = queue.min_ts_;
-        min_queue_idx = i;
-      } else if (queue.min_ts_ < min_queue_ts[1]) {
-        min_queue_ts[1] = queue.min_ts_;
-      }
-    }
-    if (all_queues_empty)
+  std::greater<QueueHeapEntry> heap_cmp;
+
+  queue_heap_.clear();
+  for (size_t i = 0; i < queues_.size(); i++) {
+    const Queue& queue = queues_[i];
+    if (queue.empty())
+      continue;
+    PERFETTO_DCHECK(queue.max_ts_ <= append_max_ts_);
+    queue_heap_.push_back(QueueHeapEntry{queue.min_ts_, i});
+  }
+  std::make_heap(queue_heap_.begin(), queue_heap_.end(), heap_cmp);
+
+  while (!queue_heap_.empty()) {
+    // Pop the queue which starts with the earliest event. The new top of the
+    // heap is the queue with the 2nd earliest event.
+    std::pop_heap(queue_heap_.begin(), queue_heap_.end(), heap_cmp);
+    size_t min_queue_idx = queue_heap_.back().queue_idx;
+    queue_heap_.pop_back();
+    int64_t second_min_ts =
+        queue_heap_.empty() ? kTsMax : queue_heap_.front().min_ts;
+
+    // Extract all events from the min-queue until we hit either: (1) the
+    // min-ts of the 2nd queue or (2) the packet index limit, whichever comes
+    // first.
+    size_t num_extracted =
+        ExtractEventsFromQueue(min_queue_idx, second_min_ts, limit_alloc_id);
+
+    // The earliest event cannot be extracted without going past the limit.
+    if (!num_extracted)
       break;
 
+    // Since we likely just removed a bunch of items try to reduce the memory
+    // usage of the token buffer.
+    token_buffer_.FreeMemory();
+
     Queue& queue = queues_[min_queue_idx];
-    auto& events = queue.events_;
-    if (queue.needs_sorting())
-      queue.Sort();
-    PERFETTO_DCHECK(queue.min_ts_ == events.front().ts);
-
-    // Now that we identified the min-queue, extract all events from it until
-    // we hit either: (1) the min-ts of the 2nd queue or (2) the packet index
-    // limit, whichever comes first.
-    size_t num_extracted = 0;
-    for (auto& event : events) {
-      if (event.alloc_id() >= limit_alloc_id) {
+    if (queue.empty())
+      continue;
+    queue_heap_.push_back(QueueHeapEntry{queue.min_ts_, min_queue_idx});
+    std::push_heap(queue_heap_.begin(), queue_heap_.end(), heap_cmp);
+  }
+}
+
+// Extracts, in (ts, alloc_id) order, the events of |queues_[queue_idx]| which
+// are <= |max_ts| and before |limit_alloc_id|. When events are spread across
+// multiple sub-queues, these are merged on the fly; as each sub-queue is
+// sorted, this yields the same order as sorting the union of them.
+// Returns the number of extracted events.
+size_t TraceSorter::ExtractEventsFromQueue(
+    size_t queue_idx,
+    int64_t max_ts,
+    BumpAllocator::AllocId limit_alloc_id) {
+  Queue& queue = queues_[queue_idx];
+
+  size_t non_empty_count = 0;
+  SubQueue* non_empty = nullptr;
+  for (SubQueue& sub_queue : queue.sub_queues_) {
+    if (sub_queue.events_.empty())
+      continue;
+    if (sub_queue.needs_sorting())
+      sub_queue.Sort();
+    non_empty = &sub_queue;
+    non_empty_count++;
+  }
+  PERFETTO_DCHECK(non_empty_count > 0);
+
+  size_t num_extracted = 0;
+  std::array<size_t, kNumEventClasses> extracted_per_sub_queue{};
+  if (PERFETTO_LIKELY(non_empty_count == 1)) {
+    // Fast path: no merging required, just walk the only sub-queue.
+    PERFETTO_DCHECK(queue.min_ts_ == non_empty->events_.front().ts);
+    for (auto& event : non_empty->events_) {
+      if (event.alloc_id() >= limit_alloc_id)
         break;
-      }
 
-      if (event.ts > min_queue_ts[1]) {
-        // We should never hit this condition on the first extraction as by
-        // the algorithm above (event.ts =) min_queue_ts[0] <= min_queue[1].
+      if (event.ts > max_ts) {
+        // We should never hit this condition on the first extraction as the
+        // caller guarantees that (event.ts =) queue.min_ts_ <= max_ts.
         PERFETTO_DCHECK(num_extracted > 0);
         break;
       }
 
       ++num_extracted;
-      MaybeExtractEvent(min_queue_idx, event);
-    }  // for (event: events)
-
-    // The earliest event cannot be extracted without going past the limit.
-    if (!num_extracted)
-      break;
+      MaybeExtractEvent(queue_idx, event);
+    }
+    size_t sub_queue_idx =
+        static_cast<size_t>(non_empty - queue.sub_queues_.data());
+    extracted_per_sub_queue[sub_queue_idx] = num_extracted;
+  } else {
+    for (;;) {
+      // Find the sub-queue whose next event is the earliest.
+      size_t next_idx = kNumEventClasses;
+      const TimestampedEvent* next = nullptr;
+      for (size_t i = 0; i < kNumEventClasses; i++) {
+        auto& events = queue.sub_queues_[i].events_;
+        size_t offset = extracted_per_sub_queue[i];
+        if (offset == events.size())
+          continue;
+        const TimestampedEvent& event = events.at(offset);
+        if (!next || event < *next) {
+          next = &event;
+          next_idx = i;
+        }
+      }
+      if (!next || next->alloc_id() >= limit_alloc_id)
+        break;
+      if (next->ts > max_ts) {
+        PERFETTO_DCHECK(num_extracted > 0);
+        break;
+      }
 
-    // Now remove the entries from the event buffer and update the queue-local
-    // and global time bounds.
-    events.erase_front(num_extracted);
-    events.shrink_to_fit();
+      ++num_extracted;
+      ++extracted_per_sub_queue[next_idx];
+      MaybeExtractEvent(queue_idx, *next);
+    }
+  }
 
-    // Since we likely just removed a bunch of items try to reduce the memory
-    // usage of the token buffer.
-    token_buffer_.FreeMemory();
+  if (!num_extracted)
+    return 0;
 
-    // Update the queue timestamps to reflect the bounds after extraction.
+  // Now remove the entries from the event buffers and update the queue-local
+  // time bounds.
+  int64_t min_ts = std::numeric_limits<int64_t>::max();
+  for (size_t i = 0; i < kNumEventClasses; i++) {
+    auto& events = queue.sub_queues_[i].events_;
+    if (extracted_per_sub_queue[i] > 0) {
+      events.erase_front(extracted_per_sub_queue[i]);
+      events.shrink_to_fit();
+    }
     if (events.empty()) {
-      queue.min_ts_ = kTsMax;
-      queue.max_ts_ = 0;
+      queue.sub_queues_[i].max_ts_ = 0;
     } else {
-      queue.min_ts_ = queue.events_.front().ts;
+      min_ts = std::min(min_ts, events.front().ts);
     }
-  }  // for(;;)
+  }
+  if (queue.empty()) {
+    queue.min_ts_ = std::numeric_limits<int64_t>::max();
+    queue.max_ts_ = 0;
+  } else {
+    queue.min_ts_ = min_ts;
+  }
+  return num_extracted;
 }
 
 void TraceSorter::ParseTracePacket(const TimestampedEvent& event) {
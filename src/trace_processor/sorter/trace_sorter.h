@@ -18,6 +18,7 @@
 #define SRC_TRACE_PROCESSOR_SORTER_TRACE_SORTER_H_
 
 #include <algorithm>
+#include <array>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -68,6 +69,13 @@ namespace trace_processor {
 // (N = num cpus + 1 for non-ftrace events). Each queue in turn gets sorted (if
 // necessary) before proceeding with the global merge-sort-extract.
 //
+// Each ftrace queue is further split into one sub-queue per event class
+// (regular events, compact sched_switch, compact sched_waking). The ftrace
+// tokenizer pushes the events of a bundle one class after the other, so each
+// class is sorted on its own but the classes are interleaved. Rather than
+// sorting the concatenation, the sub-queues of a CPU are merged on the fly
+// while extracting.
+//
 // When an event is pushed through, it is just appended to the end of one of
 // the N queues. While appending, we keep track of the fact that the queue
 // is still ordered or just lost ordering. When an out-of-order event is
@@ -143,7 +151,8 @@ class TraceSorter {
     TraceTokenBuffer::Id id =
         token_buffer_.Append(TracePacketData{std::move(tbv), std::move(state)});
     auto* queue = GetQueue(cpu + 1);
-    queue->Append(timestamp, TimestampedEvent::Type::kEtwEvent, id);
+    queue->Append(timestamp, TimestampedEvent::Type::kEtwEvent, id,
+                  EventClass::kRegular);
     UpdateAppendMaxTs(queue);
   }
 
@@ -154,24 +163,19 @@ class TraceSorter {
     TraceTokenBuffer::Id id =
         token_buffer_.Append(TracePacketData{std::move(tbv), std::move(state)});
     auto* queue = GetQueue(cpu + 1);
-    queue->Append(timestamp, TimestampedEvent::Type::kFtraceEvent, id);
+    queue->Append(timestamp, TimestampedEvent::Type::kFtraceEvent, id,
+                  EventClass::kRegular);
     UpdateAppendMaxTs(queue);
   }
 
   inline void PushInlineFtraceEvent(uint32_t cpu,
                                     int64_t timestamp,
                                     InlineSchedSwitch inline_sched_switch) {
-    // TODO(rsavitski): if a trace has a mix of normal & "compact" events
-    // (being pushed through this function), the ftrace batches will no longer
-    // be fully sorted by timestamp. In such situations, we will have to sort
-    // at the end of the batch. We can do better as both sub-sequences are
-    // sorted however. Consider adding extra queues, or pushing them in a
-    // merge-sort fashion
-    // // instead.
     TraceTokenBuffer::Id id =
         token_buffer_.Append(std::move(inline_sched_switch));
     auto* queue = GetQueue(cpu + 1);
-    queue->Append(timestamp, TimestampedEvent::Type::kInlineSchedSwitch, id);
+    queue->Append(timestamp, TimestampedEvent::Type::kInlineSchedSwitch, id,
+                  EventClass::kInlineSchedSwitch);
     UpdateAppendMaxTs(queue);
   }
 
@@ -181,7 +185,8 @@ class TraceSorter {
     TraceTokenBuffer::Id id =
         token_buffer_.Append(std::move(inline_sched_waking));
     auto* queue = GetQueue(cpu + 1);
-    queue->Append(timestamp, TimestampedEvent::Type::kInlineSchedWaking, id);
+    queue->Append(timestamp, TimestampedEvent::Type::kInlineSchedWaking, id,
+                  EventClass::kInlineSchedWaking);
     UpdateAppendMaxTs(queue);
   }
 
@@ -189,7 +194,7 @@ class TraceSorter {
     BumpAllocator::AllocId end_id = token_buffer_.PastTheEndAllocId();
     SortAndExtractEventsUntilAllocId(end_id);
     for (const auto& queue : queues_) {
-      PERFETTO_DCHECK(queue.events_.empty());
+      PERFETTO_DCHECK(queue.empty());
     }
     queues_.clear();
 
@@ -272,22 +277,22 @@ class TraceSorter {
   static_assert(std::is_nothrow_swappable<TimestampedEvent>::value,
                 "TimestampedEvent must be trivially swappable");
 
-  struct Queue {
-    void Append(int64_t ts,
-                TimestampedEvent::Type type,
-                TraceTokenBuffer::Id id) {
-      {
-        TimestampedEvent event;
-        event.ts = ts;
-        event.chunk_index = id.alloc_id.chunk_index;
-        event.chunk_offset = id.alloc_id.chunk_offset;
-        event.event_type = static_cast<uint8_t>(type);
-        events_.emplace_back(std::move(event));
-      }
+  // The class of an event within a queue. Events of the same class are
+  // (usually) pushed in timestamp order, events of different classes are not.
+  enum class EventClass : uint8_t {
+    kRegular = 0,
+    kInlineSchedSwitch = 1,
+    kInlineSchedWaking = 2,
+  };
+  static constexpr size_t kNumEventClasses = 3;
+
+  struct SubQueue {
+    void Append(const TimestampedEvent& event) {
+      events_.emplace_back(event);
 
       // Events are often seen in order.
-      if (PERFETTO_LIKELY(ts >= max_ts_)) {
-        max_ts_ = ts;
+      if (PERFETTO_LIKELY(event.ts >= max_ts_)) {
+        max_ts_ = event.ts;
       } else {
         // The event is breaking ordering. The first time it happens, keep
         // track of which index we are at. We know that everything before that
@@ -297,26 +302,66 @@ class TraceSorter {
         if (sort_start_idx_ == 0) {
           PERFETTO_DCHECK(events_.size() >= 2);
           sort_start_idx_ = events_.size() - 1;
-          sort_min_ts_ = ts;
+          sort_min_ts_ = event.ts;
         } else {
-          sort_min_ts_ = std::min(sort_min_ts_, ts);
+          sort_min_ts_ = std::min(sort_min_ts_, event.ts);
         }
       }
-
-      min_ts_ = std::min(min_ts_, ts);
-      PERFETTO_DCHECK(min_ts_ <= max_ts_);
     }
 
     bool needs_sorting() const { return sort_start_idx_ != 0; }
     void Sort();
 
     base::CircularQueue<TimestampedEvent> events_;
-    int64_t min_ts_ = std::numeric_limits<int64_t>::max();
     int64_t max_ts_ = 0;
     size_t sort_start_idx_ = 0;
     int64_t sort_min_ts_ = std::numeric_limits<int64_t>::max();
   };
 
+  struct Queue {
+    void Append(int64_t ts,
+                TimestampedEvent::Type type,
+                TraceTokenBuffer::Id id,
+                EventClass event_class) {
+      TimestampedEvent event;
+      event.ts = ts;
+      event.chunk_index = id.alloc_id.chunk_index;
+      event.chunk_offset = id.alloc_id.chunk_offset;
+      event.event_type = static_cast<uint8_t>(type);
+      sub_queues_[static_cast<size_t>(event_class)].Append(event);
+
+      max_ts_ = std::max(max_ts_, ts);
+      min_ts_ = std::min(min_ts_, ts);
+      PERFETTO_DCHECK(min_ts_ <= max_ts_);
+    }
+
+    bool empty() const {
+      for (const SubQueue& sub_queue : sub_queues_) {
+        if (!sub_queue.events_.empty())
+          return false;
+      }
+      return true;
+    }
+
+    std::array<SubQueue, kNumEventClasses> sub_queues_;
+    int64_t min_ts_ = std::numeric_limits<int64_t>::max();
+    int64_t max_ts_ = 0;
+  };
+
+  // Entry of the min-heap used to merge the queues in
+  // SortAndExtractEventsUntilAllocId().
+  struct QueueHeapEntry {
+    int64_t min_ts;
+    size_t queue_idx;
+
+    // Used with std::greater to turn std::*_heap() into a min-heap. Ties are
+    // broken on the queue index to keep the extraction order deterministic.
+    bool operator>(const QueueHeapEntry& other) const {
+      return std::tie(min_ts, queue_idx) >
+             std::tie(other.min_ts, other.queue_idx);
+    }
+  };
+
   void SortAndExtractEventsUntilAllocId(BumpAllocator::AllocId alloc_id);
 
   inline Queue* GetQueue(size_t index) {
@@ -329,7 +374,7 @@ class TraceSorter {
                                    TimestampedEvent::Type event_type,
                                    TraceTokenBuffer::Id id) {
     Queue* queue = GetQueue(0);
-    queue->Append(ts, event_type, id);
+    queue->Append(ts, event_type, id, EventClass::kRegular);
     UpdateAppendMaxTs(queue);
   }
 
@@ -341,6 +386,9 @@ class TraceSorter {
   void ParseFtracePacket(uint32_t cpu, const TimestampedEvent&);
   void ParseEtwPacket(uint32_t cpu, const TimestampedEvent&);
 
+  size_t ExtractEventsFromQueue(size_t queue_idx,
+                                int64_t max_ts,
+                                BumpAllocator::AllocId limit_alloc_id);
   void MaybeExtractEvent(size_t queue_idx, const TimestampedEvent&);
   void ExtractAndDiscardTokenizedObject(const TimestampedEvent& event);
 
@@ -373,6 +421,10 @@ class TraceSorter {
   // queues_[x] is the ftrace queue for CPU(x - 1).
   std::vector<Queue> queues_;
 
+  // Scratch space for SortAndExtractEventsUntilAllocId(), kept around to
+  // avoid re-allocating it on every extraction.
+  std::vector<QueueHeapEntry> queue_heap_;
+
   // max(e.ts for e appended to the sorter)
   int64_t append_max_ts_ = 0;
 
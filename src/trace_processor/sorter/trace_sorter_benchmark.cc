@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/trace_processor/trace_blob.h"
+#include "perfetto/trace_processor/trace_blob_view.h"
+#include "src/trace_processor/importers/common/parser_types.h"
+#include "src/trace_processor/importers/common/trace_parser.h"
+#include "src/trace_processor/sorter/trace_sorter.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// Number of events of each class pushed for each CPU in a bundle.
+constexpr uint32_t kEventsPerBundle = 64;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void CpuArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(8);
+    return;
+  }
+  for (int cpus : {8, 64, 256})
+    b->Arg(cpus);
+}
+
+class NoopTraceParser : public TraceParser {
+ public:
+  void ParseFtraceEvent(uint32_t, int64_t ts, TracePacketData) override {
+    Check(ts);
+  }
+  void ParseInlineSchedSwitch(uint32_t, int64_t ts, InlineSchedSwitch) override {
+    Check(ts);
+  }
+  void ParseInlineSchedWaking(uint32_t, int64_t ts, InlineSchedWaking) override {
+    Check(ts);
+  }
+
+  uint64_t events() const { return events_; }
+
+ private:
+  void Check(int64_t ts) {
+    PERFETTO_CHECK(ts >= last_ts_);
+    last_ts_ = ts;
+    events_++;
+  }
+
+  int64_t last_ts_ = 0;
+  uint64_t events_ = 0;
+};
+
+}  // namespace
+
+// Pushes bundles of ftrace events the way the ftrace tokenizer does for traces
+// with compact sched enabled: for each CPU, the regular events and the compact
+// sched_switch/sched_waking events are each sorted but are pushed one class
+// after the other.
+static void BM_TraceSorterMixedFtrace(benchmark::State& state) {
+  const uint32_t cpus = static_cast<uint32_t>(state.range(0));
+  const uint32_t bundles = IsBenchmarkFunctionalOnly() ? 2 : 64;
+
+  std::minstd_rand0 rnd(0);
+  std::vector<int64_t> timestamps(kEventsPerBundle * 3);
+  TraceBlobView blob(TraceBlob::Allocate(1));
+
+  uint64_t events = 0;
+  for (auto _ : state) {
+    TraceProcessorContext context;
+    context.storage.reset(new TraceStorage());
+    std::unique_ptr<NoopTraceParser> parser(new NoopTraceParser());
+    NoopTraceParser* parser_ptr = parser.get();
+    TraceSorter sorter(&context, std::move(parser),
+                       TraceSorter::SortingMode::kFullSort);
+
+    int64_t bundle_ts = 0;
+    for (uint32_t b = 0; b < bundles; ++b) {
+      int64_t bundle_end_ts = bundle_ts;
+      for (uint32_t cpu = 0; cpu < cpus; ++cpu) {
+        int64_t ts = bundle_ts;
+        for (int64_t& t : timestamps) {
+          ts += 1 + rnd() % 100;
+          t = ts;
+        }
+        // Distribute the timestamps round-robin across the three classes so
+        // that each class is sorted but they overlap in time.
+        for (size_t i = 0; i < timestamps.size(); i += 3) {
+          sorter.PushFtraceEvent(cpu, timestamps[i], blob.copy(),
+                                 RefPtr<PacketSequenceStateGeneration>());
+        }
+        for (size_t i = 1; i < timestamps.size(); i += 3)
+          sorter.PushInlineFtraceEvent(cpu, timestamps[i], InlineSchedSwitch{});
+        for (size_t i = 2; i < timestamps.size(); i += 3)
+          sorter.PushInlineFtraceEvent(cpu, timestamps[i], InlineSchedWaking{});
+        bundle_end_ts = std::max(bundle_end_ts, timestamps.back());
+      }
+      bundle_ts = bundle_end_ts;
+    }
+    sorter.ExtractEventsForced();
+    events += parser_ptr->events();
+  }
+  state.counters["events/s"] = benchmark::Counter(static_cast<double>(events),
+                                                  benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_TraceSorterMixedFtrace)
+    ->Apply(CpuArgs)
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace trace_processor
+}  // namespace perfetto
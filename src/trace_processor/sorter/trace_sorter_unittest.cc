@@ -54,6 +54,15 @@ class MockTraceParser : public ProtoTraceParser {
                            data.packet.length());
   }
 
+  MOCK_METHOD(void,
+              ParseInlineSchedSwitch,
+              (uint32_t cpu, int64_t timestamp, InlineSchedSwitch data),
+              (override));
+  MOCK_METHOD(void,
+              ParseInlineSchedWaking,
+              (uint32_t cpu, int64_t timestamp, InlineSchedWaking data),
+              (override));
+
   MOCK_METHOD(void,
               MOCK_ParseTracePacket,
               (int64_t ts, const uint8_t* data, size_t length));
@@ -318,6 +327,40 @@ TEST_F(TraceSorterTest, MultiQueueSorting) {
   EXPECT_TRUE(expectations.empty());
 }
 
+// Simulates the ftrace tokenizer pushing a bundle which contains both regular
+// and compact events: each class is sorted on its own but the classes are
+// pushed one after the other. Tests that they are merged back in timestamp
+// order.
+TEST_F(TraceSorterTest, MixedCompactAndRegularFtrace) {
+  PacketSequenceState state(&context_);
+  TraceBlobView view_1 = test_buffer_.slice_off(0, 1);
+  TraceBlobView view_2 = test_buffer_.slice_off(0, 2);
+
+  InSequence s;
+  EXPECT_CALL(*parser_, ParseInlineSchedSwitch(1, 1000, _));
+  EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(1, 1001, view_1.data(), 1));
+  EXPECT_CALL(*parser_, ParseInlineSchedWaking(1, 1002, _));
+  EXPECT_CALL(*parser_, ParseInlineSchedSwitch(1, 1003, _));
+  EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(1, 1004, view_2.data(), 2));
+  EXPECT_CALL(*parser_, ParseInlineSchedWaking(1, 1005, _));
+
+  context_.sorter->PushFtraceEvent(1 /*cpu*/, 1001 /*timestamp*/,
+                                   std::move(view_1),
+                                   state.current_generation());
+  context_.sorter->PushFtraceEvent(1 /*cpu*/, 1004 /*timestamp*/,
+                                   std::move(view_2),
+                                   state.current_generation());
+  context_.sorter->PushInlineFtraceEvent(1 /*cpu*/, 1000 /*timestamp*/,
+                                         InlineSchedSwitch{});
+  context_.sorter->PushInlineFtraceEvent(1 /*cpu*/, 1003 /*timestamp*/,
+                                         InlineSchedSwitch{});
+  context_.sorter->PushInlineFtraceEvent(1 /*cpu*/, 1002 /*timestamp*/,
+                                         InlineSchedWaking{});
+  context_.sorter->PushInlineFtraceEvent(1 /*cpu*/, 1005 /*timestamp*/,
+                                         InlineSchedWaking{});
+  context_.sorter->ExtractEventsForced();
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -23,6 +23,7 @@
 #include <functional>
 #include <limits>
 #include <optional>
+#include <string>
 #include <type_traits>
 #include <utility>
 
@@ -86,6 +87,12 @@ uint32_t GetAllocSize(const TrackEventDataDescriptor& desc) {
 
 }  // namespace
 
+TraceTokenBuffer::TraceTokenBuffer() = default;
+
+TraceTokenBuffer::TraceTokenBuffer(uint64_t memory_budget,
+                                   std::string spill_dir)
+    : allocator_(memory_budget, std::move(spill_dir)) {}
+
 TraceTokenBuffer::Id TraceTokenBuffer::Append(TrackEventData ted) {
   // TrackEventData (and TracePacketData) are two big contributors to the size
   // of the peak memory usage by sorted. The main reasons for this are a) object
@@ -20,6 +20,7 @@
 #include <cstdint>
 #include <limits>
 #include <optional>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -53,6 +54,13 @@ class TraceTokenBuffer {
     BumpAllocator::AllocId alloc_id;
   };
 
+  TraceTokenBuffer();
+
+  // Creates a buffer which keeps at most |memory_budget| bytes of tokenized
+  // objects in memory and spills the rest to a temporary file in |spill_dir|.
+  // See BumpAllocator for details. A budget of 0 disables spilling.
+  TraceTokenBuffer(uint64_t memory_budget, std::string spill_dir);
+
   // Appends an object of type |T| to the token buffer. Returns an id for
   // looking up the object later using |Extract|.
   template <typename T>
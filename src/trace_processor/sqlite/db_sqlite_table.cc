@@ -122,6 +122,26 @@ SqlValue SqliteValueToSqlValue(sqlite3_value* sqlite_val) {
   return value;
 }
 
+// Returns |schema| with the columns which have an index created with
+// CREATE PERFETTO INDEX marked as sorted: as far as cost estimation is
+// concerned, filtering on these columns is a binary search just like it is for
+// sorted columns. |storage| is only used if the schema needs to be modified.
+const Table::Schema& SchemaWithIndexedColumns(
+    const Table::Schema& schema,
+    const Table& table,
+    std::optional<Table::Schema>& storage) {
+  for (uint32_t i = 0; i < schema.columns.size(); ++i) {
+    if (schema.columns[i].is_sorted || !table.GetIndexForColumn(i)) {
+      continue;
+    }
+    if (!storage) {
+      storage = schema;
+    }
+    storage->columns[i].is_sorted = true;
+  }
+  return storage ? *storage : schema;
+}
+
 class SafeStringWriter {
  public:
   void AppendString(const char* s) {
@@ -195,12 +215,17 @@ SqliteTable::Schema DbSqliteTable::ComputeSchema(const Table::Schema& schema,
 }
 
 int DbSqliteTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
+  std::optional<Table::Schema> indexed_schema;
   switch (context_->computation) {
     case TableComputation::kStatic:
-      BestIndex(schema_, context_->static_table->row_count(), qc, info);
+      BestIndex(SchemaWithIndexedColumns(schema_, *context_->static_table,
+                                         indexed_schema),
+                context_->static_table->row_count(), qc, info);
       break;
     case TableComputation::kRuntime:
-      BestIndex(schema_, runtime_table_->row_count(), qc, info);
+      BestIndex(
+          SchemaWithIndexedColumns(schema_, *runtime_table_, indexed_schema),
+          runtime_table_->row_count(), qc, info);
       break;
     case TableComputation::kTableFunction:
       base::Status status = ValidateTableFunctionArguments(schema_, qc);
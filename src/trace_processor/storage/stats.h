@@ -87,6 +87,13 @@ namespace stats {
   F(mismatched_sched_switch_tids,         kSingle,  kError,    kAnalysis, ""), \
   F(mm_unknown_type,                      kSingle,  kError,    kAnalysis, ""), \
   F(parse_trace_duration_ns,              kSingle,  kInfo,     kAnalysis, ""), \
+  F(perfetto_index_memory_bytes,          kSingle,  kInfo,     kAnalysis,      \
+      "Memory used by all the indices created with CREATE PERFETTO INDEX."),   \
+  F(metrics_compute_duration_ns,          kSingle,  kInfo,     kAnalysis,      \
+      "Wall time spent computing metrics, summed across all the calls."),      \
+  F(metrics_run_metric_cache_hits,        kSingle,  kInfo,     kAnalysis,      \
+      "Number of RUN_METRIC invocations skipped while computing metrics "      \
+      "because they already ran and nothing they depend on changed."),         \
   F(power_rail_unknown_index,             kSingle,  kError,    kTrace,    ""), \
   F(proc_stat_unknown_counters,           kSingle,  kError,    kAnalysis, ""), \
   F(rss_stat_unknown_keys,                kSingle,  kError,    kAnalysis, ""), \
@@ -258,6 +265,12 @@ namespace stats {
   F(perf_guardrail_stop_ts,               kIndexed, kDataLoss, kTrace,    ""), \
   F(perf_samples_skipped,                 kSingle,  kInfo,     kTrace,    ""), \
   F(perf_samples_skipped_dataloss,        kSingle,  kDataLoss, kTrace,    ""), \
+  F(perf_unwinder_samples_dropped,        kIndexed, kDataLoss, kTrace,         \
+      "Samples dropped by traced_perf as the unwinding queue of the unwinder " \
+      "thread (the stat index) was full. Consider --unwinder-threads."),       \
+  F(perf_unwinder_max_queue_occupancy,    kIndexed, kInfo,     kTrace,         \
+      "Highest number of samples waiting in the unwinding queue of the "       \
+      "traced_perf unwinder thread (the stat index)."),                        \
   F(memory_snapshot_parser_failure,       kSingle,  kError,    kAnalysis, ""), \
   F(thread_time_in_state_out_of_order,    kSingle,  kError,    kAnalysis, ""), \
   F(thread_time_in_state_unknown_cpu_freq,                                     \
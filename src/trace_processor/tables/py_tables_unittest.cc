@@ -96,6 +96,31 @@ TEST_F(PyTablesUnittest, MutableColumn) {
   ASSERT_EQ((*event_.mutable_arg_set_id())[0], 0u);
 }
 
+TEST_F(PyTablesUnittest, IndexIgnoredAfterSet) {
+  event_.Insert(TestEventTable::Row(100, 3));
+  event_child_.Insert(TestEventChildTable::Row(200, 1));
+
+  uint32_t col = TestEventTable::ColumnIndex::arg_set_id;
+  event_.CreateIndex("arg_set_id_idx", col);
+  event_child_.CreateIndex("arg_set_id_idx", col);
+  ASSERT_NE(event_.GetIndexForColumn(col), nullptr);
+  ASSERT_NE(event_child_.GetIndexForColumn(col), nullptr);
+
+  // The child shares the storage of the parent so setting a value through
+  // either table invalidates the indices of both.
+  event_.mutable_arg_set_id()->Set(0, 2);
+  ASSERT_EQ(event_.GetIndexForColumn(col), nullptr);
+  ASSERT_EQ(event_child_.GetIndexForColumn(col), nullptr);
+  ASSERT_EQ(event_.QueryToRowMap({event_.arg_set_id().eq(2)}, {}).size(), 1u);
+
+  event_.CreateIndex("arg_set_id_idx", col);
+  ASSERT_NE(event_.GetIndexForColumn(col), nullptr);
+  ASSERT_TRUE(event_.DropIndex("arg_set_id_idx"));
+  ASSERT_FALSE(event_.DropIndex("arg_set_id_idx"));
+  ASSERT_EQ(event_.GetIndexForColumn(col), nullptr);
+  ASSERT_EQ(event_.IndexMemoryBytes(), 0u);
+}
+
 TEST_F(PyTablesUnittest, ShrinkToFit) {
   event_.Insert(TestEventTable::Row(100, 0));
   event_.ShrinkToFit();
@@ -442,6 +442,7 @@ size_t TraceProcessorImpl::RestoreInitialTables() {
   PERFETTO_CHECK(registered_count_before >=
                  sqlite_objects_post_constructor_initialization_);
 
+  engine_->DropStaticTableIndexes();
   InitPerfettoSqlEngine();
 
   // The registered count should now be the same as it was in the constructor.
@@ -587,8 +588,14 @@ base::Status TraceProcessorImpl::ComputeMetric(
     return base::Status("Root metrics proto descriptor not found");
 
   const auto& root_descriptor = pool_.descriptors()[opt_idx.value()];
-  return metrics::ComputeMetrics(engine_.get(), metric_names, sql_metrics_,
-                                 pool_, root_descriptor, metrics_proto);
+  auto scoped_trace = context_.storage->TraceExecutionTimeIntoStats(
+      stats::metrics_compute_duration_ns);
+  base::Status status = metrics::ComputeMetrics(
+      engine_.get(), &run_metric_cache_, metric_names, sql_metrics_, pool_,
+      root_descriptor, metrics_proto);
+  context_.storage->IncrementStats(stats::metrics_run_metric_cache_hits,
+                                   run_metric_cache_.hits());
+  return status;
 }
 
 base::Status TraceProcessorImpl::ComputeMetricText(
@@ -627,6 +634,16 @@ void TraceProcessorImpl::EnableMetatrace(MetatraceConfig config) {
 
 void TraceProcessorImpl::InitPerfettoSqlEngine() {
   engine_.reset(new PerfettoSqlEngine(context_.storage->mutable_string_pool()));
+  TraceStorage* storage = context_.storage.get();
+  engine_->set_index_memory_listener([storage](uint64_t bytes) {
+    storage->SetStats(stats::perfetto_index_memory_bytes,
+                      static_cast<int64_t>(bytes));
+  });
+  storage->SetStats(stats::perfetto_index_memory_bytes, 0);
+  engine_->set_definition_listener(
+      [this](const std::string& name, const std::string& definition) {
+        run_metric_cache_.OnDefinition(name, definition);
+      });
   sqlite3* db = engine_->sqlite_engine()->db();
   sqlite3_str_split_init(db);
 
@@ -738,7 +755,8 @@ void TraceProcessorImpl::InitPerfettoSqlEngine() {
   RegisterFunction<metrics::RunMetric>(
       engine_.get(), "RUN_METRIC", -1,
       std::unique_ptr<metrics::RunMetric::Context>(
-          new metrics::RunMetric::Context{engine_.get(), &sql_metrics_}));
+          new metrics::RunMetric::Context{engine_.get(), &sql_metrics_,
+                                          &run_metric_cache_}));
 
   // Legacy tables.
   engine_->sqlite_engine()->RegisterVirtualTableModule<SqlStatsTable>(
@@ -115,6 +115,7 @@ class TraceProcessorImpl : public TraceProcessor,
   DescriptorPool pool_;
 
   std::vector<metrics::SqlMetricFile> sql_metrics_;
+  metrics::RunMetricCache run_metric_cache_;
   std::unordered_map<std::string, std::string> proto_field_to_sql_metric_path_;
 
   // This is atomic because it is set by the CTRL-C signal handler and we need
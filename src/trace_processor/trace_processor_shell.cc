@@ -44,6 +44,7 @@
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/version.h"
+#include "perfetto/ext/trace_processor/rpc/query_result_serializer.h"
 
 #include "perfetto/trace_processor/metatrace_config.h"
 #include "perfetto/trace_processor/read_trace.h"
@@ -394,6 +395,13 @@ enum OutputFormat {
   kNone,
 };
 
+// The format of the results of the queries passed with -q.
+enum class QueryOutputFormat {
+  kCsv,
+  // A binary QueryResult proto with ColumnarBatch-es (trace_processor.proto).
+  kColumnar,
+};
+
 struct MetricNameAndPath {
   std::string name;
   std::optional<std::string> no_ext_path;
@@ -535,6 +543,35 @@ base::Status PrintQueryResultAsCsv(Iterator* it, bool has_more, FILE* output) {
   return it->Status();
 }
 
+// Writes the result of the last statement as a QueryResult proto, made of
+// ColumnarBatch-es. As the batches are concatenated QueryResult messages, the
+// output can be parsed as a single QueryResult.
+base::Status RunQueriesAndWriteColumnarResult(const std::string& sql_query,
+                                              FILE* output) {
+  PERFETTO_DLOG("Executing query: %s", sql_query.c_str());
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  // We don't want the runtime to replace "\n" with "\r\n".
+  _setmode(_fileno(output), _O_BINARY);
+#endif
+
+  QueryResultSerializer serializer(g_tp->ExecuteQuery(sql_query));
+  serializer.set_result_format(QueryResultSerializer::ResultFormat::kColumnar);
+  std::vector<uint8_t> buf;
+  std::string error;
+  for (bool has_more = true; has_more;) {
+    has_more = serializer.Serialize(&buf);
+    protos::pbzero::QueryResult::Decoder result(buf.data(), buf.size());
+    if (result.has_error())
+      error = result.error().ToStdString();
+    if (fwrite(buf.data(), 1, buf.size(), output) != buf.size())
+      return base::ErrStatus("Failed to write the query result");
+    buf.clear();
+  }
+  if (!error.empty())
+    return base::ErrStatus("%s", error.c_str());
+  return base::OkStatus();
+}
+
 base::Status RunQueriesWithoutOutput(const std::string& sql_query) {
   auto it = g_tp->ExecuteQuery(sql_query);
   if (it.StatementWithOutputCount() > 0)
@@ -671,6 +708,7 @@ struct CommandLineOptions {
   std::string sql_module_path;
   std::string metric_names;
   std::string metric_output;
+  QueryOutputFormat query_output = QueryOutputFormat::kCsv;
   std::string trace_file_path;
   std::string port_number;
   std::string override_stdlib_path;
@@ -691,6 +729,9 @@ struct CommandLineOptions {
   bool no_ftrace_raw = false;
   bool analyze_trace_proto_content = false;
   bool crop_track_events = false;
+  uint32_t tokenizer_threads = 0;
+  uint64_t sorter_memory_budget_mb = 0;
+  std::string sorter_spill_dir;
   std::vector<std::string> dev_flags;
 };
 
@@ -714,6 +755,10 @@ Options:
                                       If used with --run-metrics, the query is
                                       executed after the selected metrics and
                                       the metrics output is suppressed.
+ --query-output=[csv|columnar]        Allows the output of -q to be specified
+                                      as either CSV or a binary QueryResult
+                                      proto with column-major batches, see
+                                      trace_processor.proto (default: csv).
  -D, --httpd                          Enables the HTTP RPC server.
  --http-port PORT                     Specify what port to run HTTP RPC server.
  --stdiod                             Enables the stdio RPC server.
@@ -737,6 +782,15 @@ Feature flags:
                                       trace processor.
  --crop-track-events                  Ignores track event outside of the
                                       range of interest in trace processor.
+ --tokenizer-threads N                Decompresses compressed packets of proto
+                                      traces on N (at most 64) worker threads
+                                      while loading the trace.
+ --sorter-memory-budget-mb N          Spills events waiting to be sorted to a
+                                      temporary file once they use more than
+                                      N MB of memory.
+ --sorter-spill-dir DIR               Creates the temporary file used by
+                                      --sorter-memory-budget-mb in DIR rather
+                                      than in $TMPDIR.
  --dev                                Enables features which are reserved for
                                       local development use only and
                                       *should not* be enabled on production
@@ -806,8 +860,12 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
     OPT_METATRACE_CATEGORIES,
     OPT_ANALYZE_TRACE_PROTO_CONTENT,
     OPT_CROP_TRACK_EVENTS,
+    OPT_TOKENIZER_THREADS,
+    OPT_SORTER_MEMORY_BUDGET_MB,
+    OPT_SORTER_SPILL_DIR,
     OPT_DEV_FLAG,
     OPT_STDIOD,
+    OPT_QUERY_OUTPUT,
   };
 
   static const option long_options[] = {
@@ -832,6 +890,11 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       {"analyze-trace-proto-content", no_argument, nullptr,
        OPT_ANALYZE_TRACE_PROTO_CONTENT},
       {"crop-track-events", no_argument, nullptr, OPT_CROP_TRACK_EVENTS},
+      {"tokenizer-threads", required_argument, nullptr,
+       OPT_TOKENIZER_THREADS},
+      {"sorter-memory-budget-mb", required_argument, nullptr,
+       OPT_SORTER_MEMORY_BUDGET_MB},
+      {"sorter-spill-dir", required_argument, nullptr, OPT_SORTER_SPILL_DIR},
       {"dev", no_argument, nullptr, OPT_DEV},
       {"add-sql-module", required_argument, nullptr, OPT_ADD_SQL_MODULE},
       {"override-sql-module", required_argument, nullptr,
@@ -840,6 +903,7 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       {"run-metrics", required_argument, nullptr, OPT_RUN_METRICS},
       {"pre-metrics", required_argument, nullptr, OPT_PRE_METRICS},
       {"metrics-output", required_argument, nullptr, OPT_METRICS_OUTPUT},
+      {"query-output", required_argument, nullptr, OPT_QUERY_OUTPUT},
       {"metric-extension", required_argument, nullptr, OPT_METRIC_EXTENSION},
       {"dev-flag", required_argument, nullptr, OPT_DEV_FLAG},
       {nullptr, 0, nullptr, 0}};
@@ -945,6 +1009,32 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       continue;
     }
 
+    if (option == OPT_TOKENIZER_THREADS) {
+      std::optional<uint32_t> threads = base::StringToUInt32(optarg);
+      if (!threads || optarg[0] == '-') {
+        PERFETTO_ELOG("Invalid --tokenizer-threads: %s", optarg);
+        exit(1);
+      }
+      if (*threads > Config::kMaxTokenizerThreadCount) {
+        PERFETTO_ELOG("--tokenizer-threads capped to %" PRIu32,
+                      Config::kMaxTokenizerThreadCount);
+        threads = Config::kMaxTokenizerThreadCount;
+      }
+      command_line_options.tokenizer_threads = *threads;
+      continue;
+    }
+
+    if (option == OPT_SORTER_MEMORY_BUDGET_MB) {
+      command_line_options.sorter_memory_budget_mb =
+          static_cast<uint64_t>(atoll(optarg));
+      continue;
+    }
+
+    if (option == OPT_SORTER_SPILL_DIR) {
+      command_line_options.sorter_spill_dir = optarg;
+      continue;
+    }
+
     if (option == OPT_DEV) {
       command_line_options.dev = true;
       continue;
@@ -980,6 +1070,18 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       continue;
     }
 
+    if (option == OPT_QUERY_OUTPUT) {
+      if (strcmp(optarg, "csv") == 0) {
+        command_line_options.query_output = QueryOutputFormat::kCsv;
+      } else if (strcmp(optarg, "columnar") == 0) {
+        command_line_options.query_output = QueryOutputFormat::kColumnar;
+      } else {
+        PERFETTO_ELOG("Invalid --query-output: %s", optarg);
+        exit(1);
+      }
+      continue;
+    }
+
     if (option == OPT_METRIC_EXTENSION) {
       command_line_options.raw_metric_extensions.push_back(optarg);
       continue;
@@ -1084,15 +1186,19 @@ base::Status LoadTrace(const std::string& trace_file_path, double* size_mb) {
   return base::OkStatus();
 }
 
-base::Status RunQueries(const std::string& query_file_path,
-                        bool expect_output) {
+base::Status RunQueries(
+    const std::string& query_file_path,
+    bool expect_output,
+    QueryOutputFormat output_format = QueryOutputFormat::kCsv) {
   std::string queries;
   if (!base::ReadFile(query_file_path.c_str(), &queries)) {
     return base::ErrStatus("Unable to read file %s", query_file_path.c_str());
   }
 
   base::Status status;
-  if (expect_output) {
+  if (expect_output && output_format == QueryOutputFormat::kColumnar) {
+    status = RunQueriesAndWriteColumnarResult(queries, stdout);
+  } else if (expect_output) {
     status = RunQueriesAndPrintResult(queries, stdout);
   } else {
     status = RunQueriesWithoutOutput(queries);
@@ -1568,6 +1674,10 @@ base::Status TraceProcessorMain(int argc, char** argv) {
       options.crop_track_events
           ? DropTrackEventDataBefore::kTrackEventRangeOfInterest
           : DropTrackEventDataBefore::kNoDrop;
+  config.tokenizer_thread_count = options.tokenizer_threads;
+  config.sorter_memory_budget_bytes =
+      options.sorter_memory_budget_mb * 1024 * 1024;
+  config.sorter_spill_dir = options.sorter_spill_dir;
 
   std::vector<MetricExtension> metric_extensions;
   RETURN_IF_ERROR(ParseMetricExtensionPaths(
@@ -1659,7 +1769,8 @@ base::Status TraceProcessorMain(int argc, char** argv) {
   }
 
   if (!options.query_file_path.empty()) {
-    base::Status status = RunQueries(options.query_file_path, true);
+    base::Status status =
+        RunQueries(options.query_file_path, true, options.query_output);
     if (!status.ok()) {
       // Write metatrace if needed before exiting.
       RETURN_IF_ERROR(MaybeWriteMetatrace(options.metatrace_path));
@@ -16,13 +16,30 @@
 
 #include "src/trace_processor/util/bump_allocator.h"
 
+#include <algorithm>
 #include <limits>
 #include <optional>
+#include <string>
+#include <utility>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/compiler.h"
 #include "perfetto/base/logging.h"
+#include "perfetto/ext/base/temp_file.h"
 #include "perfetto/ext/base/utils.h"
 
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE)
+#define PERFETTO_BUMP_ALLOCATOR_CAN_SPILL() 1
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define PERFETTO_BUMP_ALLOCATOR_CAN_SPILL() 0
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 namespace {
@@ -37,10 +54,58 @@ base::AlignedUniquePtr<uint8_t[]> Allocate(uint32_t size) {
   return base::AlignedUniquePtr<uint8_t[]>(ptr);
 }
 
+#if PERFETTO_BUMP_ALLOCATOR_CAN_SPILL()
+base::ScopedFile CreateUnlinkedSpillFile(const std::string& dir) {
+  if (dir.empty())
+    return base::TempFile::CreateUnlinked().ReleaseFD();
+  std::string path = dir + "/perfetto-sorter-XXXXXX";
+  base::ScopedFile fd(mkstemp(&path[0]));
+  if (!fd)
+    PERFETTO_FATAL("Could not create spill file in %s", dir.c_str());
+  PERFETTO_CHECK(unlink(path.c_str()) == 0);
+  return fd;
+}
+
+// Frees the pages of a mapped region of the spill file whose contents are not
+// needed anymore, both from memory and from the file itself.
+void ReleaseMappedRegion(uint8_t* ptr, uint64_t size) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  // Punches a hole in the file, which drops the pages from the page cache as
+  // well (MADV_DONTNEED would just unmap them, leaving them dirty in the page
+  // cache). Not all filesystems support it: fall back on MADV_DONTNEED.
+  if (madvise(ptr, size, MADV_REMOVE) == 0)
+    return;
+#endif
+  PERFETTO_CHECK(madvise(ptr, size, MADV_DONTNEED) == 0);
+}
+#endif  // PERFETTO_BUMP_ALLOCATOR_CAN_SPILL()
+
 }  // namespace
 
+void BumpAllocator::SegmentDeleter::operator()(uint8_t* ptr) const {
+#if PERFETTO_BUMP_ALLOCATOR_CAN_SPILL()
+  PERFETTO_ASAN_UNPOISON(ptr, kSegmentSize);
+  PERFETTO_CHECK(munmap(ptr, kSegmentSize) == 0);
+#else
+  base::ignore_result(ptr);
+  PERFETTO_FATAL("Mapped segments are not supported on this platform");
+#endif
+}
+
 BumpAllocator::BumpAllocator() = default;
 
+BumpAllocator::BumpAllocator(uint64_t memory_budget, std::string spill_dir) {
+#if PERFETTO_BUMP_ALLOCATOR_CAN_SPILL()
+  if (memory_budget > 0) {
+    memory_budget_ = std::max(memory_budget, kMinMemoryBudget);
+    spill_dir_ = std::move(spill_dir);
+  }
+#else
+  base::ignore_result(memory_budget, spill_dir);
+#endif
+}
+
 BumpAllocator::~BumpAllocator() {
   for (const auto& chunk : chunks_) {
     PERFETTO_CHECK(chunk.unfreed_allocations == 0);
@@ -62,9 +127,15 @@ BumpAllocator::AllocId BumpAllocator::Alloc(uint32_t size) {
   }
 
   // Slow path: we don't have enough space in the last chunk so we create one.
-  Chunk chunk;
-  chunk.allocation = Allocate(kChunkSize);
-  chunks_.emplace_back(std::move(chunk));
+  if (memory_budget_ > 0) {
+    chunks_.emplace_back(NewMappedChunk());
+    MarkChunkResident(LastChunkIndex());
+  } else {
+    Chunk chunk;
+    chunk.allocation = Allocate(kChunkSize);
+    chunk.data = chunk.allocation.get();
+    chunks_.emplace_back(std::move(chunk));
+  }
 
   // Ensure that we haven't exceeded the maximum number of chunks.
   PERFETTO_CHECK(LastChunkIndex() < kMaxChunkCount);
@@ -87,8 +158,15 @@ void BumpAllocator::Free(AllocId id) {
 void* BumpAllocator::GetPointer(AllocId id) {
   uint64_t queue_index = ChunkIndexToQueueIndex(id.chunk_index);
   PERFETTO_CHECK(queue_index <= std::numeric_limits<size_t>::max());
-  return chunks_.at(static_cast<size_t>(queue_index)).allocation.get() +
-         id.chunk_offset;
+  Chunk& chunk = chunks_.at(static_cast<size_t>(queue_index));
+  if (PERFETTO_UNLIKELY(chunk.spilled))
+    UnspillChunk(id.chunk_index, &chunk);
+  return chunk.data + id.chunk_offset;
+}
+
+bool BumpAllocator::IsChunkSpilledForTesting(AllocId id) {
+  uint64_t queue_index = ChunkIndexToQueueIndex(id.chunk_index);
+  return chunks_.at(static_cast<size_t>(queue_index)).spilled;
 }
 
 uint64_t BumpAllocator::EraseFrontFreeChunks() {
@@ -98,9 +176,28 @@ uint64_t BumpAllocator::EraseFrontFreeChunks() {
     if (chunks_.at(to_erase_chunks).unfreed_allocations > 0) {
       break;
     }
+    const Chunk& chunk = chunks_.at(to_erase_chunks);
+    if (!chunk.allocation) {
+      if (chunk.spilled) {
+        spilled_chunks_count_--;
+      } else {
+        resident_chunks_count_--;
+      }
+    }
+  }
+  if (memory_budget_ > 0 && to_erase_chunks > 0) {
+    ReleaseErasedChunks(erased_front_chunks_count_,
+                        erased_front_chunks_count_ + to_erase_chunks);
   }
   chunks_.erase_front(to_erase_chunks);
   erased_front_chunks_count_ += to_erase_chunks;
+
+  // Drop the entries of erased chunks from the front of |resident_chunks_|.
+  // Entries not at the front are dropped by SpillChunksOverBudget().
+  while (!resident_chunks_.empty() &&
+         resident_chunks_.front() < erased_front_chunks_count_) {
+    resident_chunks_.pop_front();
+  }
   return to_erase_chunks;
 }
 
@@ -127,7 +224,7 @@ std::optional<BumpAllocator::AllocId> BumpAllocator::TryAllocInLastChunk(
   // Verify some invariants:
   // 1) The allocation must exist
   // 2) The bump must be in the bounds of the chunk.
-  PERFETTO_DCHECK(chunk.allocation);
+  PERFETTO_DCHECK(chunk.data);
   PERFETTO_DCHECK(chunk.bump_offset <= kChunkSize);
 
   // If the end of the allocation ends up after this chunk, we cannot service it
@@ -144,10 +241,128 @@ std::optional<BumpAllocator::AllocId> BumpAllocator::TryAllocInLastChunk(
   chunk.unfreed_allocations++;
 
   // Unpoison the allocation range to allow access to it on ASAN builds.
-  PERFETTO_ASAN_UNPOISON(chunk.allocation.get() + alloc_offset, size);
+  PERFETTO_ASAN_UNPOISON(chunk.data + alloc_offset, size);
+
+  // The last chunk can have been spilled by earlier chunks being accessed
+  // again. The caller is going to write to the allocation, which faults the
+  // chunk back in.
+  if (PERFETTO_UNLIKELY(chunk.spilled))
+    UnspillChunk(LastChunkIndex(), &chunk);
 
   return AllocId{LastChunkIndex(), alloc_offset};
 }
 
+BumpAllocator::Chunk BumpAllocator::NewMappedChunk() {
+#if PERFETTO_BUMP_ALLOCATOR_CAN_SPILL()
+  if (!spill_fd_)
+    spill_fd_ = CreateUnlinkedSpillFile(spill_dir_);
+
+  // Chunks are never reused, so the chunk being created is always the last
+  // one: map a new segment if it doesn't fit in the last one.
+  const uint64_t chunk_index =
+      chunks_.empty() ? erased_front_chunks_count_ : LastChunkIndex() + 1;
+  const uint64_t segment_index = chunk_index / kChunksPerSegment;
+  if (segment_index == erased_front_segments_count_ + segments_.size()) {
+    // The file is sparse: this does not use any space on disk until the
+    // pages are written back.
+    const uint64_t file_size = (segment_index + 1) * kSegmentSize;
+    PERFETTO_CHECK(ftruncate(*spill_fd_, static_cast<off_t>(file_size)) == 0);
+    void* ptr = mmap(nullptr, kSegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     *spill_fd_, static_cast<off_t>(file_size - kSegmentSize));
+    PERFETTO_CHECK(ptr != MAP_FAILED);
+
+    // Poison the region to try and catch out of bound accesses.
+    PERFETTO_ASAN_POISON(ptr, kSegmentSize);
+    segments_.emplace_back(Segment(static_cast<uint8_t*>(ptr)));
+  }
+  PERFETTO_DCHECK(segment_index >= erased_front_segments_count_);
+  const Segment& segment = segments_.at(
+      static_cast<size_t>(segment_index - erased_front_segments_count_));
+
+  Chunk chunk;
+  chunk.data =
+      segment.get() + (chunk_index % kChunksPerSegment) * kChunkSize;
+  return chunk;
+#else
+  PERFETTO_FATAL("Spilling is not supported on this platform");
+#endif
+}
+
+void BumpAllocator::ReleaseErasedChunks(uint64_t first_chunk_index,
+                                        uint64_t end_chunk_index) {
+#if PERFETTO_BUMP_ALLOCATOR_CAN_SPILL()
+  // The erased chunks are contiguous: release them with one call per segment
+  // rather than one per chunk.
+  for (uint64_t i = first_chunk_index; i < end_chunk_index;) {
+    const uint64_t segment_index = i / kChunksPerSegment;
+    const uint64_t segment_end = (segment_index + 1) * kChunksPerSegment;
+    const uint64_t end = std::min(end_chunk_index, segment_end);
+    const Chunk& chunk =
+        chunks_.at(static_cast<size_t>(ChunkIndexToQueueIndex(i)));
+    ReleaseMappedRegion(chunk.data, (end - i) * kChunkSize);
+    i = end;
+  }
+
+  // Unmap the segments whose chunks have all been erased. The segment of the
+  // next chunk is kept, as it is (or will be) still in use.
+  const uint64_t first_live_segment = end_chunk_index / kChunksPerSegment;
+  while (erased_front_segments_count_ < first_live_segment) {
+    if (!segments_.empty())
+      segments_.pop_front();
+    erased_front_segments_count_++;
+  }
+#else
+  base::ignore_result(first_chunk_index, end_chunk_index);
+#endif
+}
+
+void BumpAllocator::UnspillChunk(uint64_t chunk_index, Chunk* chunk) {
+  // The pages of the chunk will be faulted back in by the caller accessing
+  // them: just account for the chunk being resident again.
+  chunk->spilled = false;
+  spilled_chunks_count_--;
+  MarkChunkResident(chunk_index);
+}
+
+void BumpAllocator::MarkChunkResident(uint64_t chunk_index) {
+  resident_chunks_.emplace_back(chunk_index);
+  resident_chunks_count_++;
+  SpillChunksOverBudget();
+}
+
+void BumpAllocator::SpillChunksOverBudget() {
+#if PERFETTO_BUMP_ALLOCATOR_CAN_SPILL()
+  while (resident_chunks_count_ * kChunkSize > memory_budget_) {
+    PERFETTO_DCHECK(!resident_chunks_.empty());
+    uint64_t chunk_index = resident_chunks_.front();
+    resident_chunks_.pop_front();
+
+    // The chunk was erased since it became resident.
+    if (chunk_index < erased_front_chunks_count_)
+      continue;
+
+    Chunk& chunk =
+        chunks_.at(static_cast<size_t>(ChunkIndexToQueueIndex(chunk_index)));
+    PERFETTO_DCHECK(!chunk.spilled);
+
+    // As the chunk is a shared mapping of |spill_fd_|, dropping its pages
+    // does not lose the data: any later access faults them back in from the
+    // file. MADV_DONTNEED only unmaps the pages, leaving them (dirty) in the
+    // page cache. Don't wait for them to be written back, as that would
+    // block the sorter on the disk for every chunk; just start the writeback
+    // so that the kernel can reclaim them once it's done.
+    PERFETTO_CHECK(madvise(chunk.data, kChunkSize, MADV_DONTNEED) == 0);
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+    sync_file_range(*spill_fd_, static_cast<off_t>(chunk_index * kChunkSize),
+                    static_cast<off_t>(kChunkSize), SYNC_FILE_RANGE_WRITE);
+#endif
+    chunk.spilled = true;
+    resident_chunks_count_--;
+    spilled_chunks_count_++;
+  }
+#endif
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
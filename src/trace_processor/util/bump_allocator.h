@@ -23,9 +23,11 @@
 #include <limits>
 #include <memory>
 #include <optional>
+#include <string>
 #include <tuple>
 
 #include "perfetto/ext/base/circular_queue.h"
+#include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/utils.h"
 
 namespace perfetto {
@@ -49,6 +51,17 @@ namespace trace_processor {
 // object. The destructor will CHECK if it detects any allocation which is
 // unfreed.
 //
+// Optionally, the allocator can be given a memory budget (see the constructor
+// below). In this mode, chunks are not obtained from malloc but are instead
+// carved out of large segments mapped from an unlinked temporary file. Once
+// more than |budget| bytes of chunks are resident, the oldest resident chunks
+// are "spilled": their pages are dropped from memory and written back to the
+// file asynchronously. As the mapping itself is kept, pointers into spilled
+// chunks stay valid and the pages are lazily faulted back in the next time
+// they are accessed. Chunks are accounted as resident again when a pointer
+// into them is obtained with GetPointer() or when they are allocated from.
+// The file regions of erased chunks are released to the filesystem.
+//
 // [1] https://rust-hosted-langs.github.io/book/chapter-simple-bump.html
 class BumpAllocator {
  public:
@@ -102,8 +115,31 @@ class BumpAllocator {
       kChunkSize == (1 << kChunkOffsetAllocIdBits),
       "Chunk size must match the number of bits used for offset within chunk");
 
+  // The minimum memory budget which can be passed to the constructor below.
+  static constexpr uint64_t kMinMemoryBudget = 2 * kChunkSize;
+
+  // The size of the regions of the spill file which are mapped at once when
+  // spilling is enabled. Mapping each chunk separately would need one mapping
+  // per 64KB, which quickly runs into the limit on the number of mappings of
+  // a process (vm.max_map_count) on large traces.
+  static constexpr uint64_t kSegmentSize = 16ull * 1024 * 1024;  // 16MB
+  static constexpr uint64_t kChunksPerSegment = kSegmentSize / kChunkSize;
+
   BumpAllocator();
 
+  // Creates an allocator which keeps at most |memory_budget| bytes of chunks
+  // resident in memory, spilling the rest to a temporary file (see the class
+  // comment). A budget of 0 disables spilling; otherwise it is rounded up to
+  // |kMinMemoryBudget|.
+  //
+  // The temporary file is created in |spill_dir| or, if empty, in the system
+  // temporary directory ($TMPDIR or /tmp). Note that if the directory is on a
+  // tmpfs, spilled chunks are still held in memory (or swap).
+  //
+  // Spilling is only supported on platforms with mmap support: on other
+  // platforms, the budget is ignored.
+  explicit BumpAllocator(uint64_t memory_budget, std::string spill_dir = {});
+
   // Verifies that all calls to |Alloc| were paired with matching calls to
   // |Free|.
   ~BumpAllocator();
@@ -150,13 +186,33 @@ class BumpAllocator {
     return erased_front_chunks_count_;
   }
 
+  // Returns the number of chunks which are currently spilled to the temporary
+  // file. Always zero if spilling is disabled.
+  uint64_t spilled_chunks_count() const { return spilled_chunks_count_; }
+
+  // Returns whether the chunk containing |id| is currently spilled.
+  bool IsChunkSpilledForTesting(AllocId id);
+
  private:
+  // Unmaps a segment of the spill file.
+  struct SegmentDeleter {
+    void operator()(uint8_t*) const;
+  };
+  using Segment = std::unique_ptr<uint8_t[], SegmentDeleter>;
+
   struct Chunk {
-    // The allocation from the system for this chunk. Because all allocations
-    // need to be 8 byte aligned, the chunk also needs to be 8-byte aligned.
-    // base::AlignedUniquePtr ensures this is the case.
+    // The memory of this chunk. Because all allocations need to be 8 byte
+    // aligned, the chunk also needs to be 8-byte aligned. Both
+    // base::AlignedAlloc and mmap ensure this is the case.
+    uint8_t* data = nullptr;
+
+    // The allocation from the system for this chunk. Null if the chunk was
+    // carved out of a segment of the spill file.
     base::AlignedUniquePtr<uint8_t[]> allocation;
 
+    // Whether the pages of this chunk have been dropped from memory.
+    bool spilled = false;
+
     // The bump offset relative to |allocation.data|. Incremented to service
     // Alloc requests.
     uint32_t bump_offset = 0;
@@ -169,6 +225,16 @@ class BumpAllocator {
   // an AllocId if this was successful or std::nullopt otherwise.
   std::optional<AllocId> TryAllocInLastChunk(uint32_t size);
 
+  // Functions to implement spilling of chunks when |memory_budget_| != 0.
+  // Chunk i is always stored at offset i * kChunkSize of the spill file, in
+  // segment i / kChunksPerSegment.
+  Chunk NewMappedChunk();
+  void UnspillChunk(uint64_t chunk_index, Chunk* chunk);
+  void MarkChunkResident(uint64_t chunk_index);
+  void SpillChunksOverBudget();
+  void ReleaseErasedChunks(uint64_t first_chunk_index,
+                           uint64_t end_chunk_index);
+
   uint64_t ChunkIndexToQueueIndex(uint64_t chunk_index) const {
     return chunk_index - erased_front_chunks_count_;
   }
@@ -182,6 +248,20 @@ class BumpAllocator {
 
   base::CircularQueue<Chunk> chunks_;
   uint64_t erased_front_chunks_count_ = 0;
+
+  // State used only when spilling is enabled.
+  uint64_t memory_budget_ = 0;
+  std::string spill_dir_;
+  base::ScopedFile spill_fd_;
+  // The mapped segments of the spill file, starting from the segment of the
+  // first chunk in |chunks_|.
+  base::CircularQueue<Segment> segments_;
+  uint64_t erased_front_segments_count_ = 0;
+  // Indices of the chunks which are mapped and resident, in the order they
+  // became resident. Can contain indices of already erased chunks.
+  base::CircularQueue<uint64_t> resident_chunks_;
+  uint64_t resident_chunks_count_ = 0;
+  uint64_t spilled_chunks_count_ = 0;
 };
 
 }  // namespace trace_processor
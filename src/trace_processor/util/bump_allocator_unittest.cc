@@ -20,6 +20,8 @@
 #include <random>
 #include <vector>
 
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/temp_file.h"
 #include "perfetto/ext/base/utils.h"
 #include "test/gtest_and_gmock.h"
 
@@ -111,5 +113,108 @@ TEST_F(BumpAllocatorUnittest, StressTest) {
   }
 }
 
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE)
+TEST(BumpAllocatorSpillTest, SpillsOverBudgetAndReadsBack) {
+  constexpr uint32_t kChunks = 8;
+  BumpAllocator allocator(BumpAllocator::kMinMemoryBudget);
+
+  // Fill each chunk with a different byte.
+  std::vector<BumpAllocator::AllocId> ids;
+  for (uint32_t i = 0; i < kChunks; ++i) {
+    BumpAllocator::AllocId id = allocator.Alloc(BumpAllocator::kChunkSize);
+    memset(allocator.GetPointer(id), static_cast<int>(i),
+           BumpAllocator::kChunkSize);
+    ids.push_back(id);
+  }
+  ASSERT_EQ(allocator.spilled_chunks_count(),
+            kChunks - BumpAllocator::kMinMemoryBudget /
+                          BumpAllocator::kChunkSize);
+
+  // Reading back the spilled chunks should fault them back in intact.
+  for (uint32_t i = 0; i < kChunks; ++i) {
+    const uint8_t* ptr =
+        static_cast<const uint8_t*>(allocator.GetPointer(ids[i]));
+    ASSERT_EQ(ptr[0], i);
+    ASSERT_EQ(ptr[BumpAllocator::kChunkSize - 1], i);
+    allocator.Free(ids[i]);
+  }
+  ASSERT_EQ(allocator.EraseFrontFreeChunks(), kChunks);
+  ASSERT_EQ(allocator.spilled_chunks_count(), 0u);
+}
+
+TEST(BumpAllocatorSpillTest, AllocInSpilledLastChunk) {
+  BumpAllocator allocator(BumpAllocator::kMinMemoryBudget);
+  BumpAllocator::AllocId a = allocator.Alloc(BumpAllocator::kChunkSize);
+  BumpAllocator::AllocId b = allocator.Alloc(BumpAllocator::kChunkSize);
+  BumpAllocator::AllocId c = allocator.Alloc(BumpAllocator::kChunkSize);
+  BumpAllocator::AllocId d = allocator.Alloc(8);
+
+  // Accessing the first two chunks again spills the last one, which still
+  // has room for more allocations.
+  allocator.GetPointer(a);
+  allocator.GetPointer(b);
+  ASSERT_TRUE(allocator.IsChunkSpilledForTesting(d));
+  ASSERT_EQ(allocator.spilled_chunks_count(), 2u);
+
+  // Allocating from it makes it resident again, spilling the oldest
+  // resident chunk instead.
+  BumpAllocator::AllocId e = allocator.Alloc(8);
+  ASSERT_EQ(e.chunk_index, d.chunk_index);
+  ASSERT_FALSE(allocator.IsChunkSpilledForTesting(e));
+  ASSERT_TRUE(allocator.IsChunkSpilledForTesting(a));
+  ASSERT_FALSE(allocator.IsChunkSpilledForTesting(b));
+  ASSERT_EQ(allocator.spilled_chunks_count(), 2u);
+
+  for (BumpAllocator::AllocId id : {a, b, c, d, e})
+    allocator.Free(id);
+  ASSERT_EQ(allocator.EraseFrontFreeChunks(), 4u);
+  ASSERT_EQ(allocator.spilled_chunks_count(), 0u);
+}
+
+TEST(BumpAllocatorSpillTest, EraseChunksAcrossSegments) {
+  // Enough iterations for the chunks to span a few segments, which are
+  // unmapped as their chunks are erased.
+  constexpr uint32_t kIterations =
+      static_cast<uint32_t>(BumpAllocator::kChunksPerSegment);
+  BumpAllocator allocator(BumpAllocator::kMinMemoryBudget);
+  for (uint32_t i = 0; i < kIterations; ++i) {
+    BumpAllocator::AllocId a = allocator.Alloc(BumpAllocator::kChunkSize);
+    BumpAllocator::AllocId b = allocator.Alloc(BumpAllocator::kChunkSize);
+    BumpAllocator::AllocId c = allocator.Alloc(8);
+    memset(allocator.GetPointer(a), 0xcd, BumpAllocator::kChunkSize);
+    memset(allocator.GetPointer(c), 0xab, 8);
+    allocator.Free(a);
+    allocator.Free(b);
+    ASSERT_EQ(static_cast<uint8_t*>(allocator.GetPointer(c))[7], 0xab);
+    allocator.Free(c);
+    ASSERT_EQ(allocator.EraseFrontFreeChunks(), 3u);
+  }
+  ASSERT_EQ(allocator.erased_front_chunks_count(), 3 * kIterations);
+}
+
+TEST(BumpAllocatorSpillTest, SpillDir) {
+  base::TempDir dir = base::TempDir::Create();
+  {
+    BumpAllocator allocator(BumpAllocator::kMinMemoryBudget, dir.path());
+    std::vector<BumpAllocator::AllocId> ids;
+    for (uint32_t i = 0; i < 4; ++i) {
+      ids.push_back(allocator.Alloc(BumpAllocator::kChunkSize));
+      memset(allocator.GetPointer(ids.back()), static_cast<int>(i),
+             BumpAllocator::kChunkSize);
+    }
+    ASSERT_EQ(allocator.spilled_chunks_count(), 2u);
+    for (uint32_t i = 0; i < 4; ++i) {
+      ASSERT_EQ(static_cast<uint8_t*>(allocator.GetPointer(ids[i]))[1], i);
+      allocator.Free(ids[i]);
+    }
+    allocator.EraseFrontFreeChunks();
+  }
+  // The spill file is unlinked as soon as it is created, so the directory is
+  // empty and can be removed by ~TempDir().
+}
+#endif
+
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/util/zstd_utils.h"
+
+// For bazel build.
+#include "perfetto/base/build_config.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+namespace util {
+
+bool IsZstdSupported() {
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+  return true;
+#else
+  return false;
+#endif
+}
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)  // Real Implementation
+
+bool ZstdDecompressFully(const uint8_t* data,
+                         size_t size,
+                         std::vector<uint8_t>* output) {
+  ZSTD_DCtx* dctx = ZSTD_createDCtx();
+  if (!dctx)
+    return false;
+
+  ZSTD_inBuffer in{data, size, 0};
+  uint8_t buffer[4096];
+  size_t ret = 0;
+  for (;;) {
+    ZSTD_outBuffer out{buffer, sizeof(buffer), 0};
+    ret = ZSTD_decompressStream(dctx, &out, &in);
+    if (ZSTD_isError(ret))
+      break;
+    output->insert(output->end(), buffer, buffer + out.pos);
+    // If the output buffer was not filled, the decoder has flushed everything
+    // it could produce from the input consumed so far.
+    if (in.pos == in.size && out.pos < out.size)
+      break;
+  }
+  ZSTD_freeDCtx(dctx);
+
+  // A non-zero |ret| at the end of the input means the last frame was
+  // truncated.
+  return !ZSTD_isError(ret) && ret == 0;
+}
+
+#else  // Dummy Implementation
+
+bool ZstdDecompressFully(const uint8_t*, size_t, std::vector<uint8_t>*) {
+  return false;
+}
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+
+}  // namespace util
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -30,6 +30,7 @@
 #include "src/trace_processor/util/descriptors.h"
 #include "src/trace_processor/util/gzip_utils.h"
 #include "src/trace_processor/util/protozero_to_text.h"
+#include "src/trace_processor/util/zstd_utils.h"
 
 namespace perfetto {
 namespace trace_to_text {
@@ -63,6 +64,8 @@ class OnlineTraceToText {
   std::string TracePacketToText(protozero::ConstBytes packet,
                                 uint32_t indent_depth);
   void PrintCompressedPackets(protozero::ConstBytes packets);
+  void PrintZstdCompressedPackets(protozero::ConstBytes packets);
+  void PrintDecompressedPackets(const std::vector<uint8_t>& whole_data);
 
   bool ok_ = true;
   std::ostream* output_;
@@ -83,16 +86,8 @@ std::string OnlineTraceToText::TracePacketToText(protozero::ConstBytes packet,
 void OnlineTraceToText::PrintCompressedPackets(protozero::ConstBytes packets) {
   WriteToOutput(output_, "compressed_packets {\n");
   if (trace_processor::util::IsGzipSupported()) {
-    std::vector<uint8_t> whole_data =
-        GzipDecompressor::DecompressFully(packets.data, packets.size);
-    protos::pbzero::Trace::Decoder decoder(whole_data.data(),
-                                           whole_data.size());
-    for (auto it = decoder.packet(); it; ++it) {
-      WriteToOutput(output_, "  packet {\n");
-      std::string text = TracePacketToText(*it, 2);
-      output_->write(text.data(), std::streamsize(text.size()));
-      WriteToOutput(output_, "\n  }\n");
-    }
+    PrintDecompressedPackets(
+        GzipDecompressor::DecompressFully(packets.data, packets.size));
   } else {
     static const char kErrMsg[] =
         "Cannot decode compressed packets. zlib not enabled in the build "
@@ -107,6 +102,41 @@ void OnlineTraceToText::PrintCompressedPackets(protozero::ConstBytes packets) {
   WriteToOutput(output_, "}\n");
 }
 
+void OnlineTraceToText::PrintZstdCompressedPackets(
+    protozero::ConstBytes packets) {
+  WriteToOutput(output_, "zstd_compressed_packets {\n");
+  std::vector<uint8_t> whole_data;
+  if (!trace_processor::util::IsZstdSupported()) {
+    static const char kErrMsg[] =
+        "Cannot decode zstd compressed packets. zstd not enabled in the build "
+        "config";
+    WriteToOutput(output_, kErrMsg);
+    static bool log_once = [] {
+      PERFETTO_ELOG("%s", kErrMsg);
+      return true;
+    }();
+    base::ignore_result(log_once);
+  } else if (!trace_processor::util::ZstdDecompressFully(
+                 packets.data, packets.size, &whole_data)) {
+    PERFETTO_ELOG("Failed to decompress zstd compressed packets");
+    ok_ = false;
+  } else {
+    PrintDecompressedPackets(whole_data);
+  }
+  WriteToOutput(output_, "}\n");
+}
+
+void OnlineTraceToText::PrintDecompressedPackets(
+    const std::vector<uint8_t>& whole_data) {
+  protos::pbzero::Trace::Decoder decoder(whole_data.data(), whole_data.size());
+  for (auto it = decoder.packet(); it; ++it) {
+    WriteToOutput(output_, "  packet {\n");
+    std::string text = TracePacketToText(*it, 2);
+    output_->write(text.data(), std::streamsize(text.size()));
+    WriteToOutput(output_, "\n  }\n");
+  }
+}
+
 void OnlineTraceToText::Feed(const uint8_t* data, size_t len) {
   ring_buffer_.Append(data, static_cast<size_t>(len));
   while (true) {
@@ -135,6 +165,8 @@ void OnlineTraceToText::Feed(const uint8_t* data, size_t len) {
     }
     if (decoder.has_compressed_packets()) {
       PrintCompressedPackets(decoder.compressed_packets());
+    } else if (decoder.has_zstd_compressed_packets()) {
+      PrintZstdCompressedPackets(decoder.zstd_compressed_packets());
     } else {
       WriteToOutput(output_, "packet {\n");
       protozero::ConstBytes packet = {token.start, token.len};
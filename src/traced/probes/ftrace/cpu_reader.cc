@@ -36,6 +36,7 @@
 #include "src/traced/probes/ftrace/ftrace_controller.h"  // FtraceClockSnapshot
 #include "src/traced/probes/ftrace/ftrace_data_source.h"
 #include "src/traced/probes/ftrace/ftrace_print_filter.h"
+#include "src/traced/probes/ftrace/mapped_ring_buffer.h"
 #include "src/traced/probes/ftrace/proto_translation_table.h"
 
 #include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
@@ -138,13 +139,13 @@ bool SetBlocking(int fd, bool is_blocking) {
   return fcntl(fd, F_SETFL, flags) == 0;
 }
 
-void SetParseError(const std::set<FtraceDataSource*>& started_data_sources,
+void SetParseError(const std::vector<CpuReader::DataSourceTarget>& targets,
                    size_t cpu,
                    FtraceParseStatus status) {
   PERFETTO_DPLOG("[cpu%zu]: unexpected ftrace read error: %s", cpu,
                  protos::pbzero::FtraceParseStatus_Name(status));
-  for (FtraceDataSource* data_source : started_data_sources) {
-    data_source->mutable_parse_errors()->insert(status);
+  for (const CpuReader::DataSourceTarget& target : targets) {
+    target.parse_errors->insert(status);
   }
 }
 
@@ -183,14 +184,74 @@ CpuReader::CpuReader(size_t cpu,
 
 CpuReader::~CpuReader() = default;
 
+bool CpuReader::MapRingBuffer() {
+  if (mapped_buffer_)
+    return true;
+  std::unique_ptr<MappedRingBuffer> mapped =
+      MappedRingBuffer::Create(*trace_fd_);
+  if (!mapped)
+    return false;
+  // The parser expects pages of the same size as the ones read() from the
+  // trace pipe, which is not the case with non-default sub-buffer sizes
+  // (buffer_subbuf_size_kb).
+  if (mapped->subbuf_size() != base::GetSysPageSize()) {
+    PERFETTO_DLOG("[cpu%zu]: unsupported ring buffer sub-buffer size %zu",
+                  cpu_, mapped->subbuf_size());
+    return false;
+  }
+  SetMappedRingBuffer(std::move(mapped));
+  return true;
+}
+
+void CpuReader::UnmapRingBuffer() {
+  // The kernel accounts the data handed out by the last GetReader() as
+  // consumed, and that is what was parsed: read() resumes right after it.
+  mapped_buffer_.reset();
+}
+
+void CpuReader::SetMappedRingBufferForTesting(
+    std::unique_ptr<MappedRingBuffer> buf) {
+  SetMappedRingBuffer(std::move(buf));
+}
+
+void CpuReader::SetMappedRingBuffer(std::unique_ptr<MappedRingBuffer> buf) {
+  // Part of the reader sub-buffer might have been consumed already by read()s
+  // of the trace pipe: resume after it.
+  mapped_reader_id_ = buf->reader_id();
+  mapped_reader_parsed_size_ = buf->reader_read();
+  mapped_buffer_ = std::move(buf);
+}
+
 size_t CpuReader::ReadCycle(
     ParsingBuffers* parsing_bufs,
     size_t max_pages,
     const std::set<FtraceDataSource*>& started_data_sources) {
+  std::vector<DataSourceTarget> targets;
+  targets.reserve(started_data_sources.size());
+  for (FtraceDataSource* data_source : started_data_sources) {
+    targets.push_back({data_source->trace_writer(),
+                       data_source->mutable_metadata(),
+                       data_source->parsing_config(),
+                       data_source->mutable_parse_errors()});
+  }
+  return ReadCycle(parsing_bufs, max_pages, targets);
+}
+
+size_t CpuReader::ReadCycle(ParsingBuffers* parsing_bufs,
+                            size_t max_pages,
+                            const std::vector<DataSourceTarget>& targets) {
   PERFETTO_DCHECK(max_pages > 0 && parsing_bufs->ftrace_data_buf_pages() > 0);
   metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
                              metatrace::FTRACE_CPU_READ_CYCLE);
 
+  if (mapped_buffer_) {
+    size_t total_pages_read =
+        ReadAndProcessMapped(parsing_bufs, max_pages, targets);
+    PERFETTO_METATRACE_COUNTER(TAG_FTRACE, FTRACE_PAGES_DRAINED,
+                               total_pages_read);
+    return total_pages_read;
+  }
+
   // Work in batches to keep cache locality, and limit memory usage.
   size_t total_pages_read = 0;
   for (bool is_first_batch = true;; is_first_batch = false) {
@@ -198,7 +259,7 @@ size_t CpuReader::ReadCycle(
                                   max_pages - total_pages_read);
     size_t pages_read = ReadAndProcessBatch(
         parsing_bufs->ftrace_data_buf(), batch_pages, is_first_batch,
-        parsing_bufs->compact_sched_buf(), started_data_sources);
+        parsing_bufs->compact_sched_buf(), targets);
 
     PERFETTO_DCHECK(pages_read <= batch_pages);
     total_pages_read += pages_read;
@@ -225,7 +286,7 @@ size_t CpuReader::ReadAndProcessBatch(
     size_t max_pages,
     bool first_batch_in_cycle,
     CompactSchedBuffer* compact_sched_buf,
-    const std::set<FtraceDataSource*>& started_data_sources) {
+    const std::vector<DataSourceTarget>& targets) {
   const uint32_t sys_page_size = base::GetSysPageSize();
   size_t pages_read = 0;
   {
@@ -241,7 +302,7 @@ size_t CpuReader::ReadAndProcessBatch(
         // ENODEV: the cpu is offline (b/145583318).
         if (errno != EAGAIN && errno != ENOMEM && errno != EBUSY &&
             errno != ENODEV) {
-          SetParseError(started_data_sources, cpu_,
+          SetParseError(targets, cpu_,
                         FtraceParseStatus::FTRACE_STATUS_UNEXPECTED_READ_ERROR);
         }
         break;  // stop reading regardless of errno
@@ -259,7 +320,7 @@ size_t CpuReader::ReadAndProcessBatch(
         break;
       }
       if (res != static_cast<ssize_t>(sys_page_size)) {
-        SetParseError(started_data_sources, cpu_,
+        SetParseError(targets, cpu_,
                       FtraceParseStatus::FTRACE_STATUS_PARTIAL_PAGE_READ);
         break;
       }
@@ -301,14 +362,133 @@ size_t CpuReader::ReadAndProcessBatch(
   if (pages_read == 0)
     return pages_read;
 
-  for (FtraceDataSource* data_source : started_data_sources) {
-    ProcessPagesForDataSource(
-        data_source->trace_writer(), data_source->mutable_metadata(), cpu_,
-        data_source->parsing_config(), data_source->mutable_parse_errors(),
-        parsing_buf, pages_read, compact_sched_buf, table_, symbolizer_,
-        ftrace_clock_snapshot_, ftrace_clock_);
+  for (const DataSourceTarget& target : targets) {
+    ProcessPagesForDataSource(target.trace_writer, target.metadata, cpu_,
+                              target.parsing_config, target.parse_errors,
+                              parsing_buf, pages_read, compact_sched_buf,
+                              table_, symbolizer_, ftrace_clock_snapshot_,
+                              ftrace_clock_);
+  }
+
+  return pages_read;
+}
+
+// The reader page of a mapped ring buffer is handed back to the kernel when
+// asking for the next one, so the pages are parsed in place, one at a time.
+// The bundles of all data sources are kept open across pages, up to the size
+// of a read() batch, to emit packets of the same size as ReadAndProcessBatch.
+size_t CpuReader::ReadAndProcessMapped(
+    ParsingBuffers* parsing_bufs,
+    size_t max_pages,
+    const std::vector<DataSourceTarget>& targets) {
+  const uint32_t sys_page_size = base::GetSysPageSize();
+  static const size_t kRoughlyAPage = sys_page_size - 512;
+
+  while (mapped_compact_sched_bufs_.size() + 1 < targets.size()) {
+    mapped_compact_sched_bufs_.emplace_back(
+        std::make_unique<CompactSchedBuffer>());
   }
+  std::vector<std::unique_ptr<Bundler>> bundlers;
+  auto start_bundles = [&] {
+    bundlers.clear();  // Finalizes the previous bundles.
+    for (size_t i = 0; i < targets.size(); i++) {
+      const FtraceDataSourceConfig* ds_config = targets[i].parsing_config;
+      CompactSchedBuffer* compact_sched_buf =
+          i == 0 ? parsing_bufs->compact_sched_buf()
+                 : mapped_compact_sched_bufs_[i - 1].get();
+      bundlers.emplace_back(std::make_unique<Bundler>(
+          targets[i].trace_writer, targets[i].metadata,
+          ds_config->symbolize_ksyms ? symbolizer_ : nullptr, cpu_,
+          ftrace_clock_snapshot_, ftrace_clock_, compact_sched_buf,
+          ds_config->compact_sched.enabled));
+    }
+  };
+  auto set_page_error = [&](uint64_t timestamp, FtraceParseStatus status) {
+    for (size_t i = 0; i < targets.size(); i++) {
+      WriteAndSetParseError(bundlers[i].get(), targets[i].parse_errors,
+                            timestamp, status);
+    }
+  };
 
+  start_bundles();
+  size_t pages_read = 0;
+  for (bool is_first_page = true; pages_read < max_pages;
+       is_first_page = false) {
+    if (pages_read > 0 && pages_read % parsing_bufs->ftrace_data_buf_pages() ==
+                              0) {
+      start_bundles();
+    }
+
+    {
+      metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
+                                 metatrace::FTRACE_CPU_READ_BATCH);
+      if (!mapped_buffer_->GetReader()) {
+        // ENODEV: the cpu is offline.
+        if (errno != ENODEV) {
+          SetParseError(targets, cpu_,
+                        FtraceParseStatus::FTRACE_STATUS_UNEXPECTED_READ_ERROR);
+        }
+        break;
+      }
+    }
+
+    const uint32_t reader_id = mapped_buffer_->reader_id();
+    const uint8_t* page = mapped_buffer_->reader_subbuf();
+    const uint8_t* parse_pos = page;
+    std::optional<PageHeader> page_header =
+        ParsePageHeader(&parse_pos, table_->page_header_size_len());
+    if (!page_header.has_value() ||
+        parse_pos + page_header->size > page + sys_page_size) {
+      set_page_error(page_header.has_value() ? page_header->timestamp : 0,
+                     FtraceParseStatus::FTRACE_STATUS_ABI_INVALID_PAGE_HEADER);
+      break;
+    }
+
+    // The kernel keeps writing into the reader page if it's also the page
+    // being written. Only parse up to where GetReader() accounted the data as
+    // consumed, events after that are parsed after the next GetReader().
+    const uint64_t read_size =
+        std::min<uint64_t>(mapped_buffer_->reader_read(), page_header->size);
+    // Skip the part of the page parsed by previous calls.
+    const bool is_new_reader = reader_id != mapped_reader_id_;
+    const uint64_t parsed_size =
+        is_new_reader ? 0 : mapped_reader_parsed_size_;
+    if (parsed_size >= read_size)
+      break;  // Caught up with the writer.
+    PageHeader resume_header = *page_header;
+    resume_header.size = read_size - parsed_size;
+    if (is_new_reader) {
+      // The flag in the page header is only set if the writer already moved
+      // on to another page, the meta page has it in any case.
+      resume_header.lost_events |= mapped_buffer_->reader_lost_events() > 0;
+    }
+    if (parsed_size > 0) {
+      std::optional<uint64_t> timestamp = TimestampAtPayloadOffset(
+          parse_pos, parsed_size, page_header->timestamp);
+      if (!timestamp.has_value()) {
+        set_page_error(page_header->timestamp,
+                       FtraceParseStatus::FTRACE_STATUS_ABI_END_OVERFLOW);
+        break;
+      }
+      resume_header.timestamp = *timestamp;
+      resume_header.lost_events = false;  // Reported with the first part.
+    }
+    mapped_reader_id_ = reader_id;
+    mapped_reader_parsed_size_ = read_size;
+
+    for (size_t i = 0; i < targets.size(); i++) {
+      const DataSourceTarget& target = targets[i];
+      ProcessPagePayloadForDataSource(
+          bundlers[i].get(), target.metadata, target.parsing_config,
+          target.parse_errors, parse_pos + parsed_size, resume_header, table_);
+    }
+    pages_read++;
+
+    // See the same heuristic in ReadAndProcessBatch(): a page that is not
+    // full means that we caught up with the writer.
+    if (read_size < kRoughlyAPage && !is_first_page)
+      break;
+  }
   return pages_read;
 }
 
@@ -427,7 +607,6 @@ bool CpuReader::ProcessPagesForDataSource(
 
   bool success = true;
   size_t pages_parsed = 0;
-  bool compact_sched_enabled = ds_config->compact_sched.enabled;
   for (; pages_parsed < pages_read; pages_parsed++) {
     const uint8_t* curr_page = parsing_buf + (pages_parsed * sys_page_size);
     const uint8_t* curr_page_end = curr_page + sys_page_size;
@@ -446,36 +625,52 @@ bool CpuReader::ProcessPagesForDataSource(
       continue;
     }
 
-    // Start a new bundle if either:
-    // * The page we're about to read indicates that there was a kernel ring
-    //   buffer overrun since our last read from that per-cpu buffer. We have
-    //   a single |lost_events| field per bundle, so start a new packet.
-    // * The compact_sched buffer is holding more unique interned strings than
-    //   a threshold. We need to flush the compact buffer to make the
-    //   interning lookups cheap again.
-    bool interner_past_threshold =
-        compact_sched_enabled &&
-        bundler.compact_sched_buf()->interner().interned_comms_size() >
-            kCompactSchedInternerThreshold;
-
-    if (page_header->lost_events || interner_past_threshold) {
-      bundler.StartNewPacket(page_header->lost_events);
-    }
-
-    FtraceParseStatus status = ParsePagePayload(
-        parse_pos, &page_header.value(), table, ds_config, &bundler, metadata);
-
-    if (status != FtraceParseStatus::FTRACE_STATUS_OK) {
-      WriteAndSetParseError(&bundler, parse_errors, page_header->timestamp,
-                            status);
+    if (!ProcessPagePayloadForDataSource(&bundler, metadata, ds_config,
+                                         parse_errors, parse_pos,
+                                         *page_header, table)) {
       success = false;
-      continue;
     }
   }
   // bundler->FinalizeAndRunSymbolizer() will run as part of the destructor.
   return success;
 }
 
+// static
+bool CpuReader::ProcessPagePayloadForDataSource(
+    Bundler* bundler,
+    FtraceMetadata* metadata,
+    const FtraceDataSourceConfig* ds_config,
+    base::FlatSet<protos::pbzero::FtraceParseStatus>* parse_errors,
+    const uint8_t* start_of_payload,
+    const PageHeader& page_header,
+    const ProtoTranslationTable* table) {
+  // Start a new bundle if either:
+  // * The page we're about to read indicates that there was a kernel ring
+  //   buffer overrun since our last read from that per-cpu buffer. We have
+  //   a single |lost_events| field per bundle, so start a new packet.
+  // * The compact_sched buffer is holding more unique interned strings than
+  //   a threshold. We need to flush the compact buffer to make the
+  //   interning lookups cheap again.
+  bool interner_past_threshold =
+      ds_config->compact_sched.enabled &&
+      bundler->compact_sched_buf()->interner().interned_comms_size() >
+          kCompactSchedInternerThreshold;
+
+  if (page_header.lost_events || interner_past_threshold) {
+    bundler->StartNewPacket(page_header.lost_events);
+  }
+
+  FtraceParseStatus status = ParsePagePayload(
+      start_of_payload, &page_header, table, ds_config, bundler, metadata);
+
+  if (status != FtraceParseStatus::FTRACE_STATUS_OK) {
+    WriteAndSetParseError(bundler, parse_errors, page_header.timestamp,
+                          status);
+    return false;
+  }
+  return true;
+}
+
 // A page header consists of:
 // * timestamp: 8 bytes
 // * commit: 8 bytes on 64 bit, 4 bytes on 32 bit kernels
@@ -685,6 +880,69 @@ protos::pbzero::FtraceParseStatus CpuReader::ParsePagePayload(
   return FtraceParseStatus::FTRACE_STATUS_OK;
 }
 
+// Walks the event headers the same way as ParsePagePayload, without parsing
+// the events.
+// static
+std::optional<uint64_t> CpuReader::TimestampAtPayloadOffset(
+    const uint8_t* start_of_payload,
+    uint64_t offset,
+    uint64_t page_timestamp) {
+  const uint8_t* ptr = start_of_payload;
+  const uint8_t* const end = ptr + offset;
+
+  uint64_t timestamp = page_timestamp;
+  while (ptr < end) {
+    EventHeader event_header;
+    if (!ReadAndAdvance(&ptr, end, &event_header))
+      return std::nullopt;
+
+    timestamp += event_header.time_delta;
+
+    switch (event_header.type_or_length) {
+      case kTypePadding: {
+        uint32_t length = 0;
+        if (event_header.time_delta == 0 ||
+            !ReadAndAdvance<uint32_t>(&ptr, end, &length) || length < 4) {
+          return std::nullopt;
+        }
+        ptr += length - 4;
+        break;
+      }
+      case kTypeTimeExtend: {
+        uint32_t time_delta_ext = 0;
+        if (!ReadAndAdvance<uint32_t>(&ptr, end, &time_delta_ext))
+          return std::nullopt;
+        timestamp += (static_cast<uint64_t>(time_delta_ext)) << 27;
+        break;
+      }
+      case kTypeTimeStamp: {
+        uint32_t time_delta_ext = 0;
+        if (!ReadAndAdvance<uint32_t>(&ptr, end, &time_delta_ext))
+          return std::nullopt;
+        timestamp = event_header.time_delta +
+                    (static_cast<uint64_t>(time_delta_ext) << 27);
+        break;
+      }
+      default: {
+        uint32_t event_size = 0;
+        if (event_header.type_or_length == 0) {
+          if (!ReadAndAdvance<uint32_t>(&ptr, end, &event_size) ||
+              event_size < 4) {
+            return std::nullopt;
+          }
+          event_size -= 4;
+        } else {
+          event_size = 4 * event_header.type_or_length;
+        }
+        ptr += event_size;
+      }
+    }
+  }
+  if (ptr != end)
+    return std::nullopt;
+  return timestamp;
+}
+
 // |start| is the start of the current event.
 // |end| is the end of the buffer.
 bool CpuReader::ParseEvent(uint16_t ftrace_event_id,
@@ -20,8 +20,11 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <limits>
+#include <memory>
 #include <optional>
 #include <set>
+#include <vector>
 
 #include "perfetto/ext/base/paged_memory.h"
 #include "perfetto/ext/base/scoped_file.h"
@@ -39,6 +42,7 @@ namespace perfetto {
 
 class FtraceDataSource;
 class LazyKernelSymbolizer;
+class MappedRingBuffer;
 class ProtoTranslationTable;
 struct FtraceClockSnapshot;
 struct FtraceDataSourceConfig;
@@ -81,6 +85,13 @@ class CpuReader {
       compact_sched_.reset();
     }
 
+    // The number of pages read and parsed in one batch, see below.
+    size_t ftrace_data_buf_pages() const {
+      PERFETTO_DCHECK(ftrace_data_.size() ==
+                      base::GetSysPageSize() * kFtraceDataBufSizePages);
+      return kFtraceDataBufSizePages;
+    }
+
    private:
     friend class CpuReader;
     // When reading and parsing data for a particular cpu, we do it in batches
@@ -95,11 +106,6 @@ class CpuReader {
     uint8_t* ftrace_data_buf() const {
       return reinterpret_cast<uint8_t*>(ftrace_data_.Get());
     }
-    size_t ftrace_data_buf_pages() const {
-      PERFETTO_DCHECK(ftrace_data_.size() ==
-                      base::GetSysPageSize() * kFtraceDataBufSizePages);
-      return kFtraceDataBufSizePages;
-    }
     CompactSchedBuffer* compact_sched_buf() const {
       return compact_sched_.get();
     }
@@ -173,6 +179,16 @@ class CpuReader {
     bool lost_events;
   };
 
+  // Where the data parsed for a data source is written to. Normally this
+  // points to the state of the FtraceDataSource itself, but it can point to a
+  // staging area when parsing on a worker thread (see CpuReaderWorker).
+  struct DataSourceTarget {
+    TraceWriter* trace_writer;
+    FtraceMetadata* metadata;
+    const FtraceDataSourceConfig* parsing_config;
+    base::FlatSet<protos::pbzero::FtraceParseStatus>* parse_errors;
+  };
+
   CpuReader(size_t cpu,
             base::ScopedFile trace_fd,
             const ProtoTranslationTable* table,
@@ -187,6 +203,24 @@ class CpuReader {
                    size_t max_pages,
                    const std::set<FtraceDataSource*>& started_data_sources);
 
+  // As above, but writes the parsed data into |targets|.
+  size_t ReadCycle(ParsingBuffers* parsing_bufs,
+                   size_t max_pages,
+                   const std::vector<DataSourceTarget>& targets);
+
+  size_t cpu() const { return cpu_; }
+
+  // Switches to consuming the ring buffer through a memory mapping of the
+  // trace pipe, parsing the pages in place rather than read()-ing them into
+  // the ParsingBuffers. Returns false if the kernel doesn't support it, in
+  // which case the reader keeps using read().
+  bool MapRingBuffer();
+  // Switches back to read()-ing the ring buffer.
+  void UnmapRingBuffer();
+  bool is_ring_buffer_mapped() const { return !!mapped_buffer_; }
+
+  void SetMappedRingBufferForTesting(std::unique_ptr<MappedRingBuffer> buf);
+
   template <typename T>
   static bool ReadAndAdvance(const uint8_t** ptr, const uint8_t* end, T* out) {
     if (*ptr > end - sizeof(T))
@@ -301,6 +335,15 @@ class CpuReader {
       Bundler* bundler,
       FtraceMetadata* metadata);
 
+  // Returns the timestamp reached after the events in the first |offset|
+  // bytes of the payload of a raw ftrace page, i.e. the base timestamp to use
+  // to resume parsing at |offset|. Returns std::nullopt if the data is invalid
+  // or if |offset| is not at the boundary between two events.
+  static std::optional<uint64_t> TimestampAtPayloadOffset(
+      const uint8_t* start_of_payload,
+      uint64_t offset,
+      uint64_t page_timestamp);
+
   // Parse a single raw ftrace event beginning at |start| and ending at |end|
   // and write it into the provided bundle as a proto.
   // |table| contains the mix of compile time (e.g. proto field ids) and
@@ -380,20 +423,48 @@ class CpuReader {
   CpuReader& operator=(const CpuReader&) = delete;
 
   // Reads at most |max_pages| of ftrace data, parses it, and writes it
-  // into |started_data_sources|. Returns number of pages read.
+  // into |targets|. Returns number of pages read.
   // See comment on ftrace_controller.cc:kMaxParsingWorkingSetPages for
   // rationale behind the batching.
-  size_t ReadAndProcessBatch(
-      uint8_t* parsing_buf,
-      size_t max_pages,
-      bool first_batch_in_cycle,
-      CompactSchedBuffer* compact_sched_buf,
-      const std::set<FtraceDataSource*>& started_data_sources);
+  size_t ReadAndProcessBatch(uint8_t* parsing_buf,
+                             size_t max_pages,
+                             bool first_batch_in_cycle,
+                             CompactSchedBuffer* compact_sched_buf,
+                             const std::vector<DataSourceTarget>& targets);
+
+  // Parses the payload of a single page into |bundler|, starting a new packet
+  // if needed. Returns false (recording the error) if parsing failed.
+  static bool ProcessPagePayloadForDataSource(
+      Bundler* bundler,
+      FtraceMetadata* metadata,
+      const FtraceDataSourceConfig* ds_config,
+      base::FlatSet<protos::pbzero::FtraceParseStatus>* parse_errors,
+      const uint8_t* start_of_payload,
+      const PageHeader& page_header,
+      const ProtoTranslationTable* table);
+
+  void SetMappedRingBuffer(std::unique_ptr<MappedRingBuffer> buf);
+
+  // Like the ReadAndProcessBatch() loop, but for a mapped ring buffer.
+  size_t ReadAndProcessMapped(ParsingBuffers* parsing_bufs,
+                              size_t max_pages,
+                              const std::vector<DataSourceTarget>& targets);
 
   const size_t cpu_;
   const ProtoTranslationTable* const table_;
   LazyKernelSymbolizer* const symbolizer_;
   base::ScopedFile trace_fd_;
+
+  // Only for mapped ring buffers. The kernel can keep appending events to the
+  // reader page after it was handed out, so keep track of how much of it was
+  // parsed already.
+  std::unique_ptr<MappedRingBuffer> mapped_buffer_;
+  uint32_t mapped_reader_id_ = std::numeric_limits<uint32_t>::max();
+  uint64_t mapped_reader_parsed_size_ = 0;
+  // Compact sched buffers for the data sources other than the first one, as
+  // the bundles of all data sources are kept open while parsing a page at a
+  // time.
+  std::vector<std::unique_ptr<CompactSchedBuffer>> mapped_compact_sched_bufs_;
   protos::pbzero::FtraceClock ftrace_clock_{};
   const FtraceClockSnapshot* const ftrace_clock_snapshot_;
 };
@@ -15,13 +15,18 @@
 #include <benchmark/benchmark.h>
 
 #include <optional>
+#include <string>
+#include <vector>
 
 #include "perfetto/base/flat_set.h"
+#include "perfetto/ext/base/thread_task_runner.h"
 #include "perfetto/ext/base/utils.h"
+#include "perfetto/ext/base/waitable_event.h"
 #include "perfetto/protozero/root_message.h"
 #include "perfetto/protozero/scattered_stream_null_delegate.h"
 #include "perfetto/protozero/scattered_stream_writer.h"
 #include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/cpu_reader_worker.h"
 #include "src/traced/probes/ftrace/ftrace_config_muxer.h"
 #include "src/traced/probes/ftrace/ftrace_print_filter.h"
 #include "src/traced/probes/ftrace/proto_translation_table.h"
@@ -991,5 +996,124 @@ void BM_ProcessPagesFullOfPrint(benchmark::State& state) {
 }
 BENCHMARK(BM_ProcessPagesFullOfPrint)->Range(1, 64);
 
+// Measures the aggregate throughput (pages/s) of parsing the pages of
+// |num_cpus| cpus, either serially on a single thread or with one worker
+// thread per cpu as done by FtraceController with
+// FtraceConfig.parallel_cpu_parsing. In the latter case the time includes
+// copying the staged packets into the data source TraceWriter.
+void DoProcessPagesOfCpus(const ExamplePage& test_case,
+                          const std::vector<GroupAndName>& enabled_events,
+                          bool parallel,
+                          benchmark::State& state) {
+  static constexpr size_t kPagesPerCpu = 64;
+  const auto num_cpus = static_cast<size_t>(state.range(0));
+  perfetto::NullTraceWriter writer;
+
+  ProtoTranslationTable* table = GetTable(test_case.name);
+
+  auto repeated_pages =
+      std::make_unique<uint8_t[]>(base::GetSysPageSize() * kPagesPerCpu);
+  {
+    auto page = PageFromXxd(test_case.data);
+    for (size_t i = 0; i < kPagesPerCpu; i++) {
+      memcpy(&repeated_pages[i * base::GetSysPageSize()], &page[0],
+             base::GetSysPageSize());
+    }
+  }
+
+  FtraceDataSourceConfig ds_config{EventFilter{},
+                                   EventFilter{},
+                                   DisabledCompactSchedConfigForTesting(),
+                                   std::nullopt,
+                                   {},
+                                   {},
+                                   false /*symbolize_ksyms*/,
+                                   false /*preserve_ftrace_buffer*/,
+                                   {}};
+  for (const GroupAndName& enabled_event : enabled_events) {
+    ds_config.event_filter.AddEnabledEvent(
+        table->EventToFtraceId(enabled_event));
+  }
+
+  struct PerCpu {
+    std::optional<base::ThreadTaskRunner> task_runner;
+    StagingTraceWriter staging_writer;
+    FtraceMetadata metadata;
+    std::unique_ptr<CompactSchedBuffer> compact_sched_buf =
+        std::make_unique<CompactSchedBuffer>();
+    base::FlatSet<protos::pbzero::FtraceParseStatus> parse_errors;
+  };
+  std::vector<std::unique_ptr<PerCpu>> per_cpu;
+  for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+    per_cpu.emplace_back(std::make_unique<PerCpu>());
+    if (parallel) {
+      per_cpu.back()->task_runner = base::ThreadTaskRunner::CreateAndStart(
+          "bm.cpu" + std::to_string(cpu));
+    }
+  }
+
+  FtraceMetadata metadata{};
+  while (state.KeepRunning()) {
+    if (!parallel) {
+      for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+        CpuReader::ProcessPagesForDataSource(
+            &writer, &metadata, cpu, &ds_config, &per_cpu[cpu]->parse_errors,
+            repeated_pages.get(), kPagesPerCpu,
+            per_cpu[cpu]->compact_sched_buf.get(), table,
+            /*symbolizer=*/nullptr, /*ftrace_clock_snapshot=*/nullptr,
+            /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED);
+      }
+      metadata.Clear();
+      continue;
+    }
+
+    base::WaitableEvent all_done;
+    for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+      PerCpu* state_for_cpu = per_cpu[cpu].get();
+      const uint8_t* pages = repeated_pages.get();
+      state_for_cpu->task_runner->PostTask(
+          [state_for_cpu, cpu, pages, table, &ds_config, &all_done] {
+            CpuReader::ProcessPagesForDataSource(
+                &state_for_cpu->staging_writer, &state_for_cpu->metadata, cpu,
+                &ds_config, &state_for_cpu->parse_errors, pages, kPagesPerCpu,
+                state_for_cpu->compact_sched_buf.get(), table,
+                /*symbolizer=*/nullptr, /*ftrace_clock_snapshot=*/nullptr,
+                /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED);
+            all_done.Notify();
+          });
+    }
+    all_done.Wait(num_cpus);
+    for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+      per_cpu[cpu]->staging_writer.CopyPacketsInto(&writer);
+      metadata.Merge(per_cpu[cpu]->metadata);
+      per_cpu[cpu]->metadata.Clear();
+    }
+    metadata.Clear();
+  }
+  state.counters["pages/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * num_cpus * kPagesPerCpu),
+      benchmark::Counter::kIsRate);
+}
+
+void BM_ProcessPagesOfCpusFullOfSchedSwitch(benchmark::State& state) {
+  DoProcessPagesOfCpus(g_full_page_sched_switch,
+                       {GroupAndName("sched", "sched_switch")},
+                       /*parallel=*/false, state);
+}
+BENCHMARK(BM_ProcessPagesOfCpusFullOfSchedSwitch)
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->UseRealTime();
+
+void BM_ProcessPagesOfCpusFullOfSchedSwitchParallel(benchmark::State& state) {
+  DoProcessPagesOfCpus(g_full_page_sched_switch,
+                       {GroupAndName("sched", "sched_switch")},
+                       /*parallel=*/true, state);
+}
+BENCHMARK(BM_ProcessPagesOfCpusFullOfSchedSwitchParallel)
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->UseRealTime();
+
 }  // namespace
 }  // namespace perfetto
@@ -16,18 +16,22 @@
 
 #include "src/traced/probes/ftrace/cpu_reader.h"
 
+#include <fcntl.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 
 #include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "perfetto/protozero/scattered_stream_writer.h"
+#include "src/traced/probes/ftrace/cpu_reader_worker.h"
 #include "src/traced/probes/ftrace/event_info.h"
 #include "src/traced/probes/ftrace/ftrace_config_muxer.h"
 #include "src/traced/probes/ftrace/ftrace_procfs.h"
+#include "src/traced/probes/ftrace/mapped_ring_buffer.h"
 #include "src/traced/probes/ftrace/proto_translation_table.h"
 #include "src/traced/probes/ftrace/test/cpu_reader_support.h"
 #include "src/tracing/core/trace_writer_for_testing.h"
@@ -46,6 +50,8 @@
 #include "protos/perfetto/trace/ftrace/raw_syscalls.gen.h"
 #include "protos/perfetto/trace/ftrace/sched.gen.h"
 #include "protos/perfetto/trace/ftrace/task.gen.h"
+#include "protos/perfetto/trace/test_event.gen.h"
+#include "protos/perfetto/trace/test_event.pbzero.h"
 #include "protos/perfetto/trace/trace_packet.gen.h"
 #include "src/traced/probes/ftrace/test/test_messages.gen.h"
 #include "src/traced/probes/ftrace/test/test_messages.pbzero.h"
@@ -1667,6 +1673,135 @@ TEST(CpuReaderTest, NewPacketOnLostEvents) {
   EXPECT_EQ(4u, packets[2].ftrace_events().event().size());
 }
 
+// Emulates a kernel ring buffer mapped by MappedRingBuffer. Each GetReader()
+// moves to the next of |reader_states|, the last one repeats.
+class FakeMappedRingBuffer : public MappedRingBuffer {
+ public:
+  using ReaderState = decltype(TraceBufferMeta::reader);
+
+  static std::unique_ptr<FakeMappedRingBuffer> Create(
+      const std::vector<const void*>& subbufs,
+      ReaderState initial_state,
+      std::vector<ReaderState> reader_states) {
+    auto meta = std::make_unique<TraceBufferMeta>();
+    meta->subbuf_size = static_cast<uint32_t>(base::GetSysPageSize());
+    meta->nr_subbufs = static_cast<uint32_t>(subbufs.size());
+    meta->reader = initial_state;
+    std::unique_ptr<uint8_t[]> data(
+        new uint8_t[base::GetSysPageSize() * subbufs.size()]());
+    for (size_t i = 0; i < subbufs.size(); i++) {
+      memcpy(data.get() + i * base::GetSysPageSize(), subbufs[i],
+             base::GetSysPageSize());
+    }
+    return std::unique_ptr<FakeMappedRingBuffer>(new FakeMappedRingBuffer(
+        std::move(meta), std::move(data), std::move(reader_states)));
+  }
+
+  bool GetReader() override {
+    meta_->reader = reader_states_[std::min(next_state_++,
+                                            reader_states_.size() - 1)];
+    return true;
+  }
+
+ private:
+  FakeMappedRingBuffer(std::unique_ptr<TraceBufferMeta> meta,
+                       std::unique_ptr<uint8_t[]> data,
+                       std::vector<ReaderState> reader_states)
+      : MappedRingBuffer(meta.get(), data.get()),
+        meta_(std::move(meta)),
+        data_(std::move(data)),
+        reader_states_(std::move(reader_states)) {}
+
+  std::unique_ptr<TraceBufferMeta> meta_;
+  std::unique_ptr<uint8_t[]> data_;
+  std::vector<ReaderState> reader_states_;
+  size_t next_state_ = 0;
+};
+
+class CpuReaderMappedTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    table_ = GetTable("synthetic");
+    ds_config_.event_filter.AddEnabledEvent(
+        table_->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+    parsing_bufs_.AllocateIfNeeded();
+    reader_ = std::make_unique<CpuReader>(
+        /*cpu=*/1, base::OpenFile("/dev/null", O_RDONLY), table_,
+        /*symbolizer=*/nullptr, protos::pbzero::FTRACE_CLOCK_UNSPECIFIED,
+        /*ftrace_clock_snapshot=*/nullptr);
+  }
+
+  size_t ReadCycle() {
+    std::vector<CpuReader::DataSourceTarget> targets = {
+        {&trace_writer_, &metadata_, &ds_config_, &parse_errors_}};
+    return reader_->ReadCycle(&parsing_bufs_, /*max_pages=*/100, targets);
+  }
+
+  ProtoTranslationTable* table_ = nullptr;
+  FtraceDataSourceConfig ds_config_ = EmptyConfig();
+  CpuReader::ParsingBuffers parsing_bufs_;
+  std::unique_ptr<CpuReader> reader_;
+  TraceWriterForTesting trace_writer_;
+  FtraceMetadata metadata_{};
+  base::FlatSet<protos::pbzero::FtraceParseStatus> parse_errors_;
+};
+
+// The payload of g_switch_page: a time extend followed by a sched_switch.
+constexpr uint32_t kSwitchPagePayloadSize = 0x4c;
+constexpr uint32_t kSwitchPageTimeExtendSize = 8;
+
+TEST_F(CpuReaderMappedTest, ResumesAfterConsumedDataAndReportsLostEvents) {
+  auto page = PageFromXxd(g_switch_page);
+  // The time extend at the start of the reader sub-buffer was consumed by
+  // read()s before the ring buffer was mapped. The third sub-buffer comes
+  // after some events were lost.
+  reader_->SetMappedRingBufferForTesting(FakeMappedRingBuffer::Create(
+      {page.get(), page.get(), page.get()},
+      {/*lost_events=*/0, /*id=*/0, /*read=*/kSwitchPageTimeExtendSize},
+      {{0, 0, kSwitchPagePayloadSize},
+       {0, 1, kSwitchPagePayloadSize},
+       {5, 2, kSwitchPagePayloadSize}}));
+
+  // Pages that are not full stop the read cycle after the first one.
+  EXPECT_EQ(ReadCycle(), 2u);
+  EXPECT_EQ(ReadCycle(), 1u);
+  EXPECT_EQ(ReadCycle(), 0u);
+  EXPECT_TRUE(parse_errors_.empty());
+
+  auto packets = trace_writer_.GetAllTracePackets();
+  ASSERT_EQ(packets.size(), 2u);
+  EXPECT_FALSE(packets[0].ftrace_events().lost_events());
+  ASSERT_EQ(packets[0].ftrace_events().event().size(), 2u);
+  EXPECT_TRUE(packets[1].ftrace_events().lost_events());
+  ASSERT_EQ(packets[1].ftrace_events().event().size(), 1u);
+
+  // All sub-buffers have the same contents: the timestamp of the event parsed
+  // after the consumed time extend must match the others.
+  const auto& events = packets[0].ftrace_events().event();
+  EXPECT_EQ(events[0].timestamp(), events[1].timestamp());
+  EXPECT_EQ(events[0].timestamp(),
+            packets[1].ftrace_events().event()[0].timestamp());
+}
+
+TEST_F(CpuReaderMappedTest, ParsesOnlyDataHandedOutByTheKernel) {
+  auto page = PageFromXxd(g_switch_page);
+  // The page header already covers the whole payload, but the kernel handed
+  // out only the time extend on the first GetReader().
+  reader_->SetMappedRingBufferForTesting(FakeMappedRingBuffer::Create(
+      {page.get()}, {/*lost_events=*/0, /*id=*/0, /*read=*/0},
+      {{0, 0, kSwitchPageTimeExtendSize}, {0, 0, kSwitchPagePayloadSize}}));
+
+  // The second GetReader() returns the rest of the same sub-buffer.
+  EXPECT_EQ(ReadCycle(), 2u);
+  EXPECT_EQ(ReadCycle(), 0u);
+  EXPECT_TRUE(parse_errors_.empty());
+
+  size_t events = 0;
+  for (const auto& packet : trace_writer_.GetAllTracePackets())
+    events += packet.ftrace_events().event().size();
+  EXPECT_EQ(events, 1u);
+}
+
 TEST(CpuReaderTest, ProcessPagesForDataSourceError) {
   auto page_ok = PageFromXxd(g_switch_page);
   auto page_err = PageFromXxd(g_invalid_page);
@@ -1979,6 +2114,102 @@ TEST(CpuReaderTest, TranslateBlockDeviceIDToUserspace) {
             k64BitUserspaceBlockDeviceId);
 }
 
+TEST(CpuReaderTest, TimestampAtPayloadOffset) {
+  // Event headers: type_or_length in the bottom 5 bits, time delta in the top
+  // 27 bits.
+  auto header = [](uint32_t type_or_length, uint32_t time_delta) {
+    return type_or_length | (time_delta << 5);
+  };
+  const uint32_t payload[] = {
+      header(2, 10), 0xaaaaaaaa, 0xbbbbbbbb,  // 8 byte event.
+      header(30, 5), 1,                       // Time extend.
+      header(1, 7),  0xcccccccc,              // 4 byte event.
+  };
+  const uint8_t* start = reinterpret_cast<const uint8_t*>(payload);
+  const uint64_t kPageTs = 1000;
+
+  EXPECT_EQ(CpuReader::TimestampAtPayloadOffset(start, 0, kPageTs), kPageTs);
+  EXPECT_EQ(CpuReader::TimestampAtPayloadOffset(start, 12, kPageTs),
+            kPageTs + 10);
+  EXPECT_EQ(CpuReader::TimestampAtPayloadOffset(start, 20, kPageTs),
+            kPageTs + 10 + 5 + (1ull << 27));
+  EXPECT_EQ(CpuReader::TimestampAtPayloadOffset(start, sizeof(payload),
+                                                kPageTs),
+            kPageTs + 10 + 5 + (1ull << 27) + 7);
+  // Not at an event boundary.
+  EXPECT_EQ(CpuReader::TimestampAtPayloadOffset(start, 6, kPageTs),
+            std::nullopt);
+}
+
+TEST(CpuReaderTest, StagingTraceWriterCopiesPacketsInOrder) {
+  StagingTraceWriter staging_writer;
+  for (uint64_t ts = 1; ts <= 3; ts++)
+    staging_writer.NewTracePacket()->set_timestamp(ts);
+  staging_writer.FinishTracePacket();
+
+  TraceWriterForTesting trace_writer;
+  staging_writer.CopyPacketsInto(&trace_writer);
+  // The staged packets are discarded after being copied.
+  staging_writer.CopyPacketsInto(&trace_writer);
+
+  auto packets = trace_writer.GetAllTracePackets();
+  ASSERT_EQ(packets.size(), 3u);
+  EXPECT_EQ(packets[0].timestamp(), 1u);
+  EXPECT_EQ(packets[1].timestamp(), 2u);
+  EXPECT_EQ(packets[2].timestamp(), 3u);
+}
+
+TEST(CpuReaderTest, StagingTraceWriterCopiesPacketsAcrossChunks) {
+  // Packets larger than the heap chunks of the staging writer, interleaved
+  // with small and empty ones.
+  const std::string big_str(50000, 'x');
+  StagingTraceWriter staging_writer;
+  EXPECT_EQ(staging_writer.staged_bytes(), 0u);
+  for (uint64_t ts = 1; ts <= 6; ts++) {
+    auto packet = staging_writer.NewTracePacket();
+    if (ts % 3 == 0)
+      continue;
+    packet->set_timestamp(ts);
+    if (ts % 3 == 1)
+      packet->set_for_testing()->set_str(big_str);
+  }
+  staging_writer.FinishTracePacket();
+  EXPECT_GT(staging_writer.staged_bytes(), 2 * big_str.size());
+
+  TraceWriterForTesting trace_writer;
+  staging_writer.CopyPacketsInto(&trace_writer);
+  EXPECT_EQ(staging_writer.staged_bytes(), 0u);
+
+  auto packets = trace_writer.GetAllTracePackets();
+  ASSERT_EQ(packets.size(), 6u);
+  for (uint64_t ts = 1; ts <= 6; ts++) {
+    const auto& packet = packets[ts - 1];
+    EXPECT_EQ(packet.has_timestamp(), ts % 3 != 0);
+    EXPECT_EQ(packet.has_for_testing(), ts % 3 == 1);
+    if (packet.has_timestamp())
+      EXPECT_EQ(packet.timestamp(), ts);
+    if (packet.has_for_testing())
+      EXPECT_EQ(packet.for_testing().str(), big_str);
+  }
+}
+
+TEST(CpuReaderTest, FtraceMetadataMerge) {
+  FtraceMetadata metadata;
+  metadata.AddPid(1);
+  metadata.AddRenamePid(2);
+
+  FtraceMetadata other;
+  other.AddPid(1);
+  other.AddPid(3);
+  other.AddRenamePid(4);
+  other.fds.insert(std::make_pair(5, 6u));
+
+  metadata.Merge(other);
+  EXPECT_THAT(metadata.pids, ElementsAre(1, 3));
+  EXPECT_THAT(metadata.rename_pids, ElementsAre(2, 4));
+  EXPECT_THAT(metadata.fds, ElementsAre(Pair(5, 6u)));
+}
+
 // clang-format off
 // # tracer: nop
 // #
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ftrace/cpu_reader_worker.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "perfetto/base/logging.h"
+#include "src/traced/probes/ftrace/ftrace_data_source.h"
+
+namespace perfetto {
+
+StagingTraceWriter::StagingTraceWriter()
+    : delegate_(4096, 128 * 1024), stream_(&delegate_) {
+  delegate_.set_writer(&stream_);
+  cur_packet_.reset(new protozero::RootMessage<protos::pbzero::TracePacket>());
+  cur_packet_->Finalize();  // To avoid the DCHECK in NewTracePacket().
+}
+
+StagingTraceWriter::~StagingTraceWriter() = default;
+
+StagingTraceWriter::TracePacketHandle StagingTraceWriter::NewTracePacket() {
+  // If we hit this, the caller is calling NewTracePacket() without having
+  // finalized the previous packet.
+  PERFETTO_DCHECK(cur_packet_->is_finalized());
+  cur_packet_->Reset(&stream_);
+  packet_starts_.push_back(stream_.written());
+  return TraceWriter::TracePacketHandle(cur_packet_.get());
+}
+
+void StagingTraceWriter::FinishTracePacket() {
+  if (!cur_packet_->is_finalized())
+    cur_packet_->Finalize();
+}
+
+void StagingTraceWriter::Flush(std::function<void()> callback) {
+  // Flush() cannot be called in the middle of a TracePacket.
+  PERFETTO_CHECK(cur_packet_->is_finalized());
+  if (callback)
+    callback();
+}
+
+WriterID StagingTraceWriter::writer_id() const {
+  return 0;
+}
+
+uint64_t StagingTraceWriter::written() const {
+  return stream_.written();
+}
+
+void StagingTraceWriter::CopyPacketsInto(TraceWriter* trace_writer) {
+  PERFETTO_CHECK(cur_packet_->is_finalized());
+  const std::vector<protozero::ScatteredHeapBuffer::Slice>& slices =
+      delegate_.GetSlices();
+  auto slice = slices.begin();
+  const uint8_t* read_ptr = slice != slices.end() ? slice->start() : nullptr;
+  for (size_t i = 0; i < packet_starts_.size(); i++) {
+    uint64_t packet_end = i + 1 < packet_starts_.size() ? packet_starts_[i + 1]
+                                                        : stream_.written();
+    uint64_t bytes_left = packet_end - packet_starts_[i];
+    auto packet = trace_writer->NewTracePacket();
+    while (bytes_left > 0) {
+      PERFETTO_DCHECK(slice != slices.end());
+      const uint8_t* slice_end = slice->GetUsedRange().end;
+      if (read_ptr == slice_end) {
+        ++slice;
+        read_ptr = slice->start();
+        continue;
+      }
+      size_t size = static_cast<size_t>(
+          std::min(bytes_left, static_cast<uint64_t>(slice_end - read_ptr)));
+      packet->AppendRawProtoBytes(read_ptr, size);
+      read_ptr += size;
+      bytes_left -= size;
+    }
+  }
+  packet_starts_.clear();
+  delegate_.Reset();
+  stream_.Reset(protozero::ContiguousMemoryRange{});
+}
+
+size_t StagingTraceWriter::staged_bytes() const {
+  if (packet_starts_.empty())
+    return 0;
+  return static_cast<size_t>(stream_.written() - packet_starts_.front());
+}
+
+CpuReaderWorker::CpuReaderWorker(size_t cpu, size_t max_staged_bytes)
+    : max_staged_bytes_(max_staged_bytes),
+      task_runner_(base::ThreadTaskRunner::CreateAndStart(
+          "ftrace.cpu" + std::to_string(cpu))) {}
+
+CpuReaderWorker::~CpuReaderWorker() = default;
+
+void CpuReaderWorker::Prepare(
+    const std::set<FtraceDataSource*>& started_data_sources) {
+  parsing_bufs_.AllocateIfNeeded();
+
+  // Data sources can come and go between ticks. Reuse the staging areas (which
+  // are empty after Commit()), reassigning them to the current data sources.
+  while (staged_.size() < started_data_sources.size())
+    staged_.emplace_back(std::make_unique<StagedDataSource>());
+  staged_.resize(started_data_sources.size());
+
+  targets_.clear();
+  size_t i = 0;
+  for (FtraceDataSource* data_source : started_data_sources) {
+    StagedDataSource* staged = staged_[i++].get();
+    staged->data_source = data_source;
+    targets_.push_back({&staged->trace_writer, &staged->metadata,
+                        data_source->parsing_config(), &staged->parse_errors});
+  }
+}
+
+void CpuReaderWorker::StartReadCycle(CpuReader* reader, size_t max_pages) {
+  cycles_started_++;
+  task_runner_.PostTask([this, reader, max_pages] {
+    pages_read_ = ReadCycle(reader, max_pages);
+    cycle_done_.Notify();
+  });
+}
+
+size_t CpuReaderWorker::WaitForReadCycle() {
+  cycle_done_.Wait(cycles_started_);
+  return pages_read_;
+}
+
+size_t CpuReaderWorker::ReadCycle(CpuReader* reader, size_t max_pages) {
+  PERFETTO_DCHECK(task_runner_.RunsTasksOnCurrentThread());
+  // Read one batch (see CpuReader::ParsingBuffers) at a time, checking the
+  // size of the staged packets in between.
+  staging_full_ = false;
+  size_t pages_read = 0;
+  while (pages_read < max_pages) {
+    size_t batch_pages = std::min(parsing_bufs_.ftrace_data_buf_pages(),
+                                  max_pages - pages_read);
+    size_t batch_pages_read =
+        reader->ReadCycle(&parsing_bufs_, batch_pages, targets_);
+    pages_read += batch_pages_read;
+    if (batch_pages_read < batch_pages)
+      break;  // Caught up with the writer.
+    if (StagedBytes() >= max_staged_bytes_) {
+      staging_full_ = pages_read < max_pages;
+      break;
+    }
+  }
+  return pages_read;
+}
+
+size_t CpuReaderWorker::StagedBytes() const {
+  size_t staged_bytes = 0;
+  for (const auto& staged : staged_)
+    staged_bytes += staged->trace_writer.staged_bytes();
+  return staged_bytes;
+}
+
+void CpuReaderWorker::Commit() {
+  for (auto& staged : staged_) {
+    FtraceDataSource* data_source = staged->data_source;
+    staged->trace_writer.CopyPacketsInto(data_source->trace_writer());
+    data_source->mutable_metadata()->Merge(staged->metadata);
+    staged->metadata.Clear();
+    for (auto status : staged->parse_errors)
+      data_source->mutable_parse_errors()->insert(status);
+    staged->parse_errors.clear();
+  }
+}
+
+}  // namespace perfetto
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_FTRACE_CPU_READER_WORKER_H_
+#define SRC_TRACED_PROBES_FTRACE_CPU_READER_WORKER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "perfetto/base/flat_set.h"
+#include "perfetto/ext/base/thread_task_runner.h"
+#include "perfetto/ext/base/waitable_event.h"
+#include "perfetto/ext/tracing/core/trace_writer.h"
+#include "perfetto/protozero/root_message.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "perfetto/protozero/scattered_stream_writer.h"
+#include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/ftrace_metadata.h"
+
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+namespace perfetto {
+
+class FtraceDataSource;
+
+// A TraceWriter that keeps the packets in memory, until they are copied into
+// another TraceWriter with CopyPacketsInto(). The packets are written back to
+// back in the heap chunks, without any framing: their boundaries are kept
+// aside.
+class StagingTraceWriter : public TraceWriter {
+ public:
+  StagingTraceWriter();
+  ~StagingTraceWriter() override;
+
+  // TraceWriter implementation.
+  TracePacketHandle NewTracePacket() override;
+  void FinishTracePacket() override;
+  void Flush(std::function<void()> callback = {}) override;
+  WriterID writer_id() const override;
+  uint64_t written() const override;
+
+  // Writes all the packets written so far into |trace_writer|, in order, and
+  // discards them. The packets are copied straight from the heap chunks, also
+  // when they span several chunks.
+  void CopyPacketsInto(TraceWriter* trace_writer);
+
+  // Returns the size of the packets written since the last CopyPacketsInto().
+  size_t staged_bytes() const;
+
+ private:
+  StagingTraceWriter(const StagingTraceWriter&) = delete;
+  StagingTraceWriter& operator=(const StagingTraceWriter&) = delete;
+
+  protozero::ScatteredHeapBuffer delegate_;
+  protozero::ScatteredStreamWriter stream_;
+  std::unique_ptr<protozero::RootMessage<protos::pbzero::TracePacket>>
+      cur_packet_;
+
+  // The offset in |stream_| at which each packet begins. Each packet ends
+  // where the next one begins (or at |stream_|.written() for the last one).
+  std::vector<uint64_t> packet_starts_;
+};
+
+// Reads and parses the ftrace data of a cpu on a dedicated thread.
+//
+// TraceWriters are not thread-safe and the FtraceMetadata of a data source is
+// shared by all cpus, so the worker doesn't write into the data sources
+// directly. Instead, each data source gets a staging TraceWriter, metadata and
+// parse errors, which are moved into the data source by Commit() on the main
+// thread. The packets of each cpu reach the data sources in the same order as
+// when parsing on the main thread.
+//
+// To bound the memory used by the staging areas, a read cycle stops once
+// |max_staged_bytes| have been staged: the caller is expected to Commit() and
+// start another read cycle for the rest of the pages.
+class CpuReaderWorker {
+ public:
+  static constexpr size_t kDefaultMaxStagedBytes = 1024 * 1024;
+
+  explicit CpuReaderWorker(size_t cpu,
+                           size_t max_staged_bytes = kDefaultMaxStagedBytes);
+  ~CpuReaderWorker();
+
+  // Sets up the staging areas for |started_data_sources|. Must be called on
+  // the main thread before StartReadCycle().
+  void Prepare(const std::set<FtraceDataSource*>& started_data_sources);
+
+  // Reads and parses up to |max_pages| of |reader| on the worker thread, see
+  // CpuReader::ReadCycle(). Stops early if the staging areas are full. Must be
+  // followed by WaitForReadCycle().
+  void StartReadCycle(CpuReader* reader, size_t max_pages);
+
+  // Blocks until the read cycle started by StartReadCycle() has completed.
+  // Returns the number of pages read.
+  size_t WaitForReadCycle();
+
+  // Whether the last read cycle stopped because the staging areas were full,
+  // rather than because it caught up with the writer or read |max_pages|.
+  bool staging_full() const { return staging_full_; }
+
+  // Writes the data parsed by the last read cycle into the data sources passed
+  // to Prepare(). Must be called on the main thread after WaitForReadCycle().
+  void Commit();
+
+ private:
+  struct StagedDataSource {
+    FtraceDataSource* data_source = nullptr;
+    StagingTraceWriter trace_writer;
+    FtraceMetadata metadata;
+    base::FlatSet<protos::pbzero::FtraceParseStatus> parse_errors;
+  };
+
+  CpuReaderWorker(const CpuReaderWorker&) = delete;
+  CpuReaderWorker& operator=(const CpuReaderWorker&) = delete;
+
+  // Called on the worker thread.
+  size_t ReadCycle(CpuReader* reader, size_t max_pages);
+  size_t StagedBytes() const;
+
+  const size_t max_staged_bytes_;
+  base::ThreadTaskRunner task_runner_;
+  base::WaitableEvent cycle_done_;
+  uint64_t cycles_started_ = 0;
+  size_t pages_read_ = 0;
+  bool staging_full_ = false;
+  CpuReader::ParsingBuffers parsing_bufs_;
+  std::vector<std::unique_ptr<StagedDataSource>> staged_;
+  std::vector<CpuReader::DataSourceTarget> targets_;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_FTRACE_CPU_READER_WORKER_H_
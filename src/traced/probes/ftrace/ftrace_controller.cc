@@ -332,17 +332,20 @@ bool FtraceController::ReadTickForInstance(FtraceInstanceState* instance) {
   }
 #endif
 
+  std::vector<size_t> max_pages(instance->per_cpu.size());
+  for (size_t i = 0; i < instance->per_cpu.size(); i++) {
+    size_t orig_quota = instance->per_cpu[i].period_page_quota;
+    max_pages[i] = std::min(orig_quota, kMaxPagesPerCpuPerReadTick);
+  }
+  std::vector<size_t> pages_read_per_cpu = ReadCpus(instance, max_pages);
+
   bool all_cpus_done = true;
   for (size_t i = 0; i < instance->per_cpu.size(); i++) {
     size_t orig_quota = instance->per_cpu[i].period_page_quota;
     if (orig_quota == 0)
       continue;
 
-    size_t max_pages = std::min(orig_quota, kMaxPagesPerCpuPerReadTick);
-    CpuReader& cpu_reader = *instance->per_cpu[i].reader;
-    size_t pages_read = cpu_reader.ReadCycle(&parsing_mem_, max_pages,
-                                             instance->started_data_sources);
-
+    size_t pages_read = pages_read_per_cpu[i];
     size_t new_quota = (pages_read >= orig_quota) ? 0 : orig_quota - pages_read;
     instance->per_cpu[i].period_page_quota = new_quota;
 
@@ -353,14 +356,111 @@ bool FtraceController::ReadTickForInstance(FtraceInstanceState* instance) {
     // long as at least one of them hits the read page cap each tick. If all
     // readers catch up to the event stream (pages_read < max_pages), or exceed
     // their quota, we will stop for the given period.
-    PERFETTO_DCHECK(pages_read <= max_pages);
-    if (pages_read == max_pages && new_quota > 0) {
+    PERFETTO_DCHECK(pages_read <= max_pages[i]);
+    if (pages_read == max_pages[i] && new_quota > 0) {
       all_cpus_done = false;
     }
   }
   return all_cpus_done;
 }
 
+std::vector<size_t> FtraceController::ReadCpus(
+    FtraceInstanceState* instance,
+    const std::vector<size_t>& max_pages) {
+  PERFETTO_DCHECK(max_pages.size() == instance->per_cpu.size());
+  if (ShouldParseInParallel(instance))
+    return ReadCpusInParallel(instance, max_pages);
+
+  std::vector<size_t> pages_read(instance->per_cpu.size());
+  for (size_t i = 0; i < instance->per_cpu.size(); i++) {
+    if (max_pages[i] == 0)
+      continue;
+    pages_read[i] = instance->per_cpu[i].reader->ReadCycle(
+        &parsing_mem_, max_pages[i], instance->started_data_sources);
+  }
+  return pages_read;
+}
+
+// Reads and parses each cpu on its own thread (see CpuReaderWorker). The
+// packets parsed for a cpu are written into the data sources as soon as its
+// worker is done, while the workers of the other cpus keep parsing. A worker
+// stops once its staging area is full and is restarted after the packets have
+// been written, so the memory used for staging stays bounded also when
+// flushing the whole ring buffers.
+std::vector<size_t> FtraceController::ReadCpusInParallel(
+    FtraceInstanceState* instance,
+    const std::vector<size_t>& max_pages) {
+  std::vector<size_t> pages_read(instance->per_cpu.size());
+  std::vector<size_t> reading_cpus;
+  for (size_t i = 0; i < instance->per_cpu.size(); i++) {
+    if (max_pages[i] == 0)
+      continue;
+    auto& per_cpu = instance->per_cpu[i];
+    if (!per_cpu.worker)
+      per_cpu.worker =
+          std::make_unique<CpuReaderWorker>(i, max_staged_bytes_per_cpu_);
+    per_cpu.worker->Prepare(instance->started_data_sources);
+    per_cpu.worker->StartReadCycle(per_cpu.reader.get(), max_pages[i]);
+    reading_cpus.push_back(i);
+  }
+
+  while (!reading_cpus.empty()) {
+    std::vector<size_t> still_reading_cpus;
+    for (size_t i : reading_cpus) {
+      auto& per_cpu = instance->per_cpu[i];
+      pages_read[i] += per_cpu.worker->WaitForReadCycle();
+      per_cpu.worker->Commit();
+      if (per_cpu.worker->staging_full()) {
+        per_cpu.worker->StartReadCycle(per_cpu.reader.get(),
+                                       max_pages[i] - pages_read[i]);
+        still_reading_cpus.push_back(i);
+      }
+    }
+    reading_cpus = std::move(still_reading_cpus);
+  }
+  return pages_read;
+}
+
+// The cpu readers are shared by all the data sources of the instance, so the
+// data is parsed on the worker threads only if all of them opted in.
+bool FtraceController::ShouldParseInParallel(
+    const FtraceInstanceState* instance) const {
+  if (instance->per_cpu.size() < 2)
+    return false;
+  for (const FtraceDataSource* data_source : instance->started_data_sources) {
+    if (!data_source->config().parallel_cpu_parsing())
+      return false;
+    // Kernel symbols are interned across all cpus of a data source, which
+    // requires parsing them in order on a single thread.
+    if (data_source->parsing_config()->symbolize_ksyms)
+      return false;
+  }
+  return true;
+}
+
+// Like ShouldParseInParallel(): the ring buffers are mapped only if all the
+// data sources sharing the cpu readers opted in. Re-evaluated whenever a data
+// source starts or stops.
+void FtraceController::UpdateRingBufferMapping(FtraceInstanceState* instance) {
+  bool use_mmap = !instance->started_data_sources.empty();
+  for (const FtraceDataSource* data_source : instance->started_data_sources)
+    use_mmap &= data_source->config().use_mmap_ring_buffer();
+
+  size_t mapped_cpus = 0;
+  for (auto& per_cpu : instance->per_cpu) {
+    if (!use_mmap) {
+      per_cpu.reader->UnmapRingBuffer();
+    } else if (per_cpu.reader->MapRingBuffer()) {
+      mapped_cpus++;
+    }
+  }
+  if (use_mmap && mapped_cpus < instance->per_cpu.size()) {
+    PERFETTO_ILOG("Mapped the ftrace ring buffer of %zu/%zu cpus, using read()"
+                  " for the others",
+                  mapped_cpus, instance->per_cpu.size());
+  }
+}
+
 uint32_t FtraceController::GetDrainPeriodMs() {
   if (data_sources_.empty())
     return kDefaultDrainPeriodMs;
@@ -402,10 +502,8 @@ void FtraceController::FlushForInstance(FtraceInstanceState* instance) {
   // events.
   size_t per_cpubuf_size_pages =
       instance->ftrace_config_muxer->GetPerCpuBufferSizePages();
-  for (size_t i = 0; i < instance->per_cpu.size(); i++) {
-    instance->per_cpu[i].reader->ReadCycle(&parsing_mem_, per_cpubuf_size_pages,
-                                           instance->started_data_sources);
-  }
+  ReadCpus(instance, std::vector<size_t>(instance->per_cpu.size(),
+                                         per_cpubuf_size_pages));
 }
 
 // We are not implicitly flushing on Stop. The tracing service is supposed to
@@ -480,6 +578,7 @@ bool FtraceController::StartDataSource(FtraceDataSource* data_source) {
     return false;
   instance->started_data_sources.insert(data_source);
   StartIfNeeded(instance);
+  UpdateRingBufferMapping(instance);
 
   // Parse kernel symbols if required by the config. This can be an expensive
   // operation (cpu-bound for 500ms+), so delay the StartDataSource
@@ -511,6 +610,7 @@ void FtraceController::RemoveDataSource(FtraceDataSource* data_source) {
 
   instance->ftrace_config_muxer->RemoveConfig(data_source->config_id());
   instance->started_data_sources.erase(data_source);
+  UpdateRingBufferMapping(instance);
   StopIfNeeded(instance);
 }
 
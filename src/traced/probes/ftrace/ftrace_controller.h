@@ -24,6 +24,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "perfetto/base/task_runner.h"
 #include "perfetto/ext/base/paged_memory.h"
@@ -32,6 +33,7 @@
 #include "perfetto/ext/tracing/core/basic_types.h"
 #include "src/kallsyms/lazy_kernel_symbolizer.h"
 #include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/cpu_reader_worker.h"
 #include "src/traced/probes/ftrace/ftrace_config_utils.h"
 
 namespace perfetto {
@@ -108,6 +110,10 @@ class FtraceController {
           : reader(std::move(_reader)), period_page_quota(_period_page_quota) {}
       std::unique_ptr<CpuReader> reader;
       size_t period_page_quota = 0;
+
+      // Lazily created the first time the cpu is read with parallel parsing
+      // enabled (FtraceConfig.parallel_cpu_parsing).
+      std::unique_ptr<CpuReaderWorker> worker;
     };
 
     FtraceInstanceState(std::unique_ptr<FtraceProcfs>,
@@ -138,6 +144,15 @@ class FtraceController {
   // Periodic task that reads all per-cpu ftrace buffers.
   void ReadTick(int generation);
   bool ReadTickForInstance(FtraceInstanceState* instance);
+
+  // Reads and parses up to |max_pages[i]| pages of each cpu i of |instance|.
+  // Returns the number of pages read for each cpu.
+  std::vector<size_t> ReadCpus(FtraceInstanceState* instance,
+                               const std::vector<size_t>& max_pages);
+  std::vector<size_t> ReadCpusInParallel(FtraceInstanceState* instance,
+                                         const std::vector<size_t>& max_pages);
+  bool ShouldParseInParallel(const FtraceInstanceState* instance) const;
+  void UpdateRingBufferMapping(FtraceInstanceState* instance);
   uint32_t GetDrainPeriodMs();
 
   void FlushForInstance(FtraceInstanceState* instance);
@@ -154,6 +169,8 @@ class FtraceController {
   base::TaskRunner* const task_runner_;
   Observer* const observer_;
   CpuReader::ParsingBuffers parsing_mem_;
+  // Passed to the CpuReaderWorker of each cpu. Overridden by tests.
+  size_t max_staged_bytes_per_cpu_ = CpuReaderWorker::kDefaultMaxStagedBytes;
   LazyKernelSymbolizer symbolizer_;
   FtraceConfigId next_cfg_id_ = 1;
   int generation_ = 0;
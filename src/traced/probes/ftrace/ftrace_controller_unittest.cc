@@ -17,10 +17,15 @@
 #include "src/traced/probes/ftrace/ftrace_controller.h"
 
 #include <fcntl.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <map>
+
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
 #include "src/traced/probes/ftrace/cpu_reader.h"
 #include "src/traced/probes/ftrace/ftrace_config_muxer.h"
@@ -31,6 +36,9 @@
 #include "src/tracing/core/trace_writer_for_testing.h"
 #include "test/gtest_and_gmock.h"
 
+#include "protos/perfetto/trace/ftrace/ftrace_event.gen.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.gen.h"
 #include "protos/perfetto/trace/ftrace/ftrace_stats.gen.h"
 #include "protos/perfetto/trace/ftrace/ftrace_stats.pbzero.h"
 #include "protos/perfetto/trace/trace_packet.gen.h"
@@ -86,6 +94,7 @@ std::unique_ptr<Table> FakeTable(FtraceProcfs* ftrace) {
     event.name = "foo";
     event.group = "group";
     event.ftrace_event_id = 1;
+    event.proto_field_id = protos::pbzero::FtraceEvent::kGenericFieldNumber;
   }
   {
     events.push_back(Event{});
@@ -172,8 +181,16 @@ class MockFtraceProcfs : public FtraceProcfs {
     return current_tracer_;
   }
 
-  base::ScopedFile OpenPipeForCpu(size_t /*cpu*/) override {
-    return base::ScopedFile(base::OpenFile("/dev/null", O_RDONLY));
+  base::ScopedFile OpenPipeForCpu(size_t cpu) override {
+    auto it = cpu_pipe_paths_.find(cpu);
+    if (it == cpu_pipe_paths_.end())
+      return base::ScopedFile(base::OpenFile("/dev/null", O_RDONLY));
+    return base::ScopedFile(base::OpenFile(it->second, O_RDONLY));
+  }
+
+  // Makes the trace pipe of |cpu| read the contents of the file at |path|.
+  void SetCpuPipePath(size_t cpu, const std::string& path) {
+    cpu_pipe_paths_[cpu] = path;
   }
 
   MOCK_METHOD(bool,
@@ -194,6 +211,7 @@ class MockFtraceProcfs : public FtraceProcfs {
  private:
   bool tracing_on_ = true;
   std::string current_tracer_ = "nop";
+  std::map<size_t, std::string> cpu_pipe_paths_;
 };
 
 }  // namespace
@@ -217,10 +235,15 @@ class TestFtraceController : public FtraceController,
   MockTaskRunner* runner() { return runner_.get(); }
   MockFtraceProcfs* procfs() { return primary_procfs_; }
   uint32_t drain_period_ms() { return GetDrainPeriodMs(); }
+  void set_max_staged_bytes_per_cpu(size_t max_staged_bytes) {
+    max_staged_bytes_per_cpu_ = max_staged_bytes;
+  }
 
-  std::unique_ptr<FtraceDataSource> AddFakeDataSource(const FtraceConfig& cfg) {
+  std::unique_ptr<FtraceDataSource> AddFakeDataSource(
+      const FtraceConfig& cfg,
+      std::unique_ptr<TraceWriter> trace_writer = nullptr) {
     std::unique_ptr<FtraceDataSource> data_source(new FtraceDataSource(
-        GetWeakPtr(), 0 /* session id */, cfg, nullptr /* trace_writer */));
+        GetWeakPtr(), 0 /* session id */, cfg, std::move(trace_writer)));
     if (!AddDataSource(data_source.get()))
       return nullptr;
     return data_source;
@@ -567,6 +590,131 @@ TEST(FtraceControllerTest, PeriodicDrainConfig) {
   }
 }
 
+namespace {
+
+// Returns |num_pages| raw ftrace pages (as read from trace_pipe_raw), each
+// filled by a single "group/foo" event. The events are one nanosecond apart,
+// starting from |first_ts|.
+std::string FooEventPages(size_t num_pages, uint64_t first_ts) {
+  const size_t page_size = base::GetSysPageSize();
+  // Page header: 8 bytes of timestamp and 8 bytes of data size.
+  constexpr size_t kPageHeaderSize = 16;
+  const uint64_t data_size = page_size - kPageHeaderSize;
+  // Event header (type_len = 0, time_delta = 1), followed by the size of the
+  // event (including the size itself) and the payload, starting with the id.
+  const uint32_t event_header = 1u << 5;
+  const uint32_t event_size = static_cast<uint32_t>(data_size - 4);
+  const uint16_t event_id = 1;
+
+  std::string pages(num_pages * page_size, '\0');
+  for (size_t i = 0; i < num_pages; i++) {
+    char* page = &pages[i * page_size];
+    uint64_t page_ts = first_ts + i - 1;
+    memcpy(page, &page_ts, sizeof(page_ts));
+    memcpy(page + 8, &data_size, sizeof(data_size));
+    char* event = page + kPageHeaderSize;
+    memcpy(event, &event_header, sizeof(event_header));
+    memcpy(event + 4, &event_size, sizeof(event_size));
+    memcpy(event + 8, &event_id, sizeof(event_id));
+  }
+  return pages;
+}
+
+struct FlushedEvents {
+  // The cpu of each FtraceEventBundle, in the order they were written.
+  std::vector<uint32_t> bundle_cpus;
+  // The timestamps of the events of each cpu.
+  std::map<uint32_t, std::vector<uint64_t>> timestamps;
+};
+
+// Starts a data source for each entry of |parallel_cpu_parsing|, flushes
+// |num_pages| pages of "group/foo" events from each of 2 cpus and returns the
+// events written into the first data source.
+FlushedEvents FlushFooEventPages(std::vector<bool> parallel_cpu_parsing,
+                                 size_t num_pages) {
+  constexpr size_t kCpuCount = 2;
+  auto controller = CreateTestController(true /* nice procfs */, kCpuCount);
+  // Make the workers stop after each batch of pages they read.
+  controller->set_max_staged_bytes_per_cpu(1);
+  std::vector<base::TempFile> pipes;
+  for (size_t cpu = 0; cpu < kCpuCount; cpu++) {
+    pipes.emplace_back(base::TempFile::Create());
+    std::string pages = FooEventPages(num_pages, (cpu + 1) * 1000000000ull);
+    PERFETTO_CHECK(base::WriteAll(pipes.back().fd(), pages.data(),
+                                  pages.size()) ==
+                   static_cast<ssize_t>(pages.size()));
+    controller->procfs()->SetCpuPipePath(cpu, pipes.back().path());
+  }
+
+  std::vector<std::unique_ptr<FtraceDataSource>> data_sources;
+  TraceWriterForTesting* trace_writer = nullptr;
+  for (bool parallel : parallel_cpu_parsing) {
+    FtraceConfig config = CreateFtraceConfig({"group/foo"});
+    config.set_buffer_size_kb(
+        static_cast<uint32_t>(num_pages * base::GetSysPageSize() / 1024));
+    config.set_parallel_cpu_parsing(parallel);
+    auto writer = std::make_unique<TraceWriterForTesting>();
+    if (!trace_writer)
+      trace_writer = writer.get();
+    data_sources.emplace_back(
+        controller->AddFakeDataSource(config, std::move(writer)));
+    PERFETTO_CHECK(data_sources.back());
+    PERFETTO_CHECK(controller->StartDataSource(data_sources.back().get()));
+  }
+  controller->Flush(1);
+
+  FlushedEvents res;
+  for (const auto& packet : trace_writer->GetAllTracePackets()) {
+    if (!packet.has_ftrace_events())
+      continue;
+    const auto& bundle = packet.ftrace_events();
+    res.bundle_cpus.push_back(bundle.cpu());
+    for (const auto& event : bundle.event())
+      res.timestamps[bundle.cpu()].push_back(event.timestamp());
+  }
+  return res;
+}
+
+// A few read batches (see CpuReader::ParsingBuffers) for each cpu.
+constexpr size_t kFlushedPages = 80;
+
+}  // namespace
+
+TEST(FtraceControllerTest, ParallelCpuParsing) {
+  FlushedEvents serial = FlushFooEventPages({false}, kFlushedPages);
+  FlushedEvents parallel = FlushFooEventPages({true}, kFlushedPages);
+
+  ASSERT_EQ(serial.timestamps.size(), 2u);
+  for (uint32_t cpu = 0; cpu < 2; cpu++) {
+    const std::vector<uint64_t>& timestamps = serial.timestamps[cpu];
+    ASSERT_EQ(timestamps.size(), kFlushedPages);
+    for (size_t i = 0; i < timestamps.size(); i++)
+      ASSERT_EQ(timestamps[i], (cpu + 1) * 1000000000ull + i);
+  }
+  EXPECT_EQ(parallel.timestamps, serial.timestamps);
+
+  // When parsing serially all the bundles of cpu 0 come first. The workers
+  // instead stop when their staging area is full and their packets are
+  // written before they carry on, so the bundles of the two cpus interleave.
+  EXPECT_TRUE(std::is_sorted(serial.bundle_cpus.begin(),
+                             serial.bundle_cpus.end()));
+  EXPECT_FALSE(std::is_sorted(parallel.bundle_cpus.begin(),
+                              parallel.bundle_cpus.end()));
+}
+
+TEST(FtraceControllerTest, ParallelCpuParsingRequiresAllDataSources) {
+  // The second data source didn't opt in: the cpus are parsed serially.
+  FlushedEvents events = FlushFooEventPages({true, false}, kFlushedPages);
+  ASSERT_EQ(events.timestamps.size(), 2u);
+  EXPECT_TRUE(std::is_sorted(events.bundle_cpus.begin(),
+                             events.bundle_cpus.end()));
+
+  events = FlushFooEventPages({true, true}, kFlushedPages);
+  ASSERT_EQ(events.timestamps.size(), 2u);
+  EXPECT_FALSE(std::is_sorted(events.bundle_cpus.begin(),
+                              events.bundle_cpus.end()));
+}
+
 TEST(FtraceMetadataTest, Clear) {
   FtraceMetadata metadata;
   metadata.inode_and_device.insert(std::make_pair(1, 1));
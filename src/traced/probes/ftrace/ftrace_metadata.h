@@ -77,9 +77,9 @@ struct FtraceMetadata {
 #if PERFETTO_DCHECK_IS_ON()
     PERFETTO_DCHECK(seen_device_id);
 #endif
-    static int32_t cached_pid = 0;
-    if (!cached_pid)
-      cached_pid = getpid();
+    // This can be called concurrently by the CpuReaderWorker threads, hence
+    // the thread-safe initialization of the static.
+    static const int32_t cached_pid = getpid();
 
     PERFETTO_DCHECK(last_seen_common_pid);
     PERFETTO_DCHECK(cached_pid == getpid());
@@ -120,6 +120,21 @@ struct FtraceMetadata {
     return it_and_inserted.first->index;
   }
 
+  // Adds the entries collected by |other| (e.g. on a different thread) to
+  // this. Kernel symbols are not merged: their index is already written in the
+  // trace and it's meaningful only when symbolizing, which never happens on a
+  // different thread.
+  void Merge(const FtraceMetadata& other) {
+    for (const InodeBlockPair& inode : other.inode_and_device)
+      inode_and_device.insert(inode);
+    for (int32_t pid : other.rename_pids)
+      rename_pids.insert(pid);
+    for (int32_t pid : other.pids)
+      AddPid(pid);
+    for (const auto& fd : other.fds)
+      fds.insert(fd);
+  }
+
   void Clear() {
     inode_and_device.clear();
     rename_pids.clear();
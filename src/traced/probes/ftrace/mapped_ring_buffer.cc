@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ftrace/mapped_ring_buffer.h"
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/utils.h"
+
+namespace perfetto {
+
+namespace {
+// From include/uapi/linux/trace_mmap.h. Redefined here as the kernel headers
+// of most toolchains predate it.
+constexpr unsigned long kTraceMmapIoctlGetReader = _IO('R', 0x20);
+}  // namespace
+
+// static
+std::unique_ptr<MappedRingBuffer> MappedRingBuffer::Create(int trace_fd) {
+  // The size of the meta page is in the meta page itself: map the first page
+  // to find out, then remap it with the right size if needed.
+  size_t meta_size = base::GetSysPageSize();
+  void* meta = mmap(nullptr, meta_size, PROT_READ, MAP_SHARED, trace_fd, 0);
+  if (meta == MAP_FAILED) {
+    // ENODEV (or EINVAL on some kernels) if mapping is not supported, EBUSY
+    // if the buffer is in use by a snapshot.
+    PERFETTO_DPLOG("mmap(trace_pipe_raw) failed");
+    return nullptr;
+  }
+  const auto* meta_page = static_cast<const TraceBufferMeta*>(meta);
+  if (meta_page->meta_struct_len < sizeof(TraceBufferMeta) ||
+      meta_page->subbuf_size == 0 || meta_page->nr_subbufs == 0) {
+    PERFETTO_ELOG("Unexpected trace_pipe_raw meta page layout");
+    munmap(meta, meta_size);
+    return nullptr;
+  }
+  if (meta_page->meta_page_size > meta_size) {
+    size_t new_size = meta_page->meta_page_size;
+    munmap(meta, meta_size);
+    meta = mmap(nullptr, new_size, PROT_READ, MAP_SHARED, trace_fd, 0);
+    if (meta == MAP_FAILED) {
+      PERFETTO_PLOG("mmap(trace_pipe_raw) failed");
+      return nullptr;
+    }
+    meta_size = new_size;
+    meta_page = static_cast<const TraceBufferMeta*>(meta);
+  }
+
+  const size_t data_size =
+      static_cast<size_t>(meta_page->subbuf_size) * meta_page->nr_subbufs;
+  void* data = mmap(nullptr, data_size, PROT_READ, MAP_SHARED, trace_fd,
+                    static_cast<off_t>(meta_size));
+  if (data == MAP_FAILED) {
+    PERFETTO_PLOG("mmap(trace_pipe_raw) of the sub-buffers failed");
+    munmap(meta, meta_size);
+    return nullptr;
+  }
+
+  std::unique_ptr<MappedRingBuffer> buf(
+      new MappedRingBuffer(trace_fd, meta, meta_size, data, data_size));
+  buf->subbuf_size_ = meta_page->subbuf_size;
+  buf->num_subbufs_ = meta_page->nr_subbufs;
+  return buf;
+}
+
+MappedRingBuffer::MappedRingBuffer(int trace_fd,
+                                   void* meta,
+                                   size_t meta_size,
+                                   void* data,
+                                   size_t data_size)
+    : trace_fd_(trace_fd),
+      meta_(static_cast<const TraceBufferMeta*>(meta)),
+      meta_size_(meta_size),
+      data_(static_cast<const uint8_t*>(data)),
+      data_size_(data_size) {}
+
+MappedRingBuffer::MappedRingBuffer(const TraceBufferMeta* meta,
+                                   const uint8_t* data)
+    : trace_fd_(-1),
+      meta_(meta),
+      meta_size_(0),
+      data_(data),
+      data_size_(0),
+      subbuf_size_(meta->subbuf_size),
+      num_subbufs_(meta->nr_subbufs) {}
+
+MappedRingBuffer::~MappedRingBuffer() {
+  if (!meta_size_)
+    return;
+  munmap(const_cast<uint8_t*>(data_), data_size_);
+  munmap(const_cast<TraceBufferMeta*>(meta_), meta_size_);
+}
+
+bool MappedRingBuffer::GetReader() {
+  return PERFETTO_EINTR(ioctl(trace_fd_, kTraceMmapIoctlGetReader)) == 0;
+}
+
+const uint8_t* MappedRingBuffer::reader_subbuf() const {
+  uint32_t id = reader_id();
+  PERFETTO_CHECK(id < num_subbufs_);
+  return data_ + id * subbuf_size_;
+}
+
+}  // namespace perfetto
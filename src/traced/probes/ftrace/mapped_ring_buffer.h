@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_FTRACE_MAPPED_RING_BUFFER_H_
+#define SRC_TRACED_PROBES_FTRACE_MAPPED_RING_BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+namespace perfetto {
+
+// The kernel ring buffer of a cpu, memory-mapped through its trace_pipe_raw
+// file (Linux 6.10+, see Documentation/trace/ring-buffer-map.rst).
+//
+// The mapping consists of a meta page followed by the sub-buffers (i.e. the
+// ring buffer pages) of the cpu. At any time, one of the sub-buffers is owned
+// by the reader: GetReader() tells the kernel that the current reader
+// sub-buffer has been consumed, and swaps in the next one if there is no more
+// data in the current one. The contents of the reader sub-buffer are valid
+// only until the next call to GetReader().
+class MappedRingBuffer {
+ public:
+  // Layout of the meta page, from include/uapi/linux/trace_mmap.h.
+  struct TraceBufferMeta {
+    uint32_t meta_page_size;
+    uint32_t meta_struct_len;
+    uint32_t subbuf_size;
+    uint32_t nr_subbufs;
+    struct {
+      uint64_t lost_events;
+      uint32_t id;
+      uint32_t read;
+    } reader;
+    uint64_t flags;
+    uint64_t entries;
+    uint64_t overrun;
+    uint64_t read;
+    uint64_t reserved1;
+    uint64_t reserved2;
+  };
+
+  // Returns nullptr if the kernel doesn't support mapping |trace_fd|.
+  static std::unique_ptr<MappedRingBuffer> Create(int trace_fd);
+
+  virtual ~MappedRingBuffer();
+
+  // Returns false on error, with errno set by the kernel.
+  virtual bool GetReader();
+
+  // The id of the current reader sub-buffer. Stays the same for as long as
+  // the kernel keeps appending events into it.
+  uint32_t reader_id() const { return meta_->reader.id; }
+
+  // The size of the payload of the reader sub-buffer which has been consumed.
+  // Before the first GetReader(), this is the part consumed by read()s of the
+  // trace pipe. After GetReader(), this is where the data handed out to the
+  // reader ends: the kernel accounts it as consumed and can append more
+  // events after it.
+  uint32_t reader_read() const { return meta_->reader.read; }
+
+  // The number of events lost by the kernel before the reader sub-buffer was
+  // swapped in.
+  uint64_t reader_lost_events() const { return meta_->reader.lost_events; }
+
+  // The current reader sub-buffer, starting with the same page header as the
+  // pages read from trace_pipe_raw.
+  const uint8_t* reader_subbuf() const;
+
+  size_t subbuf_size() const { return subbuf_size_; }
+
+ protected:
+  // For testing: |meta| and |data| are owned by the subclass, which has to
+  // implement GetReader().
+  MappedRingBuffer(const TraceBufferMeta* meta, const uint8_t* data);
+
+ private:
+  MappedRingBuffer(int trace_fd,
+                   void* meta,
+                   size_t meta_size,
+                   void* data,
+                   size_t data_size);
+  MappedRingBuffer(const MappedRingBuffer&) = delete;
+  MappedRingBuffer& operator=(const MappedRingBuffer&) = delete;
+
+  const int trace_fd_;  // Not owned, it belongs to the CpuReader.
+  const TraceBufferMeta* const meta_;
+  const size_t meta_size_;  // 0 if not mapped by this class.
+  const uint8_t* const data_;
+  const size_t data_size_;
+  size_t subbuf_size_ = 0;
+  uint32_t num_subbufs_ = 0;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_FTRACE_MAPPED_RING_BUFFER_H_
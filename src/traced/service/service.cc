@@ -38,6 +38,10 @@
 #include "src/tracing/service/zlib_compressor.h"
 #endif
 
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+#include "src/tracing/service/zstd_compressor.h"
+#endif
+
 namespace perfetto {
 namespace {
 void PrintUsage(const char* prog_name) {
@@ -122,6 +126,9 @@ int PERFETTO_EXPORT_ENTRYPOINT ServiceMain(int argc, char** argv) {
   TracingService::InitOpts init_opts = {};
 #if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
   init_opts.compressor_fn = &ZlibCompressFn;
+#endif
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+  init_opts.zstd_compressor_fn = &ZstdCompressFn;
 #endif
   svc = ServiceIPCHost::CreateInstance(&task_runner, init_opts);
 
@@ -139,6 +139,26 @@ static void BM_TracingTrackEventBasic(benchmark::State& state) {
   PERFETTO_CHECK(!tracing_session->ReadTraceBlocking().empty());
 }
 
+// Same as above, but with events emitted concurrently by state.threads()
+// threads, each with its own TraceWriter, to measure how writing scales when
+// several threads compete for the chunks of the shared memory buffer.
+static void BM_TracingTrackEventBasicMultiThreaded(benchmark::State& state) {
+  static std::unique_ptr<perfetto::TracingSession> tracing_session;
+  if (state.thread_index() == 0)
+    tracing_session = StartTracing("track_event");
+
+  while (state.KeepRunning()) {
+    TRACE_EVENT_BEGIN("benchmark", "Event");
+    benchmark::ClobberMemory();
+  }
+
+  if (state.thread_index() == 0) {
+    tracing_session->StopBlocking();
+    PERFETTO_CHECK(!tracing_session->ReadTraceBlocking().empty());
+    tracing_session.reset();
+  }
+}
+
 static void BM_TracingTrackEventDebugAnnotations(benchmark::State& state) {
   auto tracing_session = StartTracing("track_event");
 
@@ -173,6 +193,7 @@ BENCHMARK(BM_TracingDataSourceDisabled);
 BENCHMARK(BM_TracingDataSourceLambda);
 BENCHMARK(BM_TracingDataSourceLambdaDifferentPacketSize)->Range(1, 1000);
 BENCHMARK(BM_TracingTrackEventBasic);
+BENCHMARK(BM_TracingTrackEventBasicMultiThreaded)->ThreadRange(1, 16);
 BENCHMARK(BM_TracingTrackEventDebugAnnotations);
 BENCHMARK(BM_TracingTrackEventDisabled);
 BENCHMARK(BM_TracingTrackEventLambda);
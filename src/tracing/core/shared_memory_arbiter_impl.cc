@@ -47,6 +47,10 @@ MaybeUnboundBufferID MakeTargetBufferIdForReservation(uint16_t reservation_id) {
 bool IsReservationTargetBufferId(MaybeUnboundBufferID buffer_id) {
   return (buffer_id >> 16) > 0;
 }
+
+// With adaptive batching, the batching period is shrunk when the previous one
+// ended more than this many periods ago.
+constexpr uint32_t kAdaptiveBatchCommitsIdlePeriods = 4;
 }  // namespace
 
 // static
@@ -93,100 +97,99 @@ SharedMemoryArbiterImpl::SharedMemoryArbiterImpl(
 
 Chunk SharedMemoryArbiterImpl::GetNewChunk(
     const SharedMemoryABI::ChunkHeader& header,
-    BufferExhaustedPolicy buffer_exhausted_policy) {
+    BufferExhaustedPolicy buffer_exhausted_policy,
+    size_t* page_hint) {
   int stall_count = 0;
   unsigned stall_interval_us = 0;
-  bool task_runner_runs_on_current_thread = false;
   static const unsigned kMaxStallIntervalUs = 100000;
   static const int kLogAfterNStalls = 3;
   static const int kFlushCommitsAfterEveryNStalls = 2;
   static const int kAssertAtNStalls = 200;
 
   for (;;) {
-    // TODO(primiano): Probably this lock is not really required and this code
-    // could be rewritten leveraging only the Try* atomic operations in
-    // SharedMemoryABI. But let's not be too adventurous for the moment.
-    {
-      std::unique_lock<std::mutex> scoped_lock(lock_);
-
-      // If ever unbound, we do not support stalling. In theory, we could
-      // support stalling for TraceWriters created after the arbiter and startup
-      // buffer reservations were bound, but to avoid raciness between the
-      // creation of startup writers and binding, we categorically forbid kStall
-      // mode.
-      PERFETTO_DCHECK(was_always_bound_ ||
-                      buffer_exhausted_policy == BufferExhaustedPolicy::kDrop);
-
-      task_runner_runs_on_current_thread =
-          task_runner_ && task_runner_->RunsTasksOnCurrentThread();
+    // Chunks are acquired only through the Try* atomic operations of
+    // SharedMemoryABI, without holding |lock_|, so that writers on different
+    // threads don't serialize here. Each writer starts looking from the page
+    // it got its previous chunk from (|page_hint|), which keeps writers on
+    // different pages rather than racing for the same chunks.
+    const size_t num_pages = shmem_abi_.num_pages();
+    const size_t initial_page_idx =
+        (page_hint ? *page_hint : page_idx_.load(std::memory_order_relaxed)) %
+        num_pages;
+    for (size_t i = 0; i < num_pages; i++) {
+      const size_t page_idx = (initial_page_idx + i) % num_pages;
+      bool is_new_page = false;
+
+      // TODO(primiano): make the page layout dynamic.
+      auto layout = SharedMemoryArbiterImpl::default_page_layout;
+
+      if (shmem_abi_.is_page_free(page_idx)) {
+        // TODO(primiano): Use the |size_hint| here to decide the layout.
+        is_new_page = shmem_abi_.TryPartitionPage(page_idx, layout);
+      }
+      uint32_t free_chunks;
+      if (is_new_page) {
+        free_chunks = (1 << SharedMemoryABI::kNumChunksForLayout[layout]) - 1;
+      } else {
+        free_chunks = shmem_abi_.GetFreeChunks(page_idx);
+      }
 
-      // If more than half of the SMB.size() is filled with completed chunks for
-      // which we haven't notified the service yet (i.e. they are still enqueued
-      // in |commit_data_req_|), force a synchronous CommitDataRequest() even if
-      // we acquire a chunk, to reduce the likeliness of stalling the writer.
-      //
-      // We can only do this if we're writing on the same thread that we access
-      // the producer endpoint on, since we cannot notify the producer endpoint
-      // to commit synchronously on a different thread. Attempting to flush
-      // synchronously on another thread will lead to subtle bugs caused by
-      // out-of-order commit requests (crbug.com/919187#c28).
-      bool should_commit_synchronously =
-          task_runner_runs_on_current_thread &&
-          buffer_exhausted_policy == BufferExhaustedPolicy::kStall &&
-          commit_data_req_ && bytes_pending_commit_ >= shmem_abi_.size() / 2;
-
-      const size_t initial_page_idx = page_idx_;
-      for (size_t i = 0; i < shmem_abi_.num_pages(); i++) {
-        page_idx_ = (initial_page_idx + i) % shmem_abi_.num_pages();
-        bool is_new_page = false;
-
-        // TODO(primiano): make the page layout dynamic.
-        auto layout = SharedMemoryArbiterImpl::default_page_layout;
-
-        if (shmem_abi_.is_page_free(page_idx_)) {
-          // TODO(primiano): Use the |size_hint| here to decide the layout.
-          is_new_page = shmem_abi_.TryPartitionPage(page_idx_, layout);
-        }
-        uint32_t free_chunks;
-        if (is_new_page) {
-          free_chunks = (1 << SharedMemoryABI::kNumChunksForLayout[layout]) - 1;
+      for (uint32_t chunk_idx = 0; free_chunks;
+           chunk_idx++, free_chunks >>= 1) {
+        if (!(free_chunks & 1))
+          continue;
+        // We found a free chunk.
+        Chunk chunk =
+            shmem_abi_.TryAcquireChunkForWriting(page_idx, chunk_idx, &header);
+        if (!chunk.is_valid())
+          continue;
+        if (page_hint) {
+          *page_hint = page_idx;
         } else {
-          free_chunks = shmem_abi_.GetFreeChunks(page_idx_);
+          page_idx_.store(page_idx, std::memory_order_relaxed);
+        }
+        if (stall_count > kLogAfterNStalls) {
+          PERFETTO_LOG("Recovered from stall after %d iterations",
+                       stall_count);
         }
 
-        for (uint32_t chunk_idx = 0; free_chunks;
-             chunk_idx++, free_chunks >>= 1) {
-          if (!(free_chunks & 1))
-            continue;
-          // We found a free chunk.
-          Chunk chunk = shmem_abi_.TryAcquireChunkForWriting(
-              page_idx_, chunk_idx, &header);
-          if (!chunk.is_valid())
-            continue;
-          if (stall_count > kLogAfterNStalls) {
-            PERFETTO_LOG("Recovered from stall after %d iterations",
-                         stall_count);
-          }
-
-          if (should_commit_synchronously) {
-            // We can't flush while holding the lock.
-            scoped_lock.unlock();
-            FlushPendingCommitDataRequests();
-            return chunk;
-          } else {
-            return chunk;
-          }
+        // If more than half of the SMB.size() is filled with completed chunks
+        // for which we haven't notified the service yet (i.e. they are still
+        // enqueued in |commit_data_req_|), force a synchronous
+        // CommitDataRequest() even if we acquired a chunk, to reduce the
+        // likeliness of stalling the writer.
+        //
+        // We can only do this if we're writing on the same thread that we
+        // access the producer endpoint on, since we cannot notify the producer
+        // endpoint to commit synchronously on a different thread. Attempting to
+        // flush synchronously on another thread will lead to subtle bugs
+        // caused by out-of-order commit requests (crbug.com/919187#c28).
+        if (buffer_exhausted_policy == BufferExhaustedPolicy::kStall &&
+            bytes_pending_commit_.load(std::memory_order_relaxed) >=
+                shmem_abi_.size() / 2 &&
+            TaskRunnerRunsOnCurrentThread()) {
+          FlushPendingCommitDataRequests();
         }
+        return chunk;
       }
-    }  // scoped_lock
+    }
 
     if (buffer_exhausted_policy == BufferExhaustedPolicy::kDrop) {
       PERFETTO_DLOG("Shared memory buffer exhausted, returning invalid Chunk!");
       return Chunk();
     }
 
-    // Stalling is not supported if we were ever unbound (see earlier comment).
-    PERFETTO_CHECK(was_always_bound_);
+    // If ever unbound, we do not support stalling. In theory, we could support
+    // stalling for TraceWriters created after the arbiter and startup buffer
+    // reservations were bound, but to avoid raciness between the creation of
+    // startup writers and binding, we categorically forbid kStall mode.
+    bool task_runner_runs_on_current_thread;
+    {
+      std::lock_guard<std::mutex> scoped_lock(lock_);
+      PERFETTO_CHECK(was_always_bound_);
+      task_runner_runs_on_current_thread =
+          task_runner_ && task_runner_->RunsTasksOnCurrentThread();
+    }
 
     // All chunks are taken (either kBeingWritten by us or kBeingRead by the
     // Service).
@@ -228,6 +231,11 @@ Chunk SharedMemoryArbiterImpl::GetNewChunk(
   }
 }
 
+bool SharedMemoryArbiterImpl::TaskRunnerRunsOnCurrentThread() {
+  std::lock_guard<std::mutex> scoped_lock(lock_);
+  return task_runner_ && task_runner_->RunsTasksOnCurrentThread();
+}
+
 void SharedMemoryArbiterImpl::ReturnCompletedChunk(
     Chunk chunk,
     MaybeUnboundBufferID target_buffer,
@@ -266,7 +274,9 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
       if (fully_bound_ && !delayed_flush_scheduled_) {
         weak_this = weak_ptr_factory_.GetWeakPtr();
         task_runner_to_post_delayed_callback_on = task_runner_;
-        flush_delay_ms = batch_commits_duration_ms_;
+        flush_delay_ms = adaptive_batch_commits_
+                             ? UpdateAdaptiveBatchCommitsDurationLocked()
+                             : batch_commits_duration_ms_;
         delayed_flush_scheduled_ = true;
       }
     }
@@ -359,8 +369,12 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
     // accumulate the patch and a crash occurs before the patch is sent, the
     // service will not know of the patch and won't be able to reconstruct the
     // trace.
-    if (fully_bound_ &&
-        (last_patch_req || bytes_pending_commit_ >= shmem_abi_.size() / 2)) {
+    bool smb_filling_up = bytes_pending_commit_ >= shmem_abi_.size() / 2;
+    if (fully_bound_ && (last_patch_req || smb_filling_up)) {
+      // The batching period is too long for the current rate of writes: make
+      // the next one shorter.
+      if (smb_filling_up)
+        adaptive_batch_commits_duration_ms_ /= 2;
       weak_this = weak_ptr_factory_.GetWeakPtr();
       task_runner_to_post_delayed_callback_on = task_runner_;
       flush_delay_ms = 0;
@@ -380,6 +394,8 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
             // Clear |delayed_flush_scheduled_|, allowing the next call to
             // UpdateCommitDataRequest to start another batching period.
             weak_this->delayed_flush_scheduled_ = false;
+            if (weak_this->adaptive_batch_commits_)
+              weak_this->last_batch_end_ms_ = weak_this->clock_();
           }
           weak_this->FlushPendingCommitDataRequests();
         },
@@ -387,6 +403,23 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
   }
 }
 
+uint32_t SharedMemoryArbiterImpl::UpdateAdaptiveBatchCommitsDurationLocked() {
+  uint64_t duration_ms = adaptive_batch_commits_duration_ms_;
+  uint64_t period_ms = std::max<uint64_t>(duration_ms, 1);
+  int64_t elapsed_ms = (clock_() - last_batch_end_ms_).count();
+  if (elapsed_ms <= static_cast<int64_t>(period_ms)) {
+    // Chunks are being returned as fast as the commits are sent: batch them
+    // for longer.
+    duration_ms = period_ms * 2;
+  } else if (static_cast<uint64_t>(elapsed_ms) >
+             period_ms * kAdaptiveBatchCommitsIdlePeriods) {
+    duration_ms /= 2;
+  }
+  adaptive_batch_commits_duration_ms_ = static_cast<uint32_t>(
+      std::min<uint64_t>(duration_ms, batch_commits_duration_ms_));
+  return adaptive_batch_commits_duration_ms_;
+}
+
 bool SharedMemoryArbiterImpl::TryDirectPatchLocked(
     WriterID writer_id,
     const Patch& patch,
@@ -463,6 +496,12 @@ void SharedMemoryArbiterImpl::SetBatchCommitsDuration(
   batch_commits_duration_ms_ = batch_commits_duration_ms;
 }
 
+void SharedMemoryArbiterImpl::SetAdaptiveBatchCommits(bool enabled) {
+  std::lock_guard<std::mutex> scoped_lock(lock_);
+  adaptive_batch_commits_ = enabled;
+  adaptive_batch_commits_duration_ms_ = 0;
+}
+
 bool SharedMemoryArbiterImpl::EnableDirectSMBPatching() {
   std::lock_guard<std::mutex> scoped_lock(lock_);
   if (!direct_patching_supported_by_service_) {
@@ -19,12 +19,14 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <vector>
 
+#include "perfetto/base/time.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
 #include "perfetto/ext/tracing/core/shared_memory_abi.h"
@@ -129,8 +131,13 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   // Returns a new Chunk to write tracing data. Depending on the provided
   // BufferExhaustedPolicy, this may return an invalid chunk if no valid free
   // chunk could be found in the SMB.
+  // Thread-safe and, unless the SMB is exhausted, lock-free. If |page_hint| is
+  // not null, the search for a free chunk starts from that page and the page
+  // of the returned chunk is stored back into it: TraceWriterImpl keeps one per
+  // writer, so that writers on different threads use different pages.
   SharedMemoryABI::Chunk GetNewChunk(const SharedMemoryABI::ChunkHeader&,
-                                     BufferExhaustedPolicy);
+                                     BufferExhaustedPolicy,
+                                     size_t* page_hint = nullptr);
 
   // Puts back a Chunk that has been completed and sends a request to the
   // service to move it to the central tracing buffer. |target_buffer| is the
@@ -153,6 +160,13 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
 
   SharedMemoryABI* shmem_abi_for_testing() { return &shmem_abi_; }
 
+  // Overrides the clock used to measure the idle time between two batching
+  // periods (see SetAdaptiveBatchCommits()).
+  void set_clock_for_testing(std::function<base::TimeMillis()> clock) {
+    std::lock_guard<std::mutex> scoped_lock(lock_);
+    clock_ = std::move(clock);
+  }
+
   static void set_default_layout_for_testing(SharedMemoryABI::PageLayout l) {
     default_page_layout = l;
   }
@@ -178,6 +192,8 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
 
   void SetBatchCommitsDuration(uint32_t batch_commits_duration_ms) override;
 
+  void SetAdaptiveBatchCommits(bool enabled) override;
+
   bool EnableDirectSMBPatching() override;
 
   void SetDirectSMBPatchingSupportedByService() override;
@@ -218,6 +234,13 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
                                MaybeUnboundBufferID target_buffer,
                                PatchList* patch_list);
 
+  // Returns the duration of the batching period that is about to start,
+  // growing or shrinking the adaptive duration depending on how long ago the
+  // previous period ended.
+  //
+  // Note: the caller must be holding |lock_| for the duration of the call.
+  uint32_t UpdateAdaptiveBatchCommitsDurationLocked();
+
   // Search the chunks that are being batched in |commit_data_req_| for a chunk
   // that needs patching and that matches the provided |writer_id| and
   // |patch.chunk_id|. If found, apply |patch| to that chunk, and if
@@ -237,6 +260,10 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   // Called by the TraceWriter destructor.
   void ReleaseWriterID(WriterID);
 
+  // Returns true if bound to a task runner which runs tasks on the current
+  // thread. Takes |lock_|.
+  bool TaskRunnerRunsOnCurrentThread();
+
   void BindStartupTargetBufferImpl(std::unique_lock<std::mutex> scoped_lock,
                                    uint16_t target_buffer_reservation_id,
                                    BufferID target_buffer_id);
@@ -267,10 +294,20 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   std::mutex lock_;
 
   base::TaskRunner* task_runner_ = nullptr;
+
+  // GetNewChunk() acquires chunks without holding |lock_|, through the atomic
+  // operations of SharedMemoryABI.
   SharedMemoryABI shmem_abi_;
-  size_t page_idx_ = 0;
+
+  // The page GetNewChunk() starts from when the caller passes no hint. Not
+  // protected by |lock_|.
+  std::atomic<size_t> page_idx_{0};
+
   std::unique_ptr<CommitDataRequest> commit_data_req_;
-  size_t bytes_pending_commit_ = 0;  // SUM(chunk.size() : commit_data_req_).
+
+  // SUM(chunk.size() : commit_data_req_). Only modified under |lock_|, but
+  // also read without it by GetNewChunk().
+  std::atomic<size_t> bytes_pending_commit_{0};
   IdAllocator<WriterID> active_writer_ids_;
   bool did_shutdown_ = false;
 
@@ -299,6 +336,17 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   // See SharedMemoryArbiter::SetBatchCommitsDuration.
   uint32_t batch_commits_duration_ms_ = 0;
 
+  // See SharedMemoryArbiter::SetAdaptiveBatchCommits. When enabled,
+  // |batch_commits_duration_ms_| is the upper bound of
+  // |adaptive_batch_commits_duration_ms_|, which is the duration of the next
+  // batching period.
+  bool adaptive_batch_commits_ = false;
+  uint32_t adaptive_batch_commits_duration_ms_ = 0;
+
+  // The time at which the last batching period ended.
+  base::TimeMillis last_batch_end_ms_{0};
+  std::function<base::TimeMillis()> clock_ = &base::GetWallTimeMs;
+
   // See SharedMemoryArbiter::EnableDirectSMBPatching.
   bool direct_patching_enabled_ = false;
 
@@ -17,6 +17,12 @@
 #include "src/tracing/core/shared_memory_arbiter_impl.h"
 
 #include <bitset>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
 #include "perfetto/ext/tracing/core/commit_data_request.h"
@@ -60,6 +66,31 @@ class SharedMemoryArbiterImplTest : public AlignedBufferTest {
 
   bool IsArbiterFullyBound() { return arbiter_->fully_bound_; }
 
+  uint32_t AdaptiveBatchCommitsDurationMs() {
+    std::lock_guard<std::mutex> scoped_lock(arbiter_->lock_);
+    return arbiter_->adaptive_batch_commits_duration_ms_;
+  }
+
+  // Returns a new chunk to the arbiter and waits for the end of the batching
+  // period that it started.
+  void ReturnChunkAndWaitForCommit() {
+    static int i = 0;
+    std::string checkpoint_name = "commit_" + std::to_string(i++);
+    auto on_commit = task_runner_->CreateCheckpoint(checkpoint_name);
+    SharedMemoryABI::Chunk chunk =
+        arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDefault);
+    ASSERT_TRUE(chunk.is_valid());
+    EXPECT_CALL(mock_producer_endpoint_, CommitData(_, _))
+        .WillOnce(Invoke(
+            [on_commit](const CommitDataRequest&,
+                        MockProducerEndpoint::CommitDataCallback) {
+              on_commit();
+            }));
+    PatchList ignored;
+    arbiter_->ReturnCompletedChunk(std::move(chunk), 1, &ignored);
+    task_runner_->RunUntilCheckpoint(checkpoint_name);
+  }
+
   void TearDown() override {
     arbiter_.reset();
     task_runner_.reset();
@@ -211,6 +242,65 @@ TEST_P(SharedMemoryArbiterImplTest, BatchCommits) {
   arbiter_->FlushPendingCommitDataRequests();
 }
 
+TEST_P(SharedMemoryArbiterImplTest, AdaptiveBatchCommits) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv1);
+  // The clock only moves when the test says so, so the periods always start
+  // right after the previous one ended, however long the task runner takes.
+  base::TimeMillis now(1000);
+  arbiter_->set_clock_for_testing([&now] { return now; });
+  arbiter_->SetBatchCommitsDuration(8);
+  arbiter_->SetAdaptiveBatchCommits(true);
+
+  // The first period is not preceded by any other and is not batched. Each
+  // period starting right after the previous one doubles the duration, up to
+  // the duration set with SetBatchCommitsDuration().
+  for (uint32_t expected_ms : {0u, 2u, 4u, 8u, 8u}) {
+    ReturnChunkAndWaitForCommit();
+    EXPECT_EQ(AdaptiveBatchCommitsDurationMs(), expected_ms);
+  }
+
+  // After being idle for a few periods, the duration is halved.
+  now += base::TimeMillis(40);
+  ReturnChunkAndWaitForCommit();
+  EXPECT_EQ(AdaptiveBatchCommitsDurationMs(), 4u);
+}
+
+TEST_P(SharedMemoryArbiterImplTest, AdaptiveBatchCommitsBoundedByFillLevel) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv1);
+  base::TimeMillis now(1000);
+  arbiter_->set_clock_for_testing([&now] { return now; });
+  arbiter_->SetBatchCommitsDuration(8);
+  arbiter_->SetAdaptiveBatchCommits(true);
+  for (int i = 0; i < 4; i++)
+    ReturnChunkAndWaitForCommit();
+  ASSERT_EQ(AdaptiveBatchCommitsDurationMs(), 8u);
+
+  // Returning half of the buffer within a period commits immediately and
+  // halves the duration of the next periods. The chunks are slightly smaller
+  // than the pages, hence the +1.
+  static constexpr size_t kNumChunks = kNumPages / 2 + 1;
+  std::vector<SharedMemoryABI::Chunk> chunks;
+  for (size_t i = 0; i < kNumChunks; i++) {
+    chunks.push_back(
+        arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDefault));
+    ASSERT_TRUE(chunks.back().is_valid());
+  }
+  auto on_commit = task_runner_->CreateCheckpoint("on_commit");
+  EXPECT_CALL(mock_producer_endpoint_, CommitData(_, _))
+      .WillOnce(Invoke([on_commit](const CommitDataRequest& req,
+                                   MockProducerEndpoint::CommitDataCallback) {
+        EXPECT_EQ(req.chunks_to_move_size(), static_cast<int>(kNumChunks));
+        on_commit();
+      }));
+  PatchList ignored;
+  for (auto& chunk : chunks)
+    arbiter_->ReturnCompletedChunk(std::move(chunk), 1, &ignored);
+  EXPECT_EQ(AdaptiveBatchCommitsDurationMs(), 4u);
+  task_runner_->RunUntilCheckpoint("on_commit");
+}
+
 TEST_P(SharedMemoryArbiterImplTest, UseShmemEmulation) {
   arbiter_.reset(new SharedMemoryArbiterImpl(
       buf(), buf_size(), ShmemMode::kShmemEmulation, page_size(),
@@ -362,6 +452,64 @@ TEST_P(SharedMemoryArbiterImplTest, BufferExhaustedPolicyDrop) {
   ASSERT_TRUE(chunks[0].is_valid());
 }
 
+// Verify that GetNewChunk() starts from the page hint and updates it.
+TEST_P(SharedMemoryArbiterImplTest, PageHint) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv4);
+  SharedMemoryABI* abi = arbiter_->shmem_abi_for_testing();
+  std::vector<SharedMemoryABI::Chunk> chunks;
+  size_t page_hint = 5;
+  for (size_t i = 0; i < 5; i++) {
+    chunks.push_back(
+        arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDrop, &page_hint));
+    ASSERT_TRUE(chunks.back().is_valid());
+    size_t expected_page = i < 4 ? 5 : 6;
+    EXPECT_EQ(abi->GetPageAndChunkIndex(chunks.back()).first, expected_page);
+    EXPECT_EQ(page_hint, expected_page);
+  }
+
+  // Hints beyond the last page wrap around.
+  page_hint = kNumPages + 2;
+  chunks.push_back(
+      arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDrop, &page_hint));
+  ASSERT_TRUE(chunks.back().is_valid());
+  EXPECT_EQ(abi->GetPageAndChunkIndex(chunks.back()).first, 2u);
+  EXPECT_EQ(page_hint, 2u);
+}
+
+// Verify that writers on different threads never get the same chunk.
+TEST_P(SharedMemoryArbiterImplTest, ConcurrentGetNewChunk) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv14);
+  static constexpr size_t kNumThreads = 4;
+  std::vector<SharedMemoryABI::Chunk> chunks[kNumThreads];
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([this, t, &chunks] {
+      size_t page_hint = t;
+      for (;;) {
+        SharedMemoryABI::Chunk chunk =
+            arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDrop, &page_hint);
+        if (!chunk.is_valid())
+          break;
+        chunks[t].push_back(std::move(chunk));
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  std::set<std::pair<size_t, size_t>> acquired;
+  for (auto& thread_chunks : chunks) {
+    for (const auto& chunk : thread_chunks) {
+      EXPECT_TRUE(acquired.insert(arbiter_->shmem_abi_for_testing()
+                                      ->GetPageAndChunkIndex(chunk))
+                      .second);
+    }
+  }
+  EXPECT_EQ(acquired.size(), kNumPages * 14);
+}
+
 TEST_P(SharedMemoryArbiterImplTest, CreateUnboundAndBind) {
   auto checkpoint_writer = task_runner_->CreateCheckpoint("writer_registered");
   auto checkpoint_flush = task_runner_->CreateCheckpoint("flush_completed");
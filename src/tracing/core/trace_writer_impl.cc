@@ -57,6 +57,7 @@ TraceWriterImpl::TraceWriterImpl(SharedMemoryArbiterImpl* shmem_arbiter,
       id_(id),
       target_buffer_(target_buffer),
       buffer_exhausted_policy_(buffer_exhausted_policy),
+      chunk_page_hint_(id - 1),
       protobuf_stream_writer_(this),
       process_id_(base::GetProcessId()) {
   // TODO(primiano): we could handle the case of running out of TraceWriterID(s)
@@ -239,7 +240,8 @@ protozero::ContiguousMemoryRange TraceWriterImpl::GetNewBuffer() {
   header.packets.store(packets, std::memory_order_relaxed);
 
   SharedMemoryABI::Chunk new_chunk =
-      shmem_arbiter_->GetNewChunk(header, buffer_exhausted_policy_);
+      shmem_arbiter_->GetNewChunk(header, buffer_exhausted_policy_,
+                                  &chunk_page_hint_);
   if (!new_chunk.is_valid()) {
     // Shared memory buffer exhausted, switch into |drop_packets_| mode. We'll
     // drop data until the garbage chunk has been filled once and then retry.
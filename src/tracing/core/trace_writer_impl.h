@@ -119,6 +119,11 @@ class TraceWriterImpl : public TraceWriter,
   // The chunk we are holding onto (if any).
   SharedMemoryABI::Chunk cur_chunk_;
 
+  // The SMB page where GetNewChunk() starts looking for the next chunk: the
+  // page of the previous chunk or, initially, one derived from |id_|, so that
+  // writers on different threads don't compete for the same chunks.
+  size_t chunk_page_hint_;
+
   // Passed to protozero message to write directly into |cur_chunk_|. It
   // keeps track of the write pointer. It calls us back (GetNewBuffer()) when
   // |cur_chunk_| is filled.
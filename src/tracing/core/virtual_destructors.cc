@@ -40,5 +40,6 @@ SharedMemoryArbiter::~SharedMemoryArbiter() = default;
 
 // TODO(primiano): make pure virtual after various 3way patches.
 void Consumer::OnSessionCloned(const OnSessionClonedArgs&) {}
+void SharedMemoryArbiter::SetAdaptiveBatchCommits(bool) {}
 
 }  // namespace perfetto
@@ -86,8 +86,11 @@ SystemConsumerTracingBackend::SystemConsumerTracingBackend() {}
 std::unique_ptr<ConsumerEndpoint> SystemConsumerTracingBackend::ConnectConsumer(
     const ConnectConsumerArgs& args) {
 #if PERFETTO_BUILDFLAG(PERFETTO_SYSTEM_CONSUMER)
+  // TracingMuxerImpl copies the trace data synchronously in OnTraceData(): no
+  // need to copy it out of the IPC receive buffer first.
   auto endpoint = ConsumerIPCClient::Connect(GetConsumerSocket(), args.consumer,
-                                             args.task_runner);
+                                             args.task_runner,
+                                             /*read_buffers_shm_size=*/0);
   PERFETTO_CHECK(endpoint);
   return endpoint;
 #else
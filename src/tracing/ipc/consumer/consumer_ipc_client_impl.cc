@@ -21,19 +21,40 @@
 #include <cinttypes>
 
 #include "perfetto/base/task_runner.h"
+#include "perfetto/ext/base/unix_socket.h"
 #include "perfetto/ext/ipc/client.h"
 #include "perfetto/ext/tracing/core/consumer.h"
 #include "perfetto/ext/tracing/core/observable_events.h"
 #include "perfetto/ext/tracing/core/trace_stats.h"
+#include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/tracing/core/trace_config.h"
 #include "perfetto/tracing/core/tracing_service_state.h"
 
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+#include "src/tracing/ipc/posix_shared_memory.h"
+#endif
+
 // TODO(fmayer): Add a test to check to what happens when ConsumerIPCClientImpl
 // gets destroyed w.r.t. the Consumer pointer. Also think to lifetime of the
 // Consumer* during the callbacks.
 
 namespace perfetto {
 
+namespace {
+
+using ReadBuffersResponse = protos::gen::ReadBuffersResponse;
+
+// The ReadBuffers() responses are decoded in place, in the IPC receive buffer.
+using ReadBuffersResponseDecoder =
+    protozero::TypedProtoDecoder<ReadBuffersResponse::kSlicesFieldNumber,
+                                 /*HAS_NONPACKED_REPEATED_FIELDS=*/true>;
+using ReadBuffersSliceDecoder = protozero::TypedProtoDecoder<
+    ReadBuffersResponse::Slice::kShmSizeFieldNumber,
+    false>;
+
+}  // namespace
+
 // static. (Declared in include/tracing/ipc/consumer_ipc_client.h).
 std::unique_ptr<TracingService::ConsumerEndpoint> ConsumerIPCClient::Connect(
     const char* service_sock_name,
@@ -43,16 +64,39 @@ std::unique_ptr<TracingService::ConsumerEndpoint> ConsumerIPCClient::Connect(
       new ConsumerIPCClientImpl(service_sock_name, consumer, task_runner));
 }
 
+// static. (Declared in include/tracing/ipc/consumer_ipc_client.h).
+std::unique_ptr<TracingService::ConsumerEndpoint> ConsumerIPCClient::Connect(
+    const char* service_sock_name,
+    Consumer* consumer,
+    base::TaskRunner* task_runner,
+    size_t read_buffers_shm_size) {
+  return std::unique_ptr<TracingService::ConsumerEndpoint>(
+      new ConsumerIPCClientImpl(service_sock_name, consumer, task_runner,
+                                /*borrow_trace_data_slices=*/true,
+                                read_buffers_shm_size));
+}
+
 ConsumerIPCClientImpl::ConsumerIPCClientImpl(const char* service_sock_name,
                                              Consumer* consumer,
-                                             base::TaskRunner* task_runner)
+                                             base::TaskRunner* task_runner,
+                                             bool borrow_trace_data_slices,
+                                             size_t read_buffers_shm_size)
     : consumer_(consumer),
       ipc_channel_(
           ipc::Client::CreateInstance({service_sock_name, /*sock_retry=*/false},
                                       task_runner)),
       consumer_port_(this /* event_listener */),
+      borrow_trace_data_slices_(borrow_trace_data_slices),
       weak_ptr_factory_(this) {
   ipc_channel_->BindService(consumer_port_.GetWeakPtr());
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  // The file descriptor of the ring can't be passed over TCP or vsock.
+  if (base::SockShmemSupported(service_sock_name))
+    read_buffers_shm_size_ = read_buffers_shm_size;
+#else
+  base::ignore_result(read_buffers_shm_size);
+#endif
 }
 
 ConsumerIPCClientImpl::~ConsumerIPCClientImpl() = default;
@@ -156,37 +200,128 @@ void ConsumerIPCClientImpl::ReadBuffers() {
     return;
   }
 
-  ipc::Deferred<protos::gen::ReadBuffersResponse> async_response;
+  protos::gen::ReadBuffersRequest req;
+  if (read_buffers_shm_size_) {
+    req.set_shm_size_bytes(read_buffers_shm_size_);
+    req.set_shm_mapped(!!read_buffers_ring_);
+  }
 
+  // The responses are not decoded into a ReadBuffersResponse, so that the
+  // slices can be passed to the consumer in place.
   // The IPC layer guarantees that callbacks are destroyed after this object
   // is destroyed (by virtue of destroying the |consumer_port_|). In turn the
   // contract of this class expects the caller to not destroy the Consumer class
   // before having destroyed this class. Hence binding |this| here is safe.
-  async_response.Bind(
-      [this](ipc::AsyncResult<protos::gen::ReadBuffersResponse> response) {
-        OnReadBuffersResponse(std::move(response));
+  consumer_port_.BeginInvokeRaw(
+      "ReadBuffers", req,
+      [this](bool success, protozero::ConstBytes response, bool has_more) {
+        OnReadBuffersResponse(success, response, has_more);
       });
-  consumer_port_.ReadBuffers(protos::gen::ReadBuffersRequest(),
-                             std::move(async_response));
 }
 
 void ConsumerIPCClientImpl::OnReadBuffersResponse(
-    ipc::AsyncResult<protos::gen::ReadBuffersResponse> response) {
-  if (!response) {
+    bool success,
+    protozero::ConstBytes response,
+    bool has_more) {
+  if (!success) {
     PERFETTO_DLOG("ReadBuffers() failed");
     return;
   }
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  // The service sends the file descriptor of the ring with the first response
+  // to each ReadBuffersRequest, until the ring is reported as mapped.
+  if (read_buffers_shm_size_ && !read_buffers_ring_) {
+    base::ScopedFile shm_fd = ipc_channel_->TakeReceivedFD();
+    if (shm_fd) {
+      std::unique_ptr<SharedMemory> shm =
+          PosixSharedMemory::AttachToFd(std::move(shm_fd));
+      if (shm && shm->size() > ReadBuffersRing::kHeaderSize)
+        read_buffers_ring_.reset(new ReadBuffersRing(std::move(shm)));
+    }
+  }
+#endif
+
+  // The slices received through the ring are passed to the consumer in place,
+  // and released only once the packets they belong to have been consumed.
+  // The ones received in-band are copied, unless the consumer opted in to
+  // borrowing them from the IPC receive buffer, where they are valid only
+  // until this function returns.
+  using ResponseSlice = ReadBuffersResponse::Slice;
+  ReadBuffersResponseDecoder decoder(response.data, response.size);
+  uint64_t release_offset = 0;
   std::vector<TracePacket> trace_packets;
-  for (auto& resp_slice : response->slices()) {
-    const std::string& slice_data = resp_slice.data();
-    Slice slice = Slice::Allocate(slice_data.size());
-    memcpy(slice.own_data(), slice_data.data(), slice.size);
-    partial_packet_.AddSlice(std::move(slice));
-    if (resp_slice.last_slice_for_packet())
-      trace_packets.emplace_back(std::move(partial_packet_));
+  for (auto it = decoder.GetRepeated<protozero::ConstBytes>(
+           ReadBuffersResponse::kSlicesFieldNumber);
+       it; ++it) {
+    protozero::ConstBytes slice_bytes = *it;
+    ReadBuffersSliceDecoder resp_slice(slice_bytes.data, slice_bytes.size);
+    if (auto shm_size = resp_slice.at<ResponseSlice::kShmSizeFieldNumber>()) {
+      const uint64_t shm_offset =
+          resp_slice.at<ResponseSlice::kShmOffsetFieldNumber>().as_uint64();
+      const size_t size = shm_size.as_uint32();
+      const void* data = read_buffers_ring_
+                             ? read_buffers_ring_->Read(shm_offset, size)
+                             : nullptr;
+      if (data) {
+        partial_packet_.emplace_back(data, size);
+        read_buffers_ring_end_ = shm_offset + size;
+      } else {
+        PERFETTO_ELOG("Invalid shared memory slice in ReadBuffers() response");
+        partial_packet_invalid_ = true;
+      }
+    } else {
+      protozero::ConstBytes data =
+          resp_slice.at<ResponseSlice::kDataFieldNumber>().as_bytes();
+      if (borrow_trace_data_slices_) {
+        partial_packet_.emplace_back(data.data, data.size);
+      } else {
+        Slice slice = Slice::Allocate(data.size);
+        memcpy(slice.own_data(), data.data, data.size);
+        partial_packet_.emplace_back(std::move(slice));
+      }
+    }
+    if (resp_slice.at<ResponseSlice::kLastSliceForPacketFieldNumber>()
+            .as_bool()) {
+      if (partial_packet_invalid_) {
+        partial_packet_invalid_ = false;
+      } else {
+        TracePacket packet;
+        for (Slice& slice : partial_packet_)
+          packet.AddSlice(std::move(slice));
+        trace_packets.emplace_back(std::move(packet));
+      }
+      partial_packet_.clear();
+      release_offset = read_buffers_ring_end_;
+    }
+  }
+
+  // The in-band slices of a packet that continues in the next response must
+  // outlive |response|: copy them.
+  if (!partial_packet_.empty()) {
+    Slices slices;
+    slices.reserve(partial_packet_.size());
+    for (Slice& slice : partial_packet_) {
+      const uint8_t* start = static_cast<const uint8_t*>(slice.start);
+      if (start >= response.data && start < response.data + response.size) {
+        Slice owned_slice = Slice::Allocate(slice.size);
+        memcpy(owned_slice.own_data(), slice.start, slice.size);
+        slices.emplace_back(std::move(owned_slice));
+      } else {
+        slices.emplace_back(std::move(slice));
+      }
+    }
+    partial_packet_ = std::move(slices);
+  }
+
+  if (!trace_packets.empty() || !has_more) {
+    auto weak_this = weak_ptr_factory_.GetWeakPtr();
+    consumer_->OnTraceData(std::move(trace_packets), has_more);
+    if (!weak_this)
+      return;
   }
-  if (!trace_packets.empty() || !response.has_more())
-    consumer_->OnTraceData(std::move(trace_packets), response.has_more());
+  if (read_buffers_ring_ && release_offset)
+    read_buffers_ring_->Release(release_offset);
 }
 
 void ConsumerIPCClientImpl::OnEnableTracingResponse(
@@ -20,6 +20,7 @@
 #include <stdint.h>
 
 #include <list>
+#include <memory>
 #include <vector>
 
 #include "perfetto/ext/base/scoped_file.h"
@@ -29,7 +30,9 @@
 #include "perfetto/ext/tracing/core/trace_packet.h"
 #include "perfetto/ext/tracing/core/tracing_service.h"
 #include "perfetto/ext/tracing/ipc/consumer_ipc_client.h"
+#include "perfetto/protozero/field.h"
 #include "perfetto/tracing/core/forward_decls.h"
+#include "src/tracing/ipc/read_buffers_ring.h"
 
 #include "protos/perfetto/ipc/consumer_port.ipc.h"
 
@@ -52,9 +55,13 @@ class Consumer;
 class ConsumerIPCClientImpl : public TracingService::ConsumerEndpoint,
                               public ipc::ServiceProxy::EventListener {
  public:
+  // See ConsumerIPCClient::Connect() for |borrow_trace_data_slices| and
+  // |read_buffers_shm_size|.
   ConsumerIPCClientImpl(const char* service_sock_name,
                         Consumer*,
-                        base::TaskRunner*);
+                        base::TaskRunner*,
+                        bool borrow_trace_data_slices = false,
+                        size_t read_buffers_shm_size = 0);
   ~ConsumerIPCClientImpl() override;
 
   // TracingService::ConsumerEndpoint implementation.
@@ -83,6 +90,10 @@ class ConsumerIPCClientImpl : public TracingService::ConsumerEndpoint,
   void OnConnect() override;
   void OnDisconnect() override;
 
+  // Whether the trace data of ReadBuffers() is being received through a shared
+  // memory ring.
+  bool HasReadBuffersRingForTesting() const { return !!read_buffers_ring_; }
+
  private:
   struct PendingQueryServiceRequest {
     QueryServiceStateCallback callback;
@@ -94,8 +105,9 @@ class ConsumerIPCClientImpl : public TracingService::ConsumerEndpoint,
   // List because we need stable iterators.
   using PendingQueryServiceRequests = std::list<PendingQueryServiceRequest>;
 
-  void OnReadBuffersResponse(
-      ipc::AsyncResult<protos::gen::ReadBuffersResponse>);
+  void OnReadBuffersResponse(bool success,
+                             protozero::ConstBytes response,
+                             bool has_more);
   void OnEnableTracingResponse(
       ipc::AsyncResult<protos::gen::EnableTracingResponse>);
   void OnQueryServiceStateResponse(
@@ -120,8 +132,28 @@ class ConsumerIPCClientImpl : public TracingService::ConsumerEndpoint,
   // will chunk it into several IPCs, each containing few slices of the packet
   // (a packet's slice is always guaranteed to be << kIPCBufferSize). When
   // chunking happens this field accumulates the slices received until the
-  // one with |last_slice_for_packet| == true is received.
-  TracePacket partial_packet_;
+  // one with |last_slice_for_packet| == true is received. The slices are
+  // owned, except the ones that point into the shared memory ring.
+  Slices partial_packet_;
+
+  // Whether the slices passed to Consumer::OnTraceData() can point into the
+  // IPC receive buffer rather than being copied.
+  bool borrow_trace_data_slices_ = false;
+
+  // Set when a slice of |partial_packet_| could not be read from the shared
+  // memory ring. The packet is dropped once its last slice is received.
+  bool partial_packet_invalid_ = false;
+
+  // The size of the shared memory ring to request in ReadBuffers(), or 0 if
+  // the trace data is received through the socket.
+  size_t read_buffers_shm_size_ = 0;
+
+  // The shared memory ring the service writes the trace data of ReadBuffers()
+  // into, received with the first ReadBuffersResponse.
+  std::unique_ptr<ReadBuffersRing> read_buffers_ring_;
+
+  // The end of the last slice received through |read_buffers_ring_|.
+  uint64_t read_buffers_ring_end_ = 0;
 
   // Keep last.
   base::WeakPtrFactory<ConsumerIPCClientImpl> weak_ptr_factory_;
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/ipc/read_buffers_ring.h"
+
+#include <string.h>
+
+#include <cinttypes>
+#include <utility>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+
+ReadBuffersRing::ReadBuffersRing(std::unique_ptr<SharedMemory> shmem)
+    : shmem_(std::move(shmem)),
+      data_(reinterpret_cast<uint8_t*>(shmem_->start()) + kHeaderSize),
+      data_size_(shmem_->size() - kHeaderSize) {
+  PERFETTO_CHECK(shmem_->size() > kHeaderSize);
+  static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                "The read offset must be lock free to be shared");
+}
+
+ReadBuffersRing::~ReadBuffersRing() = default;
+
+bool ReadBuffersRing::Write(const void* data, size_t size, uint64_t* offset) {
+  if (size == 0 || size > data_size_)
+    return false;
+
+  uint64_t read_offset = header()->read_offset.load(std::memory_order_acquire);
+  if (read_offset > write_offset_ || write_offset_ - read_offset > data_size_) {
+    PERFETTO_DLOG("Invalid read offset %" PRIu64 " in the ReadBuffers ring",
+                  read_offset);
+    return false;
+  }
+
+  uint64_t start = write_offset_;
+  size_t pos = static_cast<size_t>(start % data_size_);
+  if (pos + size > data_size_)
+    start += data_size_ - pos;  // Skip to the beginning of the data area.
+  if (start + size - read_offset > data_size_)
+    return false;
+
+  memcpy(data_ + start % data_size_, data, size);
+  write_offset_ = start + size;
+  *offset = start;
+  return true;
+}
+
+const void* ReadBuffersRing::Read(uint64_t offset, size_t size) const {
+  size_t pos = static_cast<size_t>(offset % data_size_);
+  if (size == 0 || size > data_size_ - pos)
+    return nullptr;
+  return data_ + pos;
+}
+
+void ReadBuffersRing::Release(uint64_t offset) {
+  header()->read_offset.store(offset, std::memory_order_release);
+}
+
+}  // namespace perfetto
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACING_IPC_READ_BUFFERS_RING_H_
+#define SRC_TRACING_IPC_READ_BUFFERS_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+#include "perfetto/ext/tracing/core/shared_memory.h"
+
+namespace perfetto {
+
+// A ring buffer in shared memory used to return the trace data of
+// ReadBuffers() to a consumer without sending it through the IPC socket.
+//
+// The service copies the slices of the trace packets into the ring and sends
+// only their offsets in the ReadBuffersResponse. The consumer passes the slices
+// to the Consumer in place and, once OnTraceData() returns, releases them by
+// advancing the read offset stored in the header of the ring. When the ring
+// doesn't have enough free space (i.e. the consumer is slower than the
+// service), the service falls back to sending the slices through the socket.
+//
+// Offsets grow monotonically and are mapped into the data area modulo its size.
+// A slice is never split across the end of the data area: if it doesn't fit
+// there, the remaining bytes are skipped and the slice is written at the
+// beginning of the data area.
+//
+// The service doesn't trust the consumer: the only thing it reads from the
+// shared memory is the read offset, which is validated before use.
+class ReadBuffersRing {
+ public:
+  // The layout of the first kHeaderSize bytes of the shared memory. The rest is
+  // the data area.
+  struct Header {
+    // All the data before this offset has been released by the consumer and
+    // can be overwritten by the service. Written only by the consumer.
+    std::atomic<uint64_t> read_offset;
+  };
+  static constexpr size_t kHeaderSize = 64;
+  static_assert(sizeof(Header) <= kHeaderSize, "Header too big");
+
+  // |shmem| must be bigger than kHeaderSize and zero-initialized.
+  explicit ReadBuffersRing(std::unique_ptr<SharedMemory> shmem);
+  ~ReadBuffersRing();
+
+  // Service side. Copies the |size| bytes at |data| into the ring and stores
+  // their offset in |offset|. Returns false, without copying anything, if the
+  // ring doesn't have |size| contiguous bytes of free space or if the consumer
+  // corrupted the read offset.
+  bool Write(const void* data, size_t size, uint64_t* offset);
+
+  // Consumer side. Returns the |size| bytes at |offset|, or nullptr if the
+  // range is not within the data area.
+  const void* Read(uint64_t offset, size_t size) const;
+
+  // Consumer side. Releases all the data before |offset|.
+  void Release(uint64_t offset);
+
+  SharedMemory* shared_memory() const { return shmem_.get(); }
+  size_t data_size() const { return data_size_; }
+
+ private:
+  ReadBuffersRing(const ReadBuffersRing&) = delete;
+  ReadBuffersRing& operator=(const ReadBuffersRing&) = delete;
+
+  Header* header() const { return reinterpret_cast<Header*>(shmem_->start()); }
+
+  std::unique_ptr<SharedMemory> shmem_;
+  uint8_t* const data_;
+  const size_t data_size_;
+
+  // The offset of the next Write(). Used only on the service side.
+  uint64_t write_offset_ = 0;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACING_IPC_READ_BUFFERS_RING_H_
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/ipc/read_buffers_ring.h"
+
+#include <string.h>
+
+#include <string>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/utils.h"
+#include "src/tracing/core/in_process_shared_memory.h"
+#include "test/gtest_and_gmock.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+#include <unistd.h>
+
+#include "perfetto/ext/base/scoped_file.h"
+#include "src/tracing/ipc/posix_shared_memory.h"
+#endif
+
+namespace perfetto {
+namespace {
+
+constexpr size_t kDataSize = 1024;
+
+std::unique_ptr<ReadBuffersRing> CreateRing() {
+  return std::unique_ptr<ReadBuffersRing>(new ReadBuffersRing(
+      InProcessSharedMemory::Create(ReadBuffersRing::kHeaderSize + kDataSize)));
+}
+
+std::string ReadString(const ReadBuffersRing& ring,
+                       uint64_t offset,
+                       size_t size) {
+  const void* data = ring.Read(offset, size);
+  if (!data)
+    return "";
+  return std::string(reinterpret_cast<const char*>(data), size);
+}
+
+TEST(ReadBuffersRingTest, WriteAndRead) {
+  auto ring = CreateRing();
+  ASSERT_EQ(ring->data_size(), kDataSize);
+
+  uint64_t offset1 = 0;
+  uint64_t offset2 = 0;
+  ASSERT_TRUE(ring->Write("foo", 3, &offset1));
+  ASSERT_TRUE(ring->Write("barbaz", 6, &offset2));
+  EXPECT_EQ(offset1, 0u);
+  EXPECT_EQ(offset2, 3u);
+  EXPECT_EQ(ReadString(*ring, offset1, 3), "foo");
+  EXPECT_EQ(ReadString(*ring, offset2, 6), "barbaz");
+}
+
+TEST(ReadBuffersRingTest, FullUntilReleased) {
+  auto ring = CreateRing();
+  std::string data(kDataSize / 2, 'a');
+
+  uint64_t offset = 0;
+  ASSERT_TRUE(ring->Write(data.data(), data.size(), &offset));
+  ASSERT_TRUE(ring->Write(data.data(), data.size(), &offset));
+  EXPECT_FALSE(ring->Write("x", 1, &offset));
+
+  // Releasing the first half makes room for it only.
+  ring->Release(kDataSize / 2);
+  std::string data2(kDataSize / 2, 'b');
+  ASSERT_TRUE(ring->Write(data2.data(), data2.size(), &offset));
+  EXPECT_EQ(offset, kDataSize);
+  EXPECT_EQ(ReadString(*ring, offset, data2.size()), data2);
+  EXPECT_FALSE(ring->Write("x", 1, &offset));
+}
+
+TEST(ReadBuffersRingTest, SlicesAreNotSplitAtTheEnd) {
+  auto ring = CreateRing();
+  std::string data(kDataSize - 10, 'a');
+
+  uint64_t offset = 0;
+  ASSERT_TRUE(ring->Write(data.data(), data.size(), &offset));
+  ring->Release(offset + data.size());
+
+  // The slice doesn't fit in the last 10 bytes of the data area: it's written
+  // at the beginning instead.
+  std::string data2(20, 'b');
+  ASSERT_TRUE(ring->Write(data2.data(), data2.size(), &offset));
+  EXPECT_EQ(offset, kDataSize);
+  EXPECT_EQ(ReadString(*ring, offset, data2.size()), data2);
+
+  // Too big for the contiguous free space, even if the total free space would
+  // be enough.
+  std::string data3(kDataSize - 20, 'c');
+  EXPECT_FALSE(ring->Write(data3.data(), data3.size(), &offset));
+}
+
+TEST(ReadBuffersRingTest, RejectsInvalidRanges) {
+  auto ring = CreateRing();
+  uint64_t offset = 0;
+  std::string too_big(kDataSize + 1, 'a');
+  EXPECT_FALSE(ring->Write(too_big.data(), too_big.size(), &offset));
+  EXPECT_EQ(ring->Read(kDataSize - 4, 8), nullptr);
+  EXPECT_EQ(ring->Read(0, kDataSize + 1), nullptr);
+  EXPECT_NE(ring->Read(kDataSize - 4, 4), nullptr);
+}
+
+TEST(ReadBuffersRingTest, CorruptedReadOffset) {
+  auto ring = CreateRing();
+  uint64_t offset = 0;
+  ASSERT_TRUE(ring->Write("foo", 3, &offset));
+
+  // A read offset past the data written by the service is ignored.
+  ring->Release(100);
+  EXPECT_FALSE(ring->Write("bar", 3, &offset));
+  ring->Release(3);
+  EXPECT_TRUE(ring->Write("bar", 3, &offset));
+}
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+TEST(ReadBuffersRingTest, SharedBetweenMappings) {
+  auto service_shm = PosixSharedMemory::Create(base::GetSysPageSize());
+  base::ScopedFile fd(dup(service_shm->fd()));
+  ReadBuffersRing service_ring(std::move(service_shm));
+  ReadBuffersRing consumer_ring(PosixSharedMemory::AttachToFd(std::move(fd)));
+
+  std::string data(service_ring.data_size(), 'a');
+  uint64_t offset = 0;
+  ASSERT_TRUE(service_ring.Write(data.data(), data.size(), &offset));
+  EXPECT_EQ(ReadString(consumer_ring, offset, data.size()), data);
+  EXPECT_FALSE(service_ring.Write("x", 1, &offset));
+
+  consumer_ring.Release(offset + data.size());
+  ASSERT_TRUE(service_ring.Write("x", 1, &offset));
+  EXPECT_EQ(ReadString(consumer_ring, offset, 1), "x");
+}
+#endif
+
+}  // namespace
+}  // namespace perfetto
@@ -16,11 +16,13 @@
 
 #include "src/tracing/ipc/service/consumer_ipc_service.h"
 
+#include <algorithm>
 #include <cinttypes>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/base/task_runner.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/ipc/basic_types.h"
 #include "perfetto/ext/ipc/host.h"
 #include "perfetto/ext/tracing/core/shared_memory_abi.h"
@@ -32,6 +34,12 @@
 #include "perfetto/tracing/core/tracing_service_capabilities.h"
 #include "perfetto/tracing/core/tracing_service_state.h"
 
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+#include "src/tracing/ipc/memfd.h"
+#include "src/tracing/ipc/posix_shared_memory.h"
+#endif
+
 namespace perfetto {
 
 ConsumerIPCService::ConsumerIPCService(TracingService* core_service)
@@ -105,9 +113,21 @@ void ConsumerIPCService::DisableTracing(
 }
 
 // Called by the IPC layer.
-void ConsumerIPCService::ReadBuffers(const protos::gen::ReadBuffersRequest&,
-                                     DeferredReadBuffersResponse resp) {
+void ConsumerIPCService::ReadBuffers(
+    const protos::gen::ReadBuffersRequest& req,
+    DeferredReadBuffersResponse resp) {
   RemoteConsumer* remote_consumer = GetConsumerForCurrentRequest();
+  // The ring is useless if its file descriptor can't be passed to the
+  // consumer, e.g. over TCP.
+  if (req.shm_size_bytes() && !use_shmem_emulation() &&
+      !remote_consumer->read_buffers_ring) {
+    remote_consumer->CreateReadBuffersRing(req.shm_size_bytes());
+  }
+  // Until the consumer confirms it has mapped the ring, its file descriptor is
+  // sent again with each request and the data is kept inline.
+  remote_consumer->read_buffers_ring_mapped =
+      remote_consumer->read_buffers_ring && req.shm_mapped();
+  remote_consumer->read_buffers_ring_fd_sent = false;
   remote_consumer->read_buffers_response = std::move(resp);
   remote_consumer->service_endpoint->ReadBuffers();
 }
@@ -381,6 +401,24 @@ void ConsumerIPCService::RemoteConsumer::OnTracingDisabled(
   }
 }
 
+void ConsumerIPCService::RemoteConsumer::CreateReadBuffersRing(
+    uint64_t requested_size) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  // Without memfd the file can't be sealed, and the consumer could shrink it
+  // causing a SIGBUS in the service when writing into the ring.
+  if (!HasMemfdSupport())
+    return;
+  constexpr uint64_t kMinSize = 64 * 1024;
+  constexpr uint64_t kMaxSize = 32 * 1024 * 1024;
+  uint64_t size = std::min(std::max(requested_size, kMinSize), kMaxSize);
+  read_buffers_ring.reset(new ReadBuffersRing(PosixSharedMemory::Create(
+      base::AlignUp(static_cast<size_t>(size), base::GetSysPageSize()))));
+#else
+  base::ignore_result(requested_size);
+#endif
+}
+
 void ConsumerIPCService::RemoteConsumer::OnTraceData(
     std::vector<TracePacket> trace_packets,
     bool has_more) {
@@ -400,6 +438,16 @@ void ConsumerIPCService::RemoteConsumer::OnTraceData(
 
   auto send_ipc_reply = [this, &result](bool more) {
     result.set_has_more(more);
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+    if (read_buffers_ring && !read_buffers_ring_mapped &&
+        !read_buffers_ring_fd_sent) {
+      result.set_fd(
+          static_cast<PosixSharedMemory*>(read_buffers_ring->shared_memory())
+              ->fd());
+      read_buffers_ring_fd_sent = true;
+    }
+#endif
     read_buffers_response.Resolve(std::move(result));
     result = ipc::AsyncResult<protos::gen::ReadBuffersResponse>::Create();
   };
@@ -416,7 +464,13 @@ void ConsumerIPCService::RemoteConsumer::OnTraceData(
       // 64: the overhead of the IPC InvokeMethodReply + wire_protocol's frame.
       // If these estimations are wrong, BufferedFrameDeserializer::Serialize()
       // will hit a DCHECK anyways.
-      const size_t approx_slice_size = slice.size + 16;
+      // When the slice goes through the shared memory ring, only its offset
+      // is sent in the IPC.
+      uint64_t shm_offset = 0;
+      const bool in_shm =
+          read_buffers_ring_mapped &&
+          read_buffers_ring->Write(slice.start, slice.size, &shm_offset);
+      const size_t approx_slice_size = (in_shm ? 0 : slice.size) + 16;
       if (approx_reply_size + approx_slice_size > ipc::kIPCBufferSize - 64) {
         // If we hit this CHECK we got a single slice that is > kIPCBufferSize.
         PERFETTO_CHECK(result->slices_size() > 0);
@@ -427,7 +481,12 @@ void ConsumerIPCService::RemoteConsumer::OnTraceData(
 
       auto* res_slice = result->add_slices();
       res_slice->set_last_slice_for_packet(--num_slices_left_for_packet == 0);
-      res_slice->set_data(slice.start, slice.size);
+      if (in_shm) {
+        res_slice->set_shm_offset(shm_offset);
+        res_slice->set_shm_size(static_cast<uint32_t>(slice.size));
+      } else {
+        res_slice->set_data(slice.start, slice.size);
+      }
     }
   }
   send_ipc_reply(has_more);
@@ -27,6 +27,8 @@
 #include "perfetto/ext/tracing/core/consumer.h"
 #include "perfetto/ext/tracing/core/tracing_service.h"
 #include "perfetto/tracing/core/forward_decls.h"
+#include "src/tracing/ipc/read_buffers_ring.h"
+
 #include "protos/perfetto/ipc/consumer_port.ipc.h"
 
 namespace perfetto {
@@ -98,6 +100,10 @@ class ConsumerIPCService : public protos::gen::ConsumerPort {
 
     void CloseObserveEventsResponseStream();
 
+    // Creates |read_buffers_ring|, if supported on this platform. See
+    // ReadBuffersRequest.shm_size_bytes.
+    void CreateReadBuffersRing(uint64_t requested_size);
+
     // The interface obtained from the core service business logic through
     // TracingService::ConnectConsumer(this). This allows to invoke methods for
     // a specific Consumer on the Service business logic.
@@ -107,6 +113,15 @@ class ConsumerIPCService : public protos::gen::ConsumerPort {
     // allows to stream trace packets back to the client.
     DeferredReadBuffersResponse read_buffers_response;
 
+    // The shared memory ring the trace data is returned through, if requested
+    // by the consumer. Until the consumer reports it has mapped the ring
+    // (|read_buffers_ring_mapped|), its file descriptor is sent with the first
+    // response of each ReadBuffers() call (|read_buffers_ring_fd_sent|) and
+    // the data is returned inline.
+    std::unique_ptr<ReadBuffersRing> read_buffers_ring;
+    bool read_buffers_ring_mapped = false;
+    bool read_buffers_ring_fd_sent = false;
+
     // After EnableTracing() is invoked, this binds the async callback that
     // allows to send the OnTracingDisabled notification.
     DeferredEnableTracingResponse enable_tracing_response;
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/tracing/core/trace_packet.h"
+#include "src/base/test/utils.h"
+#include "src/tracing/service/tracing_service_impl.h"
+#include "src/tracing/service/zlib_compressor.h"
+#include "src/tracing/service/zstd_compressor.h"
+
+#include "protos/perfetto/trace/trace.pbzero.h"
+
+namespace perfetto {
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Splits a recorded trace into chunks of packets of roughly the size that
+// ReadBuffersIntoFile() hands to the compressor on each iteration.
+std::vector<std::vector<std::string>> LoadTraceChunks(benchmark::State& state,
+                                                      size_t* total_size) {
+  std::string trace;
+  std::string path =
+      base::GetTestDataPath("test/data/example_android_trace_30s.pb");
+  if (!base::ReadFile(path, &trace)) {
+    state.SkipWithError("Trace does not exist");
+    return {};
+  }
+
+  std::vector<std::vector<std::string>> chunks(1);
+  size_t chunk_size = 0;
+  *total_size = 0;
+  protos::pbzero::Trace::Decoder decoder(trace);
+  for (auto it = decoder.packet(); it; ++it) {
+    chunks.back().emplace_back(reinterpret_cast<const char*>(it->data()),
+                               it->size());
+    chunk_size += it->size();
+    *total_size += it->size();
+    if (chunk_size >= TracingServiceImpl::kWriteIntoFileChunkSize) {
+      chunks.emplace_back();
+      chunk_size = 0;
+    }
+    if (IsBenchmarkFunctionalOnly() && chunks.size() > 2)
+      break;
+  }
+  return chunks;
+}
+
+std::vector<TracePacket> ToTracePackets(const std::vector<std::string>& chunk) {
+  std::vector<TracePacket> packets;
+  packets.reserve(chunk.size());
+  for (const std::string& data : chunk) {
+    TracePacket packet;
+    packet.AddSlice(data.data(), data.size());
+    packets.emplace_back(std::move(packet));
+  }
+  return packets;
+}
+
+template <void (*CompressFn)(std::vector<TracePacket>*)>
+void BM_CompressTrace(benchmark::State& state) {
+  size_t total_size = 0;
+  std::vector<std::vector<std::string>> chunks =
+      LoadTraceChunks(state, &total_size);
+  size_t compressed_size = 0;
+  for (auto _ : state) {
+    compressed_size = 0;
+    for (const auto& chunk : chunks) {
+      std::vector<TracePacket> packets = ToTracePackets(chunk);
+      CompressFn(&packets);
+      for (const TracePacket& packet : packets)
+        compressed_size += packet.size();
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(total_size));
+  state.counters["ratio"] = benchmark::Counter(
+      compressed_size ? static_cast<double>(total_size) /
+                            static_cast<double>(compressed_size)
+                      : 0);
+}
+
+void BM_CompressTraceZlib(benchmark::State& state) {
+  BM_CompressTrace<&ZlibCompressFn>(state);
+}
+
+void BM_CompressTraceZstd(benchmark::State& state) {
+  BM_CompressTrace<&ZstdCompressFn>(state);
+}
+
+}  // namespace
+}  // namespace perfetto
+
+BENCHMARK(perfetto::BM_CompressTraceZlib)->Unit(benchmark::kMillisecond);
+BENCHMARK(perfetto::BM_CompressTraceZstd)->Unit(benchmark::kMillisecond);
@@ -16,6 +16,7 @@
 
 #include "src/tracing/service/trace_buffer.h"
 
+#include <algorithm>
 #include <limits>
 
 #include "perfetto/base/logging.h"
@@ -80,9 +81,10 @@ bool TraceBuffer::Initialize(size_t size) {
   stats_.set_buffer_size(size);
   max_chunk_size_ = std::min(size, ChunkRecord::kMaxSize);
   wptr_ = begin();
-  index_.clear();
-  last_chunk_id_written_.clear();
-  read_iter_ = GetReadIterForSequence(index_.end());
+  index_.Clear();
+  sorted_sequences_.clear();
+  sorted_sequences_stale_ = false;
+  read_iter_ = SequenceIterator();
   return true;
 }
 
@@ -138,15 +140,17 @@ void TraceBuffer::CopyChunkUntrusted(
   record.num_fragments = num_fragments;
   record.flags = chunk_flags & ChunkRecord::kFlagsBitMask;
   ChunkMeta::Key key(record);
+  const ProducerAndWriterID producer_and_writer_id =
+      MkProducerAndWriterID(producer_id_trusted, writer_id);
 
   // Check whether we have already copied the same chunk previously. This may
   // happen if the service scrapes chunks in a potentially incomplete state
   // before receiving commit requests for them from the producer. Note that the
   // service may scrape and thus override chunks in arbitrary order since the
   // chunks aren't ordered in the SMB.
-  const auto it = index_.find(key);
-  if (PERFETTO_UNLIKELY(it != index_.end())) {
-    ChunkMeta* record_meta = &it->second;
+  ChunkSequence* sequence = index_.Find(producer_and_writer_id);
+  ChunkMeta* record_meta = sequence ? sequence->Find(chunk_id) : nullptr;
+  if (PERFETTO_UNLIKELY(record_meta)) {
     ChunkRecord* prev = GetChunkRecordAt(begin() + record_meta->record_off);
 
     // Verify that the old chunk's metadata corresponds to the new one.
@@ -178,13 +182,11 @@ void TraceBuffer::CopyChunkUntrusted(
     // chunk N after having read from chunk N+1, thereby violating sequential
     // read of packets. This shouldn't happen if the producer is well-behaved,
     // because it shouldn't start chunk N+1 before completing chunk N.
-    ChunkMeta::Key subsequent_key = key;
     static_assert(std::numeric_limits<ChunkID>::max() == kMaxChunkID,
                   "ChunkID wraps");
-    subsequent_key.chunk_id++;
-    const auto subsequent_it = index_.find(subsequent_key);
-    if (subsequent_it != index_.end() &&
-        subsequent_it->second.num_fragments_read > 0) {
+    const ChunkMeta* subsequent_meta =
+        sequence->Find(static_cast<ChunkID>(chunk_id + 1));
+    if (subsequent_meta && subsequent_meta->num_fragments_read > 0) {
       stats_.set_abi_violations(stats_.abi_violations() + 1);
       PERFETTO_DCHECK(suppress_client_dchecks_for_testing_);
       return;
@@ -264,10 +266,13 @@ void TraceBuffer::CopyChunkUntrusted(
   stats_.set_bytes_written(stats_.bytes_written() + record_size);
 
   uint32_t chunk_off = GetOffset(GetChunkRecordAt(wptr_));
-  auto it_and_inserted =
-      index_.emplace(key, ChunkMeta(chunk_off, num_fragments, chunk_complete,
-                                    chunk_flags, client_identity_trusted));
-  PERFETTO_DCHECK(it_and_inserted.second);
+  auto seq_and_inserted =
+      index_.Insert(producer_and_writer_id, ChunkSequence());
+  sequence = seq_and_inserted.first;
+  sorted_sequences_stale_ |= seq_and_inserted.second;
+  sequence->Insert(ChunkMeta(chunk_id, chunk_off, num_fragments,
+                             chunk_complete, chunk_flags,
+                             client_identity_trusted));
   TRACE_BUFFER_DLOG("  copying @ [%" PRIdPTR " - %" PRIdPTR "] %zu", wptr_ - begin(),
                     uintptr_t(wptr_ - begin()) + record_size, record_size);
   WriteChunkRecord(wptr_, record, src, size);
@@ -292,8 +297,7 @@ void TraceBuffer::CopyChunkUntrusted(
   // last_chunk_id shouldn't be updated even though it's larger (e.g. |chunk_id|
   // = kMaxChunkId and |last_chunk_id| = 1; chunk_id - last_chunk_id =
   // kMaxChunkId - 1).
-  auto producer_and_writer_id = std::make_pair(producer_id_trusted, writer_id);
-  ChunkID& last_chunk_id = last_chunk_id_written_[producer_and_writer_id];
+  ChunkID& last_chunk_id = sequence->last_chunk_id_written;
   static_assert(std::numeric_limits<ChunkID>::max() == kMaxChunkID,
                 "This code assumes that ChunkID wraps at kMaxChunkID");
   if (chunk_id - last_chunk_id < kMaxChunkID / 2) {
@@ -318,7 +322,7 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
   TRACE_BUFFER_DLOG("Delete [%zu %zu]", wptr_ - begin(), search_end - begin());
   DcheckIsAlignedAndWithinBounds(wptr_);
   PERFETTO_DCHECK(search_end <= end());
-  std::vector<ChunkMap::iterator> index_delete;
+  std::vector<std::pair<ChunkSequence*, ChunkID>> index_delete;
   uint64_t chunks_overwritten = stats_.chunks_overwritten();
   uint64_t bytes_overwritten = stats_.bytes_overwritten();
   uint64_t padding_bytes_cleared = stats_.padding_bytes_cleared();
@@ -344,17 +348,20 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
     // records are not part of the index).
     if (PERFETTO_LIKELY(!next_chunk.is_padding)) {
       ChunkMeta::Key key(next_chunk);
-      auto it = index_.find(key);
+      ChunkSequence* sequence = index_.Find(
+          MkProducerAndWriterID(key.producer_id, key.writer_id));
+      const ChunkMeta* meta =
+          sequence ? sequence->Find(key.chunk_id) : nullptr;
       bool will_remove = false;
-      if (PERFETTO_LIKELY(it != index_.end())) {
-        const ChunkMeta& meta = it->second;
-        if (PERFETTO_UNLIKELY(meta.num_fragments_read < meta.num_fragments)) {
+      if (PERFETTO_LIKELY(meta)) {
+        if (PERFETTO_UNLIKELY(meta->num_fragments_read <
+                              meta->num_fragments)) {
           if (overwrite_policy_ == kDiscard)
             return -1;
           chunks_overwritten++;
           bytes_overwritten += next_chunk.size;
         }
-        index_delete.push_back(it);
+        index_delete.emplace_back(sequence, key.chunk_id);
         will_remove = true;
       }
       TRACE_BUFFER_DLOG(
@@ -377,8 +384,8 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
   }
 
   // Remove from the index.
-  for (auto it : index_delete) {
-    index_.erase(it);
+  for (const auto& seq_and_chunk_id : index_delete) {
+    seq_and_chunk_id.first->Erase(seq_and_chunk_id.second);
   }
   stats_.set_chunks_overwritten(chunks_overwritten);
   stats_.set_bytes_overwritten(bytes_overwritten);
@@ -407,12 +414,14 @@ bool TraceBuffer::TryPatchChunkContents(ProducerID producer_id,
                                         bool other_patches_pending) {
   PERFETTO_CHECK(!read_only_);
   ChunkMeta::Key key(producer_id, writer_id, chunk_id);
-  auto it = index_.find(key);
-  if (it == index_.end()) {
+  ChunkSequence* sequence =
+      index_.Find(MkProducerAndWriterID(producer_id, writer_id));
+  ChunkMeta* chunk_meta_ptr = sequence ? sequence->Find(chunk_id) : nullptr;
+  if (!chunk_meta_ptr) {
     stats_.set_patches_failed(stats_.patches_failed() + 1);
     return false;
   }
-  ChunkMeta& chunk_meta = it->second;
+  ChunkMeta& chunk_meta = *chunk_meta_ptr;
 
   // Check that the index is consistent with the actual ProducerID/WriterID
   // stored in the ChunkRecord.
@@ -459,49 +468,55 @@ bool TraceBuffer::TryPatchChunkContents(ProducerID producer_id,
 }
 
 void TraceBuffer::BeginRead() {
-  read_iter_ = GetReadIterForSequence(index_.begin());
+  SortSequencesIfNeeded();
+  read_iter_ = GetReadIterForSequence(0);
 #if PERFETTO_DCHECK_IS_ON()
   changed_since_last_read_ = false;
 #endif
 }
 
+void TraceBuffer::SortSequencesIfNeeded() {
+  if (!sorted_sequences_stale_)
+    return;
+  sorted_sequences_.clear();
+  sorted_sequences_.reserve(index_.size());
+  for (auto it = index_.GetIterator(); it; ++it)
+    sorted_sequences_.emplace_back(it.key(), &it.value());
+  // ProducerAndWriterID sorts by ProducerID first, then by WriterID.
+  std::sort(sorted_sequences_.begin(), sorted_sequences_.end(),
+            [](const std::pair<ProducerAndWriterID, ChunkSequence*>& a,
+               const std::pair<ProducerAndWriterID, ChunkSequence*>& b) {
+              return a.first < b.first;
+            });
+  sorted_sequences_stale_ = false;
+}
+
 TraceBuffer::SequenceIterator TraceBuffer::GetReadIterForSequence(
-    ChunkMap::iterator seq_begin) {
+    size_t seq_pos) {
+  PERFETTO_DCHECK(!sorted_sequences_stale_);
   SequenceIterator iter;
-  iter.seq_begin = seq_begin;
-  if (seq_begin == index_.end()) {
-    iter.cur = iter.seq_end = index_.end();
-    return iter;
-  }
-
-#if PERFETTO_DCHECK_IS_ON()
-  // Either |seq_begin| is == index_.begin() or the item immediately before must
-  // belong to a different {ProducerID, WriterID} sequence.
-  if (seq_begin != index_.begin() && seq_begin != index_.end()) {
-    auto prev_it = seq_begin;
-    prev_it--;
-    PERFETTO_DCHECK(
-        seq_begin == index_.begin() ||
-        std::tie(prev_it->first.producer_id, prev_it->first.writer_id) <
-            std::tie(seq_begin->first.producer_id, seq_begin->first.writer_id));
+  // Skip the sequences whose chunks have all been overwritten.
+  for (; seq_pos < sorted_sequences_.size(); seq_pos++) {
+    if (!sorted_sequences_[seq_pos].second->empty())
+      break;
   }
-#endif
+  iter.seq_pos = seq_pos;
+  if (seq_pos == sorted_sequences_.size())
+    return iter;
 
-  // Find the first entry that has a greater {ProducerID, WriterID} (or just
-  // index_.end() if we reached the end).
-  ChunkMeta::Key key = seq_begin->first;  // Deliberate copy.
-  key.chunk_id = kMaxChunkID;
-  iter.seq_end = index_.upper_bound(key);
+  ChunkSequence* seq = sorted_sequences_[seq_pos].second;
+  iter.seq = seq;
+  GetProducerAndWriterID(sorted_sequences_[seq_pos].first,
+                         &iter.seq_producer_id, &iter.seq_writer_id);
+  iter.seq_begin = seq->first;
+  iter.seq_end = seq->chunks.size();
   PERFETTO_DCHECK(iter.seq_begin != iter.seq_end);
 
   // Now find the first entry between [seq_begin, seq_end) that is
-  // > last_chunk_id_written_. This is where we the sequence will start (see
+  // > last_chunk_id_written. This is where we the sequence will start (see
   // notes about wrapping of IDs in the header).
-  auto producer_and_writer_id = std::make_pair(key.producer_id, key.writer_id);
-  PERFETTO_DCHECK(last_chunk_id_written_.count(producer_and_writer_id));
-  iter.wrapping_id = last_chunk_id_written_[producer_and_writer_id];
-  key.chunk_id = iter.wrapping_id;
-  iter.cur = index_.upper_bound(key);
+  iter.wrapping_id = seq->last_chunk_id_written;
+  iter.cur = seq->UpperBound(iter.wrapping_id);
   if (iter.cur == iter.seq_end)
     iter.cur = iter.seq_begin;
   return iter;
@@ -510,29 +525,84 @@ TraceBuffer::SequenceIterator TraceBuffer::GetReadIterForSequence(
 void TraceBuffer::SequenceIterator::MoveNext() {
   // Stop iterating when we reach the end of the sequence.
   // Note: |seq_begin| might be == |seq_end|.
-  if (cur == seq_end || cur->first.chunk_id == wrapping_id) {
+  if (cur == seq_end || seq->chunks[cur].chunk_id == wrapping_id) {
     cur = seq_end;
     return;
   }
 
   // If the current chunk wasn't completed yet, we shouldn't advance past it as
   // it may be rewritten with additional packets.
-  if (!cur->second.is_complete()) {
+  if (!seq->chunks[cur].is_complete()) {
     cur = seq_end;
     return;
   }
 
-  ChunkID last_chunk_id = cur->first.chunk_id;
+  ChunkID last_chunk_id = seq->chunks[cur].chunk_id;
   if (++cur == seq_end)
     cur = seq_begin;
 
   // There may be a missing chunk in the sequence of chunks, in which case the
   // next chunk's ID won't follow the last one's. If so, skip the rest of the
   // sequence. We'll return to it later once the hole is filled.
-  if (last_chunk_id + 1 != cur->first.chunk_id)
+  if (last_chunk_id + 1 != seq->chunks[cur].chunk_id)
     cur = seq_end;
 }
 
+TraceBuffer::ChunkMeta* TraceBuffer::ChunkSequence::Insert(
+    const ChunkMeta& chunk_meta) {
+  // Fast path: chunks are almost always copied in ChunkID order.
+  if (empty() || chunks.back().chunk_id < chunk_meta.chunk_id) {
+    chunks.push_back(chunk_meta);
+    return &chunks.back();
+  }
+  size_t pos = LowerBound(chunk_meta.chunk_id);
+  PERFETTO_DCHECK(pos == chunks.size() ||
+                  chunks[pos].chunk_id != chunk_meta.chunk_id);
+  // Reuse the slot of a deleted chunk, if it's in the right place.
+  if (pos == first && first > 0) {
+    chunks[--first] = chunk_meta;
+    return &chunks[first];
+  }
+  return &*chunks.insert(chunks.begin() + static_cast<ptrdiff_t>(pos),
+                         chunk_meta);
+}
+
+void TraceBuffer::ChunkSequence::Erase(ChunkID chunk_id) {
+  size_t pos = LowerBound(chunk_id);
+  PERFETTO_DCHECK(pos < chunks.size() && chunks[pos].chunk_id == chunk_id);
+  if (pos == first) {
+    first++;
+  } else {
+    chunks.erase(chunks.begin() + static_cast<ptrdiff_t>(pos));
+  }
+  if (first == chunks.size()) {
+    chunks.clear();
+    first = 0;
+  } else if (first * 2 >= chunks.size()) {
+    chunks.erase(chunks.begin(),
+                 chunks.begin() + static_cast<ptrdiff_t>(first));
+    first = 0;
+  }
+}
+
+size_t TraceBuffer::ChunkSequence::LowerBound(ChunkID chunk_id) const {
+  auto it = std::lower_bound(chunks.begin() + static_cast<ptrdiff_t>(first),
+                             chunks.end(), chunk_id,
+                             [](const ChunkMeta& meta, ChunkID id) {
+                               return meta.chunk_id < id;
+                             });
+  return static_cast<size_t>(it - chunks.begin());
+}
+
+size_t TraceBuffer::ChunkSequence::UpperBound(ChunkID chunk_id) const {
+  auto it = std::upper_bound(chunks.begin() + static_cast<ptrdiff_t>(first),
+                             chunks.end(), chunk_id,
+                             [](ChunkID id, const ChunkMeta& meta) {
+                               return id < meta.chunk_id;
+                             });
+  return static_cast<size_t>(it - chunks.begin());
+}
+
 bool TraceBuffer::ReadNextTracePacket(
     TracePacket* packet,
     PacketSequenceProperties* sequence_properties,
@@ -560,16 +630,15 @@ bool TraceBuffer::ReadNextTracePacket(
   for (;; read_iter_.MoveNext()) {
     if (PERFETTO_UNLIKELY(!read_iter_.is_valid())) {
       // We ran out of chunks in the current {ProducerID, WriterID} sequence or
-      // we just reached the index_.end().
-
-      if (PERFETTO_UNLIKELY(read_iter_.seq_end == index_.end()))
+      // there are no sequences left.
+      if (PERFETTO_UNLIKELY(!read_iter_.seq))
         return false;
 
       // We reached the end of sequence, move to the next one.
-      // Note: ++read_iter_.seq_end might become index_.end(), but
-      // GetReadIterForSequence() knows how to deal with that.
-      read_iter_ = GetReadIterForSequence(read_iter_.seq_end);
-      PERFETTO_DCHECK(read_iter_.is_valid() && read_iter_.cur != index_.end());
+      read_iter_ = GetReadIterForSequence(read_iter_.seq_pos + 1);
+      if (!read_iter_.seq)
+        return false;
+      PERFETTO_DCHECK(read_iter_.is_valid());
       previous_packet_dropped = true;
     }
 
@@ -918,7 +987,6 @@ TraceBuffer::TraceBuffer(CloneCtor, const TraceBuffer& src)
 
   EnsureCommitted(src.used_size_);
   memcpy(data_.Get(), src.data_.Get(), src.used_size_);
-  last_chunk_id_written_ = src.last_chunk_id_written_;
 
   stats_ = src.stats_;
   stats_.set_bytes_read(0);
@@ -927,13 +995,15 @@ TraceBuffer::TraceBuffer(CloneCtor, const TraceBuffer& src)
   stats_.set_readaheads_succeeded(0);
 
   // Copy the index of chunk metadata and reset the read states.
-  index_ = ChunkMap(src.index_);
-  for (auto& kv : index_) {
-    ChunkMeta& chunk_meta = kv.second;
-    chunk_meta.num_fragments_read = 0;
-    chunk_meta.cur_fragment_offset = 0;
-    chunk_meta.set_last_read_packet_skipped(false);
+  for (auto it = src.index_.GetIterator(); it; ++it) {
+    ChunkSequence* seq = index_.Insert(it.key(), it.value()).first;
+    for (ChunkMeta& chunk_meta : seq->chunks) {
+      chunk_meta.num_fragments_read = 0;
+      chunk_meta.cur_fragment_offset = 0;
+      chunk_meta.set_last_read_packet_skipped(false);
+    }
   }
+  sorted_sequences_stale_ = true;
   read_iter_ = SequenceIterator();
 }
 
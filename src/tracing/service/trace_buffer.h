@@ -22,8 +22,9 @@
 
 #include <array>
 #include <limits>
-#include <map>
 #include <tuple>
+#include <utility>
+#include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/flat_hash_map.h"
@@ -114,7 +115,9 @@ class TracePacket;
 //
 // However, in order to keep some operations (patching and reading) fast, a
 // lookaside index is maintained (in |index_|), keeping each chunk in the buffer
-// indexed by their {ProducerID, WriterID, ChunkID} tuple.
+// indexed by their {ProducerID, WriterID, ChunkID} tuple. The index is a hash
+// table of {ProducerID, WriterID} sequences, each holding a flat array of the
+// metadata of its chunks, sorted by ChunkID.
 //
 // Patching data out-of-band
 // -------------------------
@@ -286,6 +289,7 @@ class TraceBuffer {
   std::unique_ptr<TraceBuffer> CloneReadOnly() const;
 
   void set_read_only() { read_only_ = true; }
+  bool read_only() const { return read_only_; }
   const WriterStatsMap& writer_stats() const { return writer_stats_; }
   const TraceStats::BufferStats& stats() const { return stats_; }
   size_t size() const { return size_; }
@@ -366,7 +370,7 @@ class TraceBuffer {
   // This struct should not have any field that is essential for reconstructing
   // the contents of the buffer from a crash dump.
   struct ChunkMeta {
-    // Key used for sorting in the map.
+    // Identifies a chunk in the index.
     struct Key {
       Key(ProducerID p, WriterID w, ChunkID c)
           : producer_id{p}, writer_id{w}, chunk_id{c} {}
@@ -413,12 +417,14 @@ class TraceBuffer {
       kLastReadPacketSkipped = 1 << 1
     };
 
-    ChunkMeta(uint32_t _record_off,
+    ChunkMeta(ChunkID _chunk_id,
+              uint32_t _record_off,
               uint16_t _num_fragments,
               bool complete,
               uint8_t _flags,
               const ClientIdentity& client_identity)
-        : record_off{_record_off},
+        : chunk_id{_chunk_id},
+          record_off{_record_off},
           client_identity_trusted(client_identity),
           flags{_flags},
           num_fragments{_num_fragments} {
@@ -427,6 +433,7 @@ class TraceBuffer {
     }
 
     ChunkMeta(const ChunkMeta&) noexcept = default;
+    ChunkMeta& operator=(const ChunkMeta&) noexcept = default;
 
     bool is_complete() const { return index_flags & kComplete; }
 
@@ -450,8 +457,12 @@ class TraceBuffer {
       }
     }
 
-    const uint32_t record_off;  // Offset of ChunkRecord within |data_|.
-    const ClientIdentity client_identity_trusted;
+    // The ProducerID and WriterID are implied by the ChunkSequence that
+    // contains this. The fields below are not const only to allow moving
+    // entries within ChunkSequence::chunks, they never change.
+    ChunkID chunk_id;
+    uint32_t record_off;  // Offset of ChunkRecord within |data_|.
+    ClientIdentity client_identity_trusted;
     // Flags set by TraceBuffer to track the state of the chunk in the index.
     uint8_t index_flags = 0;
 
@@ -471,12 +482,56 @@ class TraceBuffer {
     uint16_t cur_fragment_offset = 0;
   };
 
-  using ChunkMap = std::map<ChunkMeta::Key, ChunkMeta>;
+  // The chunks in the index for a {ProducerID, WriterID} sequence.
+  // Producers write chunks with increasing ChunkIDs and the buffer overwrites
+  // them in the order they were copied, so chunks are almost always appended
+  // at the end and deleted from the front. Hence a flat array sorted by
+  // ChunkID, where deleting the first chunk just advances |first|. The deleted
+  // prefix is compacted away once it's at least half of the array.
+  struct ChunkSequence {
+    ChunkMeta* Find(ChunkID chunk_id) {
+      size_t pos = LowerBound(chunk_id);
+      if (pos == chunks.size() || chunks[pos].chunk_id != chunk_id)
+        return nullptr;
+      return &chunks[pos];
+    }
+
+    // |chunk_meta.chunk_id| must not be in the sequence already.
+    ChunkMeta* Insert(const ChunkMeta& chunk_meta);
+
+    // |chunk_id| must be in the sequence.
+    void Erase(ChunkID chunk_id);
+
+    // Returns the position in |chunks| of the first chunk with an ID >= (or >
+    // for UpperBound()) |chunk_id|.
+    size_t LowerBound(ChunkID chunk_id) const;
+    size_t UpperBound(ChunkID chunk_id) const;
+
+    bool empty() const { return first == chunks.size(); }
+
+    // Sorted by ChunkID. Entries before |first| have been deleted.
+    std::vector<ChunkMeta> chunks;
+    size_t first = 0;
+
+    // Keeps track of the highest ChunkID written for this sequence, taking
+    // into account a potential overflow of ChunkIDs. In the case of overflow,
+    // stores the highest ChunkID written since the overflow.
+    ChunkID last_chunk_id_written = 0;
+  };
 
-  // Allows to iterate over a sub-sequence of |index_| for all keys belonging to
-  // the same {ProducerID,WriterID}. Furthermore takes into account the wrapping
-  // of ChunkID. Instances are valid only as long as the |index_| is not altered
-  // (can be used safely only between adjacent ReadNextTracePacket() calls).
+  // Sequences are never removed, even when they have no chunks left, as
+  // |last_chunk_id_written| must survive (realistically this is not a problem
+  // unless we have too many producers/writers within the same trace session).
+  using ChunkIndex = base::FlatHashMap<ProducerAndWriterID,
+                                       ChunkSequence,
+                                       std::hash<ProducerAndWriterID>,
+                                       base::QuadraticProbe,
+                                       /*AppendOnly=*/true>;
+
+  // Allows to iterate over the chunks of a {ProducerID,WriterID} sequence.
+  // Furthermore takes into account the wrapping of ChunkID. Instances are
+  // valid only as long as the |index_| is not altered (can be used safely only
+  // between adjacent ReadNextTracePacket() calls).
   // The order of the iteration will proceed in the following order:
   // |wrapping_id| + 1 -> |seq_end|, |seq_begin| -> |wrapping_id|.
   // Practical example:
@@ -487,38 +542,49 @@ class TraceBuffer {
   //   through a CopyChunkUntrusted()).
   // The resulting iteration order will be: c5, c6, c7, c0, c1, c2, c3, c4.
   struct SequenceIterator {
-    // Points to the 1st key (the one with the numerically min ChunkID).
-    ChunkMap::iterator seq_begin;
+    // The sequence being iterated, nullptr if there are no sequences left.
+    ChunkSequence* seq = nullptr;
+
+    // The position of |seq| in |sorted_sequences_|.
+    size_t seq_pos = 0;
+
+    ProducerID seq_producer_id = 0;
+    WriterID seq_writer_id = 0;
+
+    // Index in |seq->chunks| of the 1st chunk (the one with the numerically
+    // min ChunkID).
+    size_t seq_begin = 0;
 
-    // Points one past the last key (the one with the numerically max ChunkID).
-    ChunkMap::iterator seq_end;
+    // Index one past the last chunk (the one with the numerically max
+    // ChunkID).
+    size_t seq_end = 0;
 
-    // Current iterator, always >= seq_begin && <= seq_end.
-    ChunkMap::iterator cur;
+    // Current index, always >= seq_begin && <= seq_end.
+    size_t cur = 0;
 
     // The latest ChunkID written. Determines the start/end of the sequence.
-    ChunkID wrapping_id;
+    ChunkID wrapping_id = 0;
 
     bool is_valid() const { return cur != seq_end; }
 
     ProducerID producer_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.producer_id;
+      return seq_producer_id;
     }
 
     WriterID writer_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.writer_id;
+      return seq_writer_id;
     }
 
     ChunkID chunk_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.chunk_id;
+      return seq->chunks[cur].chunk_id;
     }
 
     ChunkMeta& operator*() {
       PERFETTO_DCHECK(is_valid());
-      return cur->second;
+      return seq->chunks[cur];
     }
 
     // Moves |cur| to the next chunk in the index.
@@ -552,14 +618,14 @@ class TraceBuffer {
 
   bool Initialize(size_t size);
 
-  // Returns an object that allows to iterate over chunks in the |index_| that
-  // have the same {ProducerID, WriterID} of
-  // |seq_begin.first.{producer,writer}_id|. |seq_begin| must be an iterator to
-  // the first entry in the |index_| that has a different {ProducerID, WriterID}
-  // from the previous one. It is valid for |seq_begin| to be == index_.end()
-  // (i.e. if the index is empty). The iteration takes care of ChunkID wrapping,
-  // by using |last_chunk_id_|.
-  SequenceIterator GetReadIterForSequence(ChunkMap::iterator seq_begin);
+  // Returns an object that allows to iterate over the chunks of the first
+  // non-empty sequence at or after |seq_pos| in |sorted_sequences_|. If there
+  // is none, the returned iterator has a null |seq|. The iteration takes care
+  // of ChunkID wrapping, by using |last_chunk_id_written|.
+  SequenceIterator GetReadIterForSequence(size_t seq_pos);
+
+  // Rebuilds |sorted_sequences_| if sequences were added to |index_|.
+  void SortSequencesIfNeeded();
 
   // Used as a last resort when a buffer corruption is detected.
   void ClearContentsAndResetRWCursors();
@@ -693,7 +759,14 @@ class TraceBuffer {
 
   // An index that keeps track of the positions and metadata of each
   // ChunkRecord.
-  ChunkMap index_;
+  ChunkIndex index_;
+
+  // The sequences in |index_|, sorted by {ProducerID, WriterID}. Used to read
+  // the sequences in a stable order. Rebuilt by BeginRead() when sequences
+  // have been added, which can also invalidate the pointers.
+  std::vector<std::pair<ProducerAndWriterID, ChunkSequence*>>
+      sorted_sequences_;
+  bool sorted_sequences_stale_ = false;
 
   // Read iterator used for ReadNext(). It is reset by calling BeginRead().
   // It becomes invalid after any call to methods that alters the |index_|.
@@ -710,15 +783,6 @@ class TraceBuffer {
   // a write fails because it would overwrite unread chunks.
   bool discard_writes_ = false;
 
-  // Keeps track of the highest ChunkID written for a given sequence, taking
-  // into account a potential overflow of ChunkIDs. In the case of overflow,
-  // stores the highest ChunkID written since the overflow.
-  //
-  // TODO(primiano): should clean up keys from this map. Right now it grows
-  // without bounds (although realistically is not a problem unless we have too
-  // many producers/writers within the same trace session).
-  std::map<std::pair<ProducerID, WriterID>, ChunkID> last_chunk_id_written_;
-
   // Statistics about buffer usage.
   TraceStats::BufferStats stats_;
 
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "perfetto/ext/tracing/core/basic_types.h"
+#include "perfetto/ext/tracing/core/client_identity.h"
+#include "perfetto/ext/tracing/core/trace_packet.h"
+#include "perfetto/protozero/proto_utils.h"
+#include "src/tracing/service/trace_buffer.h"
+
+namespace perfetto {
+namespace {
+
+// Chunks of 1KB (including the ChunkRecord header), each containing a single
+// packet.
+constexpr size_t kChunkSize = 1024;
+constexpr size_t kBufferSize = 4 * 1024 * 1024;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+std::vector<uint8_t> MakeChunkPayload() {
+  const size_t payload_size = kChunkSize - TraceBuffer::InlineChunkHeaderSize;
+  std::vector<uint8_t> payload(payload_size, 'x');
+  // Each packet is prefixed by its varint-encoded size.
+  const size_t packet_size = payload_size - 2;
+  protozero::proto_utils::WriteRedundantVarInt(
+      static_cast<uint32_t>(packet_size), payload.data(), 2);
+  return payload;
+}
+
+// Copies |num_chunks| chunks, cycling through |num_writers| writers spread
+// over 16 producers, like the service does when scraping the SMBs.
+void CopyChunks(TraceBuffer* buf,
+                const std::vector<uint8_t>& payload,
+                size_t num_writers,
+                size_t num_chunks,
+                std::vector<ChunkID>* next_chunk_ids) {
+  next_chunk_ids->resize(num_writers);
+  for (size_t i = 0; i < num_chunks; i++) {
+    size_t writer = i % num_writers;
+    ProducerID producer_id = static_cast<ProducerID>(1 + writer % 16);
+    WriterID writer_id = static_cast<WriterID>(1 + writer / 16);
+    ChunkID chunk_id = (*next_chunk_ids)[writer]++;
+    buf->CopyChunkUntrusted(producer_id, ClientIdentity(), writer_id, chunk_id,
+                            /*num_fragments=*/1, /*chunk_flags=*/0,
+                            /*chunk_complete=*/true, payload.data(),
+                            payload.size());
+  }
+}
+
+// Measures the cost of copying chunks into a full buffer, where each copy
+// also overwrites the oldest chunk.
+void BM_TraceBufferCopyChunks(benchmark::State& state) {
+  const size_t num_writers = static_cast<size_t>(state.range(0));
+  std::unique_ptr<TraceBuffer> buf = TraceBuffer::Create(kBufferSize);
+  std::vector<uint8_t> payload = MakeChunkPayload();
+  std::vector<ChunkID> next_chunk_ids;
+
+  // Fill the buffer up, so the benchmark loop measures the steady state.
+  const size_t chunks_per_buffer = kBufferSize / kChunkSize;
+  CopyChunks(buf.get(), payload, num_writers, chunks_per_buffer,
+             &next_chunk_ids);
+
+  for (auto _ : state) {
+    CopyChunks(buf.get(), payload, num_writers, chunks_per_buffer,
+               &next_chunk_ids);
+    benchmark::ClobberMemory();
+    if (IsBenchmarkFunctionalOnly())
+      break;
+  }
+  state.counters["chunks/s"] = benchmark::Counter(
+      static_cast<double>(chunks_per_buffer),
+      benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// Measures the cost of copying chunks and reading them all back, as in a
+// periodic ReadBuffers().
+void BM_TraceBufferCopyAndReadBack(benchmark::State& state) {
+  const size_t num_writers = static_cast<size_t>(state.range(0));
+  std::unique_ptr<TraceBuffer> buf = TraceBuffer::Create(kBufferSize);
+  std::vector<uint8_t> payload = MakeChunkPayload();
+  std::vector<ChunkID> next_chunk_ids;
+  const size_t chunks_per_read = kBufferSize / kChunkSize / 2;
+
+  for (auto _ : state) {
+    CopyChunks(buf.get(), payload, num_writers, chunks_per_read,
+               &next_chunk_ids);
+    buf->BeginRead();
+    size_t num_packets = 0;
+    TracePacket packet;
+    TraceBuffer::PacketSequenceProperties sequence_properties;
+    bool previous_packet_dropped;
+    while (buf->ReadNextTracePacket(&packet, &sequence_properties,
+                                    &previous_packet_dropped)) {
+      num_packets++;
+      packet = TracePacket();
+    }
+    PERFETTO_CHECK(num_packets == chunks_per_read);
+    if (IsBenchmarkFunctionalOnly())
+      break;
+  }
+  state.counters["chunks/s"] = benchmark::Counter(
+      static_cast<double>(chunks_per_read),
+      benchmark::Counter::kIsIterationInvariantRate);
+}
+
+}  // namespace
+}  // namespace perfetto
+
+BENCHMARK(perfetto::BM_TraceBufferCopyChunks)->RangeMultiplier(8)->Range(1,
+                                                                          4096);
+BENCHMARK(perfetto::BM_TraceBufferCopyAndReadBack)
+    ->RangeMultiplier(8)
+    ->Range(1, 4096);
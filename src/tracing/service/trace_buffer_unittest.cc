@@ -145,9 +145,12 @@ class TraceBufferTest : public testing::Test {
   }
 
   SequenceIterator GetReadIterForSequence(ProducerID p, WriterID w) {
-    TraceBuffer::ChunkMeta::Key key(p, w, 0);
-    return trace_buffer_->GetReadIterForSequence(
-        trace_buffer_->index_.lower_bound(key));
+    trace_buffer_->SortSequencesIfNeeded();
+    const auto& seqs = trace_buffer_->sorted_sequences_;
+    size_t pos = 0;
+    while (pos < seqs.size() && seqs[pos].first < MkProducerAndWriterID(p, w))
+      pos++;
+    return trace_buffer_->GetReadIterForSequence(pos);
   }
 
   void SuppressClientDchecksForTesting() {
@@ -156,9 +159,15 @@ class TraceBufferTest : public testing::Test {
 
   std::vector<ChunkMetaKey> GetIndex() {
     std::vector<ChunkMetaKey> keys;
-    keys.reserve(trace_buffer_->index_.size());
-    for (const auto& it : trace_buffer_->index_)
-      keys.push_back(it.first);
+    trace_buffer_->SortSequencesIfNeeded();
+    for (const auto& it : trace_buffer_->sorted_sequences_) {
+      ProducerID p;
+      WriterID w;
+      GetProducerAndWriterID(it.first, &p, &w);
+      const TraceBuffer::ChunkSequence* seq = it.second;
+      for (size_t i = seq->first; i < seq->chunks.size(); i++)
+        keys.emplace_back(p, w, seq->chunks[i].chunk_id);
+    }
     return keys;
   }
 
@@ -224,6 +233,40 @@ TEST_F(TraceBufferTest, ReadWrite_OneChunkPerWriter) {
   }  // for(num_writers)
 }
 
+// Writes the chunks of many writers, interleaved and out of order, and checks
+// that they are read back sorted by {ProducerID, WriterID, ChunkID}, also after
+// some of them have been overwritten.
+TEST_F(TraceBufferTest, ReadWrite_ManyWritersInterleaved) {
+  for (size_t buf_size : {4096u, 1024u}) {
+    ResetBuffer(buf_size);
+    for (ChunkID chunk_id : {2, 0, 1}) {
+      for (char w = 16; w >= 1; w--) {
+        char seed = static_cast<char>(w * 3 + chunk_id);
+        ASSERT_EQ(32u, CreateChunk(ProducerID(1 + w % 4), WriterID(w), chunk_id)
+                           .AddPacket(32 - 16, seed)
+                           .CopyIntoTraceBuffer());
+      }
+    }
+
+    // With the 1024 bytes buffer, the 16 chunks with ChunkID 2 (written first)
+    // have been overwritten.
+    const ChunkID num_chunks = buf_size == 4096 ? 3 : 2;
+    trace_buffer()->BeginRead();
+    for (ProducerID p = 1; p <= 4; p++) {
+      for (char w = 1; w <= 16; w++) {
+        if (1 + w % 4 != p)
+          continue;
+        for (ChunkID c = 0; c < num_chunks; c++) {
+          char seed = static_cast<char>(w * 3 + c);
+          ASSERT_THAT(ReadPacket(),
+                      ElementsAre(FakePacketFragment(32 - 16, seed)));
+        }
+      }
+    }
+    ASSERT_THAT(ReadPacket(), IsEmpty());
+  }
+}
+
 // Writes chunk that up filling the buffer precisely until the end, like this:
 // [ c0: 512 ][ c1: 512 ][ c2: 1024 ][ c3: 2048 ]
 // | ---------------- 4k buffer --------------- |
@@ -494,8 +494,15 @@ void TracingServiceImpl::DisconnectConsumer(ConsumerEndpointImpl* consumer) {
 
   // TODO(primiano) : Check that this is safe (what happens if there are
   // ReadBuffers() calls posted in the meantime? They need to become noop).
-  if (consumer->tracing_session_id_)
-    FreeBuffers(consumer->tracing_session_id_);  // Will also DisableTracing().
+  if (consumer->tracing_session_id_) {
+    TracingSessionID tsid = consumer->tracing_session_id_;
+    FreeBuffers(tsid);  // Will also DisableTracing().
+    // FreeBuffers() is deferred while the trace file is being written, but
+    // there is nobody left to notify.
+    TracingSession* tracing_session = GetTracingSession(tsid);
+    if (tracing_session)
+      tracing_session->consumer_maybe_null = nullptr;
+  }
   consumers_.erase(consumer);
 
   // At this point no more pointers to |consumer| should be around.
@@ -655,6 +662,18 @@ base::Status TracingServiceImpl::EnableTracing(ConsumerEndpointImpl* consumer,
     }
   }
 
+  // Unlike deflate, zstd is not built everywhere (e.g. Android and Bazel
+  // builds). Reject the session instead of silently writing an uncompressed
+  // trace that the consumer did not ask for.
+  if (cfg.compression_type() == TraceConfig::COMPRESSION_TYPE_ZSTD &&
+      !init_opts_.zstd_compressor_fn) {
+    MaybeLogUploadEvent(cfg, uuid,
+                        PerfettoStatsdAtom::kTracedEnableTracingUnknown);
+    return PERFETTO_SVC_ERR(
+        "COMPRESSION_TYPE_ZSTD is not supported in the current build "
+        "configuration");
+  }
+
   if ((GetTriggerMode(cfg) == TraceConfig::TriggerConfig::STOP_TRACING ||
        GetTriggerMode(cfg) == TraceConfig::TriggerConfig::CLONE_SNAPSHOT) &&
       cfg.write_into_file()) {
@@ -897,25 +916,30 @@ base::Status TracingServiceImpl::EnableTracing(ConsumerEndpointImpl* consumer,
                                 cfg.output_path().c_str());
       }
     }
-    tracing_session->write_into_file = std::move(fd);
+    tracing_session->write_into_file =
+        std::make_shared<TracingSession::FileSink>();
+    tracing_session->write_into_file->fd = std::move(fd);
+    tracing_session->write_into_file->max_file_size_bytes =
+        cfg.max_file_size_bytes();
     uint32_t write_period_ms = cfg.file_write_period_ms();
     if (write_period_ms == 0)
       write_period_ms = kDefaultWriteIntoFilePeriodMs;
     if (write_period_ms < min_write_period_ms_)
       write_period_ms = min_write_period_ms_;
     tracing_session->write_period_ms = write_period_ms;
-    tracing_session->max_file_size_bytes = cfg.max_file_size_bytes();
     tracing_session->bytes_written_into_file = 0;
   }
 
   if (cfg.compression_type() == TraceConfig::COMPRESSION_TYPE_DEFLATE) {
     if (init_opts_.compressor_fn) {
-      tracing_session->compress_deflate = true;
+      tracing_session->compressor_fn = init_opts_.compressor_fn;
     } else {
       PERFETTO_LOG(
           "COMPRESSION_TYPE_DEFLATE is not supported in the current build "
           "configuration. Skipping compression");
     }
+  } else if (cfg.compression_type() == TraceConfig::COMPRESSION_TYPE_ZSTD) {
+    tracing_session->compressor_fn = init_opts_.zstd_compressor_fn;
   }
 
   // Initialize the log buffers.
@@ -1752,6 +1776,14 @@ void TracingServiceImpl::DisableTracingNotifyConsumerAndFlushFile(
   MaybeLogUploadEvent(tracing_session->config, tracing_session->trace_uuid,
                       PerfettoStatsdAtom::kTracedNotifyTracingDisabled);
 
+  // The consumer expects the file to be complete when it's notified. If some
+  // chunks are still being written, OnFileWriteCompleted() will notify it
+  // after the file has been closed.
+  if (tracing_session->pending_file_writes > 0) {
+    tracing_session->notify_disabled_after_pending_writes = true;
+    return;
+  }
+
   if (tracing_session->consumer_maybe_null)
     tracing_session->consumer_maybe_null->NotifyOnTracingDisabled("");
 }
@@ -2172,6 +2204,7 @@ bool TracingServiceImpl::ReadBuffersIntoConsumer(
   bool has_more;
   std::vector<TracePacket> packets =
       ReadBuffers(tracing_session, kApproxBytesPerTask, &has_more);
+  MaybeCompressPackets(tracing_session, &packets);
 
   if (has_more) {
     auto weak_consumer = consumer->weak_ptr_factory_.GetWeakPtr();
@@ -2213,22 +2246,49 @@ bool TracingServiceImpl::ReadBuffersIntoFile(TracingSessionID tsid) {
   // ReadBuffersIntoConsumer, but that's not currently possible.
   // ReadBuffersIntoFile has to read the whole available data before returning,
   // to support the disable_immediately=true code paths.
+  //
+  // Compression and the file I/O, which are by far the most expensive parts,
+  // are instead done on |file_writer_task_runner_|. If the writer thread falls
+  // behind (e.g. slow storage), the periodic drain stops early and leaves the
+  // data in the buffers rather than queueing an unbounded amount of memory.
+  //
+  // The final drain (write_period_ms == 0) has to read everything. It seals
+  // the buffers instead: producers can't write into them any more, so the
+  // packets handed over to the writer thread can point straight into them
+  // without being copied or queued in memory. FreeBuffers() waits for the
+  // writer thread (asynchronously) before freeing them.
+  auto drain_start = base::GetWallTimeNs();
+  const bool final_drain = tracing_session->write_period_ms == 0;
+  if (final_drain && !tracing_session->file_writer_borrows_buffers) {
+    for (BufferID buffer_id : tracing_session->buffers_index)
+      GetBufferByID(buffer_id)->set_read_only();
+    tracing_session->file_writer_borrows_buffers = true;
+  }
   bool has_more = true;
-  bool stop_writing_into_file = false;
+  bool throttled = false;
+  bool file_full = false;
   do {
+    if (IsWriteIntoFileFull(tracing_session)) {
+      file_full = true;
+      break;
+    }
+    if (!final_drain && tracing_session->pending_file_write_bytes >=
+                            kMaxPendingWriteIntoFileBytes) {
+      throttled = true;
+      break;
+    }
     std::vector<TracePacket> packets =
         ReadBuffers(tracing_session, kWriteIntoFileChunkSize, &has_more);
-
-    stop_writing_into_file = WriteIntoFile(tracing_session, std::move(packets));
-  } while (has_more && !stop_writing_into_file);
-
-  if (stop_writing_into_file || tracing_session->write_period_ms == 0) {
-    // Ensure all data was written to the file before we close it.
-    base::FlushFile(tracing_session->write_into_file.get());
-    tracing_session->write_into_file.reset();
-    tracing_session->write_period_ms = 0;
-    if (tracing_session->state == TracingSession::STARTED)
-      DisableTracing(tsid);
+    WriteIntoFileAsync(tracing_session, std::move(packets),
+                       /*close_file=*/false);
+  } while (has_more);
+  if (throttled)
+    tracing_session->throttled_file_drains++;
+  tracing_session->file_drain_latency_hist.Add(
+      (base::GetWallTimeNs() - drain_start).count() / 1000);
+
+  if (file_full || final_drain) {
+    CloseWriteIntoFile(tracing_session);
     return true;
   }
 
@@ -2242,6 +2302,21 @@ bool TracingServiceImpl::ReadBuffersIntoFile(TracingSessionID tsid) {
   return true;
 }
 
+bool TracingServiceImpl::IsWriteIntoFileFull(
+    const TracingSession* tracing_session) {
+  const TracingSession::FileSink* sink = tracing_session->write_into_file.get();
+  if (sink->stopped.load(std::memory_order_relaxed))
+    return true;
+  // Without compression the writer thread writes at least as many bytes as
+  // the packets hold, so there is no point in reading more than what is left
+  // to |max_file_size_bytes|: the writer thread would discard it anyway.
+  if (tracing_session->compressor_fn || !sink->max_file_size_bytes)
+    return false;
+  return tracing_session->bytes_written_into_file +
+             tracing_session->pending_file_write_bytes >=
+         sink->max_file_size_bytes;
+}
+
 bool TracingServiceImpl::IsWaitingForTrigger(TracingSession* tracing_session) {
   // Ignore the logic below for cloned tracing sessions. In this case we
   // actually want to read the (cloned) trace buffers even if no trigger was
@@ -2433,8 +2508,6 @@ std::vector<TracePacket> TracingServiceImpl::ReadBuffers(
 
   MaybeFilterPackets(tracing_session, &packets);
 
-  MaybeCompressPackets(tracing_session, &packets);
-
   if (!*has_more) {
     // We've observed some extremely high memory usage by scudo after
     // MaybeFilterPackets in the past. The original bug (b/195145848) is fixed
@@ -2509,20 +2582,149 @@ void TracingServiceImpl::MaybeFilterPackets(TracingSession* tracing_session,
 void TracingServiceImpl::MaybeCompressPackets(
     TracingSession* tracing_session,
     std::vector<TracePacket>* packets) {
-  if (!tracing_session->compress_deflate) {
+  if (!tracing_session->compressor_fn) {
     return;
   }
 
-  init_opts_.compressor_fn(packets);
+  tracing_session->compressor_fn(packets);
 }
 
-bool TracingServiceImpl::WriteIntoFile(TracingSession* tracing_session,
-                                       std::vector<TracePacket> packets) {
-  if (!tracing_session->write_into_file) {
+void TracingServiceImpl::WriteIntoFileAsync(TracingSession* tracing_session,
+                                            std::vector<TracePacket> packets,
+                                            bool close_file) {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+  if (!tracing_session->write_into_file)
+    return;
+  if (packets.empty() && !close_file)
+    return;
+
+  // The slices returned by ReadBuffers() can point straight into the
+  // TraceBuffer. Once the final drain has sealed the buffers they can be
+  // handed over as they are. Before that, producers can overwrite them as
+  // soon as we return to the task runner, so they have to be copied.
+  auto owned_packets = std::make_shared<std::vector<TracePacket>>();
+  uint64_t packets_size = 0;
+  if (tracing_session->file_writer_borrows_buffers) {
+    for (const TracePacket& packet : packets)
+      packets_size += packet.size();
+    *owned_packets = std::move(packets);
+  } else {
+    owned_packets->reserve(packets.size());
+    for (const TracePacket& packet : packets) {
+      Slice slice = Slice::Allocate(packet.size());
+      uint8_t* wptr = slice.own_data();
+      for (const Slice& src : packet.slices()) {
+        memcpy(wptr, src.start, src.size);
+        wptr += src.size;
+      }
+      packets_size += packet.size();
+      TracePacket owned;
+      owned.AddSlice(std::move(slice));
+      owned_packets->emplace_back(std::move(owned));
+    }
+  }
+  packets.clear();
+
+  if (!file_writer_task_runner_)
+    file_writer_task_runner_ =
+        base::ThreadTaskRunner::CreateAndStart("svc.file");
+
+  // Both task runners run tasks in FIFO order, so the chunks are written
+  // into the file in the same order as they were read and the file is closed
+  // only after all the chunks before it have been written.
+  tracing_session->pending_file_writes++;
+  tracing_session->pending_file_write_bytes += packets_size;
+  auto weak_this = weak_ptr_factory_.GetWeakPtr();
+  TracingSessionID tsid = tracing_session->id;
+  TracingServiceInitOpts::CompressorFn compressor_fn =
+      tracing_session->compressor_fn;
+  std::shared_ptr<TracingSession::FileSink> sink =
+      tracing_session->write_into_file;
+  base::TaskRunner* task_runner = task_runner_;
+  file_writer_task_runner_->PostTask([weak_this, tsid, compressor_fn, sink,
+                                      task_runner, owned_packets, packets_size,
+                                      close_file] {
+    if (compressor_fn && !owned_packets->empty())
+      compressor_fn(owned_packets.get());
+
+    auto write_start = base::GetWallTimeNs();
+    uint64_t bytes_written = 0;
+    bool stop_writing_into_file =
+        WriteIntoFile(sink.get(), std::move(*owned_packets), &bytes_written);
+    if (close_file && sink->fd) {
+      // Ensure all data was written to the file before we close it.
+      base::FlushFile(*sink->fd);
+      sink->fd.reset();
+    }
+    int64_t write_latency_us =
+        (base::GetWallTimeNs() - write_start).count() / 1000;
+
+    task_runner->PostTask([weak_this, tsid, packets_size, bytes_written,
+                           write_latency_us, stop_writing_into_file] {
+      if (weak_this) {
+        weak_this->OnFileWriteCompleted(tsid, packets_size, bytes_written,
+                                        write_latency_us,
+                                        stop_writing_into_file);
+      }
+    });
+  });
+}
+
+void TracingServiceImpl::OnFileWriteCompleted(TracingSessionID tsid,
+                                              uint64_t packets_size,
+                                              uint64_t bytes_written,
+                                              int64_t write_latency_us,
+                                              bool stop_writing_into_file) {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+  TracingSession* tracing_session = GetTracingSession(tsid);
+  if (!tracing_session)
+    return;
+
+  PERFETTO_DCHECK(tracing_session->pending_file_writes > 0);
+  tracing_session->pending_file_writes--;
+  tracing_session->pending_file_write_bytes -= packets_size;
+  tracing_session->bytes_written_into_file += bytes_written;
+  tracing_session->file_write_latency_hist.Add(write_latency_us);
+
+  // Once the file is full (or broken) there is no point in waiting for the
+  // other chunks: the writer thread discards them.
+  if (stop_writing_into_file)
+    CloseWriteIntoFile(tracing_session);
+
+  if (tracing_session->pending_file_writes > 0)
+    return;
+
+  if (tracing_session->notify_disabled_after_pending_writes) {
+    tracing_session->notify_disabled_after_pending_writes = false;
+    if (tracing_session->consumer_maybe_null)
+      tracing_session->consumer_maybe_null->NotifyOnTracingDisabled("");
+  }
+
+  if (tracing_session->free_buffers_after_pending_writes)
+    FreeBuffers(tsid);
+}
+
+void TracingServiceImpl::CloseWriteIntoFile(TracingSession* tracing_session) {
+  if (tracing_session->write_into_file) {
+    WriteIntoFileAsync(tracing_session, {}, /*close_file=*/true);
+    tracing_session->write_into_file.reset();
+  }
+  tracing_session->write_period_ms = 0;
+  if (tracing_session->state == TracingSession::STARTED)
+    DisableTracing(tracing_session->id);
+}
+
+// static
+bool TracingServiceImpl::WriteIntoFile(TracingSession::FileSink* sink,
+                                       std::vector<TracePacket> packets,
+                                       uint64_t* bytes_written) {
+  *bytes_written = 0;
+  if (sink->stopped.load(std::memory_order_relaxed) || !sink->fd ||
+      packets.empty()) {
     return false;
   }
-  const uint64_t max_size = tracing_session->max_file_size_bytes
-                                ? tracing_session->max_file_size_bytes
+  const uint64_t max_size = sink->max_file_size_bytes
+                                ? sink->max_file_size_bytes
                                 : std::numeric_limits<size_t>::max();
 
   size_t total_slices = 0;
@@ -2553,8 +2755,7 @@ bool TracingServiceImpl::WriteIntoFile(TracingSession* tracing_session,
       iovecs[num_iovecs++] = {start, slice.size};
     }
 
-    if (tracing_session->bytes_written_into_file + bytes_about_to_be_written >=
-        max_size) {
+    if (sink->bytes_written + bytes_about_to_be_written >= max_size) {
       stop_writing_into_file = true;
       num_iovecs = num_iovecs_at_last_packet;
       break;
@@ -2563,7 +2764,7 @@ bool TracingServiceImpl::WriteIntoFile(TracingSession* tracing_session,
     num_iovecs_at_last_packet = num_iovecs;
   }
   PERFETTO_DCHECK(num_iovecs <= max_iovecs);
-  int fd = *tracing_session->write_into_file;
+  int fd = *sink->fd;
 
   uint64_t total_wr_size = 0;
 
@@ -2580,7 +2781,19 @@ bool TracingServiceImpl::WriteIntoFile(TracingSession* tracing_session,
     total_wr_size += static_cast<size_t>(wr_size);
   }
 
-  tracing_session->bytes_written_into_file += total_wr_size;
+  sink->bytes_written += total_wr_size;
+  *bytes_written = total_wr_size;
+
+  // Pace the writeback of the page cache, rather than leaving it all to the
+  // final flush.
+  sink->bytes_since_last_sync += total_wr_size;
+  if (sink->bytes_since_last_sync >= kWriteIntoFileSyncIntervalBytes) {
+    base::FlushFile(fd);
+    sink->bytes_since_last_sync = 0;
+  }
+
+  if (stop_writing_into_file)
+    sink->stopped.store(true, std::memory_order_relaxed);
 
   PERFETTO_DLOG("Draining into file, written: %" PRIu64 " KB, stop: %d",
                 (total_wr_size + 1023) / 1024, stop_writing_into_file);
@@ -2597,6 +2810,13 @@ void TracingServiceImpl::FreeBuffers(TracingSessionID tsid) {
   }
   DisableTracing(tsid, /*disable_immediately=*/true);
 
+  // The file writer thread can still be reading from the buffers. The last
+  // OnFileWriteCompleted() notifies the consumer and comes back here.
+  if (tracing_session->pending_file_writes > 0) {
+    tracing_session->free_buffers_after_pending_writes = true;
+    return;
+  }
+
   PERFETTO_DCHECK(tracing_session->AllDataSourceInstancesStopped());
   tracing_session->data_source_instances.clear();
 
@@ -2976,6 +3196,15 @@ void TracingServiceImpl::CopyProducerPageIntoLogBuffer(
     return;
   }
 
+  // The buffers of a write_into_file session are sealed by its final drain,
+  // the file writer thread can be reading from them (see
+  // ReadBuffersIntoFile()).
+  if (buf->read_only()) {
+    PERFETTO_DLOG("Target buffer %" PRIu16 " is sealed", buffer_id);
+    chunks_discarded_++;
+    return;
+  }
+
   // Verify that the producer is actually allowed to write into the target
   // buffer specified in the request. This prevents a malicious producer from
   // injecting data into a log buffer that belongs to a tracing session the
@@ -3021,10 +3250,11 @@ void TracingServiceImpl::ApplyChunkPatches(
         GetBufferByID(static_cast<BufferID>(chunk.target_buffer()));
     static_assert(std::numeric_limits<ChunkID>::max() == kMaxChunkID,
                   "Add a '|| chunk_id > kMaxChunkID' below if this fails");
-    if (!writer_id || writer_id > kMaxWriterID || !buf) {
+    if (!writer_id || writer_id > kMaxWriterID || !buf || buf->read_only()) {
       // This can genuinely happen when the trace is stopped. The producers
       // might see the stop signal with some delay and try to keep sending
-      // patches left soon after.
+      // patches left soon after. The buffers are also read-only after the
+      // final drain of a write_into_file session.
       PERFETTO_DLOG(
           "Received invalid chunks_to_patch request from Producer: %" PRIu16
           ", BufferID: %" PRIu32 " ChunkdID: %" PRIu32 " WriterID: %" PRIu16,
@@ -3428,6 +3658,27 @@ TraceStats TracingServiceImpl::GetTraceStats(TracingSession* tracing_session) {
       filt_stats->add_bytes_discarded_per_buffer(value);
   }
 
+  if (tracing_session->config.write_into_file()) {
+    auto* file_stats = trace_stats.mutable_write_into_file_stats();
+    file_stats->set_bytes_written(tracing_session->bytes_written_into_file);
+    file_stats->set_throttled_drains(tracing_session->throttled_file_drains);
+    const auto& drain_hist = tracing_session->file_drain_latency_hist;
+    const auto& write_hist = tracing_session->file_write_latency_hist;
+    // The -1 in the loop below is to skip the implicit overflow bucket.
+    for (size_t i = 0; i < drain_hist.num_buckets() - 1; ++i)
+      file_stats->add_latency_histogram_def_us(drain_hist.GetBucketThres(i));
+    for (size_t i = 0; i < drain_hist.num_buckets(); ++i) {
+      file_stats->add_drain_latency_histogram_counts(
+          drain_hist.GetBucketCount(i));
+      file_stats->add_drain_latency_histogram_sum_us(
+          drain_hist.GetBucketSum(i));
+      file_stats->add_write_latency_histogram_counts(
+          write_hist.GetBucketCount(i));
+      file_stats->add_write_latency_histogram_sum_us(
+          write_hist.GetBucketSum(i));
+    }
+  }
+
   for (BufferID buf_id : tracing_session->buffers_index) {
     TraceBuffer* buf = GetBufferByID(buf_id);
     if (!buf) {
@@ -3437,6 +3688,28 @@ TraceStats TracingServiceImpl::GetTraceStats(TracingSession* tracing_session) {
     *trace_stats.add_buffer_stats() = buf->stats();
   }  // for (buf in session).
 
+  const auto& ds_instances = tracing_session->data_source_instances;
+  for (auto it = ds_instances.begin(); it != ds_instances.end();
+       it = ds_instances.upper_bound(it->first)) {
+    ProducerEndpointImpl* producer = GetProducer(it->first);
+    if (!producer)
+      continue;
+    auto* prod_stats = trace_stats.add_producer_stats();
+    prod_stats->set_producer_id(producer->id_);
+    prod_stats->set_producer_name(producer->name_);
+    prod_stats->set_commit_data_requests(producer->commit_data_requests_);
+    prod_stats->set_chunks_committed(producer->chunks_committed_);
+    prod_stats->set_chunks_patched(producer->chunks_patched_);
+    prod_stats->set_max_chunks_per_commit(producer->max_chunks_per_commit_);
+    int64_t connected_ms =
+        (base::GetBootTimeMs() - producer->connect_time_ms_).count();
+    prod_stats->set_commit_data_requests_per_s(
+        producer->commit_data_requests_ * 1000 /
+        static_cast<uint64_t>(std::max<int64_t>(connected_ms, 1)));
+    prod_stats->set_max_commit_data_requests_per_s(
+        producer->max_commit_data_requests_per_s_);
+  }  // for (producer in session).
+
   if (!tracing_session->config.builtin_data_sources()
            .disable_chunk_usage_histograms()) {
     // Emit chunk usage stats broken down by sequence ID (i.e. by trace-writer).
@@ -3848,7 +4121,7 @@ base::Status TracingServiceImpl::DoCloneSession(ConsumerEndpointImpl* consumer,
   cloned_session->flushes_requested = src->flushes_requested;
   cloned_session->flushes_succeeded = src->flushes_succeeded;
   cloned_session->flushes_failed = src->flushes_failed;
-  cloned_session->compress_deflate = src->compress_deflate;
+  cloned_session->compressor_fn = src->compressor_fn;
   if (src->trace_filter && !skip_trace_filter) {
     // Copy the trace filter, unless it's a clone-for-bugreport (b/317065412).
     cloned_session->trace_filter.reset(
@@ -4300,6 +4573,17 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
     return;
   }
   PERFETTO_DCHECK(shmem_abi_.is_valid());
+  commit_data_requests_++;
+  chunks_patched_ += req_untrusted.chunks_to_patch().size();
+  int64_t now_s = base::GetBootTimeS().count();
+  if (now_s != commit_window_s_) {
+    commit_window_s_ = now_s;
+    commit_data_requests_in_window_ = 0;
+  }
+  commit_data_requests_in_window_++;
+  max_commit_data_requests_per_s_ = std::max(max_commit_data_requests_per_s_,
+                                             commit_data_requests_in_window_);
+  uint64_t chunks_committed = 0;
   for (const auto& entry : req_untrusted.chunks_to_move()) {
     const uint32_t page_idx = entry.page();
     if (page_idx >= shmem_abi_.num_pages())
@@ -4346,12 +4630,15 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
         id_, client_identity_, writer_id, chunk_id, buffer_id, num_fragments,
         chunk_flags,
         /*chunk_complete=*/true, chunk.payload_begin(), chunk.payload_size());
+    chunks_committed++;
 
     if (!commit_data_over_ipc) {
       // This one has release-store semantics.
       shmem_abi_.ReleaseChunkAsFree(std::move(chunk));
     }
   }  // for(chunks_to_move)
+  chunks_committed_ += chunks_committed;
+  max_chunks_per_commit_ = std::max(max_chunks_per_commit_, chunks_committed);
 
   service_->ApplyChunkPatches(id_, req_untrusted.chunks_to_patch());
 
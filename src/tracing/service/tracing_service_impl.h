@@ -18,6 +18,7 @@
 #define SRC_TRACING_SERVICE_TRACING_SERVICE_IMPL_H_
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
@@ -33,6 +34,7 @@
 #include "perfetto/base/time.h"
 #include "perfetto/ext/base/circular_queue.h"
 #include "perfetto/ext/base/periodic_task.h"
+#include "perfetto/ext/base/thread_task_runner.h"
 #include "perfetto/ext/base/uuid.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
@@ -48,6 +50,7 @@
 #include "perfetto/tracing/core/trace_config.h"
 #include "src/android_stats/perfetto_atoms.h"
 #include "src/tracing/core/id_allocator.h"
+#include "src/tracing/service/histogram.h"
 
 namespace protozero {
 class MessageFilter;
@@ -93,6 +96,22 @@ class TracingServiceImpl : public TracingService {
   // allocated.
   static constexpr size_t kWriteIntoFileChunkSize = 1024 * 1024ul;
 
+  // The periodic drain of a write_into_file session stops reading the buffers
+  // when this many bytes are queued on the file writer thread and not written
+  // yet. The data is left in the buffers and read by the next drain.
+  static constexpr size_t kMaxPendingWriteIntoFileBytes =
+      16 * kWriteIntoFileChunkSize;
+
+  // The file writer thread calls fdatasync() after writing this many bytes, to
+  // avoid accumulating a large amount of dirty pages that would make the final
+  // flush (or any other unrelated fsync on the device) stall.
+  static constexpr uint64_t kWriteIntoFileSyncIntervalBytes =
+      4 * kWriteIntoFileChunkSize;
+
+  // Histogram of the latencies (in us) of the file writing path.
+  using WriteIntoFileLatencyHistogram =
+      Histogram<100, 1000, 5000, 20000, 100000, 500000>;
+
   // The implementation behind the service endpoint exposed to each producer.
   class ProducerEndpointImpl : public TracingService::ProducerEndpoint {
    public:
@@ -180,6 +199,20 @@ class TracingServiceImpl : public TracingService {
     bool in_process_;
     bool smb_scraping_enabled_;
 
+    // Stats about the CommitData() requests received since the producer
+    // connected. See TraceStats.ProducerStats.
+    uint64_t commit_data_requests_ = 0;
+    uint64_t chunks_committed_ = 0;
+    uint64_t chunks_patched_ = 0;
+    uint64_t max_chunks_per_commit_ = 0;
+    const base::TimeMillis connect_time_ms_ = base::GetBootTimeMs();
+    // Start (in whole seconds of CLOCK_BOOTTIME) and number of requests of
+    // the current one second window, and the highest number of requests in a
+    // window.
+    int64_t commit_window_s_ = 0;
+    uint64_t commit_data_requests_in_window_ = 0;
+    uint64_t max_commit_data_requests_per_s_ = 0;
+
     // Set of the global target_buffer IDs that the producer is configured to
     // write into in any active tracing session.
     std::set<BufferID> allowed_target_buffers_;
@@ -443,6 +476,22 @@ class TracingServiceImpl : public TracingService {
       CLONED_READ_ONLY,
     };
 
+    // State of the file of a write_into_file session. Once the session has
+    // been enabled, it's accessed only by |file_writer_task_runner_|. The
+    // tasks posted there hold a reference to it, so the file stays valid even
+    // if the session is destroyed while writes are in flight.
+    struct FileSink {
+      base::ScopedFile fd;
+      uint64_t max_file_size_bytes = 0;
+      uint64_t bytes_written = 0;
+      uint64_t bytes_since_last_sync = 0;
+
+      // Set once the file is full or a write fails. All the following writes
+      // are discarded. Also read by the service thread, to stop draining the
+      // buffers.
+      std::atomic<bool> stopped{false};
+    };
+
     TracingSession(TracingSessionID,
                    ConsumerEndpointImpl*,
                    const TraceConfig&,
@@ -572,8 +621,27 @@ class TracingServiceImpl : public TracingService {
     // etc.) into the trace output yet.
     bool did_emit_initial_packets = false;
 
-    // Whether we should compress TracePackets after reading them.
-    bool compress_deflate = false;
+    // If set, the function used to compress TracePackets after reading them.
+    TracingServiceInitOpts::CompressorFn compressor_fn = nullptr;
+
+    // Number of tasks (chunks of packets read by ReadBuffersIntoFile() and
+    // the final close of the file) posted on |file_writer_task_runner_| that
+    // haven't completed yet, and the number of bytes of packets they hold.
+    uint32_t pending_file_writes = 0;
+    uint64_t pending_file_write_bytes = 0;
+
+    // Set when the consumer should be notified that tracing is disabled but
+    // |pending_file_writes| > 0. The last pending write takes care of it.
+    bool notify_disabled_after_pending_writes = false;
+
+    // Set when FreeBuffers() is called while |pending_file_writes| > 0. The
+    // last pending write frees the buffers.
+    bool free_buffers_after_pending_writes = false;
+
+    // Set by the final drain of a write_into_file session. From then on the
+    // buffers are read-only, and the packets handed over to the file writer
+    // thread point straight into them rather than being copied.
+    bool file_writer_borrows_buffers = false;
 
     // The number of received triggers we've emitted into the trace output.
     size_t num_triggers_emitted_into_trace = 0;
@@ -637,10 +705,15 @@ class TracingServiceImpl : public TracingService {
     // TraceConfig. In this case this represents the file we should stream the
     // trace packets into, rather than returning it to the consumer via
     // OnTraceData().
-    base::ScopedFile write_into_file;
+    std::shared_ptr<FileSink> write_into_file;
     uint32_t write_period_ms = 0;
-    uint64_t max_file_size_bytes = 0;
+
+    // Stats for write_into_file sessions. See WriteIntoFileStats in
+    // trace_stats.proto.
     uint64_t bytes_written_into_file = 0;
+    uint64_t throttled_file_drains = 0;
+    WriteIntoFileLatencyHistogram file_drain_latency_hist;
+    WriteIntoFileLatencyHistogram file_write_latency_hist;
 
     // Periodic task for snapshotting service events (e.g. clocks, sync markers
     // etc)
@@ -769,13 +842,39 @@ class TracingServiceImpl : public TracingService {
   void MaybeCompressPackets(TracingSession* tracing_session,
                             std::vector<TracePacket>* packets);
 
-  // If `*tracing_session` is configured to write into a file, writes `packets`
-  // into the file.
+  // Hands `packets` over to |file_writer_task_runner_|, which compresses them
+  // (if the session has compression enabled) and writes them into the file of
+  // `*tracing_session`. The chunks are written in the same order as they are
+  // passed to this function. If `close_file` is true, the file is flushed and
+  // closed after writing `packets`.
+  void WriteIntoFileAsync(TracingSession* tracing_session,
+                          std::vector<TracePacket> packets,
+                          bool close_file);
+
+  // Called on the service thread when a task posted by WriteIntoFileAsync()
+  // has completed. `stop_writing_into_file` is the return value of
+  // WriteIntoFile().
+  void OnFileWriteCompleted(TracingSessionID tsid,
+                            uint64_t packets_size,
+                            uint64_t bytes_written,
+                            int64_t write_latency_us,
+                            bool stop_writing_into_file);
+
+  // Returns true if the file of `*tracing_session` can't take any more data,
+  // so there is no point in reading more from the buffers.
+  bool IsWriteIntoFileFull(const TracingSession* tracing_session);
+
+  // Schedules the flush and the close of the file of `*tracing_session` and
+  // disables tracing if the session is still running.
+  void CloseWriteIntoFile(TracingSession* tracing_session);
+
+  // Writes `packets` into `*sink`. Runs on |file_writer_task_runner_|.
   //
   // Returns true if the file should be closed (because it's full or there has
   // been an error), false otherwise.
-  bool WriteIntoFile(TracingSession* tracing_session,
-                     std::vector<TracePacket> packets);
+  static bool WriteIntoFile(TracingSession::FileSink* sink,
+                            std::vector<TracePacket> packets,
+                            uint64_t* bytes_written);
   void OnStartTriggersTimeout(TracingSessionID tsid);
   void MaybeLogUploadEvent(const TraceConfig&,
                            const base::Uuid&,
@@ -832,6 +931,12 @@ class TracingServiceImpl : public TracingService {
 
   PERFETTO_THREAD_CHECKER(thread_checker_)
 
+  // Lazily created the first time a write_into_file session reads its
+  // buffers. Compression, writev() and fdatasync() can take hundreds of ms on
+  // slow storage, so they are kept off the service thread, which has to keep
+  // serving producers and consumers.
+  std::optional<base::ThreadTaskRunner> file_writer_task_runner_;
+
   base::WeakPtrFactory<TracingServiceImpl>
       weak_ptr_factory_;  // Keep at the end.
 };
@@ -18,7 +18,10 @@
 
 #include <string.h>
 
+#include <thread>
+
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/pipe.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/temp_file.h"
 #include "perfetto/ext/base/utils.h"
@@ -55,6 +58,11 @@
 #include "src/tracing/service/zlib_compressor.h"
 #endif
 
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+#include <zstd.h>
+#include "src/tracing/service/zstd_compressor.h"
+#endif
+
 using ::testing::_;
 using ::testing::AssertionFailure;
 using ::testing::AssertionResult;
@@ -157,6 +165,42 @@ std::vector<protos::gen::TracePacket> DecompressTrace(
 }
 #endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+std::vector<protos::gen::TracePacket> ZstdDecompressTrace(
+    const std::vector<protos::gen::TracePacket> compressed) {
+  std::vector<protos::gen::TracePacket> decompressed;
+
+  for (const protos::gen::TracePacket& c : compressed) {
+    if (c.zstd_compressed_packets().empty()) {
+      decompressed.push_back(c);
+      continue;
+    }
+
+    const std::string& data = c.zstd_compressed_packets();
+    std::string s;
+    char out[1024];
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    ZSTD_inBuffer in{data.data(), data.size(), 0};
+    size_t ret;
+    do {
+      ZSTD_outBuffer o{out, sizeof(out), 0};
+      ret = ZSTD_decompressStream(dctx, &o, &in);
+      EXPECT_FALSE(ZSTD_isError(ret));
+      if (ZSTD_isError(ret))
+        break;
+      s.append(out, o.pos);
+    } while (ret != 0);
+    ZSTD_freeDCtx(dctx);
+
+    protos::gen::Trace t;
+    EXPECT_TRUE(t.ParseFromString(s));
+    decompressed.insert(decompressed.end(), t.packet().begin(),
+                        t.packet().end());
+  }
+  return decompressed;
+}
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+
 }  // namespace
 
 class TracingServiceImplTest : public testing::Test {
@@ -206,6 +250,10 @@ class TracingServiceImplTest : public testing::Test {
     return svc->last_tracing_session_id_;
   }
 
+  bool HasTracingSession(TracingSessionID tsid) {
+    return svc->GetTracingSession(tsid) != nullptr;
+  }
+
   const std::set<BufferID>& GetAllowedTargetBuffers(ProducerID producer_id) {
     return svc->GetProducer(producer_id)->allowed_target_buffers_;
   }
@@ -1893,6 +1941,36 @@ TEST_F(TracingServiceImplTest, CompressionConfiguredButUnsupported) {
                                                   Eq("payload-2")))));
 }
 
+
+TEST_F(TracingServiceImplTest, ZstdCompressionConfiguredButUnsupported) {
+  // Initialize the service without support for zstd.
+  TracingService::InitOpts init_opts;
+  init_opts.zstd_compressor_fn = nullptr;
+  InitializeSvcWithOpts(init_opts);
+
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_compression_type(TraceConfig::COMPRESSION_TYPE_ZSTD);
+
+  // Unlike deflate, the session must fail rather than silently falling back
+  // to an uncompressed trace.
+  auto on_fail = task_runner.CreateCheckpoint("on_fail");
+  EXPECT_CALL(*consumer, OnTracingDisabled(HasSubstr("COMPRESSION_TYPE_ZSTD")))
+      .WillOnce(InvokeWithoutArgs(on_fail));
+  consumer->EnableTracing(trace_config);
+  task_runner.RunUntilCheckpoint("on_fail");
+}
+
 #if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 TEST_F(TracingServiceImplTest, CompressionReadIpc) {
   TracingService::InitOpts init_opts;
@@ -2090,6 +2168,78 @@ TEST_F(TracingServiceImplTest, CloneSessionWithCompression) {
 
 #endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+TEST_F(TracingServiceImplTest, CompressionZstdWriteIntoFile) {
+  TracingService::InitOpts init_opts;
+  init_opts.zstd_compressor_fn = ZstdCompressFn;
+  InitializeSvcWithOpts(init_opts);
+
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_write_into_file(true);
+  trace_config.set_compression_type(TraceConfig::COMPRESSION_TYPE_ZSTD);
+  base::TempFile tmp_file = base::TempFile::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str("payload-1");
+  }
+  {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str("payload-2");
+  }
+
+  writer->Flush();
+  writer.reset();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  // Compression happens on a separate thread: the service must notify the
+  // consumer only after all the compressed chunks have been written.
+  consumer->WaitForTracingDisabled();
+
+  // Verify the contents of the file.
+  std::string trace_raw;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path().c_str(), &trace_raw));
+  protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromString(trace_raw));
+  EXPECT_THAT(trace.packet(), Not(IsEmpty()));
+  EXPECT_THAT(trace.packet(),
+              Each(Property(&protos::gen::TracePacket::zstd_compressed_packets,
+                            Not(IsEmpty()))));
+  EXPECT_THAT(
+      trace.packet(),
+      Each(Property(&protos::gen::TracePacket::has_compressed_packets, false)));
+  std::vector<protos::gen::TracePacket> decompressed_packets =
+      ZstdDecompressTrace(trace.packet());
+  EXPECT_THAT(decompressed_packets,
+              Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("payload-1")))));
+  EXPECT_THAT(decompressed_packets,
+              Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("payload-2")))));
+}
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+
 // Note: file_write_period_ms is set to a large enough to have exactly one flush
 // of the tracing buffers (and therefore at most one synchronization section),
 // unless the test runs unrealistically slowly, or the implementation of the
@@ -2291,6 +2441,160 @@ TEST_F(TracingServiceImplTest, WriteIntoFileFilterMultipleChunks) {
   EXPECT_GT(total_size, kNumTestPackets * kPayloadSize);
 }
 
+TEST_F(TracingServiceImplTest, WriteIntoFileStats) {
+  static const size_t kNumTestPackets = 5;
+  static const size_t kPayloadSize = 500 * 1024UL;
+
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_write_into_file(true);
+  trace_config.set_file_write_period_ms(100000);  // 100s
+
+  base::TempFile tmp_file = base::TempFile::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  for (size_t i = 0; i < kNumTestPackets; i++) {
+    auto tp = writer->NewTracePacket();
+    std::string payload(kPayloadSize, 'c');
+    tp->set_for_testing()->set_str(payload.c_str(), payload.size());
+  }
+
+  writer->Flush();
+  writer.reset();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+
+  consumer->GetTraceStats();
+  TraceStats stats = consumer->WaitForTraceStats(true);
+  ASSERT_TRUE(stats.has_write_into_file_stats());
+  const auto& file_stats = stats.write_into_file_stats();
+
+  // The consumer is notified only after the writer thread has closed the
+  // file, so all the data must be accounted for.
+  std::string trace_raw;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path().c_str(), &trace_raw));
+  EXPECT_EQ(file_stats.bytes_written(), trace_raw.size());
+  EXPECT_GT(trace_raw.size(), kNumTestPackets * kPayloadSize);
+  EXPECT_EQ(file_stats.throttled_drains(), 0u);
+
+  size_t num_buckets = file_stats.latency_histogram_def_us().size() + 1;
+  ASSERT_EQ(file_stats.drain_latency_histogram_counts().size(), num_buckets);
+  ASSERT_EQ(file_stats.write_latency_histogram_counts().size(), num_buckets);
+  uint64_t drains = 0;
+  uint64_t writes = 0;
+  for (size_t i = 0; i < num_buckets; i++) {
+    drains += file_stats.drain_latency_histogram_counts()[i];
+    writes += file_stats.write_latency_histogram_counts()[i];
+  }
+  // At least one drain (the final one) and, since the data spans multiple
+  // chunks, more than one write.
+  EXPECT_GE(drains, 1u);
+  EXPECT_GT(writes, 1u);
+}
+
+// Neither the final drain nor FreeBuffers() wait for the file writer thread:
+// the buffers are sealed and freed, and the consumer notified, only once the
+// file is complete. Here the file is a pipe that nobody reads until
+// FreeBuffers() has returned, so any wait on the service thread would hang.
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+TEST_F(TracingServiceImplTest, WriteIntoFileFreeBuffersDoesNotWaitForWriter) {
+  static const size_t kNumTestPackets = 48;
+  static const size_t kPayloadSize = 500 * 1024UL;
+  static_assert(kNumTestPackets * kPayloadSize >
+                    TracingServiceImpl::kMaxPendingWriteIntoFileBytes,
+                "The final drain must not be throttled");
+
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(32 * 1024);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_write_into_file(true);
+  trace_config.set_file_write_period_ms(100000);  // 100s
+
+  base::Pipe pipe = base::Pipe::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(pipe.wr.release()));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  for (size_t i = 0; i < kNumTestPackets; i++) {
+    auto tp = writer->NewTracePacket();
+    std::string payload(kPayloadSize, static_cast<char>('a' + i % 26));
+    tp->set_for_testing()->set_str(payload.c_str(), payload.size());
+  }
+  writer->Flush();
+  writer.reset();
+
+  TracingSessionID tsid = GetTracingSessionID();
+  consumer->FreeBuffers();
+  producer->WaitForDataSourceStop("data_source");
+
+  // The session (and its buffers) outlive FreeBuffers() until the writer
+  // thread is done with them. Producers can't write into them any more.
+  auto* session = GetTracingSession(tsid);
+  ASSERT_NE(session, nullptr);
+  EXPECT_TRUE(session->free_buffers_after_pending_writes);
+  EXPECT_TRUE(session->file_writer_borrows_buffers);
+  EXPECT_EQ(session->throttled_file_drains, 0u);
+
+  std::string trace_raw;
+  std::thread reader([&trace_raw, &pipe] {
+    char buf[4096];
+    for (;;) {
+      ssize_t rsize = PERFETTO_EINTR(read(*pipe.rd, buf, sizeof(buf)));
+      if (rsize <= 0)
+        break;
+      trace_raw.append(buf, static_cast<size_t>(rsize));
+    }
+  });
+  consumer->WaitForTracingDisabled(30000);
+  reader.join();
+  EXPECT_FALSE(HasTracingSession(tsid));
+
+  protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromString(trace_raw));
+  size_t num_test_packets = 0;
+  for (const protos::gen::TracePacket& tp : trace.packet()) {
+    if (!tp.has_for_testing())
+      continue;
+    ASSERT_EQ(tp.for_testing().str(),
+              std::string(kPayloadSize,
+                          static_cast<char>('a' + num_test_packets % 26)));
+    num_test_packets++;
+  }
+  EXPECT_EQ(num_test_packets, kNumTestPackets);
+}
+#endif  // !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+
 // Test the logic that allows the trace config to set the shm total size and
 // page size from the trace config. Also check that, if the config doesn't
 // specify a value we fall back on the hint provided by the producer.
@@ -3851,6 +4155,57 @@ TEST_F(TracingServiceImplTest, GetTraceStats) {
   consumer->WaitForTracingDisabled();
 }
 
+TEST_F(TracingServiceImplTest, ProducerStats) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  std::unique_ptr<MockProducer> idle_producer = CreateMockProducer();
+  idle_producer->Connect(svc.get(), "idle_producer");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(128);
+  trace_config.add_data_sources()->mutable_config()->set_name("data_source");
+
+  consumer->EnableTracing(trace_config);
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  // Each Flush() returns the current chunk and commits it.
+  auto writer = producer->CreateTraceWriter("data_source");
+  for (int i = 0; i < 3; i++) {
+    writer->NewTracePacket()->set_for_testing()->set_str("payload");
+    writer->Flush();
+  }
+
+  consumer->GetTraceStats();
+  TraceStats stats = consumer->WaitForTraceStats(true);
+
+  // Only the producers with data sources in the session are reported.
+  ASSERT_EQ(stats.producer_stats().size(), 1u);
+  const auto& prod_stats = stats.producer_stats()[0];
+  EXPECT_EQ(prod_stats.producer_name(), "mock_producer");
+  EXPECT_GE(prod_stats.commit_data_requests(), 3u);
+  EXPECT_GE(prod_stats.chunks_committed(), 3u);
+  EXPECT_GE(prod_stats.max_chunks_per_commit(), 1u);
+  EXPECT_LE(prod_stats.chunks_committed(),
+            prod_stats.commit_data_requests() *
+                prod_stats.max_chunks_per_commit());
+  EXPECT_GT(prod_stats.commit_data_requests_per_s(), 0u);
+  EXPECT_GE(prod_stats.max_commit_data_requests_per_s(), 1u);
+  EXPECT_LE(prod_stats.max_commit_data_requests_per_s(),
+            prod_stats.commit_data_requests());
+
+  writer.reset();
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+}
+
 TEST_F(TracingServiceImplTest, TraceWriterStats) {
   std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
   consumer->Connect(svc.get());
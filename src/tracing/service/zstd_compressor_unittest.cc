@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/service/zstd_compressor.h"
+
+#include <random>
+
+#include <zstd.h>
+
+#include "protos/perfetto/trace/test_event.gen.h"
+#include "protos/perfetto/trace/trace.gen.h"
+#include "protos/perfetto/trace/trace_packet.gen.h"
+#include "src/tracing/service/tracing_service_impl.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace {
+
+using ::testing::Each;
+using ::testing::ElementsAre;
+using ::testing::Field;
+using ::testing::IsEmpty;
+using ::testing::Le;
+using ::testing::Not;
+using ::testing::Property;
+using ::testing::SizeIs;
+
+template <typename F>
+TracePacket CreateTracePacket(F fill_function) {
+  protos::gen::TracePacket msg;
+  fill_function(&msg);
+  std::vector<uint8_t> buf = msg.SerializeAsArray();
+  Slice slice = Slice::Allocate(buf.size());
+  memcpy(slice.own_data(), buf.data(), buf.size());
+  perfetto::TracePacket packet;
+  packet.AddSlice(std::move(slice));
+  return packet;
+}
+
+std::string RandomString(size_t size, uint32_t seed) {
+  std::default_random_engine rnd(seed);
+  std::uniform_int_distribution<> dist(0, 255);
+  std::string s;
+  s.resize(size);
+  for (size_t i = 0; i < s.size(); i++)
+    s[i] = static_cast<char>(dist(rnd));
+  return s;
+}
+
+std::string Decompress(const std::string& data) {
+  char out[1024];
+  ZSTD_DCtx* dctx = ZSTD_createDCtx();
+  ZSTD_inBuffer in{data.data(), data.size(), 0};
+  std::string s;
+  size_t ret;
+  do {
+    ZSTD_outBuffer o{out, sizeof(out), 0};
+    ret = ZSTD_decompressStream(dctx, &o, &in);
+    EXPECT_FALSE(ZSTD_isError(ret));
+    if (ZSTD_isError(ret))
+      break;
+    s.append(out, o.pos);
+  } while (ret != 0);
+  ZSTD_freeDCtx(dctx);
+  return s;
+}
+
+static_assert(kZstdCompressSliceSize ==
+              TracingServiceImpl::kMaxTracePacketSliceSize);
+
+TEST(ZstdCompressFnTest, Empty) {
+  std::vector<TracePacket> packets;
+
+  ZstdCompressFn(&packets);
+
+  EXPECT_THAT(packets, IsEmpty());
+}
+
+TEST(ZstdCompressFnTest, End2EndCompressAndDecompress) {
+  std::vector<TracePacket> packets;
+
+  packets.push_back(CreateTracePacket([](protos::gen::TracePacket* msg) {
+    auto* for_testing = msg->mutable_for_testing();
+    for_testing->set_str("abc");
+  }));
+  packets.push_back(CreateTracePacket([](protos::gen::TracePacket* msg) {
+    auto* for_testing = msg->mutable_for_testing();
+    for_testing->set_str("def");
+  }));
+
+  ZstdCompressFn(&packets);
+
+  ASSERT_THAT(packets, SizeIs(1));
+  protos::gen::TracePacket compressed_packet_proto;
+  ASSERT_TRUE(compressed_packet_proto.ParseFromString(
+      packets[0].GetRawBytesForTesting()));
+  EXPECT_FALSE(compressed_packet_proto.has_compressed_packets());
+  const std::string& data = compressed_packet_proto.zstd_compressed_packets();
+  EXPECT_THAT(data, Not(IsEmpty()));
+  protos::gen::Trace subtrace;
+  ASSERT_TRUE(subtrace.ParseFromString(Decompress(data)));
+  EXPECT_THAT(
+      subtrace.packet(),
+      ElementsAre(Property(&protos::gen::TracePacket::for_testing,
+                           Property(&protos::gen::TestEvent::str, "abc")),
+                  Property(&protos::gen::TracePacket::for_testing,
+                           Property(&protos::gen::TestEvent::str, "def"))));
+}
+
+TEST(ZstdCompressFnTest, MaxSliceSize) {
+  // Random data is incompressible, so the output is at least as large as the
+  // input. Each packet uses a different seed: unlike deflate, the zstd window
+  // is large enough to deduplicate identical 64KB payloads.
+  std::vector<TracePacket> packets;
+  for (uint32_t i = 0; i < 4; i++) {
+    packets.push_back(CreateTracePacket([i](protos::gen::TracePacket* msg) {
+      auto* for_testing = msg->mutable_for_testing();
+      for_testing->set_str(RandomString(65536, i));
+    }));
+  }
+
+  ZstdCompressFn(&packets);
+
+  ASSERT_THAT(packets, SizeIs(1));
+  const TracePacket& compressed_packet = packets[0];
+  EXPECT_GE(compressed_packet.slices().size(), 2u);
+  ASSERT_GT(compressed_packet.size(),
+            TracingServiceImpl::kMaxTracePacketSliceSize);
+  EXPECT_THAT(compressed_packet.slices(),
+              Each(Field(&Slice::size,
+                         Le(TracingServiceImpl::kMaxTracePacketSliceSize))));
+}
+
+}  // namespace
+}  // namespace perfetto
@@ -32,6 +32,8 @@
 #include "perfetto/tracing/core/trace_config.h"
 #include "src/base/test/test_task_runner.h"
 #include "src/ipc/test/test_socket.h"
+#include "src/tracing/ipc/consumer/consumer_ipc_client_impl.h"
+#include "src/tracing/ipc/memfd.h"
 #include "src/tracing/service/tracing_service_impl.h"
 #include "test/gtest_and_gmock.h"
 
@@ -308,12 +310,14 @@ TEST_F(TracingIntegrationTest, WithIPCTransport) {
   bool saw_clock_snapshot = false;
   bool saw_trace_config = false;
   bool saw_trace_stats = false;
+  std::vector<TracePacket> retained_packets;
   auto all_packets_rx = task_runner_->CreateCheckpoint("all_packets_rx");
   EXPECT_CALL(consumer_, OnTracePackets(_, _))
       .WillRepeatedly(
           Invoke([&num_pack_rx, all_packets_rx, &trace_config,
-                  &saw_clock_snapshot, &saw_trace_config, &saw_trace_stats](
-                     std::vector<TracePacket>* packets, bool has_more) {
+                  &saw_clock_snapshot, &saw_trace_config, &saw_trace_stats,
+                  &retained_packets](std::vector<TracePacket>* packets,
+                                     bool has_more) {
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE)
             const int kExpectedMinNumberOfClocks = 1;
 #elif PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
@@ -342,6 +346,8 @@ TEST_F(TracingIntegrationTest, WithIPCTransport) {
                 CheckTraceStats(packet);
               }
             }
+            for (auto& encoded_packet : *packets)
+              retained_packets.emplace_back(std::move(encoded_packet));
             if (!has_more)
               all_packets_rx();
           }));
@@ -351,6 +357,20 @@ TEST_F(TracingIntegrationTest, WithIPCTransport) {
   EXPECT_TRUE(saw_trace_config);
   EXPECT_TRUE(saw_trace_stats);
 
+  // The consumer connected without opting in to zero-copy reads: the packets
+  // own their data and are still valid after OnTraceData() returned.
+  size_t num_retained_for_testing = 0;
+  for (auto& encoded_packet : retained_packets) {
+    protos::gen::TracePacket packet;
+    ASSERT_TRUE(packet.ParseFromString(encoded_packet.GetRawBytesForTesting()));
+    if (!packet.has_for_testing())
+      continue;
+    char buf[8];
+    base::SprintfTrunc(buf, sizeof(buf), "evt_%zu", num_retained_for_testing++);
+    EXPECT_EQ(std::string(buf), packet.for_testing().str());
+  }
+  EXPECT_EQ(kNumPackets, num_retained_for_testing);
+
   // Disable tracing.
   consumer_endpoint_->DisableTracing();
 
@@ -362,6 +382,170 @@ TEST_F(TracingIntegrationTest, WithIPCTransport) {
   task_runner_->RunUntilCheckpoint("on_tracing_disabled");
 }
 
+// Reads back the trace through the shared memory ring, once the consumer has
+// mapped it. The data is bigger than the ring, which has to be reused (or
+// bypassed through the socket when full).
+TEST_F(TracingIntegrationTest, ReadBuffersThroughSharedMemory) {
+  consumer_endpoint_ = ConsumerIPCClient::Connect(
+      kConsumerSock.name(), &consumer_, task_runner_.get(),
+      /*read_buffers_shm_size=*/1);
+  auto on_consumer_connect =
+      task_runner_->CreateCheckpoint("on_consumer_reconnect");
+  EXPECT_CALL(consumer_, OnConnect()).WillOnce(Invoke(on_consumer_connect));
+  task_runner_->RunUntilCheckpoint("on_consumer_reconnect");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("perfetto.test");
+  ds_config->set_target_buffer(0);
+  consumer_endpoint_->EnableTracing(trace_config);
+
+  BufferID global_buf_id = 0;
+  auto on_start_ds = task_runner_->CreateCheckpoint("on_start_ds");
+  EXPECT_CALL(producer_, OnTracingSetup());
+  EXPECT_CALL(producer_, SetupDataSource(_, _));
+  EXPECT_CALL(producer_, StartDataSource(_, _))
+      .WillOnce(Invoke([on_start_ds, &global_buf_id](
+                           DataSourceInstanceID, const DataSourceConfig& cfg) {
+        global_buf_id = static_cast<BufferID>(cfg.target_buffer());
+        on_start_ds();
+      }));
+  task_runner_->RunUntilCheckpoint("on_start_ds");
+
+  std::unique_ptr<TraceWriter> writer =
+      producer_endpoint_->CreateTraceWriter(global_buf_id);
+  ASSERT_TRUE(writer);
+  const std::string payload(1000, 'x');
+  size_t num_pack_tx = 0;
+  size_t num_pack_rx = 0;
+  auto write_and_read_back = [&](size_t num_packets) {
+    for (size_t i = 0; i < num_packets; i++) {
+      std::string str = std::to_string(num_pack_tx++) + payload;
+      writer->NewTracePacket()->set_for_testing()->set_str(str.data(),
+                                                           str.size());
+    }
+    static int n = 0;
+    std::string suffix = std::to_string(n++);
+    auto on_data_committed =
+        task_runner_->CreateCheckpoint("on_data_committed_" + suffix);
+    writer->Flush(on_data_committed);
+    task_runner_->RunUntilCheckpoint("on_data_committed_" + suffix);
+
+    consumer_endpoint_->ReadBuffers();
+    auto all_packets_rx =
+        task_runner_->CreateCheckpoint("all_packets_rx_" + suffix);
+    EXPECT_CALL(consumer_, OnTracePackets(_, _))
+        .WillRepeatedly(Invoke([&num_pack_rx, &payload, all_packets_rx](
+                                   std::vector<TracePacket>* packets,
+                                   bool has_more) {
+          for (auto& encoded_packet : *packets) {
+            protos::gen::TracePacket packet;
+            ASSERT_TRUE(packet.ParseFromString(
+                encoded_packet.GetRawBytesForTesting()));
+            if (packet.has_for_testing()) {
+              EXPECT_EQ(std::to_string(num_pack_rx++) + payload,
+                        packet.for_testing().str());
+            }
+          }
+          if (!has_more)
+            all_packets_rx();
+        }));
+    task_runner_->RunUntilCheckpoint("all_packets_rx_" + suffix);
+    ASSERT_EQ(num_pack_tx, num_pack_rx);
+  };
+
+  // The first read returns the data inline, together with the file descriptor
+  // of the ring.
+  write_and_read_back(10);
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  EXPECT_EQ(static_cast<ConsumerIPCClientImpl*>(consumer_endpoint_.get())
+                ->HasReadBuffersRingForTesting(),
+            HasMemfdSupport());
+#endif
+
+  // ~100KB of data, while the ring is 64KB (the minimum size). This still fits
+  // in the SMB, as the service can't run while the packets are written.
+  write_and_read_back(100);
+
+  consumer_endpoint_->DisableTracing();
+  auto on_tracing_disabled =
+      task_runner_->CreateCheckpoint("on_tracing_disabled");
+  EXPECT_CALL(producer_, StopDataSource(_));
+  EXPECT_CALL(consumer_, OnTracingDisabled(_))
+      .WillOnce(InvokeWithoutArgs(on_tracing_disabled));
+  task_runner_->RunUntilCheckpoint("on_tracing_disabled");
+}
+
+// Reads back a packet bigger than an IPC frame, whose slices are split over
+// several ReadBuffers() responses. The consumer receives the slices in place
+// and has to copy the ones of the partial packet before the next response.
+TEST_F(TracingIntegrationTest, ReadBuffersPacketSpanningResponses) {
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("perfetto.test");
+  ds_config->set_target_buffer(0);
+  consumer_endpoint_->EnableTracing(trace_config);
+
+  BufferID global_buf_id = 0;
+  auto on_start_ds = task_runner_->CreateCheckpoint("on_start_ds");
+  EXPECT_CALL(producer_, OnTracingSetup());
+  EXPECT_CALL(producer_, SetupDataSource(_, _));
+  EXPECT_CALL(producer_, StartDataSource(_, _))
+      .WillOnce(Invoke([on_start_ds, &global_buf_id](
+                           DataSourceInstanceID, const DataSourceConfig& cfg) {
+        global_buf_id = static_cast<BufferID>(cfg.target_buffer());
+        on_start_ds();
+      }));
+  task_runner_->RunUntilCheckpoint("on_start_ds");
+
+  // 200KB, bigger than kIPCBufferSize but smaller than the SMB.
+  std::unique_ptr<TraceWriter> writer =
+      producer_endpoint_->CreateTraceWriter(global_buf_id);
+  ASSERT_TRUE(writer);
+  std::string big_payload(200 * 1024, 'x');
+  for (size_t i = 0; i < big_payload.size(); i += 1000)
+    big_payload[i] = static_cast<char>('a' + (i / 1000) % 26);
+  writer->NewTracePacket()->set_for_testing()->set_str(big_payload.data(),
+                                                       big_payload.size());
+  writer->NewTracePacket()->set_for_testing()->set_str("small");
+  auto on_data_committed = task_runner_->CreateCheckpoint("on_data_committed");
+  writer->Flush(on_data_committed);
+  task_runner_->RunUntilCheckpoint("on_data_committed");
+
+  consumer_endpoint_->ReadBuffers();
+  std::vector<std::string> payloads;
+  auto all_packets_rx = task_runner_->CreateCheckpoint("all_packets_rx");
+  EXPECT_CALL(consumer_, OnTracePackets(_, _))
+      .WillRepeatedly(Invoke([&payloads, all_packets_rx](
+                                 std::vector<TracePacket>* packets,
+                                 bool has_more) {
+        for (auto& encoded_packet : *packets) {
+          protos::gen::TracePacket packet;
+          ASSERT_TRUE(
+              packet.ParseFromString(encoded_packet.GetRawBytesForTesting()));
+          if (packet.has_for_testing())
+            payloads.push_back(packet.for_testing().str());
+        }
+        if (!has_more)
+          all_packets_rx();
+      }));
+  task_runner_->RunUntilCheckpoint("all_packets_rx");
+  ASSERT_EQ(2u, payloads.size());
+  EXPECT_TRUE(payloads[0] == big_payload);
+  EXPECT_EQ("small", payloads[1]);
+
+  consumer_endpoint_->DisableTracing();
+  auto on_tracing_disabled =
+      task_runner_->CreateCheckpoint("on_tracing_disabled");
+  EXPECT_CALL(producer_, StopDataSource(_));
+  EXPECT_CALL(consumer_, OnTracingDisabled(_))
+      .WillOnce(InvokeWithoutArgs(on_tracing_disabled));
+  task_runner_->RunUntilCheckpoint("on_tracing_disabled");
+}
+
 // Regression test for b/172950370.
 TEST_F(TracingIntegrationTest, ValidErrorOnDisconnection) {
   // Start tracing.
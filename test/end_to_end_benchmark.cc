@@ -218,6 +218,72 @@ static void BenchmarkConsumer(benchmark::State& state) {
                          static_cast<double>(read_time_taken_ns));
 }
 
+// Only counts the bytes read back, so that the drain benchmark measures the
+// transport rather than the decoding of the packets.
+class DrainingTestHelper : public TestHelper {
+ public:
+  explicit DrainingTestHelper(base::TestTaskRunner* task_runner)
+      : TestHelper(task_runner) {}
+
+  void ReadTraceData(std::vector<TracePacket> packets) override {
+    for (const TracePacket& packet : packets)
+      bytes_read_ += packet.size();
+  }
+
+  uint64_t bytes_read() const { return bytes_read_; }
+
+ private:
+  uint64_t bytes_read_ = 0;
+};
+
+// Measures how fast a consumer drains a full trace buffer, either through the
+// socket or through the shared memory ring (ReadBuffersRequest.shm_size_bytes).
+static void BenchmarkConsumerDrain(benchmark::State& state) {
+  base::TestTaskRunner task_runner;
+
+  DrainingTestHelper helper(&task_runner);
+  helper.StartServiceIfRequired();
+
+  FakeProducer* producer = helper.ConnectFakeProducer();
+  const bool use_shm = state.range(0) != 0;
+  helper.ConnectConsumer(use_shm ? 8 * 1024 * 1024 : 0);
+  helper.WaitForConsumerConnect();
+
+  static const uint32_t kBufferSizeBytes =
+      IsBenchmarkFunctionalOnly() ? 16 * 1024 : 1024 * 1024 * 1024;
+  static constexpr uint32_t kMessageBytes = 1024;
+  static constexpr uint32_t kTimeoutMs = 120 * 1000;
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(kBufferSizeBytes / 1024);
+
+  // Fill ~90% of the buffer, to leave room for the overhead of the packets
+  // and the service-generated packets without overwriting anything.
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("android.perfetto.FakeProducer");
+  ds_config->set_target_buffer(0);
+  ds_config->mutable_for_testing()->set_seed(42);
+  ds_config->mutable_for_testing()->set_message_count(kBufferSizeBytes / 10 *
+                                                      9 / kMessageBytes);
+  ds_config->mutable_for_testing()->set_message_size(kMessageBytes);
+
+  helper.StartTracing(trace_config);
+  helper.WaitForProducerEnabled();
+
+  uint32_t counter = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto cname = "produced.and.committed." + std::to_string(counter);
+    auto on_produced_and_committed = task_runner.CreateCheckpoint(cname);
+    producer->ProduceEventBatch(helper.WrapTask(on_produced_and_committed));
+    task_runner.RunUntilCheckpoint(cname, kTimeoutMs);
+    state.ResumeTiming();
+
+    helper.ReadData(counter);
+    helper.WaitForReadData(counter++, kTimeoutMs);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(helper.bytes_read()));
+}
+
 void SaturateCpuProducerArgs(benchmark::internal::Benchmark* b) {
   int min_message_count = 16;
   int max_message_count = IsBenchmarkFunctionalOnly() ? 16 : 1024 * 1024;
@@ -257,6 +323,12 @@ void ConstantRateConsumerArgs(benchmark::internal::Benchmark* b) {
   }
 }
 
+void ConsumerDrainArgs(benchmark::internal::Benchmark* b) {
+  b->ArgName("shm");
+  b->Arg(0);
+  b->Arg(1);
+}
+
 }  // namespace
 
 static void BM_EndToEnd_Producer_SaturateCpu(benchmark::State& state) {
@@ -295,4 +367,14 @@ BENCHMARK(BM_EndToEnd_Consumer_ConstantRate)
     ->UseRealTime()
     ->Apply(ConstantRateConsumerArgs);
 
+static void BM_EndToEnd_Consumer_Drain(benchmark::State& state) {
+  BenchmarkConsumerDrain(state);
+}
+
+BENCHMARK(BM_EndToEnd_Consumer_Drain)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->Iterations(1)
+    ->Apply(ConsumerDrainArgs);
+
 }  // namespace perfetto
@@ -150,11 +150,12 @@ FakeProducer* TestHelper::ConnectFakeProducer(size_t idx) {
   return fake_producer_threads_[idx]->producer();
 }
 
-void TestHelper::ConnectConsumer() {
+void TestHelper::ConnectConsumer(size_t read_buffers_shm_size) {
   cur_consumer_num_++;
   on_connect_callback_ = CreateCheckpoint("consumer.connected." +
                                           std::to_string(cur_consumer_num_));
-  endpoint_ = ConsumerIPCClient::Connect(consumer_socket_, this, task_runner_);
+  endpoint_ = ConsumerIPCClient::Connect(consumer_socket_, this, task_runner_,
+                                         read_buffers_shm_size);
 }
 
 void TestHelper::DetachConsumer(const std::string& key) {
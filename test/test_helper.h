@@ -313,7 +313,8 @@ class TestHelper : public Consumer {
   // RegisterDataSource() call.
   FakeProducer* ConnectFakeProducer(size_t idx = 0);
 
-  void ConnectConsumer();
+  // See ConsumerIPCClient::Connect() for |read_buffers_shm_size|.
+  void ConnectConsumer(size_t read_buffers_shm_size = 0);
   void StartTracing(const TraceConfig& config,
                     base::ScopedFile = base::ScopedFile());
   void DisableTracing();
@@ -109,3 +109,12 @@ class ProfilingMetrics(TestSuite):
         trace=Path('heap_graph.textproto'),
         query=Metric('java_heap_histogram'),
         out=Path('java_heap_histogram.out'))
+
+  # Both metrics RUN_METRIC the same helper files: the second run reuses the
+  # cached results and must produce exactly the output of the two
+  # single-metric tests above.
+  def test_java_heap_stats_and_histogram(self):
+    return DiffTestBlueprint(
+        trace=Path('heap_graph.textproto'),
+        query=Metric('java_heap_stats,java_heap_histogram'),
+        out=Path('java_heap_stats_and_histogram.out'))
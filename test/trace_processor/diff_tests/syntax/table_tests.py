@@ -48,6 +48,52 @@ class PerfettoTable(TestSuite):
         43
         """))
 
+  def test_create_perfetto_index(self):
+    return DiffTestBlueprint(
+        trace=TextProto(r''),
+        query="""
+        CREATE PERFETTO TABLE foo AS
+        SELECT 1 AS x, 'a' AS name
+        UNION ALL SELECT 3, 'b'
+        UNION ALL SELECT NULL, 'c'
+        UNION ALL SELECT 2, 'd'
+        UNION ALL SELECT 1, 'e';
+
+        CREATE PERFETTO INDEX foo_x ON foo(x);
+
+        SELECT
+          (SELECT GROUP_CONCAT(name) FROM foo WHERE x = 1) AS eq,
+          (SELECT GROUP_CONCAT(name) FROM foo WHERE x <= 2) AS le,
+          (SELECT GROUP_CONCAT(name) FROM foo WHERE x > 1) AS gt,
+          (SELECT GROUP_CONCAT(name) FROM foo WHERE x IS NULL) AS is_null;
+        """,
+        out=Csv("""
+        "eq","le","gt","is_null"
+        "a,e","a,d,e","b,d","c"
+        """))
+
+  def test_drop_perfetto_index(self):
+    return DiffTestBlueprint(
+        trace=TextProto(r''),
+        query="""
+        CREATE PERFETTO TABLE foo AS
+        SELECT 1 AS x
+        UNION ALL SELECT 2;
+
+        CREATE PERFETTO INDEX foo_x ON foo(x);
+        DROP PERFETTO INDEX foo_x ON foo;
+
+        SELECT
+          (SELECT COUNT() FROM foo WHERE x = 1) AS cnt,
+          value AS index_memory_bytes
+        FROM stats
+        WHERE name = 'perfetto_index_memory_bytes';
+        """,
+        out=Csv("""
+        "cnt","index_memory_bytes"
+        1,0
+        """))
+
   def test_create_perfetto_table_double_metric_run(self):
     return DiffTestBlueprint(
         trace=TextProto(r''),